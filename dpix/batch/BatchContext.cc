@@ -0,0 +1,155 @@
+/*****************************************************************************\
+
+BatchContext.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQInclude.h"
+#include "BatchContext.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef GQ_USE_OSMESA
+#include <GL/osmesa.h>
+#else
+#include <QGLPixelBuffer>
+#endif
+
+BatchContext::BatchContext()
+{
+#ifdef GQ_USE_OSMESA
+    _context = 0;
+#else
+    _pbuffer = 0;
+#endif
+}
+
+BatchContext::~BatchContext()
+{
+    clear();
+}
+
+void BatchContext::clear()
+{
+#ifdef GQ_USE_OSMESA
+    if (_context)
+        OSMesaDestroyContext(_context);
+    _context = 0;
+    _buffer.clear();
+#else
+    delete _pbuffer;
+    _pbuffer = 0;
+#endif
+    _size = QSize();
+}
+
+bool BatchContext::init( const QSize& size )
+{
+    clear();
+
+#ifdef GQ_USE_OSMESA
+    _context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+    if (!_context)
+    {
+        qCritical("BatchContext::init: could not create an OSMesa context.");
+        return false;
+    }
+    _buffer.resize(size.width() * size.height() * 4);
+#else
+    if (!QGLPixelBuffer::hasOpenGLPbuffers())
+    {
+        qCritical("BatchContext::init: pixel buffers are not supported on "
+                  "this display. Rebuild with CONFIG+=osmesa.");
+        return false;
+    }
+
+    QGLFormat format;
+    format.setDoubleBuffer(false);
+    format.setDepth(true);
+    format.setAlpha(true);
+    format.setStencil(true);
+    _pbuffer = new QGLPixelBuffer(size, format);
+    if (!_pbuffer->isValid())
+    {
+        qCritical("BatchContext::init: could not create a %d x %d pixel buffer.",
+                  size.width(), size.height());
+        clear();
+        return false;
+    }
+#endif
+
+    _size = size;
+    return makeCurrent();
+}
+
+bool BatchContext::makeCurrent()
+{
+#ifdef GQ_USE_OSMESA
+    if (!_context || 
+        !OSMesaMakeCurrent(_context, _buffer.data(), GL_UNSIGNED_BYTE, 
+                           _size.width(), _size.height()))
+    {
+        qCritical("BatchContext::makeCurrent: OSMesaMakeCurrent failed.");
+        return false;
+    }
+    // OSMesa stores the first row at the bottom, like glReadPixels.
+    OSMesaPixelStore(OSMESA_Y_UP, 1);
+    return true;
+#else
+    if (!_pbuffer)
+        return false;
+    return _pbuffer->makeCurrent();
+#endif
+}
+
+void BatchContext::readPixels( int width, int height, QImage& image )
+{
+    assert(width <= _size.width() && height <= _size.height());
+
+    if (image.width() != width || image.height() != height ||
+        image.format() != QImage::Format_RGB32)
+    {
+        image = QImage(width, height, QImage::Format_RGB32);
+    }
+
+    glFinish();
+
+    // QImage::Format_RGB32 is stored as BGRA bytes on little-endian
+    // machines.
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadBuffer(GL_FRONT);
+    glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, image.bits());
+
+    // GL rows start at the bottom.
+    int row_bytes = image.bytesPerLine();
+    QVector<unsigned char> row(row_bytes);
+    for (int y = 0; y < height / 2; y++)
+    {
+        unsigned char* top = image.scanLine(y);
+        unsigned char* bottom = image.scanLine(height - 1 - y);
+        memcpy(row.data(), top, row_bytes);
+        memcpy(top, bottom, row_bytes);
+        memcpy(bottom, row.data(), row_bytes);
+    }
+}
+
+void BatchContext::readPixelsRGB( int x, int y, int width, int height, 
+                                  int row_length, unsigned char* pixels )
+{
+    assert(x >= 0 && y >= 0 && x + width <= _size.width() && 
+           y + height <= _size.height());
+
+    glFinish();
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, row_length);
+    glReadBuffer(GL_FRONT);
+    glReadPixels(x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+}
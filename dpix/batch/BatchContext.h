@@ -0,0 +1,64 @@
+/*****************************************************************************\
+
+BatchContext.h
+Copyright (c) 2009 Forrester Cole
+
+An offscreen OpenGL context for dpix-batch. By default this is a 
+QGLPixelBuffer, which needs a display connection but no window. When 
+built with CONFIG+=osmesa (GQ_USE_OSMESA), the context is an OSMesa
+context rendering into client memory, which needs no display at all.
+
+The default framebuffer of the context is the image that is read back,
+so the renderer draws into it exactly as it would into a window.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef BATCH_CONTEXT_H_
+#define BATCH_CONTEXT_H_
+
+#include <QImage>
+#include <QSize>
+#include <QVector>
+
+#ifdef GQ_USE_OSMESA
+struct osmesa_context;
+#else
+class QGLPixelBuffer;
+#endif
+
+class BatchContext
+{
+public:
+    BatchContext();
+    ~BatchContext();
+
+    bool init( const QSize& size );
+    void clear();
+
+    bool makeCurrent();
+    const QSize& size() const { return _size; }
+
+    // Reads the lower left width x height pixels of the default framebuffer.
+    void readPixels( int width, int height, QImage& image );
+
+    // Reads a width x height block of RGB pixels at (x, y) into pixels,
+    // bottom row first, with rows row_length pixels apart. Used to copy
+    // poster tiles straight into their strip.
+    void readPixelsRGB( int x, int y, int width, int height, int row_length,
+                        unsigned char* pixels );
+
+protected:
+    QSize   _size;
+
+#ifdef GQ_USE_OSMESA
+    osmesa_context*          _context;
+    QVector<unsigned char>   _buffer;
+#else
+    QGLPixelBuffer*          _pbuffer;
+#endif
+};
+
+#endif // BATCH_CONTEXT_H_
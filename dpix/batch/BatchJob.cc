@@ -0,0 +1,291 @@
+/*****************************************************************************\
+
+BatchJob.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "BatchJob.h"
+
+#include <QDomDocument>
+#include <QDomElement>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QtAlgorithms>
+
+const int CURRENT_VERSION = 1;
+
+// Larger images are rendered as posters. 2048 fits the framebuffers of
+// any card that runs libnpr, with room for the guard band.
+const int DEFAULT_TILE_SIZE = 2048;
+// Wide enough for the widest pens, overshoot, and the supersampled
+// visibility kernel, so nothing near a tile edge depends on what lies 
+// outside the tile.
+const int DEFAULT_GUARD_BAND = 64;
+
+// 10 degree steps.
+const int DEFAULT_TURNTABLE_VIEWS = 36;
+
+BatchCamera::BatchCamera()
+{
+    _source = VIEWER;
+    _first_frame = 0;
+    _last_frame = -1;
+    _frame_step = 1;
+    _num_views = DEFAULT_TURNTABLE_VIEWS;
+}
+
+bool BatchCamera::load( const QDomElement& element, const QDir& path )
+{
+    QString source = element.attribute("source", "viewer");
+    if (source == "viewer")
+    {
+        _source = VIEWER;
+        return true;
+    }
+    else if (source == "turntable")
+    {
+        _source = TURNTABLE;
+        _num_views = element.attribute("views", 
+                         QString::number(DEFAULT_TURNTABLE_VIEWS)).toInt();
+        if (_num_views <= 0)
+        {
+            qWarning("BatchCamera::load: bad number of views on line %d",
+                     element.lineNumber());
+            return false;
+        }
+        return true;
+    }
+    else if (source != "session")
+    {
+        qWarning("BatchCamera::load: unknown camera source \"%s\"", 
+                 qPrintable(source));
+        return false;
+    }
+
+    _source = SESSION;
+    if (element.hasAttribute("file"))
+        _session_file = path.absoluteFilePath(element.attribute("file"));
+
+    return parseFrames(element.attribute("frames", "all"));
+}
+
+// Accepts "all", "n", "first-last", or "first-last:step".
+bool BatchCamera::parseFrames( const QString& frames )
+{
+    _first_frame = 0;
+    _last_frame = -1;
+    _frame_step = 1;
+
+    if (frames == "all")
+        return true;
+
+    QRegExp range("(\\d+)(?:-(\\d+))?(?::(\\d+))?");
+    if (!range.exactMatch(frames))
+    {
+        qWarning("BatchCamera::parseFrames: could not parse \"%s\"", 
+                 qPrintable(frames));
+        return false;
+    }
+
+    _first_frame = range.cap(1).toInt();
+    _last_frame = range.cap(2).isEmpty() ? _first_frame : range.cap(2).toInt();
+    if (!range.cap(3).isEmpty())
+        _frame_step = qMax(1, range.cap(3).toInt());
+
+    return true;
+}
+
+QList<int> BatchCamera::frameList( int num_frames ) const
+{
+    QList<int> frames;
+    int last = (_last_frame < 0) ? num_frames - 1 : qMin(_last_frame, num_frames - 1);
+    for (int i = _first_frame; i <= last; i += _frame_step)
+        frames.append(i);
+    return frames;
+}
+
+BatchJob::BatchJob()
+{
+    _output_pattern = "{scene}_{camera}.png";
+    _tile_size = DEFAULT_TILE_SIZE;
+    _guard_band = DEFAULT_GUARD_BAND;
+}
+
+QString BatchJob::outputFilename( const QString& style_file, 
+                                  const QString& camera,
+                                  const QSize& size ) const
+{
+    QString style_name = style_file.isEmpty() ? 
+        QString("scene") : QFileInfo(style_file).completeBaseName();
+
+    QString filename = _output_pattern;
+    filename.replace("{scene}", QFileInfo(_scene_file).completeBaseName());
+    filename.replace("{style}", style_name);
+    filename.replace("{camera}", camera);
+    filename.replace("{width}", QString::number(size.width()));
+    filename.replace("{height}", QString::number(size.height()));
+    return filename;
+}
+
+bool BatchJobList::load( const QString& filename )
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("Could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QDomDocument doc("dpixbatch");
+    QString parse_errors;
+    int line;
+    if (!doc.setContent(&file, &parse_errors, &line))
+    {
+        qWarning("%s:%d: %s", qPrintable(filename), line, 
+                 qPrintable(parse_errors));
+        return false;
+    }
+
+    file.close();
+
+    QDomElement root = doc.documentElement();
+    if (root.tagName() != "dpixbatch")
+    {
+        qWarning("BatchJobList::load: %s is not a dpixbatch file", 
+                 qPrintable(filename));
+        return false;
+    }
+
+    int version = root.attribute("version", QString::number(CURRENT_VERSION)).toInt();
+    if (version != CURRENT_VERSION)
+    {
+        qWarning("BatchJobList::load: file version out of date (%d, current is %d)", 
+            version, CURRENT_VERSION);
+        return false;
+    }
+
+    QDir path = QFileInfo(filename).absoluteDir();
+    QDomElement job = root.firstChildElement("job");
+    while (!job.isNull())
+    {
+        if (!loadJob(job, path))
+            return false;
+        job = job.nextSiblingElement("job");
+    }
+
+    return true;
+}
+
+// Each <job> element becomes one BatchJob per scene.
+bool BatchJobList::loadJob( const QDomElement& element, const QDir& path )
+{
+    BatchJob job;
+    if (element.hasAttribute("output"))
+        job._output_pattern = path.absoluteFilePath(element.attribute("output"));
+    else
+        job._output_pattern = path.absoluteFilePath(job._output_pattern);
+
+    for (QDomElement e = element.firstChildElement("style"); !e.isNull(); 
+         e = e.nextSiblingElement("style"))
+    {
+        if (e.hasAttribute("file"))
+            job._style_files.append(path.absoluteFilePath(e.attribute("file")));
+        else
+            job._style_files.append(QString());
+    }
+    if (job._style_files.isEmpty())
+        job._style_files.append(QString());
+
+    for (QDomElement e = element.firstChildElement("camera"); !e.isNull(); 
+         e = e.nextSiblingElement("camera"))
+    {
+        BatchCamera camera;
+        if (!camera.load(e, path))
+            return false;
+        job._cameras.append(camera);
+    }
+    if (job._cameras.isEmpty())
+        job._cameras.append(BatchCamera());
+
+    for (QDomElement e = element.firstChildElement("resolution"); !e.isNull(); 
+         e = e.nextSiblingElement("resolution"))
+    {
+        QSize size(e.attribute("width").toInt(), e.attribute("height").toInt());
+        if (size.width() <= 0 || size.height() <= 0)
+        {
+            qWarning("BatchJobList::loadJob: bad resolution on line %d", 
+                     e.lineNumber());
+            return false;
+        }
+        job._resolutions.append(size);
+    }
+    if (job._resolutions.isEmpty())
+        job._resolutions.append(QSize(1024, 768));
+
+    QDomElement tiles = element.firstChildElement("tiles");
+    if (!tiles.isNull())
+    {
+        job._tile_size = tiles.attribute("size", QString::number(DEFAULT_TILE_SIZE)).toInt();
+        job._guard_band = tiles.attribute("guard", QString::number(DEFAULT_GUARD_BAND)).toInt();
+        if (job._tile_size <= 0 || job._guard_band < 0)
+        {
+            qWarning("BatchJobList::loadJob: bad tiles on line %d", 
+                     tiles.lineNumber());
+            return false;
+        }
+    }
+
+    QDomElement scene = element.firstChildElement("scene");
+    if (scene.isNull())
+    {
+        qWarning("BatchJobList::loadJob: job on line %d has no scene", 
+                 element.lineNumber());
+        return false;
+    }
+
+    for (; !scene.isNull(); scene = scene.nextSiblingElement("scene"))
+    {
+        job._scene_file = path.absoluteFilePath(scene.attribute("file"));
+        _jobs.append(job);
+    }
+
+    return true;
+}
+
+bool BatchJob::isTiled( const QSize& size ) const
+{
+    return size.width() > _tile_size || size.height() > _tile_size;
+}
+
+QSize BatchJob::renderSize( const QSize& size ) const
+{
+    if (!isTiled(size))
+        return size;
+
+    return QSize(qMin(size.width(), _tile_size) + 2*_guard_band,
+                 qMin(size.height(), _tile_size) + 2*_guard_band);
+}
+
+QSize BatchJobList::maxResolution() const
+{
+    QSize max_size(0, 0);
+    for (int i = 0; i < _jobs.size(); i++)
+        for (int j = 0; j < _jobs[i]._resolutions.size(); j++)
+            max_size = max_size.expandedTo(_jobs[i].renderSize(_jobs[i]._resolutions[j]));
+    return max_size;
+}
+
+static bool sceneLessThan( const BatchJob& a, const BatchJob& b )
+{
+    return a._scene_file < b._scene_file;
+}
+
+void BatchJobList::sortByScene()
+{
+    qStableSort(_jobs.begin(), _jobs.end(), sceneLessThan);
+}
@@ -0,0 +1,136 @@
+/*****************************************************************************\
+
+BatchJob.h
+Copyright (c) 2009 Forrester Cole
+
+Job lists for dpix-batch. A job file looks like:
+
+<dpixbatch>
+  <job output="renders/{scene}_{style}_{camera}_{width}x{height}.png">
+    <scene file="house.dps"/>
+    <scene file="tower.dps"/>
+    <style file="pencil.sty"/>
+    <style/>
+    <camera/>
+    <camera source="session" frames="0-99:5"/>
+    <camera source="session" file="flyby.xml" frames="all"/>
+    <camera source="turntable" views="36"/>
+    <resolution width="1920" height="1080"/>
+    <resolution width="640" height="480"/>
+  </job>
+  <job output="posters/{scene}.png">
+    <scene file="house.dps"/>
+    <resolution width="16384" height="16384"/>
+    <tiles size="2048" guard="64"/>
+  </job>
+</dpixbatch>
+
+Each job renders every combination of its scenes, styles, cameras, and
+resolutions. A style without a file (or no style at all) uses the style
+saved with the scene. A camera without a source uses the viewer state
+saved with the scene; session cameras use the frames of the session saved
+with the scene or of a separate session file. Turntable cameras orbit the
+saved view around its revolve point, about its up vector, in equal steps.
+Relative paths are resolved against the directory of the job file.
+
+Cameras with more than one view (sessions and turntables) are drawn as
+one batch by NPRRendererStandard::drawViews, so the work that does not 
+depend on the camera is done once per batch instead of once per image.
+
+Images wider or taller than the tile size are rendered as posters: a grid
+of tiles, each drawn with a sub-frustum of the full camera and a guard
+band of extra pixels on every side, so that strokes and line visibility
+near the tile edges match the untiled image. Posters are written a strip
+of tiles at a time to .png or .ppm files (see StripedImageWriter.h).
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef BATCH_JOB_H_
+#define BATCH_JOB_H_
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QSize>
+#include <QDir>
+
+class QDomElement;
+
+class BatchCamera
+{
+public:
+    typedef enum {
+        VIEWER,
+        SESSION,
+        TURNTABLE,
+        NUM_SOURCES
+    } Source;
+
+public:
+    BatchCamera();
+
+    bool load( const QDomElement& element, const QDir& path );
+    bool parseFrames( const QString& frames );
+
+    // Frame numbers to render from a session with num_frames frames.
+    QList<int> frameList( int num_frames ) const;
+
+public:
+    Source  _source;
+    QString _session_file;  // empty for the session saved with the scene
+    int     _first_frame;
+    int     _last_frame;    // -1 for the last frame of the session
+    int     _frame_step;
+    int     _num_views;     // for turntables
+};
+
+class BatchJob
+{
+public:
+    BatchJob();
+
+    // {scene}, {style}, {camera}, {width} and {height} in the output
+    // pattern are replaced for each image.
+    QString outputFilename( const QString& style_file, const QString& camera,
+                            const QSize& size ) const;
+
+    bool  isTiled( const QSize& size ) const;
+    // Size of the viewport that renders an image of the given size: the 
+    // image itself, or one tile plus its guard band.
+    QSize renderSize( const QSize& size ) const;
+
+public:
+    QString             _scene_file;
+    QStringList         _style_files;  // empty entries use the scene style
+    QList<BatchCamera>  _cameras;
+    QList<QSize>        _resolutions;
+    QString             _output_pattern;
+    int                 _tile_size;
+    int                 _guard_band;
+};
+
+class BatchJobList
+{
+public:
+    bool load( const QString& filename );
+
+    void append( const BatchJob& job ) { _jobs.append(job); }
+
+    int             numJobs() const { return _jobs.size(); }
+    const BatchJob& job( int which ) const { return _jobs[which]; }
+    QSize           maxResolution() const;
+
+    // Groups jobs that share a scene so each scene is loaded only once.
+    void            sortByScene();
+
+protected:
+    bool loadJob( const QDomElement& element, const QDir& path );
+
+protected:
+    QList<BatchJob> _jobs;
+};
+
+#endif // BATCH_JOB_H_
@@ -0,0 +1,712 @@
+/*****************************************************************************\
+
+BatchRenderer.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "BatchRenderer.h"
+#include "LightPreset.h"
+#include "SceneFile.h"
+#include "SessionFile.h"
+#include "StripedImageWriter.h"
+
+#include "NPRScene.h"
+#include "NPRStyle.h"
+#include "NPRLight.h"
+#include "NPRSettings.h"
+#include "NPRGLDraw.h"
+#include "NPRRendererStandard.h"
+#include "GQShaderManager.h"
+#include "GQStats.h"
+#include "timestamp.h"
+
+#include <qglviewer.h>
+#include <QDir>
+#include <QFileInfo>
+
+#include <stdio.h>
+
+// GLViewer defaults.
+const int DEFAULT_LIGHT_PRESET = 3; // NORTHEAST
+const float DEFAULT_LIGHT_DEPTH = 1.0f;
+
+BatchRenderer::BatchRenderer()
+{
+    _renderer = 0;
+    _scene = 0;
+    _scene_style = 0;
+    _num_images = 0;
+    _num_failures = 0;
+    _single_view = false;
+    _views_saved = 0;
+    _view_encode_time = 0.0f;
+}
+
+BatchRenderer::~BatchRenderer()
+{
+    clear();
+}
+
+void BatchRenderer::clear()
+{
+    releaseScene();
+
+    QHashIterator<QString, NPRStyle*> it(_styles);
+    while (it.hasNext())
+    {
+        it.next();
+        delete it.value();
+    }
+    _styles.clear();
+    _sessions.clear();
+
+    _context.clear();
+}
+
+bool BatchRenderer::init( const QSize& max_size )
+{
+    if (!_context.init(max_size))
+        return false;
+
+    // Same initial state as QGLViewer::initializeGL.
+    glEnable(GL_LIGHT0);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_COLOR_MATERIAL);
+
+    GQShaderManager::initialize();
+    if (GQShaderManager::status() != GQ_SHADERS_OK)
+    {
+        qCritical("BatchRenderer::init: could not load shaders.");
+        return false;
+    }
+
+    return true;
+}
+
+bool BatchRenderer::loadScene( const QString& filename )
+{
+    releaseScene();
+
+    if (!QFileInfo(filename).exists())
+    {
+        qWarning("BatchRenderer::loadScene: \"%s\" does not exist.", 
+                 qPrintable(filename));
+        return false;
+    }
+
+    NPRSettings::instance().loadDefaults();
+    _light_preset = DEFAULT_LIGHT_PRESET;
+    _light_depth = DEFAULT_LIGHT_DEPTH;
+
+    // Same as Scene::load, without the interactive Session.
+    _scene = new NPRScene();
+    if (filename.endsWith("dps"))
+    {
+        _scene_doc = QDomDocument("dpixscene");
+        if (!SceneFile::readDocument(filename, _scene_doc))
+        {
+            releaseScene();
+            return false;
+        }
+
+        QDomElement root = _scene_doc.documentElement();
+        QDir path = QFileInfo(filename).absoluteDir();
+        NPRSettings settings;
+        if (!SceneFile::loadScene(root, path, settings, *_scene))
+        {
+            releaseScene();
+            return false;
+        }
+        NPRSettings::instance().copyPersistent(settings);
+
+        QDomElement session = root.firstChildElement("session");
+        if (session.hasAttribute("file"))
+        {
+            loadSession(path.absoluteFilePath(session.attribute("file")), 
+                        _scene_session);
+        }
+        else if (!session.isNull())
+        {
+            SceneFile::loadSessionFrames(session, _scene_session);
+        }
+
+        QDomElement viewer_state = root.firstChildElement("viewerstate");
+        _camera_state = viewer_state.firstChildElement("Camera");
+        QDomElement light = viewer_state.firstChildElement("light");
+        if (!light.isNull())
+        {
+            _light_preset = light.attribute("preset").toInt();
+            _light_depth = light.attribute("depth").toFloat();
+        }
+    }
+    else if (!_scene->load(filename))
+    {
+        releaseScene();
+        return false;
+    }
+
+    QMapIterator<int, bool> it(_bool_overrides);
+    while (it.hasNext())
+    {
+        it.next();
+        NPRSettings::instance().set((NPRBoolSetting)it.key(), it.value());
+    }
+
+    _scene_file = filename;
+    _scene_style = _scene->style();
+
+    GQStats::instance().clear();
+    _scene->recordStats(GQStats::instance());
+    _scene->updateVBOs();
+
+    // The renderer holds per-scene buffers (path vertices, atlas layout),
+    // so each scene gets a fresh one. Shaders stay loaded.
+    _renderer = new NPRRendererStandard();
+    _renderer_size = QSize();
+
+    return true;
+}
+
+void BatchRenderer::releaseScene()
+{
+    delete _renderer;
+    _renderer = 0;
+
+    if (_scene)
+    {
+        // Give the scene its own style back, so it doesn't delete a cached one.
+        _scene->swapStyle(_scene_style);
+        delete _scene;
+    }
+    _scene = 0;
+    _scene_style = 0;
+    _scene_file = QString();
+    _scene_doc.clear();
+    _camera_state.clear();
+    _scene_session.clear();
+}
+
+bool BatchRenderer::loadSession( const QString& filename, 
+                                 QVector<SessionFrame>& frames )
+{
+    if (SessionFile::isSessionFile(filename))
+    {
+        SessionFile session;
+        if (!session.open(filename))
+            return false;
+
+        frames.resize(session.numFrames());
+        for (int i = 0; i < session.numFrames(); i++)
+            frames[i] = session.frame(i);
+        return true;
+    }
+
+    QDomDocument doc("session");
+    if (!SceneFile::readDocument(filename, doc))
+        return false;
+
+    return SceneFile::loadSessionFrames(doc.documentElement(), frames);
+}
+
+const QVector<SessionFrame>* BatchRenderer::sessionFrames( const BatchCamera& camera )
+{
+    if (camera._session_file.isEmpty())
+        return &_scene_session;
+
+    if (!_sessions.contains(camera._session_file))
+    {
+        QVector<SessionFrame> frames;
+        if (!loadSession(camera._session_file, frames))
+            return 0;
+        _sessions[camera._session_file] = frames;
+    }
+    return &_sessions[camera._session_file];
+}
+
+NPRStyle* BatchRenderer::style( const QString& filename )
+{
+    if (filename.isEmpty())
+        return _scene_style;
+
+    NPRStyle* style = _styles.value(filename, 0);
+    if (!style)
+    {
+        style = new NPRStyle();
+        if (!style->load(filename))
+        {
+            qWarning("BatchRenderer::style: could not load %s", 
+                     qPrintable(filename));
+            delete style;
+            return 0;
+        }
+        _styles[filename] = style;
+    }
+    return style;
+}
+
+bool BatchRenderer::run( const BatchJobList& jobs )
+{
+    _num_images = 0;
+    _num_failures = 0;
+
+    for (int i = 0; i < jobs.numJobs(); i++)
+    {
+        const BatchJob& job = jobs.job(i);
+        if (job._scene_file != _scene_file)
+        {
+            timestamp start = now();
+            if (!loadScene(job._scene_file))
+            {
+                qWarning("Skipping job %d: could not load %s", i, 
+                         qPrintable(job._scene_file));
+                _num_failures++;
+                continue;
+            }
+            printf("Loaded %s (%.1f s)\n", qPrintable(job._scene_file), 
+                   now() - start);
+        }
+
+        runJob(job);
+    }
+
+    releaseScene();
+
+    return _num_failures == 0;
+}
+
+void BatchRenderer::runJob( const BatchJob& job )
+{
+    for (int s = 0; s < job._style_files.size(); s++)
+    {
+        NPRStyle* current_style = style(job._style_files[s]);
+        if (!current_style)
+        {
+            _num_failures++;
+            continue;
+        }
+        _scene->swapStyle(current_style);
+
+        for (int c = 0; c < job._cameras.size(); c++)
+        {
+            const BatchCamera& batch_camera = job._cameras[c];
+
+            QList<int> frames;
+            const QVector<SessionFrame>* session = 0;
+            if (batch_camera._source == BatchCamera::SESSION)
+            {
+                session = sessionFrames(batch_camera);
+                if (!session || session->isEmpty())
+                {
+                    qWarning("BatchRenderer::runJob: no session frames for %s",
+                             qPrintable(job._scene_file));
+                    _num_failures++;
+                    continue;
+                }
+                frames = batch_camera.frameList(session->size());
+            }
+            else if (batch_camera._source == BatchCamera::TURNTABLE)
+            {
+                for (int v = 0; v < batch_camera._num_views; v++)
+                    frames.append(v);
+            }
+            else
+            {
+                frames.append(-1);
+            }
+
+            for (int r = 0; r < job._resolutions.size(); r++)
+            {
+                const QSize& size = job._resolutions[r];
+
+                qglviewer::Camera camera;
+                setupCamera(camera, size);
+                qglviewer::Camera base_camera(camera);
+
+                // Posters are drawn tile by tile, so only whole images 
+                // are batched.
+                bool batch_views = !_single_view && frames.size() > 1 && 
+                                   !job.isTiled(size);
+                QVector<NPRView> views;
+                _view_filenames.clear();
+
+                for (int f = 0; f < frames.size(); f++)
+                {
+                    QString camera_name = "view";
+                    if (session)
+                    {
+                        const SessionFrame& frame = (*session)[frames[f]];
+                        camera.setFromModelViewMatrix(frame._camera_mat);
+                        camera_name = QString("%1").arg(frames[f], 4, 10, QChar('0'));
+                    }
+                    else if (batch_camera._source == BatchCamera::TURNTABLE)
+                    {
+                        setupTurntableView(camera, base_camera, frames[f], 
+                                           frames.size());
+                        camera_name = QString("%1").arg(frames[f], 4, 10, QChar('0'));
+                    }
+
+                    QString filename = job.outputFilename(job._style_files[s],
+                                                          camera_name, size);
+
+                    if (job.isTiled(size))
+                    {
+                        _num_images++;
+                        if (!renderPoster(camera, size, job, filename))
+                            _num_failures++;
+                        continue;
+                    }
+
+                    if (batch_views)
+                    {
+                        views.append(NPRView());
+                        getView(camera, views.last());
+                        _view_filenames.append(filename);
+                        continue;
+                    }
+
+                    timestamp start = now();
+                    bool success = renderImage(camera, size);
+                    timestamp rendered = now();
+                    success = success && saveImage(filename);
+                    timestamp saved = now();
+
+                    _num_images++;
+                    if (success)
+                    {
+                        printf("Wrote %s (render %.1f ms, encode %.1f ms)\n",
+                               qPrintable(filename), (rendered - start) * 1000.0f,
+                               (saved - rendered) * 1000.0f);
+                    }
+                    else
+                    {
+                        _num_failures++;
+                    }
+                }
+
+                if (!views.isEmpty())
+                    renderViews(views, size);
+            }
+        }
+    }
+}
+
+// Same camera as GLViewer: the saved viewer state if there is one, 
+// otherwise GLViewer::resetView.
+void BatchRenderer::setupCamera( qglviewer::Camera& camera, const QSize& size ) const
+{
+    camera.setScreenWidthAndHeight(size.width(), size.height());
+
+    if (!_camera_state.isNull())
+    {
+        camera.initFromDOMElement(_camera_state);
+    }
+    else
+    {
+        vec center;
+        float radius;
+        _scene->boundingSphere(center, radius);
+
+        camera.setSceneRadius(radius);
+        camera.setSceneCenter(qglviewer::Vec(center[0], center[1], center[2]));
+        camera.setFieldOfView(3.1415926f / 6.0f);
+        camera.setZNearCoefficient(0.01f);
+        camera.setOrientation(0,0);
+        camera.showEntireScene();
+    }
+}
+
+// Orbits the base camera around its revolve point, about its up vector, 
+// by which / num_views of a full turn.
+void BatchRenderer::setupTurntableView( qglviewer::Camera& camera, 
+                                        const qglviewer::Camera& base_camera,
+                                        int which, int num_views ) const
+{
+    qglviewer::Vec center = base_camera.revolveAroundPoint();
+    double angle = 2.0 * 3.1415926 * which / num_views;
+    qglviewer::Quaternion spin(base_camera.upVector(), angle);
+
+    camera.setPosition(center + spin.rotate(base_camera.position() - center));
+    camera.setOrientation(spin * base_camera.orientation());
+}
+
+// Everything NPRRendererStandard::drawViews needs from the camera.
+void BatchRenderer::getView( const qglviewer::Camera& camera, NPRView& view ) const
+{
+    camera.getModelViewMatrix(view._modelview);
+    camera.getProjectionMatrix(view._projection);
+    view._camera_transform = xform(camera.frame()->matrix());
+    view._field_of_view = camera.fieldOfView();
+}
+
+// The work of QGLViewer::preDraw and GLViewer::draw. If tile_origin is 
+// given, the viewport is one tile of the camera's image (of size 
+// screenWidth x screenHeight), with its lower left corner at tile_origin
+// in image pixels.
+bool BatchRenderer::drawFrame( qglviewer::Camera& camera, 
+                               const QSize& viewport_size,
+                               const QPoint* tile_origin )
+{
+    if (viewport_size != _renderer_size)
+    {
+        _renderer->resize(viewport_size.width(), viewport_size.height());
+        _renderer_size = viewport_size;
+    }
+
+    GQStats::instance().reset();
+
+    glViewport(0, 0, viewport_size.width(), viewport_size.height());
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (tile_origin)
+    {
+        loadTileProjection(camera, viewport_size, *tile_origin);
+        NPRGLDraw::setImageRegion(camera.screenWidth(), camera.screenHeight(),
+                                  tile_origin->x(), tile_origin->y());
+    }
+    else
+    {
+        camera.loadProjectionMatrix();
+    }
+    camera.loadModelViewMatrix();
+
+    NPRLight* light = _scene->light(0);
+    light->setLightDir(lightPresetDirection(_light_preset, _light_depth));
+    light->applyToGL(0);
+    glShadeModel(GL_SMOOTH);
+
+    xform cam_xf = xform(camera.frame()->matrix());
+    _scene->setCameraTransform(cam_xf);
+    _scene->setFieldOfView(camera.fieldOfView());
+    _scene->computePotentiallyVisibleSet();
+
+    _renderer->drawScene(*_scene);
+
+    NPRGLDraw::clearImageRegion();
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+    {
+        qWarning("BatchRenderer::drawFrame: GL error %s", (const char*)gluErrorString(error));
+        return false;
+    }
+    return true;
+}
+
+// Loads the part of the camera's projection that covers one tile: the full
+// projection followed by a scale and offset from the NDC of the image to 
+// the NDC of the tile. Works for perspective and orthographic cameras.
+void BatchRenderer::loadTileProjection( const qglviewer::Camera& camera, 
+                                        const QSize& viewport_size,
+                                        const QPoint& tile_origin ) const
+{
+    GLdouble projection[16];
+    camera.getProjectionMatrix(projection);
+
+    double image_width = camera.screenWidth();
+    double image_height = camera.screenHeight();
+    double tile_width = viewport_size.width();
+    double tile_height = viewport_size.height();
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glTranslated((image_width - 2*tile_origin.x() - tile_width) / tile_width,
+                 (image_height - 2*tile_origin.y() - tile_height) / tile_height, 
+                 0.0);
+    glScaled(image_width / tile_width, image_height / tile_height, 1.0);
+    glMultMatrixd(projection);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+bool BatchRenderer::renderImage( qglviewer::Camera& camera, const QSize& size )
+{
+    __TIME_CODE_BLOCK("Batch Render");
+
+    if (!drawFrame(camera, size))
+        return false;
+
+    _context.readPixels(size.width(), size.height(), _image);
+    return true;
+}
+
+// Draws all the views of one camera at one size in a single batch. Each 
+// view is read back and saved from viewDrawn, before the next is drawn.
+void BatchRenderer::renderViews( const QVector<NPRView>& views, const QSize& size )
+{
+    __TIME_CODE_BLOCK("Batch Render Views");
+
+    if (size != _renderer_size)
+    {
+        _renderer->resize(size.width(), size.height());
+        _renderer_size = size;
+    }
+
+    GQStats::instance().reset();
+
+    glViewport(0, 0, size.width(), size.height());
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    NPRLight* light = _scene->light(0);
+    light->setLightDir(lightPresetDirection(_light_preset, _light_depth));
+    glShadeModel(GL_SMOOTH);
+
+    _view_size = size;
+    _views_saved = 0;
+    _view_encode_time = 0.0f;
+
+    timestamp start = now();
+    int num_drawn = _renderer->drawViews(*_scene, views, this);
+    float elapsed = now() - start;
+
+    _num_images += views.size();
+    _num_failures += views.size() - _views_saved;
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+        qWarning("BatchRenderer::renderViews: GL error %s", (const char*)gluErrorString(error));
+
+    float render_time = elapsed - _view_encode_time;
+    printf("Drew %d views in %.2f s (%.1f views/s, render %.1f ms per view, "
+           "encode %.1f ms per view)\n", num_drawn, elapsed, 
+           elapsed > 0.0f ? num_drawn / elapsed : 0.0f,
+           num_drawn > 0 ? render_time * 1000.0f / num_drawn : 0.0f,
+           num_drawn > 0 ? _view_encode_time * 1000.0f / num_drawn : 0.0f);
+}
+
+bool BatchRenderer::viewDrawn( int which )
+{
+    timestamp start = now();
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+    {
+        qWarning("BatchRenderer::viewDrawn: GL error %s", (const char*)gluErrorString(error));
+        return false;
+    }
+
+    _context.readPixels(_view_size.width(), _view_size.height(), _image);
+    const QString& filename = _view_filenames[which];
+    if (saveImage(filename))
+    {
+        printf("Wrote %s\n", qPrintable(filename));
+        _views_saved++;
+    }
+
+    _view_encode_time += now() - start;
+    return true;
+}
+
+// Renders the image as a grid of tiles, one strip of tiles at a time from
+// the top of the image down. Each tile is drawn with a guard band on every
+// side and only its interior is read back, straight into the strip, which 
+// is written out before the next strip is drawn. Memory use depends on the
+// image width and the tile size, but not on the image height.
+bool BatchRenderer::renderPoster( qglviewer::Camera& camera, const QSize& size,
+                                  const BatchJob& job, const QString& filename )
+{
+    if (!makeOutputDirectory(filename))
+        return false;
+
+    // A failed poster is removed rather than left half written.
+    StripedImageWriter writer;
+    if (!writer.open(filename, size.width(), size.height()))
+    {
+        writer.discard();
+        return false;
+    }
+
+    int tile_size = job._tile_size;
+    int guard = job._guard_band;
+    QSize viewport_size = job.renderSize(size);
+    int num_columns = (size.width() + tile_size - 1) / tile_size;
+    int num_rows = (size.height() + tile_size - 1) / tile_size;
+
+    _strip.resize(size.width() * qMin(tile_size, size.height()) * 3);
+
+    float render_time = 0.0f;
+    float encode_time = 0.0f;
+
+    for (int row = 0; row < num_rows; row++)
+    {
+        // Rows of the strip, counted from the top, and the GL y (counted
+        // from the bottom) of its lowest row.
+        int strip_top = row * tile_size;
+        int strip_height = qMin(tile_size, size.height() - strip_top);
+        int strip_y = size.height() - strip_top - strip_height;
+
+        timestamp start = now();
+        for (int column = 0; column < num_columns; column++)
+        {
+            int tile_x = column * tile_size;
+            int tile_width = qMin(tile_size, size.width() - tile_x);
+
+            QPoint tile_origin(tile_x - guard, strip_y - guard);
+            if (!drawFrame(camera, viewport_size, &tile_origin))
+            {
+                writer.discard();
+                return false;
+            }
+
+            _context.readPixelsRGB(guard, guard, tile_width, strip_height,
+                                   size.width(), _strip.data() + tile_x * 3);
+        }
+        timestamp rendered = now();
+
+        // The strip is bottom row first, like GL.
+        int row_bytes = size.width() * 3;
+        if (!writer.writeRows(_strip.data() + (strip_height - 1) * row_bytes,
+                              strip_height, -row_bytes))
+        {
+            writer.discard();
+            return false;
+        }
+
+        render_time += rendered - start;
+        encode_time += now() - rendered;
+    }
+
+    if (!writer.close())
+    {
+        writer.discard();
+        return false;
+    }
+
+    float megapixels = (float)size.width() * (float)size.height() / 1.0e6f;
+    float drawn_megapixels = (float)(num_rows * num_columns) * 
+        viewport_size.width() * viewport_size.height() / 1.0e6f;
+    printf("Wrote %s (%d x %d tiles of %d + %d guard, render %.1f s, "
+           "%.1f ms per Mpixel, %.2fx overdraw, encode %.1f s, %.1f MB)\n",
+           qPrintable(filename), num_columns, num_rows, tile_size, guard, 
+           render_time, render_time * 1000.0f / megapixels,
+           drawn_megapixels / megapixels, encode_time, 
+           writer.bytesWritten() / (1024.0f * 1024.0f));
+    return true;
+}
+
+bool BatchRenderer::makeOutputDirectory( const QString& filename )
+{
+    QDir dir = QFileInfo(filename).absoluteDir();
+    if (!dir.exists() && !dir.mkpath("."))
+    {
+        qWarning("Could not create %s", qPrintable(dir.absolutePath()));
+        return false;
+    }
+    return true;
+}
+
+bool BatchRenderer::saveImage( const QString& filename )
+{
+    if (!makeOutputDirectory(filename))
+        return false;
+
+    if (!_image.save(filename))
+    {
+        qWarning("Could not save %s", qPrintable(filename));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,131 @@
+/*****************************************************************************\
+
+BatchRenderer.h
+Copyright (c) 2009 Forrester Cole
+
+Renders dpix-batch jobs without a window. One offscreen context is kept for
+the whole run, so shaders are compiled once. Each scene is loaded once for
+all of its jobs, and styles (with their textures) are loaded once and 
+swapped in and out of the scene, so the cost of each image is just the
+render and the image encode.
+
+Images larger than a job's tile size are rendered as posters, tile by tile
+(see BatchJob.h), and streamed to disk with StripedImageWriter.
+
+Cameras with several views (session frames, turntables) are drawn with one
+call to NPRRendererStandard::drawViews, and each view is read back and 
+saved from viewDrawn while the next batch waits. -singleview draws them one
+at a time instead, for comparison.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef BATCH_RENDERER_H_
+#define BATCH_RENDERER_H_
+
+#include "BatchJob.h"
+#include "BatchContext.h"
+#include "SessionFrame.h"
+#include "NPRView.h"
+#include "NPRSettings.h"
+
+#include <QDomDocument>
+#include <QDomElement>
+#include <QHash>
+#include <QImage>
+#include <QMap>
+#include <QPoint>
+#include <QStringList>
+#include <QVector>
+
+class NPRScene;
+class NPRStyle;
+class NPRRendererStandard;
+namespace qglviewer { class Camera; }
+
+class BatchRenderer : public NPRViewCallback
+{
+public:
+    BatchRenderer();
+    ~BatchRenderer();
+
+    bool init( const QSize& max_size );
+    void clear();
+
+    // Renders every image of every job. Returns false if any image failed;
+    // failures are reported and the remaining images are still rendered.
+    bool run( const BatchJobList& jobs );
+
+    // Draw multi-view cameras one view at a time.
+    void setSingleView( bool single_view ) { _single_view = single_view; }
+
+    // Forces a setting on every scene, over the defaults and the settings
+    // saved with the scene (e.g. -nolines).
+    void setOverride( NPRBoolSetting which, bool value ) { _bool_overrides[which] = value; }
+
+    int numImages() const { return _num_images; }
+    int numFailures() const { return _num_failures; }
+
+protected:
+    bool loadScene( const QString& filename );
+    void releaseScene();
+    bool loadSession( const QString& filename, QVector<SessionFrame>& frames );
+    const QVector<SessionFrame>* sessionFrames( const BatchCamera& camera );
+    NPRStyle* style( const QString& filename );
+
+    void runJob( const BatchJob& job );
+    void setupCamera( qglviewer::Camera& camera, const QSize& size ) const;
+    void setupTurntableView( qglviewer::Camera& camera, 
+                             const qglviewer::Camera& base_camera,
+                             int which, int num_views ) const;
+    void getView( const qglviewer::Camera& camera, NPRView& view ) const;
+    bool drawFrame( qglviewer::Camera& camera, const QSize& viewport_size,
+                    const QPoint* tile_origin = 0 );
+    void loadTileProjection( const qglviewer::Camera& camera, 
+                             const QSize& viewport_size,
+                             const QPoint& tile_origin ) const;
+    bool renderImage( qglviewer::Camera& camera, const QSize& size );
+    void renderViews( const QVector<NPRView>& views, const QSize& size );
+    bool viewDrawn( int which );
+    bool renderPoster( qglviewer::Camera& camera, const QSize& size,
+                       const BatchJob& job, const QString& filename );
+    bool makeOutputDirectory( const QString& filename );
+    bool saveImage( const QString& filename );
+
+protected:
+    BatchContext            _context;
+    NPRRendererStandard*    _renderer;
+    QSize                   _renderer_size;
+
+    // The current scene, with its own style and the state saved with it.
+    QString                 _scene_file;
+    NPRScene*               _scene;
+    NPRStyle*               _scene_style;
+    QDomDocument            _scene_doc;
+    QDomElement             _camera_state;
+    int                     _light_preset;
+    float                   _light_depth;
+    QVector<SessionFrame>   _scene_session;
+
+    QMap<int, bool>         _bool_overrides;
+
+    QHash<QString, NPRStyle*>               _styles;
+    QHash<QString, QVector<SessionFrame> >  _sessions;
+
+    QImage                  _image;
+    QVector<unsigned char>  _strip;
+
+    // The batch being drawn by renderViews.
+    bool                    _single_view;
+    QSize                   _view_size;
+    QStringList             _view_filenames;
+    int                     _views_saved;
+    float                   _view_encode_time;
+
+    int                     _num_images;
+    int                     _num_failures;
+};
+
+#endif // BATCH_RENDERER_H_
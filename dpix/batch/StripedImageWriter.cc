@@ -0,0 +1,271 @@
+/*****************************************************************************\
+
+StripedImageWriter.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "StripedImageWriter.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <string.h>
+
+// Size of the deflate output buffer, and so of each IDAT chunk.
+const int DEFLATE_BUFFER_SIZE = 1 << 18;
+
+// Line drawings compress well even at the fastest level, and posters
+// can be hundreds of megapixels.
+const int PNG_COMPRESSION_LEVEL = Z_BEST_SPEED;
+
+// The PNG "Sub" filter: each byte minus the same channel of the previous
+// pixel. Needs no previous row, and helps a lot on flat paper and
+// background regions.
+const unsigned char PNG_FILTER_SUB = 1;
+
+static void putBigEndian( unsigned char* dest, unsigned int value )
+{
+    dest[0] = (value >> 24) & 0xff;
+    dest[1] = (value >> 16) & 0xff;
+    dest[2] = (value >> 8) & 0xff;
+    dest[3] = value & 0xff;
+}
+
+StripedImageWriter::StripedImageWriter()
+{
+    _file = 0;
+    _created = false;
+    _format = PNG;
+    _width = 0;
+    _height = 0;
+    _rows_written = 0;
+    _bytes_written = 0;
+    _stream_open = false;
+}
+
+StripedImageWriter::~StripedImageWriter()
+{
+    release();
+}
+
+bool StripedImageWriter::isSupported( const QString& filename )
+{
+    QString suffix = QFileInfo(filename).suffix().toLower();
+    return suffix == "png" || suffix == "ppm";
+}
+
+bool StripedImageWriter::open( const QString& filename, int width, int height )
+{
+    release();
+
+    if (!isSupported(filename))
+    {
+        qWarning("StripedImageWriter::open: %s is not a .png or .ppm file.",
+                 qPrintable(filename));
+        return false;
+    }
+
+    _format = (QFileInfo(filename).suffix().toLower() == "png") ? PNG : PPM;
+    _filename = filename;
+    _width = width;
+    _height = height;
+    _rows_written = 0;
+    _bytes_written = 0;
+
+    _file = fopen(qPrintable(filename), "wb");
+    if (!_file)
+    {
+        qWarning("StripedImageWriter::open: could not open %s",
+                 qPrintable(filename));
+        return false;
+    }
+    _created = true;
+
+    if (_format == PPM)
+    {
+        QByteArray header = QString("P6\n%1 %2\n255\n").arg(width).arg(height).toAscii();
+        return writeBytes(header.constData(), header.size());
+    }
+
+    memset(&_stream, 0, sizeof(_stream));
+    if (deflateInit(&_stream, PNG_COMPRESSION_LEVEL) != Z_OK)
+    {
+        qWarning("StripedImageWriter::open: deflateInit failed.");
+        release();
+        return false;
+    }
+    _stream_open = true;
+
+    _row.resize(width * 3 + 1);
+    _deflated.resize(DEFLATE_BUFFER_SIZE);
+    _stream.next_out = _deflated.data();
+    _stream.avail_out = DEFLATE_BUFFER_SIZE;
+
+    const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    unsigned char header[13];
+    putBigEndian(header, width);
+    putBigEndian(header + 4, height);
+    header[8] = 8;   // bits per channel
+    header[9] = 2;   // RGB
+    header[10] = 0;  // deflate
+    header[11] = 0;  // adaptive filtering
+    header[12] = 0;  // not interlaced
+
+    return writeBytes(signature, 8) && writeChunk("IHDR", header, 13);
+}
+
+bool StripedImageWriter::writeRows( const unsigned char* first_row,
+                                    int num_rows, int row_stride )
+{
+    if (!_file)
+        return false;
+
+    if (_rows_written + num_rows > _height)
+    {
+        qWarning("StripedImageWriter::writeRows: %s only has %d rows.",
+                 qPrintable(_filename), _height);
+        return false;
+    }
+
+    int row_bytes = _width * 3;
+    for (int y = 0; y < num_rows; y++)
+    {
+        const unsigned char* source = first_row + (qint64)y * row_stride;
+        bool success;
+        if (_format == PPM)
+        {
+            success = writeBytes(source, row_bytes);
+        }
+        else
+        {
+            unsigned char* filtered = _row.data() + 1;
+            _row[0] = PNG_FILTER_SUB;
+            memcpy(filtered, source, 3);
+            for (int i = 3; i < row_bytes; i++)
+                filtered[i] = source[i] - source[i-3];
+            success = deflateRow(_row.data(), false);
+        }
+
+        if (!success)
+            return false;
+        _rows_written++;
+    }
+    return true;
+}
+
+bool StripedImageWriter::close()
+{
+    if (!_file)
+        return false;
+
+    bool success = true;
+    if (_rows_written != _height)
+    {
+        qWarning("StripedImageWriter::close: wrote %d of %d rows of %s.",
+                 _rows_written, _height, qPrintable(_filename));
+        success = false;
+    }
+
+    if (success && _format == PNG)
+    {
+        success = deflateRow(0, true) && writeChunk("IEND", 0, 0);
+    }
+
+    if (fclose(_file) != 0)
+    {
+        qWarning("StripedImageWriter::close: error closing %s.",
+                 qPrintable(_filename));
+        success = false;
+    }
+    _file = 0;
+
+    release();
+    if (success)
+        _created = false;
+    return success;
+}
+
+void StripedImageWriter::discard()
+{
+    release();
+    if (_created)
+        QFile::remove(_filename);
+    _created = false;
+}
+
+// Deflates one filtered row (or, with finish set, whatever is left) and
+// writes an IDAT chunk each time the output buffer fills.
+bool StripedImageWriter::deflateRow( const unsigned char* row, bool finish )
+{
+    _stream.next_in = (Bytef*)row;
+    _stream.avail_in = row ? _row.size() : 0;
+
+    while (true)
+    {
+        int result = deflate(&_stream, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (result == Z_STREAM_ERROR)
+        {
+            qWarning("StripedImageWriter::deflateRow: deflate failed.");
+            return false;
+        }
+
+        bool full = _stream.avail_out == 0;
+        bool done = finish ? (result == Z_STREAM_END) : (_stream.avail_in == 0);
+        if (full || (finish && done))
+        {
+            int length = DEFLATE_BUFFER_SIZE - _stream.avail_out;
+            if (length > 0 && !writeChunk("IDAT", _deflated.data(), length))
+                return false;
+            _stream.next_out = _deflated.data();
+            _stream.avail_out = DEFLATE_BUFFER_SIZE;
+        }
+
+        if (done && !full)
+            return true;
+    }
+}
+
+bool StripedImageWriter::writeChunk( const char* type,
+                                     const unsigned char* data, int length )
+{
+    unsigned char length_bytes[4], crc_bytes[4];
+    putBigEndian(length_bytes, length);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef*)type, 4);
+    if (length > 0)
+        crc = crc32(crc, data, length);
+    putBigEndian(crc_bytes, crc);
+
+    return writeBytes(length_bytes, 4) && writeBytes(type, 4) &&
+           (length == 0 || writeBytes(data, length)) && writeBytes(crc_bytes, 4);
+}
+
+bool StripedImageWriter::writeBytes( const void* data, int length )
+{
+    if (fwrite(data, 1, length, _file) != (size_t)length)
+    {
+        qWarning("StripedImageWriter::writeBytes: error writing %s.",
+                 qPrintable(_filename));
+        return false;
+    }
+    _bytes_written += length;
+    return true;
+}
+
+void StripedImageWriter::release()
+{
+    if (_stream_open)
+        deflateEnd(&_stream);
+    _stream_open = false;
+
+    if (_file)
+        fclose(_file);
+    _file = 0;
+
+    _row.clear();
+    _deflated.clear();
+}
@@ -0,0 +1,81 @@
+/*****************************************************************************\
+
+StripedImageWriter.h
+Copyright (c) 2009 Forrester Cole
+
+Writes an RGB image to disk a strip of rows at a time, top row first, so
+images far larger than memory (or than QImage allows) can be written as
+they are rendered. PNG files are deflated as the rows arrive and written
+as a sequence of IDAT chunks; PPM files are written raw. Only one row is
+buffered, plus the deflate state.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef STRIPED_IMAGE_WRITER_H_
+#define STRIPED_IMAGE_WRITER_H_
+
+#include <QString>
+#include <QVector>
+
+#include <stdio.h>
+#include <zlib.h>
+
+class StripedImageWriter
+{
+public:
+    typedef enum {
+        PNG,
+        PPM,
+        NUM_FORMATS
+    } Format;
+
+public:
+    StripedImageWriter();
+    ~StripedImageWriter();
+
+    // Formats are chosen by suffix (.png or .ppm).
+    static bool isSupported( const QString& filename );
+
+    bool open( const QString& filename, int width, int height );
+
+    // Appends num_rows rows of width RGB pixels. Rows are row_stride bytes
+    // apart, and the stride may be negative to write a bottom-up buffer
+    // (pass a pointer to its last row).
+    bool writeRows( const unsigned char* first_row, int num_rows,
+                    int row_stride );
+
+    // Fails if fewer than height rows were written.
+    bool close();
+    // Closes and deletes the file, after a failed open, write or close.
+    void discard();
+
+    int     rowsWritten() const { return _rows_written; }
+    qint64  bytesWritten() const { return _bytes_written; }
+
+protected:
+    bool writeBytes( const void* data, int length );
+    bool writeChunk( const char* type, const unsigned char* data, int length );
+    bool deflateRow( const unsigned char* row, bool finish );
+    void release();
+
+protected:
+    FILE*       _file;
+    QString     _filename;
+    // The file was created by open and not yet closed successfully.
+    bool        _created;
+    Format      _format;
+    int         _width;
+    int         _height;
+    int         _rows_written;
+    qint64      _bytes_written;
+
+    z_stream                _stream;
+    bool                    _stream_open;
+    QVector<unsigned char>  _row;
+    QVector<unsigned char>  _deflated;
+};
+
+#endif // STRIPED_IMAGE_WRITER_H_
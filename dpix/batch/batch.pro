@@ -0,0 +1,80 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+DESTDIR = $${DBGNAME}
+
+win32 {
+    TEMPLATE = vcapp
+    UNAME = Win32
+}
+else {
+    TEMPLATE = app
+
+    macx {
+        DEFINES += DARWIN
+        UNAME = Darwin
+        CONFIG -= app_bundle
+
+        LIBS += -framework CoreFoundation
+        QMAKE_CXXFLAGS += -fopenmp
+        QMAKE_LFLAGS += -fopenmp
+    }
+    else {
+        DEFINES += LINUX
+        UNAME = Linux
+        QMAKE_CXXFLAGS += -fopenmp
+        QMAKE_LFLAGS += -fopenmp
+        # clock_gettime, for GQProfiler.
+        LIBS += -lrt
+    }
+}
+
+# Build with "qmake CONFIG+=osmesa" to render without a display.
+osmesa {
+    DEFINES += GQ_USE_OSMESA
+    LIBS += -lOSMesa
+}
+
+QT += opengl xml
+CONFIG += console
+TARGET = dpix-batch
+
+PRE_TARGETDEPS += ../../libnpr/$${DBGNAME}/libnpr.a
+DEPENDPATH += ../../libnpr/include
+INCLUDEPATH += ../../libnpr/include
+LIBS += -L../../libnpr/$${DBGNAME} -lnpr
+
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+DEPENDPATH += ../../libgq/include
+INCLUDEPATH += ../../libgq/include
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+
+PRE_TARGETDEPS += ../../libcda/$${DBGNAME}/libcda.a
+DEPENDPATH += ../../libcda/include
+INCLUDEPATH += ../../libcda/include 
+LIBS += -L../../libcda/$${DBGNAME} -lcda
+
+# Only the camera classes are used, for the saved viewer state.
+PRE_TARGETDEPS += ../../qglviewer/$${DBGNAME}/libqglviewer.a
+DEPENDPATH += ../../qglviewer
+INCLUDEPATH += ../../qglviewer
+LIBS += -L../../qglviewer/$${DBGNAME} -lqglviewer
+DEFINES += QGLVIEWER_STATIC
+
+# Shared with dpix, and free of widgets.
+DEPENDPATH += ../src
+INCLUDEPATH += ../src
+HEADERS += ../src/SessionFrame.h ../src/SessionFile.h ../src/SceneFile.h ../src/LightPreset.h
+SOURCES += ../src/SessionFrame.cc ../src/SessionFile.cc ../src/SceneFile.cc ../src/LightPreset.cc
+
+# StripedImageWriter deflates PNG posters with libgq's copy of zlib.
+INCLUDEPATH += ../../libgq/zlib
+
+# Input
+HEADERS += *.h
+SOURCES += *.cc
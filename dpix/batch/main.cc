@@ -0,0 +1,273 @@
+/*****************************************************************************\
+
+main.cc
+Copyright (c) 2009 Forrester Cole
+
+main function for dpix-batch, which renders scenes to image files without
+opening a window. Takes either a job file (see BatchJob.h) or a single 
+scene with options.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QApplication>
+#include <QString>
+#include <QStringList>
+#include <QDir>
+#include <QFileInfo>
+
+#include "NPRSettings.h"
+#include "GQShaderManager.h"
+#include "GQStats.h"
+#include "timestamp.h"
+
+#include "BatchJob.h"
+#include "BatchRenderer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+void printUsage(const char *myname)
+{
+    fprintf(stderr, "\n");
+    fprintf(stderr, "\n Usage    : %s <jobfile.xml> [options]\n", myname);
+    fprintf(stderr, "          : %s <scene> -o <output> [options]\n", myname);
+
+    fprintf(stderr, " options: -h | --help          : print this message\n");
+    fprintf(stderr, "        : -o <filename>        : output image, may contain {scene}, {style},\n");
+    fprintf(stderr, "                                 {camera}, {width} and {height}\n");
+    fprintf(stderr, "        : -size <W>x<H>        : output resolution (may be repeated)\n");
+    fprintf(stderr, "        : -style <filename>    : style file (may be repeated)\n");
+    fprintf(stderr, "        : -session [filename]  : use the frames of a session instead of the\n");
+    fprintf(stderr, "                                 saved view (default: the scene's session)\n");
+    fprintf(stderr, "        : -frames <a-b[:step]> : session frames to render (default: all)\n");
+    fprintf(stderr, "        : -turntable <n>       : render n views orbiting the saved view\n");
+    fprintf(stderr, "        : -tile <size>         : render larger images as posters, in tiles of\n");
+    fprintf(stderr, "                                 this size, to .png or .ppm (default: 2048)\n");
+    fprintf(stderr, "        : -guard <pixels>      : overlap around each poster tile (default: 64)\n");
+    fprintf(stderr, "        : -shaders <dir>       : directory containing programs.xml\n");
+    fprintf(stderr, "        : -stats <basename>    : save a performance trace (.json), per-frame\n");
+    fprintf(stderr, "                                 timers and percentiles (_frames.csv and\n");
+    fprintf(stderr, "                                 _summary.csv)\n");
+
+    fprintf(stderr, "\n        : DEBUGGING OPTIONS:\n");
+    fprintf(stderr, "        : -nolines      : turn off line drawing\n");
+    fprintf(stderr, "        : -singleview   : draw multi-view cameras one view at a time\n");
+
+    exit(1);
+}
+
+bool findShadersDirectory( const QString& app_path, QDir& shaders_dir )
+{
+    // look for the shaders/programs.xml file, as dpix does
+    QStringList candidates;
+    candidates << QDir::currentPath()
+    << QDir::cleanPath(app_path)
+    << QDir::cleanPath(app_path + "/../../libnpr/")
+    << QDir::cleanPath(app_path + "/../../../libnpr/");
+
+    for (int i = 0; i < candidates.size(); i++)
+    {
+        if (QFileInfo(candidates[i] + "/shaders/programs.xml").exists())
+        {
+            shaders_dir = QDir(candidates[i] + "/shaders");
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Could not find shaders/programs.xml. Tried:\n");
+    for (int i = 0; i < candidates.size(); i++)
+        fprintf(stderr, "  %s/shaders/programs.xml\n", qPrintable(candidates[i]));
+    return false;
+}
+
+int main( int argc, char** argv )
+{
+#ifdef GQ_USE_OSMESA
+    // No display connection is needed (or wanted) with OSMesa.
+    QApplication app(argc, argv, false);
+#else
+    QApplication app(argc, argv);
+#endif
+
+    QStringList arguments = app.arguments();
+    if (arguments.size() < 2 || arguments[1].startsWith("-"))
+        printUsage(argv[0]);
+
+    NPRSettings::instance().loadDefaults();
+
+    BatchJobList jobs;
+    BatchJob single_job;
+    bool is_job_file = arguments[1].endsWith(".xml");
+    bool has_output = false;
+    bool use_session = false;
+    BatchCamera session_camera;
+    session_camera._source = BatchCamera::SESSION;
+    bool use_turntable = false;
+    BatchCamera turntable_camera;
+    turntable_camera._source = BatchCamera::TURNTABLE;
+    bool single_view = false;
+    bool no_lines = false;
+    QString shaders_path;
+    QString stats_basename;
+
+    if (!is_job_file)
+        single_job._scene_file = QDir::current().absoluteFilePath(arguments[1]);
+
+    for (int i = 2; i < arguments.size(); i++)
+    {
+        const QString& arg = arguments[i];
+        bool has_value = i+1 < arguments.size() && !arguments[i+1].startsWith("-");
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+        }
+        else if (arg == "-shaders" && has_value)
+        {
+            shaders_path = arguments[++i];
+        }
+        else if (arg == "-nolines")
+        {
+            no_lines = true;
+        }
+        else if (arg == "-singleview")
+        {
+            single_view = true;
+        }
+        else if (arg == "-stats" && has_value)
+        {
+            stats_basename = QDir::current().absoluteFilePath(arguments[++i]);
+        }
+        else if (is_job_file)
+        {
+            printUsage(argv[0]);
+        }
+        else if (arg == "-o" && has_value)
+        {
+            single_job._output_pattern = QDir::current().absoluteFilePath(arguments[++i]);
+            has_output = true;
+        }
+        else if (arg == "-size" && has_value)
+        {
+            QStringList dims = arguments[++i].split('x');
+            if (dims.size() != 2 || dims[0].toInt() <= 0 || dims[1].toInt() <= 0)
+                printUsage(argv[0]);
+            single_job._resolutions.append(QSize(dims[0].toInt(), dims[1].toInt()));
+        }
+        else if (arg == "-style" && has_value)
+        {
+            single_job._style_files.append(QDir::current().absoluteFilePath(arguments[++i]));
+        }
+        else if (arg == "-session")
+        {
+            use_session = true;
+            if (has_value)
+                session_camera._session_file = QDir::current().absoluteFilePath(arguments[++i]);
+        }
+        else if (arg == "-frames" && has_value)
+        {
+            use_session = true;
+            if (!session_camera.parseFrames(arguments[++i]))
+                printUsage(argv[0]);
+        }
+        else if (arg == "-turntable" && has_value)
+        {
+            use_turntable = true;
+            turntable_camera._num_views = arguments[++i].toInt();
+            if (turntable_camera._num_views <= 0)
+                printUsage(argv[0]);
+        }
+        else if (arg == "-tile" && has_value)
+        {
+            single_job._tile_size = arguments[++i].toInt();
+            if (single_job._tile_size <= 0)
+                printUsage(argv[0]);
+        }
+        else if (arg == "-guard" && has_value)
+        {
+            single_job._guard_band = arguments[++i].toInt();
+            if (single_job._guard_band < 0)
+                printUsage(argv[0]);
+        }
+        else
+            printUsage(argv[0]);
+    }
+
+    if (is_job_file)
+    {
+        if (!jobs.load(arguments[1]))
+            return 1;
+    }
+    else
+    {
+        if (!has_output)
+            printUsage(argv[0]);
+        if (single_job._style_files.isEmpty())
+            single_job._style_files.append(QString());
+        if (single_job._resolutions.isEmpty())
+            single_job._resolutions.append(QSize(1024, 768));
+        if (use_session)
+            single_job._cameras.append(session_camera);
+        if (use_turntable)
+            single_job._cameras.append(turntable_camera);
+        if (single_job._cameras.isEmpty())
+            single_job._cameras.append(BatchCamera());
+        jobs.append(single_job);
+    }
+
+    if (jobs.numJobs() == 0)
+    {
+        fprintf(stderr, "No jobs to run.\n");
+        return 1;
+    }
+    jobs.sortByScene();
+
+    QDir shaders_dir(shaders_path);
+    if (shaders_path.isEmpty() && 
+        !findShadersDirectory(app.applicationDirPath(), shaders_dir))
+        return 1;
+    GQShaderManager::setShaderDirectory(shaders_dir);
+
+    timestamp start = now();
+
+    BatchRenderer renderer;
+    renderer.setSingleView(single_view);
+    // Each scene loads its own settings, so this is reapplied per scene.
+    if (no_lines)
+        renderer.setOverride(NPR_ENABLE_LINES, false);
+    if (!renderer.init(jobs.maxResolution()))
+        return 1;
+
+    printf("Initialized %d x %d offscreen context (%.1f s)\n", 
+           jobs.maxResolution().width(), jobs.maxResolution().height(), 
+           now() - start);
+
+    // Every image is a frame of the history; keep them all.
+    if (!stats_basename.isEmpty())
+    {
+        GQStats::instance().beginTrace();
+        GQStats::instance().setHistoryLength(INT_MAX);
+    }
+
+    bool success = renderer.run(jobs);
+
+    if (!stats_basename.isEmpty())
+    {
+        // Each render starts with a reset, which ends the frame before it.
+        GQStats::instance().reset();
+        if (!GQStats::instance().saveStats(stats_basename))
+            success = false;
+    }
+
+    float elapsed = now() - start;
+    printf("Rendered %d images in %.1f s (%.1f ms per image), %d failures\n",
+           renderer.numImages(), elapsed, 
+           renderer.numImages() > 0 ? elapsed * 1000.0f / renderer.numImages() : 0.0f,
+           renderer.numFailures());
+
+    return success ? 0 : 1;
+}
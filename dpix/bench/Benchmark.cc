@@ -0,0 +1,502 @@
+/*****************************************************************************\
+
+Benchmark.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "Benchmark.h"
+
+#include "NPRScene.h"
+#include "NPRSettings.h"
+#include "NPRRendererStandard.h"
+#include "GQStats.h"
+#include "timestamp.h"
+
+#include <qglviewer.h>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTextStream>
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+// A stage of the frame, and the GQStats timers that make it up. Stages
+// that have GPU timers are also reported on the GPU, as <stage>_gpu.
+struct BenchmarkStage
+{
+    const char* name;
+    const char* timers[3];
+};
+
+const int NUM_STAGES = 7;
+const BenchmarkStage stages[NUM_STAGES] =
+{
+    { "pvs",      { "Compute PVS", 0, 0 } },
+    { "depth",    { "Draw depth buffer", "Build depth pyramid", 0 } },
+    { "clip",     { "draw clip buf", 0, 0 } },
+    { "scan",     { "sum lengths", 0, 0 } },
+    { "atlas",    { "draw segment atlas", "smooth atlas", 0 } },
+    { "polygons", { "Draw Polygons", 0, 0 } },
+    { "strokes",  { "Draw Quads", 0, 0 } },
+};
+
+// Medians below this (in ms) are too noisy to compare.
+const float MIN_COMPARED_TIME = 0.05f;
+
+const char* RESULTS_HEADER =
+    "scene,method,width,height,supersample,frame_cache,stage,frames,"
+    "mean_ms,p50_ms,p90_ms,p99_ms,max_ms,rep_stddev_ms";
+const int NUM_RESULT_FIELDS = 14;
+
+// Quotes a CSV field if it holds a separator, a quote or a line break.
+static QString csvField( const QString& field )
+{
+    if (!field.contains(',') && !field.contains('"') &&
+        !field.contains('\n') && !field.contains('\r'))
+    {
+        return field;
+    }
+    QString quoted = field;
+    quoted.replace("\"", "\"\"");
+    return "\"" + quoted + "\"";
+}
+
+// Reads one CSV record, which spans several lines if a quoted field holds
+// a line break. Returns false at the end of the stream.
+static bool readCsvRecord( QTextStream& in, QStringList& fields )
+{
+    fields.clear();
+    if (in.atEnd())
+        return false;
+
+    QString line = in.readLine();
+    QString field;
+    bool quoted = false;
+    for (int i = 0; ; i++)
+    {
+        if (i == line.size())
+        {
+            if (!quoted || in.atEnd())
+                break;
+            field += '\n';
+            line = in.readLine();
+            i = -1;
+            continue;
+        }
+
+        QChar c = line[i];
+        if (quoted)
+        {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"')
+            {
+                field += c;
+                i++;
+            }
+            else if (c == '"')
+                quoted = false;
+            else
+                field += c;
+        }
+        else if (c == '"')
+            quoted = true;
+        else if (c == ',')
+        {
+            fields.append(field);
+            field.clear();
+        }
+        else
+            field += c;
+    }
+    fields.append(field);
+    return true;
+}
+
+// Nearest-rank percentile of sorted values.
+static float percentile( const QVector<float>& sorted, float p )
+{
+    if (sorted.isEmpty())
+        return 0;
+    int rank = (int)ceil(p * 0.01f * sorted.size()) - 1;
+    return sorted[qBound(0, rank, sorted.size() - 1)];
+}
+
+static float mean( const QVector<float>& values )
+{
+    if (values.isEmpty())
+        return 0;
+    float sum = 0;
+    for (int i = 0; i < values.size(); i++)
+        sum += values[i];
+    return sum / values.size();
+}
+
+// Times in seconds in, milliseconds out.
+static BenchmarkResult makeResult( const BenchmarkResult& config,
+                                   const QString& stage,
+                                   QVector<float> values,
+                                   const QVector<float>& rep_means )
+{
+    BenchmarkResult result = config;
+    result._stage = stage;
+
+    std::sort(values.begin(), values.end());
+    result._frames = values.size();
+    result._mean = mean(values) * 1000.0f;
+    result._p50 = percentile(values, 50) * 1000.0f;
+    result._p90 = percentile(values, 90) * 1000.0f;
+    result._p99 = percentile(values, 99) * 1000.0f;
+    result._max = percentile(values, 100) * 1000.0f;
+
+    float rep_mean = mean(rep_means);
+    float variance = 0;
+    for (int i = 0; i < rep_means.size(); i++)
+        variance += (rep_means[i] - rep_mean) * (rep_means[i] - rep_mean);
+    if (rep_means.size() > 1)
+        variance /= rep_means.size() - 1;
+    result._rep_stddev = sqrt(variance) * 1000.0f;
+
+    return result;
+}
+
+QString BenchmarkResult::key() const
+{
+    return QString("%1 %2 %3x%4 x%5%6 %7").arg(_scene).arg(_method).
+        arg(_size.width()).arg(_size.height()).arg(_supersample).
+        arg(_frame_cache ? " cached" : "").arg(_stage);
+}
+
+Benchmark::Benchmark()
+{
+    _methods << NPR_SPINE_TEST << NPR_SEGMENT_ATLAS;
+    _sizes << QSize(1024, 768);
+    _num_frames = 100;
+    _num_warmup_frames = 10;
+    _num_reps = 3;
+    _frame_cache = false;
+}
+
+QString Benchmark::methodName( int method )
+{
+    switch (method)
+    {
+        case NPR_SPINE_TEST : return "spine";
+        case NPR_SEGMENT_ATLAS : return "atlas";
+        default : return QString::number(method);
+    }
+}
+
+bool Benchmark::run()
+{
+    _results.clear();
+    GQStats::instance().setHistoryLength(_num_frames + 1);
+
+    bool success = true;
+    for (int i = 0; i < _scenes.size(); i++)
+    {
+        if (!runScene(_scenes[i]))
+            success = false;
+    }
+
+    releaseScene();
+    return success;
+}
+
+bool Benchmark::runScene( const QString& filename )
+{
+    timestamp start = now();
+    if (!loadScene(filename))
+    {
+        qWarning("Benchmark::runScene: could not load %s", qPrintable(filename));
+        return false;
+    }
+    float load_time = now() - start;
+
+    QString scene_name = QFileInfo(filename).fileName();
+    printf("Loaded %s (%.1f s)\n", qPrintable(scene_name), load_time);
+
+    QList<int> supersamples = _supersamples;
+    if (supersamples.isEmpty())
+        supersamples << NPRSettings::instance().get(NPR_LINE_VISIBILITY_SUPERSAMPLE);
+
+    bool success = true;
+    for (int m = 0; m < _methods.size(); m++)
+    {
+        for (int r = 0; r < _sizes.size(); r++)
+        {
+            for (int s = 0; s < supersamples.size(); s++)
+            {
+                if (!runConfiguration(scene_name, _methods[m], _sizes[r],
+                                      supersamples[s], load_time))
+                    success = false;
+            }
+        }
+    }
+    return success;
+}
+
+// The scene's session (or the one given), resampled to the frame count,
+// otherwise a turntable around the saved view.
+void Benchmark::makeCameraPath( const QSize& size, QVector<xform>& path )
+{
+    path.clear();
+
+    QVector<SessionFrame> session_file_frames;
+    const QVector<SessionFrame>* session = &_scene_session;
+    if (!_session_file.isEmpty())
+    {
+        if (loadSession(_session_file, session_file_frames))
+            session = &session_file_frames;
+        else
+            qWarning("Benchmark::makeCameraPath: could not load %s, using the scene's camera.",
+                     qPrintable(_session_file));
+    }
+
+    if (!session->isEmpty())
+    {
+        for (int i = 0; i < _num_frames; i++)
+            path.append((*session)[i * session->size() / _num_frames]._camera_mat);
+        return;
+    }
+
+    qglviewer::Camera camera;
+    setupCamera(camera, size);
+    qglviewer::Camera base_camera(camera);
+    for (int i = 0; i < _num_frames; i++)
+    {
+        setupTurntableView(camera, base_camera, i, _num_frames);
+        GLdouble modelview[16];
+        camera.getModelViewMatrix(modelview);
+        path.append(xform(modelview));
+    }
+}
+
+bool Benchmark::runConfiguration( const QString& scene_name, int method,
+                                  const QSize& size, int supersample,
+                                  float load_time )
+{
+    NPRSettings& settings = NPRSettings::instance();
+    settings.set(NPR_LINE_VISIBILITY_METHOD, method);
+    settings.set(NPR_LINE_VISIBILITY_SUPERSAMPLE, supersample);
+
+    QVector<xform> path;
+    makeCameraPath(size, path);
+
+    if (!drawPath(path, size, _num_warmup_frames, 0))
+        return false;
+
+    GQStats& stats = GQStats::instance();
+    QVector<float> frame_times;
+    QVector<float> frame_rep_means;
+    QVector<float> stage_times[NUM_STAGES][2];
+    QVector<float> stage_rep_means[NUM_STAGES][2];
+
+    for (int rep = 0; rep < _num_reps; rep++)
+    {
+        // Closes the last warmup frame before the history is cleared.
+        stats.reset();
+        stats.clearHistory();
+
+        QVector<float> rep_frame_times;
+        if (!drawPath(path, size, _num_frames, &rep_frame_times))
+            return false;
+        stats.reset();
+
+        frame_times += rep_frame_times;
+        frame_rep_means.append(mean(rep_frame_times));
+
+        for (int i = 0; i < NUM_STAGES; i++)
+        {
+            QStringList cpu_timers, gpu_timers;
+            for (int j = 0; j < 3 && stages[i].timers[j]; j++)
+            {
+                cpu_timers << stages[i].timers[j];
+                gpu_timers << QString(stages[i].timers[j]) + " (GPU)";
+            }
+
+            QVector<float> values;
+            stats.timerHistory(cpu_timers, values);
+            stage_times[i][0] += values;
+            stage_rep_means[i][0].append(mean(values));
+
+            stats.timerHistory(gpu_timers, values);
+            stage_times[i][1] += values;
+            stage_rep_means[i][1].append(mean(values));
+        }
+    }
+
+    BenchmarkResult config;
+    config._scene = scene_name;
+    config._method = methodName(method);
+    config._size = size;
+    config._supersample = supersample;
+    config._frame_cache = _frame_cache;
+
+    _results.append(makeResult(config, "load", QVector<float>() << load_time,
+                               QVector<float>() << load_time));
+    _results.append(makeResult(config, "frame", frame_times, frame_rep_means));
+    const BenchmarkResult& frame = _results.last();
+    printf("%s %s %dx%d x%d%s: frame mean %.2f ms, p50 %.2f, p99 %.2f, max %.2f (+/- %.2f over %d reps)\n",
+           qPrintable(scene_name), qPrintable(config._method), size.width(),
+           size.height(), supersample, _frame_cache ? " cached" : "",
+           frame._mean, frame._p50, frame._p99,
+           frame._max, frame._rep_stddev, _num_reps);
+
+    for (int i = 0; i < NUM_STAGES; i++)
+    {
+        // Stages the method does not use (e.g. the atlas stages of the
+        // spine test) are left out.
+        if (!stage_times[i][0].isEmpty())
+        {
+            _results.append(makeResult(config, stages[i].name,
+                                       stage_times[i][0], stage_rep_means[i][0]));
+        }
+        if (!stage_times[i][1].isEmpty())
+        {
+            _results.append(makeResult(config, QString(stages[i].name) + "_gpu",
+                                       stage_times[i][1], stage_rep_means[i][1]));
+        }
+    }
+
+    return true;
+}
+
+// Each frame is finished before the next starts, so its GPU timers are
+// read back right away and land in the same frame of the history.
+bool Benchmark::drawPath( const QVector<xform>& path, const QSize& size,
+                          int num_frames, QVector<float>* frame_times )
+{
+    qglviewer::Camera camera;
+    setupCamera(camera, size);
+
+    for (int i = 0; i < num_frames; i++)
+    {
+        camera.setFromModelViewMatrix(path[i % path.size()]);
+
+        // Otherwise a frame whose camera matches the last one (e.g. a 
+        // pause in a recorded session) skips most of its stages.
+        if (!_frame_cache)
+            _renderer->invalidateCache();
+
+        timestamp start = now();
+        if (!drawFrame(camera, size))
+            return false;
+        glFinish();
+        float elapsed = now() - start;
+
+        GQGPUTimer::instance().endFrame();
+        if (frame_times)
+            frame_times->append(elapsed);
+    }
+    return true;
+}
+
+bool Benchmark::saveResults( const QString& filename ) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning("Benchmark::saveResults: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << RESULTS_HEADER << "\n";
+    for (int i = 0; i < _results.size(); i++)
+    {
+        const BenchmarkResult& r = _results[i];
+        out << csvField(r._scene) << "," << csvField(r._method) << ","
+            << r._size.width() << "," << r._size.height() << ","
+            << r._supersample << "," << (r._frame_cache ? 1 : 0) << ","
+            << csvField(r._stage) << "," << r._frames << ","
+            << r._mean << "," << r._p50 << "," << r._p90 << ","
+            << r._p99 << "," << r._max << "," << r._rep_stddev << "\n";
+    }
+    out.flush();
+
+    return file.error() == QFile::NoError;
+}
+
+bool Benchmark::loadResults( const QString& filename, QList<BenchmarkResult>& results )
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning("Benchmark::loadResults: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QTextStream in(&file);
+    if (in.readLine() != RESULTS_HEADER)
+    {
+        qWarning("Benchmark::loadResults: %s is not a dpix-bench results file",
+                 qPrintable(filename));
+        return false;
+    }
+
+    results.clear();
+    QStringList fields;
+    while (readCsvRecord(in, fields))
+    {
+        if (fields.size() != NUM_RESULT_FIELDS)
+            continue;
+
+        BenchmarkResult r;
+        r._scene = fields[0];
+        r._method = fields[1];
+        r._size = QSize(fields[2].toInt(), fields[3].toInt());
+        r._supersample = fields[4].toInt();
+        r._frame_cache = fields[5].toInt() != 0;
+        r._stage = fields[6];
+        r._frames = fields[7].toInt();
+        r._mean = fields[8].toFloat();
+        r._p50 = fields[9].toFloat();
+        r._p90 = fields[10].toFloat();
+        r._p99 = fields[11].toFloat();
+        r._max = fields[12].toFloat();
+        r._rep_stddev = fields[13].toFloat();
+        results.append(r);
+    }
+    return true;
+}
+
+int Benchmark::compare( const QList<BenchmarkResult>& baseline, float threshold ) const
+{
+    QHash<QString, const BenchmarkResult*> base_results;
+    for (int i = 0; i < baseline.size(); i++)
+        base_results[baseline[i].key()] = &baseline[i];
+
+    int num_slower = 0;
+    printf("\n%-48s %10s %10s %8s\n", "stage", "base p50", "p50", "change");
+    for (int i = 0; i < _results.size(); i++)
+    {
+        const BenchmarkResult& current = _results[i];
+        const BenchmarkResult* base = base_results.value(current.key(), 0);
+        if (!base)
+        {
+            printf("%-48s %10s %10.3f %8s\n", qPrintable(current.key()), "-",
+                   current._p50, "new");
+            continue;
+        }
+
+        float change = 0;
+        if (base->_p50 > 0)
+            change = (current._p50 - base->_p50) * 100.0f / base->_p50;
+
+        bool slower = base->_p50 >= MIN_COMPARED_TIME && change > threshold;
+        if (slower)
+            num_slower++;
+
+        printf("%-48s %10.3f %10.3f %+7.1f%%%s\n", qPrintable(current.key()),
+               base->_p50, current._p50, change, slower ? "  SLOWER" : "");
+    }
+
+    printf("\n%d of %d stages slower than the baseline by more than %.1f%%\n",
+           num_slower, _results.size(), threshold);
+    return num_slower;
+}
@@ -0,0 +1,121 @@
+/*****************************************************************************\
+
+Benchmark.h
+Copyright (c) 2009 Forrester Cole
+
+Measures the renderer the same way on every run, for dpix-bench. Each
+scene is drawn along a fixed camera path: its recorded session (or a
+given one), resampled to a fixed number of frames, or a turntable around
+the saved view if it has no session. Every combination of line visibility
+method, resolution and supersample count is warmed up, then drawn a few
+times along the path.
+
+Frames end with glFinish, so the frame time is the real cost of the frame.
+The renderer's frame cache is invalidated before every frame, so each
+frame runs every line visibility stage, unless the cache is turned on to
+measure what an interactive session sees. Results record which was used.
+The stages are read from the GQStats timers: the CPU timers, and the GPU
+timers where a stage has them. For each stage the results hold the mean
+and percentiles over all measured frames, and the spread of the mean
+across repetitions.
+
+Results are saved as CSV, one row per scene, configuration and stage, 
+with text fields quoted where needed (RFC 4180). A saved file can be used
+as the baseline of a later run, which then reports every stage whose 
+median got slower by more than a threshold.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "BatchRenderer.h"
+
+#include <QList>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class BenchmarkResult
+{
+public:
+    QString key() const;
+
+public:
+    QString _scene;
+    QString _method;
+    QSize   _size;
+    int     _supersample;
+    bool    _frame_cache;
+    QString _stage;
+
+    // All in milliseconds.
+    int     _frames;
+    float   _mean;
+    float   _p50;
+    float   _p90;
+    float   _p99;
+    float   _max;
+    float   _rep_stddev;
+};
+
+class Benchmark : public BatchRenderer
+{
+public:
+    Benchmark();
+
+    void setScenes( const QStringList& scenes ) { _scenes = scenes; }
+    void setMethods( const QList<int>& methods ) { _methods = methods; }
+    void setSizes( const QList<QSize>& sizes ) { _sizes = sizes; }
+    // An empty list keeps each scene's own setting.
+    void setSupersamples( const QList<int>& supersamples ) { _supersamples = supersamples; }
+    void setFrames( int frames ) { _num_frames = frames; }
+    void setWarmupFrames( int frames ) { _num_warmup_frames = frames; }
+    void setRepetitions( int reps ) { _num_reps = reps; }
+    void setSessionFile( const QString& filename ) { _session_file = filename; }
+    // Keep the renderer's frame cache between frames instead of 
+    // invalidating it before each one.
+    void setFrameCache( bool enabled ) { _frame_cache = enabled; }
+
+    // Returns false if any scene failed to load or draw.
+    bool run();
+
+    const QList<BenchmarkResult>& results() const { return _results; }
+
+    bool saveResults( const QString& filename ) const;
+    static bool loadResults( const QString& filename, QList<BenchmarkResult>& results );
+
+    // Prints the change in each median against the baseline. Returns the
+    // number of stages slower by more than threshold percent.
+    int  compare( const QList<BenchmarkResult>& baseline, float threshold ) const;
+
+    static QString methodName( int method );
+
+protected:
+    bool runScene( const QString& filename );
+    // Model view matrices, one per frame.
+    void makeCameraPath( const QSize& size, QVector<xform>& path );
+    bool runConfiguration( const QString& scene_name, int method,
+                           const QSize& size, int supersample, float load_time );
+    bool drawPath( const QVector<xform>& path, const QSize& size,
+                   int num_frames, QVector<float>* frame_times );
+
+protected:
+    QStringList         _scenes;
+    QList<int>          _methods;
+    QList<QSize>        _sizes;
+    QList<int>          _supersamples;
+    int                 _num_frames;
+    int                 _num_warmup_frames;
+    int                 _num_reps;
+    QString             _session_file;
+    bool                _frame_cache;
+
+    QList<BenchmarkResult> _results;
+};
+
+#endif // BENCHMARK_H_
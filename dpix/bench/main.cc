@@ -0,0 +1,235 @@
+/*****************************************************************************\
+
+main.cc
+Copyright (c) 2009 Forrester Cole
+
+main function for dpix-bench, which times the renderer on a fixed set of
+scenes, camera paths and settings (see Benchmark.h), and compares the
+results to a saved baseline.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QApplication>
+#include <QString>
+#include <QStringList>
+#include <QDir>
+#include <QFileInfo>
+
+#include "NPRSettings.h"
+#include "NPRRendererStandard.h"
+#include "GQShaderManager.h"
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void printUsage(const char *myname)
+{
+    fprintf(stderr, "\n");
+    fprintf(stderr, "\n Usage    : %s [scene.dps ...] [options]\n", myname);
+    fprintf(stderr, "            (default: samples/scenes/*.dps)\n");
+
+    fprintf(stderr, " options: -h | --help          : print this message\n");
+    fprintf(stderr, "        : -o <filename>        : save the results as CSV\n");
+    fprintf(stderr, "        : -compare <filename>  : compare to the results of an earlier run,\n");
+    fprintf(stderr, "                                 exit with 2 if any stage got slower\n");
+    fprintf(stderr, "        : -threshold <percent> : slowdown reported by -compare (default: 10)\n");
+    fprintf(stderr, "        : -method <spine|atlas>: line visibility method (may be repeated;\n");
+    fprintf(stderr, "                                 default: both)\n");
+    fprintf(stderr, "        : -size <W>x<H>        : resolution (may be repeated; default: 1024x768)\n");
+    fprintf(stderr, "        : -supersample <n>     : visibility supersampling (may be repeated;\n");
+    fprintf(stderr, "                                 default: each scene's setting)\n");
+    fprintf(stderr, "        : -session <filename>  : camera path for every scene (default: each\n");
+    fprintf(stderr, "                                 scene's session, or a turntable)\n");
+    fprintf(stderr, "        : -frames <n>          : frames per repetition (default: 100)\n");
+    fprintf(stderr, "        : -warmup <n>          : frames drawn before measuring (default: 10)\n");
+    fprintf(stderr, "        : -reps <n>            : repetitions of the camera path (default: 3)\n");
+    fprintf(stderr, "        : -cache               : keep the frame cache between frames (default:\n");
+    fprintf(stderr, "                                 invalidated before every frame)\n");
+    fprintf(stderr, "        : -shaders <dir>       : directory containing programs.xml\n");
+
+    exit(1);
+}
+
+// Looks for the shaders and the sample scenes, as dpix-batch does.
+bool findDirectory( const QString& app_path, const QString& subdir,
+                    const QString& file, QDir& dir )
+{
+    QStringList candidates;
+    candidates << QDir::currentPath()
+    << QDir::cleanPath(app_path + "/../../libnpr/")
+    << QDir::cleanPath(app_path + "/../../../libnpr/")
+    << QDir::cleanPath(app_path + "/../../")
+    << QDir::cleanPath(app_path + "/../../../");
+
+    for (int i = 0; i < candidates.size(); i++)
+    {
+        if (QFileInfo(candidates[i] + "/" + subdir + "/" + file).exists())
+        {
+            dir = QDir(candidates[i] + "/" + subdir);
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Could not find %s/%s. Tried:\n", qPrintable(subdir), qPrintable(file));
+    for (int i = 0; i < candidates.size(); i++)
+        fprintf(stderr, "  %s/%s/%s\n", qPrintable(candidates[i]),
+                qPrintable(subdir), qPrintable(file));
+    return false;
+}
+
+int main( int argc, char** argv )
+{
+#ifdef GQ_USE_OSMESA
+    QApplication app(argc, argv, false);
+#else
+    QApplication app(argc, argv);
+#endif
+
+    QStringList arguments = app.arguments();
+    NPRSettings::instance().loadDefaults();
+
+    Benchmark benchmark;
+    QStringList scenes;
+    QList<int> methods;
+    QList<QSize> sizes;
+    QList<int> supersamples;
+    QString output_file;
+    QString baseline_file;
+    float threshold = 10.0f;
+    QString shaders_path;
+
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        const QString& arg = arguments[i];
+        bool has_value = i+1 < arguments.size() && !arguments[i+1].startsWith("-");
+
+        if (!arg.startsWith("-"))
+        {
+            scenes.append(QDir::current().absoluteFilePath(arg));
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+        }
+        else if (arg == "-o" && has_value)
+        {
+            output_file = arguments[++i];
+        }
+        else if (arg == "-compare" && has_value)
+        {
+            baseline_file = arguments[++i];
+        }
+        else if (arg == "-threshold" && has_value)
+        {
+            threshold = arguments[++i].toFloat();
+        }
+        else if (arg == "-method" && has_value)
+        {
+            QString method = arguments[++i];
+            if (method == "spine")
+                methods.append(NPR_SPINE_TEST);
+            else if (method == "atlas")
+                methods.append(NPR_SEGMENT_ATLAS);
+            else
+                printUsage(argv[0]);
+        }
+        else if (arg == "-size" && has_value)
+        {
+            QStringList dims = arguments[++i].split('x');
+            if (dims.size() != 2 || dims[0].toInt() <= 0 || dims[1].toInt() <= 0)
+                printUsage(argv[0]);
+            sizes.append(QSize(dims[0].toInt(), dims[1].toInt()));
+        }
+        else if (arg == "-supersample" && has_value)
+        {
+            int supersample = arguments[++i].toInt();
+            if (supersample <= 0)
+                printUsage(argv[0]);
+            supersamples.append(supersample);
+        }
+        else if (arg == "-session" && has_value)
+        {
+            benchmark.setSessionFile(QDir::current().absoluteFilePath(arguments[++i]));
+        }
+        else if (arg == "-frames" && has_value)
+        {
+            int frames = arguments[++i].toInt();
+            if (frames <= 0)
+                printUsage(argv[0]);
+            benchmark.setFrames(frames);
+        }
+        else if (arg == "-warmup" && has_value)
+        {
+            benchmark.setWarmupFrames(qMax(arguments[++i].toInt(), 0));
+        }
+        else if (arg == "-reps" && has_value)
+        {
+            int reps = arguments[++i].toInt();
+            if (reps <= 0)
+                printUsage(argv[0]);
+            benchmark.setRepetitions(reps);
+        }
+        else if (arg == "-cache")
+        {
+            benchmark.setFrameCache(true);
+        }
+        else if (arg == "-shaders" && has_value)
+        {
+            shaders_path = arguments[++i];
+        }
+        else
+            printUsage(argv[0]);
+    }
+
+    QList<BenchmarkResult> baseline;
+    if (!baseline_file.isEmpty() && !Benchmark::loadResults(baseline_file, baseline))
+        return 1;
+
+    if (scenes.isEmpty())
+    {
+        QDir scenes_dir;
+        if (!findDirectory(app.applicationDirPath(), "samples/scenes",
+                           "clevis_blue.dps", scenes_dir))
+            return 1;
+        QStringList names = scenes_dir.entryList(QStringList() << "*.dps",
+                                                 QDir::Files, QDir::Name);
+        for (int i = 0; i < names.size(); i++)
+            scenes.append(scenes_dir.absoluteFilePath(names[i]));
+    }
+
+    QDir shaders_dir(shaders_path);
+    if (shaders_path.isEmpty() &&
+        !findDirectory(app.applicationDirPath(), "shaders", "programs.xml", shaders_dir))
+        return 1;
+    GQShaderManager::setShaderDirectory(shaders_dir);
+
+    if (!methods.isEmpty())
+        benchmark.setMethods(methods);
+    if (!sizes.isEmpty())
+        benchmark.setSizes(sizes);
+    benchmark.setSupersamples(supersamples);
+    benchmark.setScenes(scenes);
+
+    QSize max_size(0, 0);
+    QList<QSize> all_sizes = sizes.isEmpty() ? QList<QSize>() << QSize(1024, 768) : sizes;
+    for (int i = 0; i < all_sizes.size(); i++)
+        max_size = max_size.expandedTo(all_sizes[i]);
+
+    if (!benchmark.init(max_size))
+        return 1;
+
+    bool success = benchmark.run();
+
+    if (!output_file.isEmpty() && !benchmark.saveResults(output_file))
+        success = false;
+
+    if (!baseline.isEmpty() && benchmark.compare(baseline, threshold) > 0)
+        return 2;
+
+    return success ? 0 : 1;
+}
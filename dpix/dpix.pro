@@ -31,11 +31,26 @@ else {
 
         LIBS += -framework CoreFoundation
         QMAKE_CXXFLAGS += -fopenmp
+        QMAKE_LFLAGS += -fopenmp
     }
     else {
         DEFINES += LINUX
         UNAME = Linux
+        QMAKE_CXXFLAGS += -fopenmp
+        QMAKE_LFLAGS += -fopenmp
+        # clock_gettime, for GQProfiler.
+        LIBS += -lrt
+        # dladdr, and exported symbols so GQSampler can name dpix's own
+        # functions in CPU profiles.
+        LIBS += -ldl
+        QMAKE_LFLAGS += -rdynamic
     }
+
+    # Frame pointers, for the stacks in GQSampler's CPU profiles.
+    QMAKE_CXXFLAGS += -fno-omit-frame-pointer
+
+    # FrameInterpolator.cc relies on loop vectorization.
+    QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
 }
 
 QT += opengl xml
@@ -50,6 +65,8 @@ PRE_TARGETDEPS += ../libgq/$${DBGNAME}/libgq.a
 DEPENDPATH += ../libgq/include
 INCLUDEPATH += ../libgq/include
 LIBS += -L../libgq/$${DBGNAME} -lgq
+# FrameExporter checksums streamed frames with libgq's copy of zlib.
+INCLUDEPATH += ../libgq/zlib
 
 PRE_TARGETDEPS += ../libcda/$${DBGNAME}/libcda.a
 DEPENDPATH += ../libcda/include
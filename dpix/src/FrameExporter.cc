@@ -0,0 +1,582 @@
+/*****************************************************************************\
+
+FrameExporter.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQInclude.h"
+#include "FrameExporter.h"
+#include "GQStats.h"
+
+#include <QImage>
+#include <QMutexLocker>
+#include <assert.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifndef WIN32
+#include <signal.h>
+#define popen_binary(cmd) popen(cmd, "w")
+#else
+#define popen_binary(cmd) _popen(cmd, "wb")
+#define pclose _pclose
+#endif
+
+// Key frames are blended in place of the output frame, so the interpolator
+// holds two key frames and a couple more can be in flight.
+const int NUM_KEY_BUFFERS = 4;
+
+void FrameEncoderThread::run()
+{
+    GQProfiler::setThreadName("Frame encoder");
+
+    FrameExporter::FrameBuffer* buffer;
+    while ((buffer = _exporter->takeQueuedBuffer(_exporter->_output)) != 0)
+    {
+        {
+            __TIME_CODE_BLOCK("Encode Frame");
+            _exporter->encode(buffer);
+        }
+        _exporter->releaseBuffer(_exporter->_output, buffer);
+    }
+}
+
+void FrameInterpolatorThread::run()
+{
+    GQProfiler::setThreadName("Frame interpolator");
+    _exporter->interpolate();
+}
+
+FrameExporter::FrameExporter()
+{
+    _quality = -1;
+    _output.stopping = false;
+    _keys.stopping = false;
+    _interpolator_thread = 0;
+    _interpolation_fps = 0;
+    _use_pbos = false;
+    _pbos[0] = _pbos[1] = 0;
+    _pbo_size = 0;
+    _pending_pbo = 0;
+    _pbo_pending = false;
+    _pending_width = 0;
+    _pending_height = 0;
+    _pending_time = 0;
+
+    _stream = 0;
+    _stream_width = 0;
+    _stream_height = 0;
+    _stream_checksum = 0;
+    _stream_bytes = 0;
+    _stream_frames = 0;
+    _stream_dropped_frames = 0;
+    _stream_exit_code = 0;
+    _old_sigpipe_handler = 0;
+
+    _elapsed_time = 0;
+    _readback_time = 0;
+    _stall_time = 0;
+    _encode_time = 0;
+    _num_frames = 0;
+    _num_failures = 0;
+    _num_encoders = 0;
+    _blend_time = 0;
+    _num_output_frames = 0;
+}
+
+FrameExporter::~FrameExporter()
+{
+    // Without a GL context any pending pixel buffer is dropped, so 
+    // finish() should have been called already.
+    assert(!isRunning());
+}
+
+void FrameExporter::setInterpolation( float fps, const QString& filename_pattern )
+{
+    assert(!isRunning());
+
+    _interpolation_fps = qMax(fps, 0.0f);
+    _interpolation_pattern = filename_pattern;
+}
+
+void FrameExporter::start( int num_encoders, int num_buffers, int quality )
+{
+    assert(!isRunning());
+
+    if (num_encoders <= 0)
+        num_encoders = qMax(1, QThread::idealThreadCount());
+
+    _quality = quality;
+    startThreads(num_encoders, num_buffers);
+}
+
+bool FrameExporter::startStream( const QString& command, 
+                                 const QStringList& arguments, 
+                                 int width, int height, int num_buffers )
+{
+    assert(!isRunning());
+    assert(width > 0 && height > 0);
+
+    QString command_line = QString("\"%1\"").arg(command);
+    for (int i = 0; i < arguments.size(); i++)
+    {
+        QString argument = arguments[i];
+        argument.replace("\"", "\\\"");
+        command_line += QString(" \"%1\"").arg(argument);
+    }
+
+#ifndef WIN32
+    // If the encoder exits early, writes should fail rather than kill us.
+    _old_sigpipe_handler = signal(SIGPIPE, SIG_IGN);
+#endif
+
+    _stream = popen_binary(qPrintable(command_line));
+    if (!_stream)
+    {
+        qWarning("FrameExporter::startStream: could not run %s", 
+                 qPrintable(command_line));
+        restoreSigpipeHandler();
+        return false;
+    }
+    _stream_width = width;
+    _stream_height = height;
+
+    // Frames must reach the stream in order, so there is one writer.
+    startThreads(1, num_buffers);
+    return true;
+}
+
+void FrameExporter::startThreads( int num_encoders, int num_buffers )
+{
+    if (num_buffers <= 0)
+        num_buffers = 2 * num_encoders + 2;
+
+    allocatePool(_output, num_buffers);
+    for (int i = 0; i < num_encoders; i++)
+    {
+        _encoders.append(new FrameEncoderThread(this));
+        _encoders.last()->start();
+    }
+
+    if (isInterpolating())
+    {
+        _interpolator.reset(_interpolation_fps);
+        allocatePool(_keys, NUM_KEY_BUFFERS);
+        _interpolator_thread = new FrameInterpolatorThread(this);
+        _interpolator_thread->start();
+    }
+
+    _use_pbos = GLEE_ARB_pixel_buffer_object;
+    if (_use_pbos)
+        glGenBuffersARB(2, _pbos);
+    _pbo_size = 0;
+    _pending_pbo = 0;
+    _pbo_pending = false;
+
+    _start_time = now();
+    _elapsed_time = 0;
+    _readback_time = 0;
+    _stall_time = 0;
+    _encode_time = 0;
+    _num_frames = 0;
+    _num_failures = 0;
+    _num_encoders = num_encoders;
+    _blend_time = 0;
+    _num_output_frames = 0;
+
+    _stream_checksum = adler32(0L, Z_NULL, 0);
+    _stream_bytes = 0;
+    _stream_frames = 0;
+    _stream_dropped_frames = 0;
+    _stream_exit_code = 0;
+}
+
+void FrameExporter::readFrame( int width, int height, const QString& filename,
+                               float time )
+{
+    assert(isRunning());
+
+    timestamp start = now();
+    float stall_before = _stall_time;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    if (_use_pbos)
+    {
+        int size = width * height * 4;
+        if (size != _pbo_size)
+        {
+            flushPixelBuffer();
+            for (int i = 0; i < 2; i++)
+            {
+                glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, _pbos[i]);
+                glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, 
+                                GL_STREAM_READ_ARB);
+            }
+            _pbo_size = size;
+        }
+
+        // Start this frame's readback, then copy out the previous frame
+        // while the transfer runs.
+        int target = 1 - _pending_pbo;
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, _pbos[target]);
+        glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+        flushPixelBuffer();
+
+        _pending_pbo = target;
+        _pbo_pending = true;
+        _pending_width = width;
+        _pending_height = height;
+        _pending_filename = filename;
+        _pending_time = time;
+    }
+    else
+    {
+        FrameBuffer* buffer = acquireBuffer(readPool(), &_stall_time);
+        buffer->image.resize(width, height, 4);
+        buffer->filename = filename;
+        buffer->time = time;
+        glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, 
+                     buffer->image.raster());
+        queueBuffer(readPool(), buffer);
+    }
+
+    _num_frames++;
+    _readback_time += (now() - start) - (_stall_time - stall_before);
+}
+
+void FrameExporter::flushPixelBuffer()
+{
+    if (!_pbo_pending)
+        return;
+
+    FrameBuffer* buffer = acquireBuffer(readPool(), &_stall_time);
+    buffer->image.resize(_pending_width, _pending_height, 4);
+    buffer->filename = _pending_filename;
+    buffer->time = _pending_time;
+
+    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, _pbos[_pending_pbo]);
+    void* pixels = glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+    if (pixels)
+    {
+        memcpy(buffer->image.raster(), pixels, _pending_width * _pending_height * 4);
+        glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+        queueBuffer(readPool(), buffer);
+    }
+    else
+    {
+        qWarning("FrameExporter: could not map pixel buffer for %s", 
+                 qPrintable(_pending_filename));
+        _num_failures++;
+        releaseBuffer(readPool(), buffer);
+    }
+    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    _pbo_pending = false;
+}
+
+void FrameExporter::finish()
+{
+    if (!isRunning())
+        return;
+
+    flushPixelBuffer();
+
+    // The interpolator has to drain its key frames before the encoders 
+    // can be told that no more output is coming.
+    if (_interpolator_thread)
+    {
+        stopPool(_keys);
+        _interpolator_thread->wait();
+        delete _interpolator_thread;
+        _interpolator_thread = 0;
+        freePool(_keys);
+    }
+
+    stopPool(_output);
+    for (int i = 0; i < _encoders.size(); i++)
+    {
+        _encoders[i]->wait();
+        delete _encoders[i];
+    }
+    _encoders.clear();
+    freePool(_output);
+
+    clearPixelBuffers();
+
+    if (_stream)
+    {
+        // Closing the pipe waits for the encoder to exit.
+        _stream_exit_code = pclose(_stream);
+        _stream = 0;
+        if (_stream_exit_code != 0)
+            _num_failures++;
+        restoreSigpipeHandler();
+    }
+
+    _elapsed_time = now() - _start_time;
+}
+
+void FrameExporter::restoreSigpipeHandler()
+{
+#ifndef WIN32
+    if (_old_sigpipe_handler != SIG_ERR)
+        signal(SIGPIPE, _old_sigpipe_handler);
+#endif
+    _old_sigpipe_handler = 0;
+}
+
+void FrameExporter::clearPixelBuffers()
+{
+    if (_use_pbos)
+        glDeleteBuffersARB(2, _pbos);
+    _pbos[0] = _pbos[1] = 0;
+    _pbo_size = 0;
+    _pbo_pending = false;
+}
+
+void FrameExporter::allocatePool( BufferPool& pool, int num_buffers )
+{
+    pool.stopping = false;
+    for (int i = 0; i < num_buffers; i++)
+        pool.buffers.append(new FrameBuffer);
+    pool.free_buffers = pool.buffers;
+}
+
+void FrameExporter::stopPool( BufferPool& pool )
+{
+    QMutexLocker locker(&_mutex);
+    pool.stopping = true;
+    pool.frame_queued.wakeAll();
+}
+
+void FrameExporter::freePool( BufferPool& pool )
+{
+    assert(pool.queue.isEmpty());
+    for (int i = 0; i < pool.buffers.size(); i++)
+        delete pool.buffers[i];
+    pool.buffers.clear();
+    pool.free_buffers.clear();
+}
+
+// Blocks until a buffer is free. This is the back-pressure on rendering
+// (and on the interpolator). Time spent waiting is added to stall_time.
+FrameExporter::FrameBuffer* FrameExporter::acquireBuffer( BufferPool& pool,
+                                                          float* stall_time )
+{
+    QMutexLocker locker(&_mutex);
+
+    if (pool.free_buffers.isEmpty())
+    {
+        timestamp start = now();
+        while (pool.free_buffers.isEmpty())
+            pool.buffer_freed.wait(&_mutex);
+        if (stall_time)
+            *stall_time += now() - start;
+    }
+
+    return pool.free_buffers.takeLast();
+}
+
+void FrameExporter::queueBuffer( BufferPool& pool, FrameBuffer* buffer )
+{
+    QMutexLocker locker(&_mutex);
+    pool.queue.enqueue(buffer);
+    pool.frame_queued.wakeOne();
+}
+
+// Returns 0 once the pool is stopping and the queue is empty.
+FrameExporter::FrameBuffer* FrameExporter::takeQueuedBuffer( BufferPool& pool )
+{
+    QMutexLocker locker(&_mutex);
+    while (pool.queue.isEmpty() && !pool.stopping)
+        pool.frame_queued.wait(&_mutex);
+
+    if (pool.queue.isEmpty())
+        return 0;
+    return pool.queue.dequeue();
+}
+
+void FrameExporter::releaseBuffer( BufferPool& pool, FrameBuffer* buffer )
+{
+    QMutexLocker locker(&_mutex);
+    pool.free_buffers.append(buffer);
+    pool.buffer_freed.wakeOne();
+}
+
+// Runs on the interpolator thread. Each key frame produces the output 
+// frames between it and the previous key frame, blended from the two.
+void FrameExporter::interpolate()
+{
+    FrameBuffer* previous = 0;
+    FrameBuffer* current;
+    while ((current = takeQueuedBuffer(_keys)) != 0)
+    {
+        int first_output, num_outputs;
+        _interpolator.addKeyFrame(current->time, first_output, num_outputs);
+
+        // After a resize there is nothing to blend with.
+        const GQImage& current_image = current->image;
+        bool can_blend = previous && 
+            previous->image.width() == current_image.width() &&
+            previous->image.height() == current_image.height();
+        const GQImage& previous_image = can_blend ? previous->image : current_image;
+
+        for (int i = 0; i < num_outputs; i++)
+        {
+            int which = first_output + i;
+            FrameBuffer* output = acquireBuffer(_output);
+
+            timestamp start = now();
+            int weight = can_blend ? _interpolator.weight(which) 
+                                   : FrameInterpolator::MAX_WEIGHT;
+            FrameInterpolator::blend(previous_image, current_image, weight, 
+                                     output->image);
+            if (!_stream)
+                output->filename.sprintf(qPrintable(_interpolation_pattern), which);
+            output->time = which / _interpolator.fps();
+            float elapsed = now() - start;
+
+            queueBuffer(_output, output);
+
+            QMutexLocker locker(&_mutex);
+            _blend_time += elapsed;
+            _num_output_frames++;
+        }
+
+        if (previous)
+            releaseBuffer(_keys, previous);
+        previous = current;
+    }
+
+    if (previous)
+        releaseBuffer(_keys, previous);
+}
+
+// Runs on an encoder thread. The image rows are bottom to top, as read.
+void FrameExporter::encode( FrameBuffer* buffer )
+{
+    timestamp start = now();
+
+    bool success = true;
+    if (_stream)
+    {
+        writeToStream(buffer);
+    }
+    else
+    {
+        const GQImage& image = buffer->image;
+        QImage wrapper(image.raster(), image.width(), image.height(), 
+                       image.width() * 4, QImage::Format_RGB32);
+        success = wrapper.mirrored().save(buffer->filename, 0, _quality);
+    }
+
+    float elapsed = now() - start;
+
+    QMutexLocker locker(&_mutex);
+    _encode_time += elapsed;
+    if (!success)
+        _num_failures++;
+}
+
+// Converts the BGRA rows to top-down RGB and writes the frame. A failed 
+// write (e.g. the encoder exited) is counted once and stops further output.
+// A frame of the wrong size would shift every following frame in the raw 
+// stream, so it is dropped.
+void FrameExporter::writeToStream( FrameBuffer* buffer )
+{
+    if (ferror(_stream))
+        return;
+
+    const GQImage& image = buffer->image;
+    int width = image.width();
+    int height = image.height();
+    if (width != _stream_width || height != _stream_height)
+    {
+        QMutexLocker locker(&_mutex);
+        _num_failures++;
+        _stream_dropped_frames++;
+        return;
+    }
+    _stream_frame.resize(width * height * 3);
+
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char* src = image.raster() + (height - 1 - y) * width * 4;
+        unsigned char* dst = _stream_frame.data() + y * width * 3;
+        for (int x = 0; x < width; x++)
+        {
+            dst[3*x + 0] = src[4*x + 2];
+            dst[3*x + 1] = src[4*x + 1];
+            dst[3*x + 2] = src[4*x + 0];
+        }
+    }
+
+    if (fwrite(_stream_frame.data(), 1, _stream_frame.size(), _stream) != 
+        (size_t)_stream_frame.size())
+    {
+        QMutexLocker locker(&_mutex);
+        _num_failures++;
+        return;
+    }
+    _stream_checksum = adler32(_stream_checksum, _stream_frame.data(), 
+                               _stream_frame.size());
+    _stream_bytes += _stream_frame.size();
+    _stream_frames++;
+}
+
+QString FrameExporter::statistics() const
+{
+    if (_num_frames == 0)
+        return QString("No frames exported.\n");
+
+    float elapsed = isRunning() ? now() - _start_time : _elapsed_time;
+
+    // If the render thread spent a noticeable part of the export waiting
+    // for free buffers, the encoders were the bottleneck.
+    bool encode_bound = _stall_time > 0.1f * elapsed;
+
+    QString stats = QString("Exported %1 frames in %2 s (%3 fps, %4).\n")
+        .arg(_num_frames).arg(elapsed, 0, 'f', 2)
+        .arg(_num_frames / elapsed, 0, 'f', 1)
+        .arg(encode_bound ? "encode-bound" : "render-bound");
+    stats += QString("  readback %1 ms/frame%2, waited %3 s for encoders\n")
+        .arg(1000.0f * _readback_time / _num_frames, 0, 'f', 2)
+        .arg(_use_pbos ? " (pixel buffer objects)" : "")
+        .arg(_stall_time, 0, 'f', 2);
+    int num_encoded = isInterpolating() ? _num_output_frames : _num_frames;
+    if (isInterpolating())
+    {
+        stats += QString("  interpolated %1 output frames at %2 fps, "
+                         "blending %3 ms/frame on %4 threads\n")
+            .arg(_num_output_frames).arg(_interpolation_fps, 0, 'f', 2)
+            .arg(1000.0f * _blend_time / qMax(_num_output_frames, 1), 0, 'f', 2)
+            .arg(FrameInterpolator::maxThreads());
+    }
+    stats += QString("  encoding %1 ms/frame on %2 threads (%3 fps)\n")
+        .arg(1000.0f * _encode_time / qMax(num_encoded, 1), 0, 'f', 1)
+        .arg(_num_encoders)
+        .arg(num_encoded * _num_encoders / qMax(_encode_time, 1e-6f), 0, 'f', 1);
+    if (_stream_frames > 0)
+    {
+        stats += QString("  streamed %1 output frames (%2 MB), adler32 %3\n")
+            .arg(_stream_frames).arg(_stream_bytes / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg((qulonglong)_stream_checksum, 8, 16, QChar('0'));
+    }
+    if (_stream_dropped_frames > 0)
+    {
+        stats += QString("  dropped %1 frames that were not %2 x %3\n")
+            .arg(_stream_dropped_frames).arg(_stream_width).arg(_stream_height);
+    }
+    if (_stream_exit_code != 0)
+        stats += QString("  encoder exited with status %1\n").arg(_stream_exit_code);
+    if (_num_failures > 0)
+        stats += QString("  %1 frames could not be written\n").arg(_num_failures);
+    return stats;
+}
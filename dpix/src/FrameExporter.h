@@ -0,0 +1,210 @@
+/*****************************************************************************\
+
+FrameExporter.h
+Copyright (c) 2009 Forrester Cole
+
+Pipelined export of rendered frames to image files. Each frame is read back
+into a pixel buffer object, so the copy runs while the next frame renders,
+and the pixels are moved into one of a fixed pool of GQImage buffers. A 
+pool of encoder threads compresses and writes the buffers. When every 
+buffer is waiting to be encoded, readFrame blocks until one is free, so 
+memory use stays bounded when encoding is slower than rendering.
+
+Alternatively, the frames can be streamed as raw RGB (top row first) into
+the standard input of an encoder process such as ffmpeg, with no 
+intermediate files. A single writer thread keeps the frames in order.
+
+If interpolation is on, the frames read back are key frames with a time 
+stamp. An interpolation thread resamples them to a fixed frame rate with 
+FrameInterpolator, blending into buffers from the output pool, and the 
+encoders or the stream writer consume those as usual. Key frames have 
+their own small pool, so memory stays bounded at both stages.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef FRAME_EXPORTER_H_
+#define FRAME_EXPORTER_H_
+
+#include "GQImage.h"
+#include "FrameInterpolator.h"
+#include "timestamp.h"
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+#include <stdio.h>
+
+class FrameExporter;
+
+class FrameEncoderThread : public QThread
+{
+public:
+    FrameEncoderThread( FrameExporter* exporter ) : _exporter(exporter) {}
+
+protected:
+    void run();
+
+protected:
+    FrameExporter* _exporter;
+};
+
+class FrameInterpolatorThread : public QThread
+{
+public:
+    FrameInterpolatorThread( FrameExporter* exporter ) : _exporter(exporter) {}
+
+protected:
+    void run();
+
+protected:
+    FrameExporter* _exporter;
+};
+
+class FrameExporter
+{
+public:
+    FrameExporter();
+    ~FrameExporter();
+
+    // Resample the frames passed to readFrame to fps (0 turns this off).
+    // Output frames are written to filename_pattern with the output frame
+    // number, e.g. "movie%05d.jpg", or to the stream. Call before start.
+    void setInterpolation( float fps, const QString& filename_pattern = QString() );
+
+    // num_encoders and num_buffers of 0 pick defaults based on the number
+    // of cores. quality is passed to QImage::save.
+    void start( int num_encoders = 0, int num_buffers = 0, int quality = -1 );
+
+    // Starts command with arguments and streams frames into its standard 
+    // input. Returns false if the process could not be started. The 
+    // encoder is told the frame size up front, so only width x height 
+    // frames are streamed; any other frame (e.g. read after the window was
+    // resized) is dropped and counted as a failure.
+    bool startStream( const QString& command, const QStringList& arguments,
+                      int width, int height, int num_buffers = 0 );
+
+    // Reads the lower left width x height pixels of the current read buffer
+    // and queues them to be written to filename. When interpolating, 
+    // filename is ignored and the frame is a key frame at time, which must
+    // not decrease. Must be called with the GL context current.
+    void readFrame( int width, int height, const QString& filename, 
+                    float time = 0 );
+
+    // Writes any frame still in a pixel buffer object and waits for the 
+    // encoders to finish. Must be called with the GL context current.
+    void finish();
+
+    bool isRunning() const { return !_encoders.isEmpty(); }
+    bool isStreaming() const { return _stream != 0; }
+    bool isInterpolating() const { return _interpolation_fps > 0; }
+
+    // Frame rate and where the time went, for the last start/finish pair.
+    QString statistics() const;
+
+protected:
+    struct FrameBuffer
+    {
+        GQImage     image;
+        QString     filename;
+        float       time;
+    };
+
+    // A fixed set of buffers, a free list, and a queue of filled buffers
+    // for the next stage. Guarded by _mutex.
+    struct BufferPool
+    {
+        QList<FrameBuffer*>     buffers;
+        QList<FrameBuffer*>     free_buffers;
+        QQueue<FrameBuffer*>    queue;
+        QWaitCondition          buffer_freed;
+        QWaitCondition          frame_queued;
+        bool                    stopping;
+    };
+
+    FrameBuffer* acquireBuffer( BufferPool& pool, float* stall_time = 0 );
+    void         queueBuffer( BufferPool& pool, FrameBuffer* buffer );
+    FrameBuffer* takeQueuedBuffer( BufferPool& pool );
+    void         releaseBuffer( BufferPool& pool, FrameBuffer* buffer );
+    void         allocatePool( BufferPool& pool, int num_buffers );
+    void         stopPool( BufferPool& pool );
+    void         freePool( BufferPool& pool );
+
+    // The pool that readFrame fills.
+    BufferPool&  readPool() { return isInterpolating() ? _keys : _output; }
+
+    void         startThreads( int num_encoders, int num_buffers );
+    void         interpolate();
+    void         encode( FrameBuffer* buffer );
+    void         writeToStream( FrameBuffer* buffer );
+    void         flushPixelBuffer();
+    void         clearPixelBuffers();
+    void         restoreSigpipeHandler();
+
+protected:
+    int                         _quality;
+
+    // Frames waiting to be encoded or streamed.
+    BufferPool                  _output;
+    QList<FrameEncoderThread*>  _encoders;
+
+    // Key frames waiting to be interpolated, when interpolating.
+    BufferPool                  _keys;
+    FrameInterpolatorThread*    _interpolator_thread;
+    FrameInterpolator           _interpolator;
+    float                       _interpolation_fps;
+    QString                     _interpolation_pattern;
+
+    QMutex                      _mutex;
+
+    // Two pixel buffer objects: one being filled by this frame's readback,
+    // one holding the previous frame, which is copied out now.
+    bool                        _use_pbos;
+    unsigned int                _pbos[2];
+    int                         _pbo_size;
+    int                         _pending_pbo;
+    bool                        _pbo_pending;
+    int                         _pending_width;
+    int                         _pending_height;
+    QString                     _pending_filename;
+    float                       _pending_time;
+
+    // Only touched by the single writer thread while streaming.
+    FILE*                       _stream;
+    int                         _stream_width;
+    int                         _stream_height;
+    QVector<unsigned char>      _stream_frame;
+    unsigned long               _stream_checksum;
+    double                      _stream_bytes;
+    int                         _stream_frames;
+    int                         _stream_dropped_frames;
+    int                         _stream_exit_code;
+    // The SIGPIPE handler replaced by startStream, restored by finish.
+    void                        (*_old_sigpipe_handler)(int);
+
+    // Statistics. The encode and blend totals are updated by the worker 
+    // threads under _mutex.
+    timestamp                   _start_time;
+    float                       _elapsed_time;
+    float                       _readback_time;
+    float                       _stall_time;
+    float                       _encode_time;
+    int                         _num_frames;
+    int                         _num_failures;
+    int                         _num_encoders;
+    float                       _blend_time;
+    int                         _num_output_frames;
+
+    friend class FrameEncoderThread;
+    friend class FrameInterpolatorThread;
+};
+
+#endif // FRAME_EXPORTER_H_
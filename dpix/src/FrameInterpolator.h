@@ -0,0 +1,63 @@
+/*****************************************************************************\
+
+FrameInterpolator.h
+Copyright (c) 2009 Forrester Cole
+
+Resamples a sequence of timestamped key frames (e.g., a session replay) to 
+a fixed frame rate. Output frame f is shown at time f / fps and is a linear
+blend of the two key frames around it. Blending is done in 8 bit fixed 
+point on whole rows, so the inner loop is branch free and can be 
+vectorized, and rows are distributed across threads with OpenMP.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef FRAME_INTERPOLATOR_H_
+#define FRAME_INTERPOLATOR_H_
+
+class GQImage;
+
+class FrameInterpolator
+{
+public:
+    // Blend weights are in [0, MAX_WEIGHT]. MAX_WEIGHT is all key frame b.
+    static const int MAX_WEIGHT = 256;
+
+public:
+    FrameInterpolator( float fps = 30.0f );
+
+    void  reset( float fps );
+    float fps() const { return _fps; }
+
+    // Adds the next key frame time and returns the output frames that fall
+    // between the previous key frame (exclusive) and this one (inclusive).
+    // Output frames before the first key frame repeat it.
+    void addKeyFrame( float time, int& first_output, int& num_outputs );
+
+    // Weight of the most recent key frame in output frame which.
+    int  weight( int which ) const;
+
+    int  numKeyFrames() const { return _num_key_frames; }
+
+    // result = (a * (MAX_WEIGHT - weight) + b * weight) / MAX_WEIGHT, per 
+    // channel, rounded. a and b must have the same size.
+    static void blend( const GQImage& a, const GQImage& b, int weight,
+                       GQImage& result );
+
+    // Per-pixel floating point version, used to check blend().
+    static void blendReference( const GQImage& a, const GQImage& b, 
+                                int weight, GQImage& result );
+
+    static int  maxThreads();
+
+protected:
+    float _fps;
+    float _previous_time;
+    float _current_time;
+    int   _next_output;
+    int   _num_key_frames;
+};
+
+#endif // FRAME_INTERPOLATOR_H_
@@ -18,8 +18,11 @@ See the COPYING file for details.
 #include "NPRStyle.h"
 #include "GQStats.h"
 #include "Session.h"
+#include "LightPreset.h"
+#include "NPRGLDraw.h"
 #include <XForm.h>
 #include <assert.h>
+#include <string.h>
 #include <QFile>
 #include <QTextStream>
 #include <QMessageBox>
@@ -27,6 +30,9 @@ See the COPYING file for details.
 #include <QDebug>
 #include <QMouseEvent>
 
+// Full quality comes back once the camera has been still this long.
+const int QUALITY_RESTORE_DELAY_MS = 250;
+
 const QString GLViewer::lightPresetNames[] = { "Headlight",
     "North", "North-Northeast", "Northeast", "East-Northeast", "East", "East-Southeast", "Southeast", "South-Southeast",
     "South", "South-Southwest", "Southwest", "West-Southwest", "West", "West-Northwest", "Northwest", "North-Northwest" };
@@ -45,6 +51,24 @@ GLViewer::GLViewer(QWidget* parent) : QGLViewer( parent )
     _renderer = NULL;
 
     camera()->frame()->setWheelSensitivity(-1.0);
+
+    _dirty_flags = DIRTY_ALL;
+    for (int i = 0; i < 16; i++)
+    {
+        _drawn_modelview[i] = 0;
+        _drawn_projection[i] = 0;
+    }
+
+    // A zero timeout fires once the pending events have been handled, so 
+    // every change made while handling them is drawn in one frame.
+    _redraw_timer.setSingleShot(true);
+    _redraw_timer.setInterval(0);
+    connect(&_redraw_timer, SIGNAL(timeout()), this, SLOT(drawScheduledFrame()));
+
+    _quality_restore_timer.setSingleShot(true);
+    _quality_restore_timer.setInterval(QUALITY_RESTORE_DELAY_MS);
+    connect(&_quality_restore_timer, SIGNAL(timeout()), 
+            this, SLOT(restoreFullQuality()));
 }
 
 void GLViewer::resetView()
@@ -102,45 +126,7 @@ void GLViewer::setupLighting()
 //            xform mv_xf( mv );
 //            mv_xf = inv(rot_only( mv_xf ));
 
-        switch(_light_preset)
-        {
-            case HEADLIGHT:
-                _light_direction = vec(0.0f, 0.0f, 1.0f); break;
-            case NORTH:
-                _light_direction = vec(0.0f, 1.0f, _light_depth); break;
-            case NORTHNORTHEAST:
-                _light_direction = vec(0.374f, 1.0f, _light_depth); break;
-            case NORTHEAST:
-                _light_direction = vec(1.0f, 1.0f, _light_depth); break;
-            case EASTNORTHEAST:
-                _light_direction = vec(1.0f, 0.374f, _light_depth); break;
-            case EAST:
-                _light_direction = vec(1.0f, 0.0f, _light_depth); break;
-            case EASTSOUTHEAST:
-                _light_direction = vec(1.0f, -0.374f, _light_depth); break;
-            case SOUTHEAST:
-                _light_direction = vec(1.0f, -1.0f, _light_depth); break;
-            case SOUTHSOUTHEAST:
-                _light_direction = vec(0.374f, -1.0f, _light_depth); break;
-            case SOUTH:
-                _light_direction = vec(0.0f, -1.0f, _light_depth); break;
-            case SOUTHSOUTHWEST:
-                _light_direction = vec(-0.374f, -1.0f, _light_depth); break;
-            case SOUTHWEST:
-                _light_direction = vec(-1.0f, -1.0f, _light_depth); break;
-            case WESTSOUTHWEST:
-                _light_direction = vec(-1.0f, -0.374f, _light_depth); break;
-            case WEST:
-                _light_direction = vec(-1.0f, 0.0f, _light_depth); break;
-            case WESTNORTHWEST:
-                _light_direction = vec(-1.0f, 0.374f, _light_depth); break;
-            case NORTHWEST:
-                _light_direction = vec(-1.0f, 1.0f, _light_depth); break;
-            case NORTHNORTHWEST:
-                _light_direction = vec(-0.374f, 1.0f, _light_depth); break;
-            default: break;
-        }
-        normalize(_light_direction);
+        _light_direction = lightPresetDirection(_light_preset, _light_depth);
 //            _light_direction = mv_xf * _light_direction;
 //        }
 
@@ -164,6 +150,7 @@ void GLViewer::resizeGL( int width, int height )
     }
 
     _visible = (width * height != 0);
+    _dirty_flags |= DIRTY_CAMERA;
     
     QGLViewer::resizeGL( width, height);
     if (_inited && _renderer)
@@ -184,10 +171,22 @@ void GLViewer::draw()
     
     in_draw_function = true;
 
+    bool camera_moved = checkCamera();
+    if (_dirty_flags == 0 && drawSavedFrame())
+    {
+        in_draw_function = false;
+        return;
+    }
+
     GQStats& perf = GQStats::instance();
     if (_reset_timers_each_frame)
         perf.reset();
 
+    // The stage caches track their own inputs, except for edits made
+    // to the scene from outside the renderer.
+    if (_dirty_flags & DIRTY_SCENE)
+        _renderer->invalidateCache();
+
     setupLighting();
 
     xform cam_xf = xform(camera()->frame()->matrix());
@@ -202,6 +201,12 @@ void GLViewer::draw()
 
     _renderer->drawScene(*_npr_scene);
 
+    saveFrame();
+    _dirty_flags = 0;
+
+    if (_quality_controller.isEnabled())
+        updateQuality(camera_moved);
+
     if (_display_timers)
     {
         perf.updateView();
@@ -211,6 +216,124 @@ void GLViewer::draw()
 }
 
 
+void GLViewer::setAdaptiveQuality( bool enable )
+{
+    _quality_restore_timer.stop();
+    bool restored = !enable && _quality_controller.restoreFullQuality();
+    _quality_controller.setEnabled(enable);
+    if (restored)
+        scheduleRedraw(DIRTY_SETTINGS);
+}
+
+// Only frames drawn while the camera moves are measured. Each one pushes 
+// back the restore timer, so full quality returns after the camera stops.
+void GLViewer::updateQuality( bool camera_moved )
+{
+    if (camera_moved)
+    {
+        if (_quality_controller.frameDrawn())
+            _dirty_flags |= DIRTY_SETTINGS;
+        _quality_restore_timer.start();
+    }
+
+    __SET_COUNTER("adaptive quality level", _quality_controller.level());
+}
+
+void GLViewer::restoreFullQuality()
+{
+    if (_quality_controller.restoreFullQuality())
+        scheduleRedraw(DIRTY_SETTINGS);
+}
+
+void GLViewer::scheduleRedraw( int dirty_flags )
+{
+    _dirty_flags |= dirty_flags;
+    if (!_redraw_timer.isActive())
+        _redraw_timer.start();
+}
+
+void GLViewer::animationAdvanced()
+{
+    scheduleRedraw(DIRTY_ANIMATION);
+}
+
+void GLViewer::drawScheduledFrame()
+{
+    if (_dirty_flags)
+        updateGL();
+}
+
+// Sets DIRTY_CAMERA if the view differs from the last frame drawn. Returns
+// true if it does.
+bool GLViewer::checkCamera()
+{
+    GLdouble modelview[16], projection[16];
+    camera()->getModelViewMatrix(modelview);
+    camera()->getProjectionMatrix(projection);
+
+    vec focal_point;
+    _focus_frame.getTranslation(focal_point[0], focal_point[1], focal_point[2]);
+
+    bool moved = memcmp(modelview, _drawn_modelview, sizeof(modelview)) != 0 ||
+                 memcmp(projection, _drawn_projection, sizeof(projection)) != 0 ||
+                 focal_point != _drawn_focal_point;
+    if (moved)
+    {
+        memcpy(_drawn_modelview, modelview, sizeof(modelview));
+        memcpy(_drawn_projection, projection, sizeof(projection));
+        _drawn_focal_point = focal_point;
+        _dirty_flags |= DIRTY_CAMERA;
+    }
+    return moved;
+}
+
+// Keeps a copy of the frame (before QGLViewer's overlays) in a texture.
+void GLViewer::saveFrame()
+{
+    if (!_saved_frame.isInitialized() || 
+        (int)_saved_frame.width() != width() || 
+        (int)_saved_frame.height() != height())
+    {
+        _saved_frame.clear();
+        if (!_saved_frame.create(width(), height(), GL_RGBA8, GL_RGBA, 
+                                 GL_UNSIGNED_BYTE, 0, GL_TEXTURE_RECTANGLE_ARB))
+        {
+            _saved_frame.clear();
+            return;
+        }
+    }
+
+    glReadBuffer(GL_BACK);
+    _saved_frame.bind();
+    glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, 0, 0, width(), height());
+    _saved_frame.unbind();
+}
+
+// Draws the saved frame in place of the scene. The depth buffer is left 
+// clear, so overlays that are depth tested (the axis and grid) would be
+// drawn on top of the scene; with those on, the scene is always redrawn.
+bool GLViewer::drawSavedFrame()
+{
+    if (!_saved_frame.isInitialized() ||
+        (int)_saved_frame.width() != width() ||
+        (int)_saved_frame.height() != height() ||
+        axisIsDrawn() || gridIsDrawn())
+        return false;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glEnable(GL_TEXTURE_RECTANGLE_ARB);
+    _saved_frame.bind();
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    NPRGLDraw::drawFullScreenQuad(GL_TEXTURE_RECTANGLE_ARB);
+    _saved_frame.unbind();
+    glPopAttrib();
+
+    return true;
+}
+
 void GLViewer::forceFullRedraw()
 {
     forceExtractLines();
@@ -219,6 +342,7 @@ void GLViewer::forceFullRedraw()
         GQStats::instance().clearTimers();
         GQStats::instance().clearCounters();
     }
+    _dirty_flags = DIRTY_ALL;
     updateGL();
 }
 
@@ -327,7 +451,7 @@ void GLViewer::keyPressEvent( QKeyEvent* e )
 
         if (_focus_paths[path])
         {
-            connect( _focus_paths[path], SIGNAL(interpolated()), SLOT(updateGL()) );
+            connect( _focus_paths[path], SIGNAL(interpolated()), SLOT(animationAdvanced()) );
             _focus_paths[path]->startInterpolation();
         }
     }
@@ -16,6 +16,8 @@ See the COPYING file for details.
 #define GLVIEWER_H_
 
 #include "NPRUtility.h"
+#include "QualityController.h"
+#include "GQTexture.h"
 #include <qglviewer.h>
 #include <QString>
 #include <QTimer>
@@ -57,6 +59,20 @@ public:
     
     static const QString lightPresetNames[];
 
+    // What has changed since the last frame was drawn. Camera changes 
+    // (including the focal point and the window size) are also detected 
+    // by draw() itself. STYLE covers anything that changes shading but not
+    // the geometry, including the lights.
+    typedef enum
+    {
+        DIRTY_CAMERA    = 1 << 0,
+        DIRTY_STYLE     = 1 << 1,
+        DIRTY_SETTINGS  = 1 << 2,
+        DIRTY_SCENE     = 1 << 3,
+        DIRTY_ANIMATION = 1 << 4,
+        DIRTY_ALL       = (1 << 5) - 1
+    } DirtyFlag;
+
 public:
     GLViewer( QWidget* parent = 0 );
 
@@ -74,14 +90,30 @@ public:
     void setTimersAreDisplayed( bool enable ) { _display_timers = enable; }
     void setResetTimersEachFrame( bool enable ) { _reset_timers_each_frame = enable; }
 
+    // Lowers the line visibility quality while the camera moves, to hold
+    // the controller's target frame time (see QualityController.h).
+    void setAdaptiveQuality( bool enable );
+    QualityController& qualityController() { return _quality_controller; }
+
     void setAppropriateTextColor();
 
+    // Marks part of the frame out of date and schedules a redraw. Any 
+    // number of calls before control returns to the event loop (e.g., from
+    // a dragged slider) are drawn as one frame.
+    void scheduleRedraw( int dirty_flags );
+    int  dirtyFlags() const { return _dirty_flags; }
+
     virtual QDomElement domElement(const QString& name, QDomDocument& document) const;
 
 public slots:
     void forceFullRedraw();
     virtual void initFromDOMElement(const QDomElement& element);
 
+protected slots:
+    void restoreFullQuality();
+    void drawScheduledFrame();
+    void animationAdvanced();
+
 protected:
     virtual void draw();
     virtual void resizeGL( int width, int height );
@@ -94,6 +126,10 @@ protected:
 
 private:
     void setupLighting();
+    void updateQuality( bool camera_moved );
+    bool checkCamera();
+    void saveFrame();
+    bool drawSavedFrame();
 
 private:
     NPRRenderer* _renderer;
@@ -110,6 +146,19 @@ private:
 
     vector<qglviewer::KeyFrameInterpolator*> _focus_paths;
     qglviewer::Frame _focus_frame;
+
+    QualityController   _quality_controller;
+    QTimer              _quality_restore_timer;
+
+    // Redraw scheduling. A repaint with nothing dirty (an expose, or an 
+    // update that changed nothing) copies the last frame back instead of
+    // drawing the scene.
+    int                 _dirty_flags;
+    QTimer              _redraw_timer;
+    GLdouble            _drawn_modelview[16];
+    GLdouble            _drawn_projection[16];
+    vec                 _drawn_focal_point;
+    GQTexture2D         _saved_frame;
 };
 
 #endif /*GLVIEWER_H_*/
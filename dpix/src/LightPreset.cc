@@ -0,0 +1,48 @@
+/*****************************************************************************\
+
+LightPreset.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "LightPreset.h"
+
+// x and y of each preset direction, in the order of GLViewer::LightPreset.
+// The first entry (HEADLIGHT) is handled separately.
+static const float preset_directions[][2] = {
+    { 0.0f, 0.0f },
+    { 0.0f, 1.0f },         // NORTH
+    { 0.374f, 1.0f },       // NORTHNORTHEAST
+    { 1.0f, 1.0f },         // NORTHEAST
+    { 1.0f, 0.374f },       // EASTNORTHEAST
+    { 1.0f, 0.0f },         // EAST
+    { 1.0f, -0.374f },      // EASTSOUTHEAST
+    { 1.0f, -1.0f },        // SOUTHEAST
+    { 0.374f, -1.0f },      // SOUTHSOUTHEAST
+    { 0.0f, -1.0f },        // SOUTH
+    { -0.374f, -1.0f },     // SOUTHSOUTHWEST
+    { -1.0f, -1.0f },       // SOUTHWEST
+    { -1.0f, -0.374f },     // WESTSOUTHWEST
+    { -1.0f, 0.0f },        // WEST
+    { -1.0f, 0.374f },      // WESTNORTHWEST
+    { -1.0f, 1.0f },        // NORTHWEST
+    { -0.374f, 1.0f }       // NORTHNORTHWEST
+};
+
+static const int num_presets = 
+    sizeof(preset_directions) / sizeof(preset_directions[0]);
+
+vec lightPresetDirection( int preset, float depth )
+{
+    vec direction(0.0f, 0.0f, 1.0f);
+    if (preset > 0 && preset < num_presets)
+    {
+        direction = vec(preset_directions[preset][0], 
+                        preset_directions[preset][1], depth);
+    }
+    normalize(direction);
+    return direction;
+}
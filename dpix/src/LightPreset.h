@@ -0,0 +1,23 @@
+/*****************************************************************************\
+
+LightPreset.h
+Copyright (c) 2009 Forrester Cole
+
+Light directions for the lighting presets in GLViewer. Shared with
+dpix-batch, which lights scenes the same way without a viewer.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef LIGHT_PRESET_H_
+#define LIGHT_PRESET_H_
+
+#include "Vec.h"
+
+// preset is a GLViewer::LightPreset. The direction is in camera space;
+// depth is the z component before normalization (except for the headlight).
+vec lightPresetDirection( int preset, float depth );
+
+#endif // LIGHT_PRESET_H_
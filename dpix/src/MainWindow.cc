@@ -25,9 +25,11 @@ See the COPYING file for details.
 
 #include "NPRDrawable.h"
 #include "GQStats.h"
+#include "GQSampler.h"
 
 #include "Session.h"
 #include "Console.h"
+#include "SceneLoader.h"
 
 #include <XForm.h>
 #include <assert.h>
@@ -36,6 +38,12 @@ const int CURRENT_INTERFACE_VERSION = 3;
 
 const int MAX_RECENT_SCENES = 4;
 
+// While a scene loads in the background, finished paths are collected and 
+// a share of the geometry is copied to VBOs this often (ms)...
+const int LOAD_UPDATE_INTERVAL = 50;
+// ...up to this many vertices at a time, so the viewer keeps drawing.
+const int VBO_VERTICES_PER_UPDATE = 250000;
+
 MainWindow::MainWindow( )
 {
     _current_renderer = NULL;
@@ -45,10 +53,24 @@ MainWindow::MainWindow( )
     _npr_scene = NULL;
     _glViewer = NULL;
     _dpix_scene = NULL;
+    _loading_scene = NULL;
+    _load_in_background = true;
+    _load_first_frame_time = 0;
     _recent_scenes_actions.resize(MAX_RECENT_SCENES);
     
     _ui.setupUi(this);
 
+    _load_timer.setInterval(LOAD_UPDATE_INTERVAL);
+    connect( &_load_timer, SIGNAL(timeout()), this, SLOT(onmy_loadTimer_timeout()) );
+
+    _load_progress = new QProgressDialog(this);
+    _load_progress->setWindowTitle("Loading Scene");
+    _load_progress->setMinimumDuration(500);
+    _load_progress->setAutoReset(false);
+    _load_progress->setAutoClose(false);
+    _load_progress->reset();
+    connect( _load_progress, SIGNAL(canceled()), this, SLOT(onmy_loadProgress_canceled()) );
+
     for (int i = 0; i < (int)(GLViewer::NUM_LIGHT_PRESETS); i++) {
         _ui.lightingPositionComboBox->addItem(GLViewer::lightPresetNames[i]);
     }
@@ -56,6 +78,14 @@ MainWindow::MainWindow( )
 
 MainWindow::~MainWindow()
 {
+    _scene_loader.cancel();
+    _scene_loader.wait();
+    if (_loading_scene)
+    {
+        _loading_scene->clear();
+        delete _loading_scene;
+    }
+
     clearRenderers();
     delete _npr_scene;
 }
@@ -122,10 +152,7 @@ void MainWindow::init( const QDir& working_dir, const QString& scenename )
 
     if (!scenename.isEmpty())
     {
-        if (openScene( scenename ))
-        {
-            _scenename = QDir::fromNativeSeparators(scenename);
-        }
+        openScene( scenename );
     }
 
     makeWindowTitle();
@@ -163,7 +190,6 @@ bool MainWindow::openScene( const QString& filename )
     // Try to do all the file loading before we change the mainwindow state at all.
 
     QString absfilename = QDir::fromNativeSeparators(_working_dir.absoluteFilePath(filename));
-    _scenename = QDir::fromNativeSeparators(absfilename);
     QFileInfo fileinfo(absfilename);
     
     if (!fileinfo.exists())
@@ -172,16 +198,47 @@ bool MainWindow::openScene( const QString& filename )
         return false;
     }
 
+    // Only one scene loads at a time.
+    cancelSceneLoad();
+    timestamp load_start_time = now();
+
+    // In the background, only the scene file is read here (settings, 
+    // style, session); the model is left to the loader thread.
     Scene* new_scene = new Scene();
     
-    if (!new_scene->load(absfilename))
+    if (!new_scene->load(absfilename, !_load_in_background))
     {
         QMessageBox::critical(this, "Open Failed", QString("Failed to load \"%1\". Check console.").arg(absfilename));
         delete new_scene;
         return false;
     }
 
-    // Success: file has been loaded, now change state
+    if (_load_in_background)
+    {
+        _loading_scene = new_scene;
+        _loading_scenename = absfilename;
+        _load_start_time = load_start_time;
+        _load_first_frame_time = 0;
+        _scene_loader.load(new_scene->nprScene());
+
+        _load_progress->setLabelText(QString("%1...").arg(SceneLoader::stageName(NPR_LOAD_PARSE)));
+        _load_progress->setRange(0, 1);
+        _load_progress->setValue(0);
+        _load_timer.start();
+        return true;
+    }
+
+    showScene(new_scene, absfilename);
+    _npr_scene->updateVBOs();
+
+    return true;
+}
+
+// Success: file has been loaded, now change state. A scene loading in the
+// background may not have its paths or VBOs yet.
+void MainWindow::showScene( Scene* new_scene, const QString& filename )
+{
+    _scenename = QDir::fromNativeSeparators(filename);
 
     clearRenderers();
     allocRenderers();
@@ -192,11 +249,11 @@ bool MainWindow::openScene( const QString& filename )
     _dpix_scene = new_scene;
 
     NPRSettings::instance().copyPersistent(*(_dpix_scene->nprSettings()));
+    _glViewer->qualityController().reset();
 
     _npr_scene = _dpix_scene->nprScene();
     GQStats::instance().clear();
     _npr_scene->recordStats(GQStats::instance());
-    _npr_scene->updateVBOs();
 
     _current_session = _dpix_scene->session();
     if (_current_session)
@@ -222,8 +279,108 @@ bool MainWindow::openScene( const QString& filename )
 
     // Now set the proper renderer.
     _glViewer->setNPR(_current_renderer, _npr_scene);
-    
-    return true;
+}
+
+void MainWindow::onmy_loadTimer_timeout()
+{
+    if (!_scene_loader.isCancelled())
+    {
+        int stage, done, total;
+        _scene_loader.progress(stage, done, total);
+        _load_progress->setLabelText(QString("%1...").arg(SceneLoader::stageName(stage)));
+        _load_progress->setRange(0, total);
+        _load_progress->setValue(done);
+    }
+
+    if (_loading_scene)
+    {
+        if (!_scene_loader.isModelDone())
+            return;
+
+        Scene* new_scene = _loading_scene;
+        _loading_scene = NULL;
+        if (!_scene_loader.isModelLoaded())
+        {
+            _load_timer.stop();
+            _load_progress->reset();
+            if (!_scene_loader.isCancelled())
+                QMessageBox::critical(this, "Open Failed", QString("Failed to load \"%1\". Check console.").arg(_loading_scenename));
+            new_scene->clear();
+            delete new_scene;
+            return;
+        }
+
+        showScene(new_scene, _loading_scenename);
+        _glViewer->forceFullRedraw();
+        _load_first_frame_time = now() - _load_start_time;
+    }
+
+    // Check before collecting the paths, so none are missed.
+    bool loader_done = _scene_loader.isFinished();
+
+    if (_scene_loader.addFinishedPaths() > 0)
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_SCENE);
+
+    _glViewer->makeCurrent();
+    bool vbos_done = _npr_scene->updateVBOs(VBO_VERTICES_PER_UPDATE);
+
+    if (loader_done && vbos_done)
+        finishSceneLoad();
+}
+
+void MainWindow::onmy_loadProgress_canceled()
+{
+    _scene_loader.cancel();
+}
+
+// Stops a background load. A scene that has not been shown yet is 
+// dropped; a shown scene keeps the paths stitched so far.
+void MainWindow::cancelSceneLoad()
+{
+    if (!_load_timer.isActive())
+        return;
+
+    _scene_loader.cancel();
+    _scene_loader.wait();
+
+    if (_loading_scene)
+    {
+        _loading_scene->clear();
+        delete _loading_scene;
+        _loading_scene = NULL;
+        _load_timer.stop();
+        _load_progress->reset();
+    }
+    else
+    {
+        finishSceneLoad();
+    }
+}
+
+void MainWindow::finishSceneLoad()
+{
+    _load_timer.stop();
+    _load_progress->reset();
+
+    if (_scene_loader.addFinishedPaths() > 0)
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_SCENE);
+
+    _glViewer->makeCurrent();
+    _npr_scene->updateVBOs();
+
+    // The stats recorded when the scene was shown did not count the paths.
+    // Constant groups are appended, so the old ones are cleared first.
+    GQStats& stats = GQStats::instance();
+    stats.clearConstants();
+    _npr_scene->recordStats(stats);
+
+    if (!_scene_loader.isCancelled())
+    {
+        stats.beginConstantGroup("Scene Load (s)");
+        stats.setConstant("first frame", QString::number(_load_first_frame_time, 'f', 2));
+        stats.setConstant("complete", QString::number(now() - _load_start_time, 'f', 2));
+        stats.endConstantGroup();
+    }
 }
 
 bool MainWindow::saveScene( const QString& filename )
@@ -291,9 +448,59 @@ void MainWindow::on_actionShow_FPS_toggled( bool checked )
 {
     _glViewer->setAppropriateTextColor();             
     _glViewer->setFPSIsDisplayed( checked );
-    _glViewer->forceFullRedraw();
+    _glViewer->updateGL();
+}
+
+void MainWindow::on_actionRecord_Performance_Trace_toggled( bool checked )
+{
+    if (checked)
+        GQStats::instance().beginTrace();
+    else
+        GQStats::instance().endTrace();
+}
+
+// Saves the trace and the frame history next to each other, named after 
+// the chosen .json file.
+void MainWindow::on_actionSave_Performance_Stats_triggered()
+{
+    QString filename = QFileDialog::getSaveFileName( this, 
+        "Save Performance Stats", ".", "Chrome Traces (*.json)" );
+
+    if (!filename.isNull())
+    {
+        if (filename.endsWith(".json"))
+            filename.chop(5);
+        if (!GQStats::instance().saveStats(filename))
+            QMessageBox::critical(this, "Save Failed", 
+                QString("Could not save performance stats: \"%1\"").arg(filename));
+    }
 }
     
+// Samples the CPU while checked, then saves the collapsed stacks for a 
+// flame graph.
+void MainWindow::on_actionRecord_CPU_Profile_toggled( bool checked )
+{
+    GQSampler& sampler = GQSampler::instance();
+    if (checked)
+    {
+        sampler.clear();
+        if (!sampler.start())
+            _ui.actionRecord_CPU_Profile->setChecked(false);
+        return;
+    }
+
+    if (!sampler.isRunning())
+        return;
+    sampler.stop();
+
+    QString filename = QFileDialog::getSaveFileName( this, 
+        "Save CPU Profile", ".", "Collapsed Stacks (*.folded)" );
+
+    if (!filename.isNull() && !sampler.save(filename))
+        QMessageBox::critical(this, "Save Failed", 
+            QString("Could not save CPU profile: \"%1\"").arg(filename));
+}
+
 void MainWindow::on_actionOpen_Style_triggered()
 {
     if (_npr_scene)
@@ -393,7 +600,9 @@ void MainWindow::on_actionSave_Scene_As_triggered()
 void MainWindow::on_actionReload_Shaders_triggered()
 {
     GQShaderManager::reload();
-    _glViewer->updateGL();
+    if (_standard_renderer)
+        _standard_renderer->invalidateCache();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::on_actionLighting_Lambertian_triggered()
@@ -447,43 +656,43 @@ void MainWindow::setFocusMode( int mode )
 void MainWindow::on_focusOffButton_clicked()
 {
     setFocusMode(NPR_FOCUS_NONE);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::on_focus2DButton_clicked()
 {
     setFocusMode(NPR_FOCUS_SCREEN);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::on_focus3DButton_clicked()
 {
     setFocusMode(NPR_FOCUS_WORLD);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::on_farSlider_valueChanged( int value )
 {
     getCurrentStyle()->transferRef( (NPRStyle::TransferFunc)_currentTransferIndex ).vfar = (float)value / 100;
-    _glViewer->updateGL(); 
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_nearSlider_valueChanged( int value )
 {
     getCurrentStyle()->transferRef( (NPRStyle::TransferFunc)_currentTransferIndex ).vnear = (float)value / 100;
-    _glViewer->updateGL(); 
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_v1Slider_valueChanged( int value )
 {
     getCurrentStyle()->transferRef( (NPRStyle::TransferFunc)_currentTransferIndex ).v1 = (float)value / 100;
-    _glViewer->updateGL(); 
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_v2Slider_valueChanged( int value )
 {
     getCurrentStyle()->transferRef( (NPRStyle::TransferFunc)_currentTransferIndex ).v2 = (float)value / 100;
-    _glViewer->updateGL(); 
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_transferComboBox_currentIndexChanged( int index )
@@ -736,29 +945,33 @@ void MainWindow::on_actionShow_Statistics_Widget_toggled( bool checked )
 void MainWindow::on_itembufferSegmentAtlasButton_clicked()
 {
     updateLineVisibilitySettingsFromUi();
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::on_itembufferSpineTestButton_clicked()
 {
     updateLineVisibilitySettingsFromUi();
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::on_lowQualityButton_clicked()
 {
     updateLineVisibilitySettingsFromUi();
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 void MainWindow::on_mediumQualityButton_clicked()
 {
     updateLineVisibilitySettingsFromUi();
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 void MainWindow::on_highQualityButton_clicked()
 {
     updateLineVisibilitySettingsFromUi();
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
+}
+void MainWindow::on_adaptiveQualityButton_toggled(bool checked)
+{
+    _glViewer->setAdaptiveQuality(checked);
 }
 
 
@@ -770,7 +983,7 @@ void MainWindow::on_actionCamera_Perspective_toggled(bool checked)
     else {
         _glViewer->camera()->setType(qglviewer::Camera::ORTHOGRAPHIC);
     }
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_CAMERA);
 }
 
 void MainWindow::on_actionSave_Screenshot_triggered()
@@ -782,37 +995,37 @@ void MainWindow::on_lightingPositionComboBox_activated(int index)
 {
     if (index >= 0 && index < GLViewer::NUM_LIGHT_PRESETS) {
         _glViewer->setLightPreset((GLViewer::LightPreset)index);
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
     }
 }
 
 void MainWindow::on_lightingDepthSlider_valueChanged(int value)
 {
     _glViewer->setLightDepth((float)value / 1000.0f);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_actionLighting_Ambient_Component_toggled( bool checked )
 {
     _npr_scene->light(0)->setEnableAmbient(checked);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_actionLighting_Diffuse_Component_toggled( bool checked )
 {
     _npr_scene->light(0)->setEnableDiffuse(checked);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 void MainWindow::on_actionLighting_Specular_Component_toggled( bool checked )
 {
     _npr_scene->light(0)->setEnableSpecular(checked);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_actionEnable_Lighting_toggled( bool checked )
 {
     setBoolSetting(NPR_ENABLE_LIGHTING, checked);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::on_actionUse_VBOs_for_Geometry_toggled( bool checked )
@@ -820,14 +1033,14 @@ void MainWindow::on_actionUse_VBOs_for_Geometry_toggled( bool checked )
     setBoolSetting(NPR_ENABLE_VBOS, checked);
     if (_npr_scene)
         _npr_scene->updateVBOs();
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SCENE);
 }
     
 void MainWindow::setFoV(float degrees)
 {
     _glViewer->camera()->setFieldOfView( degrees * ( 3.1415926f / 180.0f ) );
     _npr_scene->setFieldOfView(degrees * ( 3.1415926f / 180.0f ) );
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_CAMERA);
 }
 
 void MainWindow::on_actionPaper_Texture_triggered()
@@ -839,7 +1052,7 @@ void MainWindow::on_actionPaper_Texture_triggered()
     {
         getCurrentStyle()->loadPaperTexture(filename);
         updateUiFromStyle();
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
     }
 }
 
@@ -852,7 +1065,7 @@ void MainWindow::on_actionBackground_Texture_triggered()
     {
         getCurrentStyle()->loadBackgroundTexture(filename);
         updateUiFromStyle();
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
     }
 }
 
@@ -861,7 +1074,7 @@ void MainWindow::on_actionDraw_Paper_Texture_toggled( bool checked )
     if (_ui.actionDraw_Paper_Texture->isEnabled())
     {
         NPRSettings::instance().set(NPR_ENABLE_PAPER_TEXTURE, checked);
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
     }
 }
 
@@ -870,7 +1083,7 @@ void MainWindow::on_actionDraw_Background_Texture_toggled( bool checked )
     if (_ui.actionDraw_Background_Texture->isEnabled())
     {
         NPRSettings::instance().set(NPR_ENABLE_BACKGROUND_TEXTURE, checked);
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
     }
 }
 
@@ -891,7 +1104,7 @@ void MainWindow::on_actionBackground_Color_triggered()
     {
         vec color = vec(qc.redF(), qc.greenF(), qc.blueF());
         getCurrentStyle()->setBackgroundColor(color);
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
     }
 }
 
@@ -904,7 +1117,7 @@ void MainWindow::on_actionPen_Color_triggered()
     {
         vec color = vec(qc.redF(), qc.greenF(), qc.blueF());
         getCurrentStyle()->penStyle(0)->setColor(color);
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
     }
 }
 
@@ -917,6 +1130,7 @@ void MainWindow::changeSessionState( int newstate )
         _ui.actionStart_Recording->setEnabled(true);
         _ui.actionStop_Recording->setEnabled(false);
         _ui.actionReplay_Session->setEnabled(false);
+        _ui.actionReplay_From->setEnabled(false);
         _ui.actionReplay_as_fast_as_possible->setEnabled(false);
         _ui.actionReplay_and_Save_Paths->setEnabled(false);
         _ui.actionReplay_and_Save_Screenshots->setEnabled(false);
@@ -930,6 +1144,7 @@ void MainWindow::changeSessionState( int newstate )
         _ui.actionStart_Recording->setEnabled(true);
         _ui.actionStop_Recording->setEnabled(false);
         _ui.actionReplay_Session->setEnabled(true);
+        _ui.actionReplay_From->setEnabled(true);
         _ui.actionReplay_as_fast_as_possible->setEnabled(true);
         _ui.actionReplay_and_Save_Paths->setEnabled(true);
         _ui.actionReplay_and_Save_Screenshots->setEnabled(true);
@@ -939,12 +1154,15 @@ void MainWindow::changeSessionState( int newstate )
         _ui.actionSave_Session->setEnabled(true);
 
         disconnect( _current_session, SIGNAL(playbackFinished()), this, SLOT(onmy_replayFinished()) );
+
+        _glViewer->setAdaptiveQuality(_ui.adaptiveQualityButton->isChecked());
     }
     else if (newstate == SESSION_PLAYING)
     {
         _ui.actionStart_Recording->setEnabled(false);
         _ui.actionStop_Recording->setEnabled(false);
         _ui.actionReplay_Session->setEnabled(false);
+        _ui.actionReplay_From->setEnabled(false);
         _ui.actionReplay_as_fast_as_possible->setEnabled(false);
         _ui.actionReplay_and_Save_Paths->setEnabled(false);
         _ui.actionReplay_and_Save_Screenshots->setEnabled(false);
@@ -954,6 +1172,8 @@ void MainWindow::changeSessionState( int newstate )
         _ui.actionSave_Session->setEnabled(false);
 
         _glViewer->setResetTimersEachFrame(false);
+        // Replays are exported and timed, so they keep the chosen quality.
+        _glViewer->setAdaptiveQuality(false);
 
         connect( _current_session, SIGNAL(playbackFinished()), this, SLOT(onmy_replayFinished()) );
     }
@@ -962,6 +1182,7 @@ void MainWindow::changeSessionState( int newstate )
         _ui.actionStart_Recording->setEnabled(false);
         _ui.actionStop_Recording->setEnabled(true);
         _ui.actionReplay_Session->setEnabled(false);
+        _ui.actionReplay_From->setEnabled(false);
         _ui.actionReplay_as_fast_as_possible->setEnabled(false);
         _ui.actionReplay_and_Save_Paths->setEnabled(false);
         _ui.actionReplay_and_Save_Screenshots->setEnabled(false);
@@ -998,6 +1219,20 @@ void MainWindow::on_actionReplay_Session_triggered()
     _current_session->startPlayback( _glViewer, &_ui );
 }
 
+void MainWindow::on_actionReplay_From_triggered()
+{
+    bool ok;
+    double start_time = QInputDialog::getDouble( this, "Replay From", 
+        "Start time (s):", 0, 0, _current_session->length(), 2, &ok );
+
+    if (ok)
+    {
+        changeSessionState( SESSION_PLAYING );
+        _current_session->startPlayback( _glViewer, &_ui, Session::PLAYBACK_NORMAL, 
+                                         QString(), start_time );
+    }
+}
+
 void MainWindow::on_actionReplay_as_fast_as_possible_triggered()
 {
     changeSessionState( SESSION_PLAYING );
@@ -1041,6 +1276,40 @@ void MainWindow::on_actionReplay_Settings_triggered()
     Session::execSettingsDialog();
 }
 
+void MainWindow::on_actionOpen_Session_triggered()
+{
+    QString filename = 
+        myFileDialog(QFileDialog::AcceptOpen, "Open Session", 
+        "Sessions (*.dpsb *.xml)", _last_scene_dir );
+
+    if (!filename.isNull())
+    {
+        Session* session = new Session();
+        if (!session->load(filename))
+        {
+            QMessageBox::critical(this, "Open Failed", QString("Failed to load \"%1\". Check console.").arg(filename));
+            delete session;
+            return;
+        }
+
+        _current_session = session;
+        changeSessionState( SESSION_LOADED );
+    }
+}
+
+void MainWindow::on_actionSave_Session_triggered()
+{
+    QString filename = 
+        myFileDialog(QFileDialog::AcceptSave, "Save Session", 
+        "Binary Sessions (*.dpsb);;XML Sessions (*.xml)", _last_scene_dir );
+
+    if (!filename.isNull())
+    {
+        if (!_current_session->save( filename ))
+            QMessageBox::critical(this, "Save Failed", QString("Could not save session: \"%1\"").arg(filename));
+    }
+}
+
 
 void MainWindow::resizeToFitViewerSize( int x, int y )
 {
@@ -1141,21 +1410,21 @@ void MainWindow::on_penWidthBox_valueChanged(double value)
     getCurrentStyle()->penStyle(name)->setStripWidth(value);
     _glViewer->forceFullRedraw();*/
     getCurrentStyle()->penStyle(0)->setStripWidth(value);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_penOpacityBox_valueChanged(double value)
 {
     QString name = _ui.penStyleTypeBox->currentText();
     getCurrentStyle()->penStyle(name)->setOpacity(value);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_penElisionWidthBox_valueChanged(double value)
 {
     QString name = _ui.penStyleTypeBox->currentText();
     getCurrentStyle()->penStyle(name)->setElisionWidth(value);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_penLengthScaleBox_valueChanged(double value)
@@ -1164,19 +1433,19 @@ void MainWindow::on_penLengthScaleBox_valueChanged(double value)
     getCurrentStyle()->penStyle(name)->setLengthScale(value);
     _glViewer->forceFullRedraw();*/
     getCurrentStyle()->penStyle(0)->setLengthScale(value);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_drawInvisibleCheckBox_toggled( bool value )
 {
     getCurrentStyle()->setDrawInvisibleLines(value);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_enableLineElisionCheckBox_toggled( bool value )
 {
     getCurrentStyle()->setEnableLineElision(value);
-    _glViewer->updateGL();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
 }
 
 void MainWindow::on_cameraInterpSpeedBox_valueChanged( double value )
@@ -1199,7 +1468,7 @@ void MainWindow::changePenTexture(const QString& pen_style)
         QString rel_name = _working_dir.absoluteFilePath(filename);
 
         getCurrentStyle()->penStyle(pen_style)->setTexture(rel_name);
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
     }
 }
 
@@ -1210,7 +1479,7 @@ void MainWindow::changePenColor(const QString& pen_style)
     {
         vec color = vec(qc.redF(), qc.greenF(), qc.blueF());
         getCurrentStyle()->penStyle(pen_style)->setColor(color);
-        _glViewer->updateGL();
+        _glViewer->scheduleRedraw(GLViewer::DIRTY_STYLE);
     }
 }
 
@@ -1287,7 +1556,7 @@ QString MainWindow::myFileDialog( int mode, const QString& caption, const QStrin
 
 void MainWindow::sceneUpdated() {
 	if (_session_state != SESSION_PLAYING) {
-		_glViewer->updateGL();
+		_glViewer->scheduleRedraw(GLViewer::DIRTY_SCENE);
 	}
 }
 
@@ -1308,6 +1577,9 @@ void MainWindow::updateLineVisibilitySettingsFromUi()
 
         setIntSetting(NPR_LINE_VISIBILITY_METHOD, viz_method);
 
+        // The buttons set the full quality the controller works down from.
+        _glViewer->qualityController().reset();
+
         if (_ui.lowQualityButton->isChecked()) 
         {
             setIntSetting(NPR_LINE_VISIBILITY_SUPERSAMPLE, 1);
@@ -1332,17 +1604,17 @@ void MainWindow::updateLineVisibilitySettingsFromUi()
 void MainWindow::setBoolSetting(NPRBoolSetting name, bool value)
 {
     NPRSettings::instance().set(name, value);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::setIntSetting(NPRIntSetting name, int value)
 {
     NPRSettings::instance().set(name, value);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
 
 void MainWindow::setFloatSetting(NPRFloatSetting name, float value)
 {
     NPRSettings::instance().set(name, value);
-    _glViewer->forceFullRedraw();
+    _glViewer->scheduleRedraw(GLViewer::DIRTY_SETTINGS);
 }
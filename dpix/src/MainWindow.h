@@ -17,9 +17,12 @@ See the COPYING file for details.
 
 #include <QMainWindow>
 #include <QDir>
+#include <QTimer>
 #include "ui_Interface.h"
 #include "Console.h"
 #include "Scene.h"
+#include "SceneLoader.h"
+#include "timestamp.h"
 #include "NPRSettings.h"
 
 class GLViewer;
@@ -30,6 +33,7 @@ class NPRLight;
 class NPRStyle;
 class NPRDrawable;
 class QSlider;
+class QProgressDialog;
 
 class MainWindow : public QMainWindow
 {
@@ -44,6 +48,10 @@ class MainWindow : public QMainWindow
     void resizeToFitViewerSize( int x, int y );
     void setFoV(float degrees);
 
+    // Scenes load on a worker thread by default, and are shown before 
+    // they are complete. Set before init.
+    void setLoadInBackground( bool background ) { _load_in_background = background; }
+
   protected:
     void closeEvent(QCloseEvent* event );
 
@@ -73,6 +81,9 @@ public slots:
     void on_actionFilter_Priority_toggled( bool checked ) 
         { setBoolSetting(NPR_FILTER_LINE_PRIORITY, checked); };
     void on_actionShow_FPS_toggled( bool checked );
+    void on_actionRecord_Performance_Trace_toggled( bool checked );
+    void on_actionSave_Performance_Stats_triggered();
+    void on_actionRecord_CPU_Profile_toggled( bool checked );
     void on_actionEnable_Stylized_Lines_toggled( bool checked ) 
         { setBoolSetting(NPR_ENABLE_STYLIZED_LINES, checked); };
     void on_actionEnable_Color_Blur_toggled( bool checked )
@@ -99,11 +110,14 @@ public slots:
     void on_actionStart_Recording_triggered();
     void on_actionStop_Recording_triggered();
     void on_actionReplay_Session_triggered();
+    void on_actionReplay_From_triggered();
     void on_actionReplay_as_fast_as_possible_triggered();
     void on_actionReplay_and_Save_Screenshots_triggered();
     void on_actionReplay_and_Save_Movie_triggered();
     void on_actionStop_Replaying_triggered();
     void on_actionReplay_Settings_triggered();
+    void on_actionOpen_Session_triggered();
+    void on_actionSave_Session_triggered();
 
     void on_actionPaper_Texture_triggered();
     void on_actionBackground_Texture_triggered();
@@ -169,6 +183,7 @@ public slots:
     void on_lowQualityButton_clicked();
     void on_mediumQualityButton_clicked();
     void on_highQualityButton_clicked();
+    void on_adaptiveQualityButton_toggled(bool checked);
 
     void on_penStyleTypeBox_currentIndexChanged( const QString& text );
     void on_penStyleSameAsBaseCheck_toggled(bool checked);
@@ -185,6 +200,8 @@ public slots:
     void on_cameraInterpSpeedBox_valueChanged( double value );
 
     void onmy_replayFinished();
+    void onmy_loadTimer_timeout();
+    void onmy_loadProgress_canceled();
 
     void onmy_recentScene0_triggered() { openRecentScene(0); }
     void onmy_recentScene1_triggered() { openRecentScene(1); }
@@ -196,6 +213,9 @@ public slots:
 protected:
     bool saveStyle( const QString& filename );
     bool openScene( const QString& filename );
+    void showScene( Scene* scene, const QString& filename );
+    void cancelSceneLoad();
+    void finishSceneLoad();
     bool saveScene( const QString& filename );
     bool openRecentScene( int which );
     void addCurrentSceneToRecentList();
@@ -261,6 +281,19 @@ protected:
     static const int SESSION_RECORDING = 3;
     
     int       _currentTransferIndex;
+
+    // Background scene loading. _loading_scene is set until its model is
+    // done; the timer then keeps feeding paths and VBOs to the shown scene
+    // until the loader finishes.
+    bool             _load_in_background;
+    SceneLoader      _scene_loader;
+    Scene*           _loading_scene;
+    QString          _loading_scenename;
+    QTimer           _load_timer;
+    QProgressDialog* _load_progress;
+    // When the load started, and how long it took to show the first frame.
+    timestamp        _load_start_time;
+    float            _load_first_frame_time;
 };
 
 #endif
@@ -0,0 +1,214 @@
+/*****************************************************************************\
+
+QualityController.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "QualityController.h"
+#include "NPRSettings.h"
+#include "GQStats.h"
+
+#include <QString>
+
+// 20 frames per second.
+const float DEFAULT_TARGET_FRAME_TIME = 0.05f;
+
+// Step down after this many frames in a row over the target (plus slack),
+// and up after this many in a row well under it. Stepping up roughly
+// doubles the cost, so "well under" is half the target.
+const int   SLOW_FRAMES_TO_STEP_DOWN = 3;
+const int   FAST_FRAMES_TO_STEP_UP = 15;
+const float SLOW_FRAME_RATIO = 1.1f;
+const float FAST_FRAME_RATIO = 0.5f;
+
+// Frames ignored after a step, while buffers are reallocated and the
+// frame cache refills.
+const int   SETTLE_FRAMES = 2;
+
+// Weight of the newest frame in the smoothed frame time.
+const float SMOOTHING = 0.3f;
+
+const int NUM_TIMERS = 3;
+const char* timer_names[NUM_TIMERS] =
+{
+    "Compute Line Vis.",
+    "Draw Polygons",
+    "Draw Quads"
+};
+
+// Cheaper settings, from best to worst. The first three match the high,
+// medium and low buttons.
+struct QualityEntry
+{
+    int   supersample;
+    float depth_scale;
+    float kernel_scale_y;
+    float sample_spacing;
+};
+
+const int NUM_LADDER_ENTRIES = 6;
+const QualityEntry quality_ladder[NUM_LADDER_ENTRIES] =
+{
+    { 16, 3.0f, 0.3f,  2.0f },
+    { 9,  2.0f, 0.5f,  2.0f },
+    { 4,  1.5f, 0.75f, 2.0f },
+    { 1,  1.0f, 1.0f,  2.0f },
+    { 1,  1.0f, 1.0f,  3.0f },
+    { 1,  1.0f, 1.0f,  4.0f },
+};
+
+QualityController::QualityController()
+{
+    _enabled = false;
+    _target_frame_time = DEFAULT_TARGET_FRAME_TIME;
+    reset();
+}
+
+void QualityController::setEnabled( bool enabled )
+{
+    if (!enabled)
+        restoreFullQuality();
+    _enabled = enabled;
+}
+
+void QualityController::reset()
+{
+    _level = 0;
+    _first_entry = NUM_LADDER_ENTRIES;
+    _smoothed_time = 0;
+    _frames_since_change = 0;
+    _slow_frames = 0;
+    _fast_frames = 0;
+    for (int i = 0; i < NUM_TIMERS; i++)
+        _last_timer_totals[i] = 0;
+}
+
+bool QualityController::frameDrawn()
+{
+    float frame_time = measureFrameTime();
+    if (!_enabled)
+        return false;
+
+    _frames_since_change++;
+    if (_frames_since_change <= SETTLE_FRAMES)
+        return false;
+
+    if (_frames_since_change == SETTLE_FRAMES + 1)
+        _smoothed_time = frame_time;
+    else
+        _smoothed_time = SMOOTHING * frame_time + (1.0f - SMOOTHING) * _smoothed_time;
+
+    if (_smoothed_time > _target_frame_time * SLOW_FRAME_RATIO)
+    {
+        _slow_frames++;
+        _fast_frames = 0;
+    }
+    else if (_smoothed_time < _target_frame_time * FAST_FRAME_RATIO)
+    {
+        _fast_frames++;
+        _slow_frames = 0;
+    }
+    else
+    {
+        _slow_frames = 0;
+        _fast_frames = 0;
+    }
+
+    if (_slow_frames >= SLOW_FRAMES_TO_STEP_DOWN)
+    {
+        if (_level == 0)
+            saveFullQuality();
+        if (_first_entry + _level < NUM_LADDER_ENTRIES)
+        {
+            applyLevel(_level + 1);
+            return true;
+        }
+        _slow_frames = 0;
+    }
+    else if (_fast_frames >= FAST_FRAMES_TO_STEP_UP && _level > 0)
+    {
+        applyLevel(_level - 1);
+        return true;
+    }
+
+    return false;
+}
+
+bool QualityController::restoreFullQuality()
+{
+    if (_level == 0)
+        return false;
+
+    applyLevel(0);
+    return true;
+}
+
+// The time this frame added to the timers. The viewer normally resets the
+// timers each frame, but not during session replays, so the totals are
+// differenced.
+float QualityController::measureFrameTime()
+{
+    GQStats& stats = GQStats::instance();
+
+    float frame_time = 0;
+    for (int i = 0; i < NUM_TIMERS; i++)
+    {
+        float total = stats.timerValue(QString(timer_names[i]));
+        if (total >= _last_timer_totals[i])
+            frame_time += total - _last_timer_totals[i];
+        else
+            frame_time += total;
+        _last_timer_totals[i] = total;
+    }
+    return frame_time;
+}
+
+// The ladder starts at the first entry cheaper than the user's settings.
+void QualityController::saveFullQuality()
+{
+    NPRSettings& settings = NPRSettings::instance();
+    _full_supersample = settings.get(NPR_LINE_VISIBILITY_SUPERSAMPLE);
+    _full_depth_scale = settings.get(NPR_SEGMENT_ATLAS_DEPTH_SCALE);
+    _full_kernel_scale_y = settings.get(NPR_SEGMENT_ATLAS_KERNEL_SCALE_Y);
+    _full_sample_spacing = settings.get(NPR_SEGMENT_ATLAS_SAMPLE_SPACING);
+
+    _first_entry = 0;
+    while (_first_entry < NUM_LADDER_ENTRIES)
+    {
+        const QualityEntry& entry = quality_ladder[_first_entry];
+        if (entry.supersample < _full_supersample ||
+            (entry.supersample == _full_supersample &&
+             entry.sample_spacing > _full_sample_spacing))
+            break;
+        _first_entry++;
+    }
+}
+
+void QualityController::applyLevel( int level )
+{
+    NPRSettings& settings = NPRSettings::instance();
+    if (level == 0)
+    {
+        settings.set(NPR_LINE_VISIBILITY_SUPERSAMPLE, _full_supersample);
+        settings.set(NPR_SEGMENT_ATLAS_DEPTH_SCALE, _full_depth_scale);
+        settings.set(NPR_SEGMENT_ATLAS_KERNEL_SCALE_Y, _full_kernel_scale_y);
+        settings.set(NPR_SEGMENT_ATLAS_SAMPLE_SPACING, _full_sample_spacing);
+    }
+    else
+    {
+        const QualityEntry& entry = quality_ladder[_first_entry + level - 1];
+        settings.set(NPR_LINE_VISIBILITY_SUPERSAMPLE, entry.supersample);
+        settings.set(NPR_SEGMENT_ATLAS_DEPTH_SCALE, entry.depth_scale);
+        settings.set(NPR_SEGMENT_ATLAS_KERNEL_SCALE_Y, entry.kernel_scale_y);
+        settings.set(NPR_SEGMENT_ATLAS_SAMPLE_SPACING, entry.sample_spacing);
+    }
+
+    _level = level;
+    _frames_since_change = 0;
+    _slow_frames = 0;
+    _fast_frames = 0;
+}
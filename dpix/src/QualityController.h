@@ -0,0 +1,81 @@
+/*****************************************************************************\
+
+QualityController.h
+Copyright (c) 2009 Forrester Cole
+
+Trades line visibility quality for frame rate while the camera moves. After
+each moving frame, the time spent in the line visibility, polygon, and
+stroke passes (the GQStats timers "Compute Line Vis.", "Draw Polygons" and
+"Draw Quads") is compared to a target frame time. Slow frames step down a
+ladder of quality levels (supersample count, depth and kernel scale, then
+atlas sample spacing); fast frames step back up. Steps down need a few slow
+frames in a row and steps up need many fast ones, and a step is only taken
+once the frames after the previous step have settled, so the quality does
+not oscillate. When the camera stops, the viewer restores the settings the
+user chose.
+
+The controller writes NPRSettings directly. The settings it found when it
+first stepped down are the full quality settings, so call reset() before
+changing the quality settings from the interface.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef QUALITY_CONTROLLER_H_
+#define QUALITY_CONTROLLER_H_
+
+class QualityController
+{
+public:
+    QualityController();
+
+    void  setEnabled( bool enabled );
+    bool  isEnabled() const { return _enabled; }
+
+    void  setTargetFrameTime( float seconds ) { _target_frame_time = seconds; }
+    float targetFrameTime() const { return _target_frame_time; }
+
+    // Call after each frame drawn while the camera moves. Returns true if
+    // the quality settings changed for the next frame.
+    bool  frameDrawn();
+
+    // Puts back the full quality settings. Returns true if they had been
+    // changed.
+    bool  restoreFullQuality();
+
+    // Forgets the full quality settings without touching NPRSettings.
+    void  reset();
+
+    // 0 is full quality.
+    int   level() const { return _level; }
+    float smoothedFrameTime() const { return _smoothed_time; }
+
+protected:
+    float measureFrameTime();
+    void  saveFullQuality();
+    void  applyLevel( int level );
+
+protected:
+    bool  _enabled;
+    float _target_frame_time;
+
+    // Level 0 is the user's settings; level n > 0 is entry
+    // _first_entry + n - 1 of the quality ladder.
+    int   _level;
+    int   _first_entry;
+
+    int   _full_supersample;
+    float _full_depth_scale;
+    float _full_kernel_scale_y;
+    float _full_sample_spacing;
+
+    float _last_timer_totals[3];
+    float _smoothed_time;
+    int   _frames_since_change;
+    int   _slow_frames;
+    int   _fast_frames;
+};
+
+#endif // QUALITY_CONTROLLER_H_
@@ -10,6 +10,7 @@ See the COPYING file for details.
 \*****************************************************************************/
 
 #include "Scene.h"
+#include "SceneFile.h"
 
 #include "NPRScene.h"
 #include "NPRSettings.h"
@@ -18,8 +19,6 @@ See the COPYING file for details.
 
 #include <QFileInfo>
 
-const int CURRENT_VERSION = 1;
-
 Scene::Scene()
 {
     _npr_scene = 0;
@@ -38,40 +37,34 @@ void Scene::clear()
 }
 
 
-bool Scene::load( const QString& filename )
+bool Scene::load( const QString& filename, bool load_model )
 {
     if (filename.endsWith("dps"))
     {
-        QFile file(filename);
-        if (!file.open(QIODevice::ReadOnly))
-        {
-            qWarning("Could not open %s", qPrintable(filename));
-            return false;
-        }
-
         QDomDocument doc("dpixscene");
-        QString parse_errors;
-        if (!doc.setContent(&file, &parse_errors))
-        {
-            qWarning("Parse errors: %s", qPrintable(parse_errors));
+        if (!SceneFile::readDocument(filename, doc))
             return false;
-        }
-
-        file.close();
 
         QDomElement root = doc.documentElement();
         QDir path = QFileInfo(filename).absoluteDir();
 
-        return load(root, path); 
+        return load(root, path, load_model); 
     }
     else
     {
         _npr_scene = new NPRScene();
-        bool ret = _npr_scene->load(filename);
-        if (!ret)
+        if (load_model)
         {
-            clear();
-            return false;
+            bool ret = _npr_scene->load(filename);
+            if (!ret)
+            {
+                clear();
+                return false;
+            }
+        }
+        else
+        {
+            _npr_scene->beginLoad(filename);
         }
         _npr_settings = new NPRSettings();
         _session = 0;
@@ -81,41 +74,12 @@ bool Scene::load( const QString& filename )
     }
 }
 
-bool Scene::load( const QDomElement& root, const QDir& path )
+bool Scene::load( const QDomElement& root, const QDir& path, bool load_model )
 {
-    int version = root.attribute("version").toInt();
-    if (version != CURRENT_VERSION)
-    {
-        qWarning("Scene::load: file version out of date (%d, current is %d)", 
-            version, CURRENT_VERSION);
-        return false;
-    }
-
-	QDomElement nprsettings = root.firstChildElement("nprsettings");
-    if (nprsettings.isNull())
-    {
-        qWarning("Scene::load: no nprsettings node found.\n");
-        clear();
-        return false;
-    }
-
     _npr_settings = new NPRSettings();
-    bool ret = _npr_settings->load(nprsettings);
-    if (!ret)
-    {
-        clear();
-        return false;
-    }
-
-	QDomElement nprscene = root.firstChildElement("nprscene");
-    if (nprscene.isNull())
-    {
-        qWarning("Scene::load: no nprscene node found.\n");
-        return false;
-    }
-
     _npr_scene = new NPRScene();
-    ret = _npr_scene->load(nprscene, path);
+    bool ret = SceneFile::loadScene(root, path, *_npr_settings, *_npr_scene, 
+                                    load_model);
     if (!ret)
     {
         clear();
@@ -125,8 +89,12 @@ bool Scene::load( const QDomElement& root, const QDir& path )
 	QDomElement session = root.firstChildElement("session");
     if (!session.isNull())
     {
+        // Long binary sessions are kept in their own file.
         _session = new Session();
-        ret = _session->load(session);
+        if (session.hasAttribute("file"))
+            ret = _session->load(path.absoluteFilePath(session.attribute("file")));
+        else
+            ret = _session->load(session);
         if (!ret)
         {
             clear();
@@ -175,7 +143,7 @@ bool Scene::save( const QString& filename, const GLViewer* viewer )
 
 bool Scene::save( QDomDocument& doc, QDomElement& root, const QDir& path )
 {
-    root.setAttribute("version", CURRENT_VERSION);
+    root.setAttribute("version", SceneFile::CURRENT_SCENE_VERSION);
 
 	QDomElement nprscene = doc.createElement("nprscene");
     _npr_scene->save(doc, nprscene, path);
@@ -188,7 +156,10 @@ bool Scene::save( QDomDocument& doc, QDomElement& root, const QDir& path )
     if (_session)
     {
     	QDomElement session = doc.createElement("session");
-        _session->save(doc, session);
+        if (_session->isBinary())
+            session.setAttribute("file", path.relativeFilePath(_session->binaryFilename()));
+        else
+            _session->save(doc, session);
         root.appendChild(session);
     }
 
@@ -29,8 +29,12 @@ public:
 
     void clear();
 
-	bool load( const QString& filename );
-    bool load( const QDomElement& root, const QDir& path );
+    // With load_model false, the NPRScene is only prepared (see 
+    // NPRScene::beginLoad) and the caller loads the model, e.g. with a 
+    // SceneLoader.
+	bool load( const QString& filename, bool load_model = true );
+    bool load( const QDomElement& root, const QDir& path, 
+               bool load_model = true );
 	bool save( const QString& filename, const GLViewer* viewer );
     bool save( QDomDocument& doc, QDomElement& root, const QDir& path );
 
@@ -0,0 +1,91 @@
+/*****************************************************************************\
+
+SceneFile.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SceneFile.h"
+
+#include "NPRScene.h"
+#include "NPRSettings.h"
+
+#include <QFile>
+
+bool SceneFile::readDocument( const QString& filename, QDomDocument& doc )
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("Could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QString parse_errors;
+    if (!doc.setContent(&file, &parse_errors))
+    {
+        qWarning("Parse errors: %s", qPrintable(parse_errors));
+        return false;
+    }
+
+    file.close();
+    return true;
+}
+
+bool SceneFile::loadScene( const QDomElement& root, const QDir& path,
+                           NPRSettings& settings, NPRScene& scene,
+                           bool load_model )
+{
+    int version = root.attribute("version").toInt();
+    if (version != CURRENT_SCENE_VERSION)
+    {
+        qWarning("SceneFile::loadScene: file version out of date (%d, current is %d)", 
+            version, CURRENT_SCENE_VERSION);
+        return false;
+    }
+
+    QDomElement nprsettings = root.firstChildElement("nprsettings");
+    if (nprsettings.isNull())
+    {
+        qWarning("SceneFile::loadScene: no nprsettings node found.");
+        return false;
+    }
+    if (!settings.load(nprsettings))
+        return false;
+
+    QDomElement nprscene = root.firstChildElement("nprscene");
+    if (nprscene.isNull())
+    {
+        qWarning("SceneFile::loadScene: no nprscene node found.");
+        return false;
+    }
+    return scene.load(nprscene, path, load_model);
+}
+
+bool SceneFile::loadSessionFrames( const QDomElement& root, 
+                                   QVector<SessionFrame>& frames )
+{
+    QDomElement version = root.firstChildElement("header").firstChildElement("version");
+    int version_num = version.text().toInt();
+    if (version_num != CURRENT_SESSION_VERSION)
+    {
+        qWarning("Obsolete file version %d (current is %d)", version_num, 
+                 CURRENT_SESSION_VERSION);
+        return false;
+    }
+
+    frames.clear();
+    QDomElement frame = root.firstChildElement("frames").firstChildElement();
+    while (!frame.isNull())
+    {
+        SessionFrame sf;
+        sf.load(frame);
+        frames.append(sf);
+        frame = frame.nextSiblingElement();
+    }
+
+    return true;
+}
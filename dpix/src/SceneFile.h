@@ -0,0 +1,51 @@
+/*****************************************************************************\
+
+SceneFile.h
+Copyright (c) 2009 Forrester Cole
+
+Reading of .dps scene files and XML sessions, without any widgets, so the
+same code is used by dpix (Scene and Session) and dpix-batch. The viewer
+state is left to the caller, since only dpix has a viewer to restore.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SCENE_FILE_H_
+#define SCENE_FILE_H_
+
+#include "SessionFrame.h"
+
+#include <QDomDocument>
+#include <QDomElement>
+#include <QDir>
+#include <QString>
+#include <QVector>
+
+class NPRScene;
+class NPRSettings;
+
+class SceneFile
+{
+public:
+    static const int CURRENT_SCENE_VERSION = 1;
+    static const int CURRENT_SESSION_VERSION = 1;
+
+    // Opens and parses an XML file, either a .dps scene or a session.
+    static bool readDocument( const QString& filename, QDomDocument& doc );
+
+    // Reads the settings and the model saved under the root of a .dps 
+    // file. With load_model false the model is only prepared (see 
+    // NPRScene::beginLoad).
+    static bool loadScene( const QDomElement& root, const QDir& path,
+                           NPRSettings& settings, NPRScene& scene,
+                           bool load_model = true );
+
+    // Reads the frames of an XML session: the root of a session file or
+    // the session node of a .dps file.
+    static bool loadSessionFrames( const QDomElement& root, 
+                                   QVector<SessionFrame>& frames );
+};
+
+#endif // SCENE_FILE_H_
@@ -0,0 +1,172 @@
+/*****************************************************************************\
+
+SceneLoader.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SceneLoader.h"
+#include "GQStats.h"
+
+#include <QMutexLocker>
+#include <QAbstractItemModel>
+
+// Minimum time between progress reports within a stage, in ms.
+const int REPORT_INTERVAL = 100;
+
+const char* stage_names[NPR_NUM_LOAD_STAGES] =
+{
+    "Reading model",
+    "Converting geometry",
+    "Instancing",
+    "Stitching lines"
+};
+
+SceneLoader::SceneLoader()
+{
+    _scene = 0;
+    _cancelled = false;
+    _stage = NPR_LOAD_PARSE;
+    _done = 0;
+    _total = 0;
+    _model_done = false;
+    _model_loaded = false;
+}
+
+SceneLoader::~SceneLoader()
+{
+    cancel();
+    wait();
+
+    while (!_finished_paths.isEmpty())
+        delete _finished_paths.takeLast();
+}
+
+const char* SceneLoader::stageName( int stage )
+{
+    if (stage < 0 || stage >= NPR_NUM_LOAD_STAGES)
+        return "";
+    return stage_names[stage];
+}
+
+void SceneLoader::load( NPRScene* scene )
+{
+    cancel();
+    wait();
+
+    while (!_finished_paths.isEmpty())
+        delete _finished_paths.takeLast();
+    _finished_drawables.clear();
+
+    _scene = scene;
+    _cancelled = false;
+    _stage = NPR_LOAD_PARSE;
+    _done = 0;
+    _total = 1;
+    _model_done = false;
+    _model_loaded = false;
+    _last_report_time.start();
+
+    start();
+}
+
+void SceneLoader::progress( int& stage, int& done, int& total ) const
+{
+    QMutexLocker locker(&_mutex);
+    stage = _stage;
+    done = _done;
+    total = _total;
+}
+
+bool SceneLoader::isModelDone() const
+{
+    QMutexLocker locker(&_mutex);
+    return _model_done;
+}
+
+bool SceneLoader::isModelLoaded() const
+{
+    QMutexLocker locker(&_mutex);
+    return _model_loaded;
+}
+
+// Called from the loader thread. Reports are only stored, so they are 
+// cheap, but are still thinned out within a stage.
+bool SceneLoader::loadProgress( NPRLoadStage stage, int done, int total )
+{
+    if (stage != _stage || done == total || 
+        _last_report_time.elapsed() >= REPORT_INTERVAL)
+    {
+        QMutexLocker locker(&_mutex);
+        _stage = stage;
+        _done = done;
+        _total = total;
+        _last_report_time.start();
+    }
+    return !_cancelled;
+}
+
+void SceneLoader::run()
+{
+    GQProfiler::setThreadName("Scene loader");
+    __TIME_CODE_BLOCK("Load Scene");
+
+    bool loaded = _scene->loadModel(this) && !_cancelled;
+
+    // The scene graph model was created on this thread, but the 
+    // interface uses it from the GUI thread.
+    QAbstractItemModel* model = _scene->itemModel();
+    if (model)
+        model->moveToThread(thread());
+
+    {
+        QMutexLocker locker(&_mutex);
+        _model_done = true;
+        _model_loaded = loaded;
+    }
+
+    if (!loaded)
+        return;
+
+    // From here on the GUI thread draws the scene. Stitching only reads 
+    // the drawables and their geometry, and the new paths are handed over
+    // through the queue.
+    int num_drawables = _scene->numDrawables();
+    for (int i = 0; i < num_drawables; i++)
+    {
+        if (!loadProgress(NPR_LOAD_PATHS, i, num_drawables))
+            return;
+
+        NPRFixedPathSet* paths = _scene->buildPaths(i);
+
+        QMutexLocker locker(&_mutex);
+        _finished_drawables.append(i);
+        _finished_paths.append(paths);
+    }
+    loadProgress(NPR_LOAD_PATHS, num_drawables, num_drawables);
+}
+
+int SceneLoader::addFinishedPaths()
+{
+    QList<int> drawables;
+    QList<NPRFixedPathSet*> paths;
+    {
+        QMutexLocker locker(&_mutex);
+        drawables = _finished_drawables;
+        paths = _finished_paths;
+        _finished_drawables.clear();
+        _finished_paths.clear();
+    }
+
+    if (drawables.isEmpty())
+        return 0;
+
+    for (int i = 0; i < drawables.size(); i++)
+        _scene->addPaths(drawables[i], paths[i]);
+    _scene->updateSortedPaths();
+
+    return drawables.size();
+}
@@ -0,0 +1,85 @@
+/*****************************************************************************\
+
+SceneLoader.h
+Copyright (c) 2009 Forrester Cole
+
+Loads the model of an NPRScene on a worker thread, so the interface stays
+live while large COLLADA files are parsed. The thread runs the stages of 
+NPRScene::load: parsing, geometry conversion and instancing, then path 
+stitching. Once the drawables exist the scene may be drawn (without 
+lines), and the thread goes on to stitch the paths one drawable at a time, 
+queueing them for the GUI thread. 
+
+The loader reports nothing by itself: the GUI thread polls progress(), 
+isModelDone() and addFinishedPaths() from a timer, and does the GL work 
+(VBO uploads, redraws) there. Cancelling before the model is done fails 
+the load; cancelling afterwards leaves the remaining drawables without 
+paths.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SCENE_LOADER_H_
+#define SCENE_LOADER_H_
+
+#include "NPRScene.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QTime>
+#include <QList>
+
+class SceneLoader : public QThread, public NPRLoadCallback
+{
+public:
+    SceneLoader();
+    ~SceneLoader();
+
+    // Starts loading the model of a scene that has been through 
+    // NPRScene::beginLoad. The scene belongs to the loader until 
+    // isModelDone() returns true, and must outlive the thread.
+    void load( NPRScene* scene );
+    void cancel() { _cancelled = true; }
+    bool isCancelled() const { return _cancelled; }
+
+    NPRScene* scene() { return _scene; }
+
+    // The latest progress report.
+    void progress( int& stage, int& done, int& total ) const;
+
+    // True once NPRScene::loadModel has returned, after which 
+    // isModelLoaded tells whether it succeeded.
+    bool isModelDone() const;
+    bool isModelLoaded() const;
+
+    // Gives the paths stitched so far to their drawables and rebuilds the
+    // scene's sorted path list. Call on the GUI thread. Returns the number
+    // of drawables that got paths.
+    int  addFinishedPaths();
+
+    static const char* stageName( int stage );
+
+    bool loadProgress( NPRLoadStage stage, int done, int total );
+
+protected:
+    void run();
+
+protected:
+    NPRScene*       _scene;
+    volatile bool   _cancelled;
+    QTime           _last_report_time;
+
+    // Guarded by _mutex.
+    mutable QMutex  _mutex;
+    int             _stage;
+    int             _done;
+    int             _total;
+    bool            _model_done;
+    bool            _model_loaded;
+    QList<int>      _finished_drawables;
+    QList<NPRFixedPathSet*> _finished_paths;
+};
+
+#endif // SCENE_LOADER_H_
@@ -10,6 +10,8 @@ See the COPYING file for details.
 \*****************************************************************************/
 
 #include "Session.h"
+#include "SessionFile.h"
+#include "SceneFile.h"
 #include <QFile>
 #include <QDomDocument>
 #include <QDomText>
@@ -19,62 +21,19 @@ See the COPYING file for details.
 #include <QDir>
 #include <QSettings>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <assert.h>
 #include <qglviewer.h>
 #include "Console.h"
 #include "timestamp.h"
 #include <QDebug>
 #include <QProgressDialog>
+#include <algorithm>
 
 #include "GQStats.h"
 
 Console* Session::_console = 0;
 
-SessionFrame::~SessionFrame()
-{
-}
-
-void SessionFrame::load( const QDomElement& element )
-{
-	QDomElement t = element.firstChildElement("time");
-	assert(!t.isNull());
-	_time = t.text().toFloat();
-
-	QDomElement cam = element.firstChildElement("camera_mat");
-	assert(!cam.isNull());
-
-	QString es = cam.text();
-	QTextStream stream(&es);
-
-	stream	>> _camera_mat[0] >> _camera_mat[4] >> _camera_mat[8] >> _camera_mat[12]
-			>> _camera_mat[1] >> _camera_mat[5] >> _camera_mat[9] >> _camera_mat[13]
-			>> _camera_mat[2] >> _camera_mat[6] >> _camera_mat[10] >> _camera_mat[14]
-			>> _camera_mat[3] >> _camera_mat[7] >> _camera_mat[11] >> _camera_mat[15];	
-}
-
-void SessionFrame::save( QDomDocument& doc, QDomElement& element )
-{
-	QDomElement t = doc.createElement("time");
-	QDomText ttext = doc.createTextNode(QString("%1").arg(_time) );
-
-	element.appendChild(t);
-	t.appendChild(ttext);
-
-	QDomElement cam = doc.createElement("camera_mat");
-	QString cam_string;
-	QTextStream stream(&cam_string);
-	
-	stream	<< "\n" << _camera_mat[0] << " " << _camera_mat[4] << " " << _camera_mat[8] << " " << _camera_mat[12]
-			<< "\n" << _camera_mat[1] << " " << _camera_mat[5] << " " << _camera_mat[9] << " " << _camera_mat[13]
-			<< "\n" << _camera_mat[2] << " " << _camera_mat[6] << " " << _camera_mat[10] << " " << _camera_mat[14]
-			<< "\n" << _camera_mat[3] << " " << _camera_mat[7] << " " << _camera_mat[11] << " " << _camera_mat[15] 
-			<< "\n";
-
-	QDomText camtext = doc.createTextNode(cam_string);
-	element.appendChild(cam);
-	cam.appendChild(camtext);
-}
-
 Session::Session()
 {
     _viewer = 0;
@@ -100,40 +59,72 @@ void Session::recordFrame( const SessionFrame& frame )
     _console->print( msg );
 }
 
-const SessionFrame& Session::frame( int which ) const
+SessionFrame Session::frame( int which ) const
 {
+    if (_file.isOpen())
+        return _file.frame(which);
+
 	assert( which >= 0 && which < (int)(_frames.size()) );
 	return _frames[which];
 }
 
+int Session::numFrames() const
+{
+    if (_file.isOpen())
+        return _file.numFrames();
+    return _frames.size();
+}
+
 float Session::length() const
 {
+    if (_file.isOpen())
+        return _file.length();
+
 	if (_frames.size() == 0)
 		return 0;
 	else
 		return _frames[_frames.size()-1]._time;
 }
 
-const int CURRENT_VERSION = 1;
+static bool frameTimeLess( float time, const SessionFrame& frame )
+{
+    return time < frame._time;
+}
+
+int Session::frameAtTime( float time ) const
+{
+    if (_file.isOpen())
+        return _file.frameAtTime(time);
+
+    vector<SessionFrame>::const_iterator it = 
+        std::upper_bound(_frames.begin(), _frames.end(), time, frameTimeLess);
+    if (it == _frames.begin())
+        return 0;
+    return (it - _frames.begin()) - 1;
+}
+
+QString Session::binaryFilename() const
+{
+    return _file.isOpen() ? _file.filename() : QString();
+}
 
 bool Session::load( const QString& filename )
 {
-	QDomDocument doc("session");
-	QFile file(filename);
-	if (!file.open(QIODevice::ReadOnly))
-	{
-		qWarning("Could not open %s", qPrintable(filename));
-		return false;
-	}
+    if (SessionFile::isSessionFile(filename))
+    {
+        assert(_state == STATE_NO_DATA || _state == STATE_LOADED );
 
-	QString parse_errors;
-	if (!doc.setContent(&file, &parse_errors))
-	{
-		qWarning("Parse errors: %s", qPrintable(parse_errors));
-		return false;
-	}
+        _frames.clear();
+        if (!_file.open(filename))
+            return false;
 
-	file.close();
+        _state = STATE_LOADED;
+        return true;
+    }
+
+	QDomDocument doc("session");
+	if (!SceneFile::readDocument(filename, doc))
+		return false;
 
 	QDomElement root = doc.documentElement();
 
@@ -144,28 +135,12 @@ bool Session::load( const QDomElement& root )
 {
     assert(_state == STATE_NO_DATA || _state == STATE_LOADED );
 
-	QDomElement header = root.firstChildElement("header");
-	assert(!header.isNull());
-	QDomElement version = header.firstChildElement("version");
-	assert(!version.isNull());
-
-	int version_num = version.text().toInt();
-	if (version_num != CURRENT_VERSION)
-	{
-		qWarning("Obsolete file version %d (current is %d)", version_num, CURRENT_VERSION );
+	QVector<SessionFrame> frames;
+	if (!SceneFile::loadSessionFrames(root, frames))
 		return false;
-	}
 
-	_frames.clear();
-	QDomElement frames = root.firstChildElement("frames");
-	QDomElement frame = frames.firstChildElement();
-	while (!frame.isNull())
-	{
-		SessionFrame sf;
-		sf.load( frame );
-		_frames.push_back( sf );
-		frame = frame.nextSiblingElement();
-	}
+	_file.close();
+	_frames = frames.toStdVector();
 
     _state = STATE_LOADED;
 
@@ -174,6 +149,9 @@ bool Session::load( const QDomElement& root )
 
 bool Session::save( const QString& filename )
 {
+    if (QFileInfo(filename).suffix() == "dpsb")
+        return saveBinary(filename);
+
 	QDomDocument doc("session");
 	QDomElement root = doc.createElement("session");
 	doc.appendChild(root);
@@ -204,26 +182,49 @@ bool Session::save( QDomDocument& doc, QDomElement& root )
 	root.appendChild(header);
 
 	QDomElement version = doc.createElement("version");
-	QDomText versiontext = doc.createTextNode( QString("%1").arg(CURRENT_VERSION) );
+	QDomText versiontext = doc.createTextNode( QString("%1").arg(SceneFile::CURRENT_SESSION_VERSION) );
 	header.appendChild(version);
 	version.appendChild(versiontext);
 
 	QDomElement frames = doc.createElement("frames");
 	root.appendChild(frames);
-	for (int i = 0; i < (int)(_frames.size()); i++)
+	for (int i = 0; i < numFrames(); i++)
 	{
-		QDomElement frame = doc.createElement("frame");
-		_frames[i].save(doc, frame);
-		frames.appendChild(frame);
+		QDomElement frame_element = doc.createElement("frame");
+		frame(i).save(doc, frame_element);
+		frames.appendChild(frame_element);
 	}
 
     return true;
 }
 
+bool Session::saveBinary( const QString& filename )
+{
+    assert( _state == STATE_LOADED );
+
+    if (_file.isOpen())
+    {
+        if (QFileInfo(filename) == QFileInfo(_file.filename()))
+            return true;
+
+        SessionFileWriter writer;
+        if (!writer.open(filename))
+            return false;
+        for (int i = 0; i < numFrames(); i++)
+            writer.append(frame(i));
+        return writer.close();
+    }
+
+    if (_frames.empty())
+        return SessionFile::write(filename, 0, 0);
+    return SessionFile::write(filename, &_frames[0], _frames.size());
+}
+
 void Session::startRecording( QGLViewer* viewer, Ui::MainWindow *ui )
 {
     assert(_state == STATE_NO_DATA || _state == STATE_LOADED );
 
+    _file.close();
     _frames.clear();
     _viewer = viewer;
 	_ui_mainwindow = ui;
@@ -245,7 +246,8 @@ void Session::stopRecording()
     emit recordingStopped();
 }
 
-void Session::startPlayback( QGLViewer* viewer, Ui::MainWindow *ui, PlaybackMode mode, const QString& filename )
+void Session::startPlayback( QGLViewer* viewer, Ui::MainWindow *ui, PlaybackMode mode, const QString& filename,
+                             float start_time )
 {
     assert( _state == STATE_LOADED );
 
@@ -253,12 +255,19 @@ void Session::startPlayback( QGLViewer* viewer, Ui::MainWindow *ui, PlaybackMode
 	_ui_mainwindow = ui;
     _state = STATE_PLAYING;
     _playback_mode = mode;
-    _current_frame = -1;
+    _first_frame = 0;
+    if (start_time > 0 && numFrames() > 0 &&
+        (mode == PLAYBACK_NORMAL || mode == PLAYBACK_AS_FAST_AS_POSSIBLE))
+    {
+        _first_frame = frameAtTime(start_time);
+    }
+    _first_frame_time = (numFrames() > 0) ? frame(_first_frame)._time : 0;
+    _current_frame = _first_frame - 1;
     _has_dumped_current_frame = false;
     _screenshot_file_pattern = "";
     _screenshot_filenames.clear();
 
-    connect( this, SIGNAL( redrawNeeded() ), _viewer, SLOT( forceFullRedraw() ) );
+    connect( this, SIGNAL( redrawNeeded() ), _viewer, SLOT( updateGL() ) );
     if (_playback_mode == PLAYBACK_SCREENSHOTS)
     {
         int extindex = filename.lastIndexOf('.');
@@ -267,7 +276,14 @@ void Session::startPlayback( QGLViewer* viewer, Ui::MainWindow *ui, PlaybackMode
         connect( _viewer, SIGNAL( drawFinished(bool)), this, SLOT(dumpScreenshot()) );
     }
     else if (_playback_mode == PLAYBACK_SCREENSHOTS_INTERPOLATED ||
-             _playback_mode == PLAYBACK_MOVIE)
+             (_playback_mode == PLAYBACK_MOVIE && getStreamFromSettings()))
+    {
+        // The exporter resamples the frames to the output frame rate in 
+        // memory and either saves them or streams them into ffmpeg's stdin.
+        _final_filename = filename;
+        connect( _viewer, SIGNAL( drawFinished(bool)), this, SLOT(dumpScreenshot()) );
+    }
+    else if (_playback_mode == PLAYBACK_MOVIE)
     {
         _final_filename = filename;
 
@@ -284,9 +300,41 @@ void Session::startPlayback( QGLViewer* viewer, Ui::MainWindow *ui, PlaybackMode
         connect( _viewer, SIGNAL( drawFinished(bool)), this, SLOT(dumpScreenshot()) );
     }
 
+    if (_playback_mode == PLAYBACK_SCREENSHOTS_INTERPOLATED)
+    {
+        int extindex = _final_filename.lastIndexOf('.');
+        _viewer->makeCurrent();
+        _exporter.setInterpolation( getFPSFromSettings(), 
+                                    _final_filename.left(extindex) + "%05d.jpg" );
+        _exporter.start( 0, 0, _viewer->snapshotQuality() );
+    }
+    else if (_playback_mode == PLAYBACK_MOVIE && _screenshot_file_pattern.isEmpty())
+    {
+        _viewer->makeCurrent();
+        _exporter.setInterpolation( getFPSFromSettings() );
+        if (!startMovieStream())
+        {
+            disconnect( _viewer, SIGNAL( drawFinished(bool)), this, SLOT(dumpScreenshot()) );
+            disconnect( this, SIGNAL( redrawNeeded() ), _viewer, SLOT( updateGL() ) );
+            _state = STATE_LOADED;
+            _viewer = 0;
+            return;
+        }
+    }
+    else if (_playback_mode == PLAYBACK_SCREENSHOTS ||
+             _playback_mode == PLAYBACK_MOVIE)
+    {
+        _viewer->makeCurrent();
+        _exporter.setInterpolation( 0 );
+        _exporter.start( 0, 0, _viewer->snapshotQuality() );
+    }
+
     QString msg;
     QTextStream(&msg) << "Replaying session (" << length() << " s. / " 
-                      << numFrames() << " frames)...\n";
+                      << numFrames() << " frames)";
+    if (_first_frame > 0)
+        QTextStream(&msg) << " from " << _first_frame_time << " s. (frame " << _first_frame << ")";
+    msg += "...\n";
     _console->print( msg );
 
     emit playbackStarted();
@@ -300,9 +348,17 @@ void Session::cleanUpPlayback()
 {
     assert( _state == STATE_PLAYING );
 
-    disconnect( this, SIGNAL( redrawNeeded() ), _viewer, SLOT( forceFullRedraw() ) );
+    disconnect( this, SIGNAL( redrawNeeded() ), _viewer, SLOT( updateGL() ) );
     disconnect( _viewer, SIGNAL( drawFinished(bool)), this, SLOT(dumpScreenshot()) );
 
+    // Wait for the last frames to be written before anything reads them.
+    if (_exporter.isRunning())
+    {
+        _viewer->makeCurrent();
+        _exporter.finish();
+        _console->print( _exporter.statistics() );
+    }
+
     _state = STATE_LOADED;
     _viewer = 0;
 }
@@ -334,7 +390,7 @@ void Session::advancePlaybackFrame()
     _current_frame++;
     _has_dumped_current_frame = false;
 
-    const SessionFrame& current_frame = frame(_current_frame);
+    const SessionFrame current_frame = frame(_current_frame);
     _viewer->camera()->setFromModelViewMatrix( current_frame._camera_mat );
     _viewer->camera()->loadModelViewMatrix();
 
@@ -343,7 +399,7 @@ void Session::advancePlaybackFrame()
     float elapsed_time = now() - _session_timer;
     if (_current_frame < numFrames() - 1)
     {
-        float time_until_next = frame(_current_frame+1)._time - elapsed_time;
+        float time_until_next = frame(_current_frame+1)._time - _first_frame_time - elapsed_time;
         if (time_until_next < 0)
             time_until_next = 0;
 
@@ -362,12 +418,10 @@ void Session::advancePlaybackFrame()
     {
         cleanUpPlayback();
 
-        if (_playback_mode == PLAYBACK_MOVIE)
+        if (_playback_mode == PLAYBACK_MOVIE && !_screenshot_file_pattern.isEmpty())
             convertReplayFramesToMovie();
-        else if (_playback_mode == PLAYBACK_SCREENSHOTS_INTERPOLATED)
-            interpolateScreenshotFrames();
 
-        _console->print(QString("Replay finished. fps: %1\n").arg((float)numFrames() / elapsed_time));
+        _console->print(QString("Replay finished. fps: %1\n").arg((float)(numFrames() - _first_frame) / elapsed_time));
 
         emit playbackFinished();
     }
@@ -375,56 +429,61 @@ void Session::advancePlaybackFrame()
 
 void Session::dumpScreenshot()
 {
-    if (!_has_dumped_current_frame)
+    if (!_has_dumped_current_frame && _exporter.isInterpolating())
+    {
+        glReadBuffer( GL_BACK );
+        _exporter.readFrame( _viewer->width(), _viewer->height(), QString(), 
+                             frame(_current_frame)._time );
+        _has_dumped_current_frame = true;
+    }
+    else if (!_has_dumped_current_frame)
     {
         QString filename;
         filename.sprintf(qPrintable(_screenshot_file_pattern), _current_frame);
         _screenshot_filenames.push_back(filename);
-        
-        _viewer->saveSnapshot( filename, true );
 
-        _console->print( QString("Saved %1\n").arg(filename) );
+        // drawFinished is emitted before the buffers are swapped.
+        glReadBuffer( GL_BACK );
+        _exporter.readFrame( _viewer->width(), _viewer->height(), filename );
+
+        _console->print( QString("Queued %1\n").arg(filename) );
 
         _has_dumped_current_frame = true;
     }
 }
 
-void Session::interpolateScreenshotFrames()
+bool Session::startMovieStream()
 {
-    float fps = getFPSFromSettings();
+    QString ffmpeg_cmd;
+    QStringList ffmpeg_input_options;
+    QStringList ffmpeg_output_options;
+    float fps;
+    getFFMPEGFromSettings( ffmpeg_cmd, ffmpeg_input_options, ffmpeg_output_options, fps );
 
-    int   num_frames = int(length() * fps);
-    int   cur_input = 0; 
+    // The exporter drops any frame that is not this size, e.g. if the 
+    // window is resized during playback.
+    int width = _viewer->width();
+    int height = _viewer->height();
 
-    QDir temp = QDir("./temp");
-    assert(temp.exists());
+    QStringList ffmpeg_args = ffmpeg_input_options;
+    ffmpeg_args << "-f" << "rawvideo" << "-pix_fmt" << "rgb24" 
+                << "-s" << QString("%1x%2").arg(width).arg(height)
+                << "-i" << "-" << ffmpeg_output_options << "-y" << _final_filename;
 
-    QProgressDialog progress("Interpolating Screenshots...", "Cancel", 0, num_frames+1, 0);
-    progress.setWindowModality(Qt::WindowModal);
-    progress.setMinimumDuration(2000);
+#ifdef WIN32
+    ffmpeg_cmd.replace("/", "\\");
+    ffmpeg_args.replaceInStrings("/", "\\");
+#endif
 
-    int extindex = _final_filename.lastIndexOf('.');
-    QString prefix = _final_filename.left(extindex);
-    vector<QString> tempfiles;
-    for (int f = 0; f < num_frames + 1; f++)
-    {
-		while (f > int(frame(cur_input)._time * fps))
-			cur_input++;
+    _console->print( "Streaming to ffmpeg...\n" );
+    _console->print( QString("%1 %2\n\n").arg(ffmpeg_cmd).arg(ffmpeg_args.join(" ")));
 
-		QString targetfile = QString("%1%2.jpg").arg(prefix).arg(f, 5, 10, QLatin1Char('0'));
-		qDebug() << _screenshot_filenames[cur_input] << "->" << targetfile << "for time" << frame(cur_input)._time;
-        QFile::copy( _screenshot_filenames[cur_input], targetfile );
-        progress.setValue(f);
+    if (!_exporter.startStream( ffmpeg_cmd, ffmpeg_args, width, height ))
+    {
+        _console->print( QString("Could not start %1\n").arg(ffmpeg_cmd) );
+        return false;
     }
-    progress.setValue(num_frames+1);
-
-    // Clean up temp files.
-    for (int i = 0; i < (int)(_screenshot_filenames.size()); i++)
-        QFile::remove(_screenshot_filenames[i]);
-
-    // rmdir will only succeed if the directory is empty.
-    QDir work = QDir(".");
-    work.rmdir("temp");
+    return true;
 }
 
 void Session::convertReplayFramesToMovie()
@@ -529,6 +588,14 @@ void Session::getFFMPEGFromSettings( QString& cmd, QStringList& input_options, Q
     output_options << output_options_string.split(" ", QString::SkipEmptyParts);
 }
 
+bool Session::getStreamFromSettings()
+{
+    QSettings settings("dpix", "dpix");
+
+    settings.beginGroup("session/ffmpeg");
+    return settings.value("stream", true).toBool();
+}
+
 float Session::getFPSFromSettings()
 {
     QSettings settings("dpix", "dpix");
@@ -17,6 +17,9 @@ See the COPYING file for details.
 #include "Vec.h"
 #include "XForm.h"
 #include "timestamp.h"
+#include "SessionFrame.h"
+#include "SessionFile.h"
+#include "FrameExporter.h"
 #include "ui_Session.h"
 #include "ui_Interface.h"
 #include <vector>
@@ -29,24 +32,6 @@ using std::vector;
 class QGLViewer;
 class Console;
 
-class SessionFrame
-{
-public:
-    ~SessionFrame();
-	void load( const QDomElement& element );
-	void save( QDomDocument& doc, QDomElement& element );
-
-public:
-	float	_time;
-	xform	_camera_mat;
-	int     _active_partition;
-	float   _cutaway_angle;
-	float	_cutaway_depth;
-	bool	_cutaway_enable;
-	bool	_cutaway_visible;
-	bool	_anim_playing;
-};
-
 class Session : public QObject
 {
     Q_OBJECT
@@ -72,29 +57,44 @@ public:
 public:
     Session();
 
+    // Files written by saveBinary are detected and mapped; frames are then
+    // read from the file as they are played. Anything else is read as XML.
 	bool load( const QString& filename );
     bool load( const QDomElement& root );
+    // Files with the .dpsb suffix are written with saveBinary.
 	bool save( const QString& filename );
     bool save( QDomDocument& doc, QDomElement& root );
+    bool saveBinary( const QString& filename );
+
+    bool    isBinary() const { return _file.isOpen(); }
+    QString binaryFilename() const;
 
 	void startRecording( QGLViewer* viewer, Ui::MainWindow *ui );
     void stopRecording();
 
+    // Plain replays (PLAYBACK_NORMAL and PLAYBACK_AS_FAST_AS_POSSIBLE) 
+    // start from the frame shown at start_time. Replays that save images
+    // always start from the beginning.
 	void startPlayback( QGLViewer* viewer, Ui::MainWindow *ui, PlaybackMode mode = PLAYBACK_NORMAL, 
-                                           const QString& filename = QString::null );
+                                           const QString& filename = QString::null,
+                                           float start_time = 0 );
     void stopPlayback();
 
     State getState() const { return _state; }
 
 	float               length() const;
-	int					numFrames() const { return _frames.size(); }
-	const SessionFrame& frame( int which ) const;
+	int					numFrames() const;
+	SessionFrame        frame( int which ) const;
+    // The last frame recorded at or before time.
+    int                 frameAtTime( float time ) const;
 
 	void recordFrame( const SessionFrame& frame );
 
     static void execSettingsDialog();
     static void getFFMPEGFromSettings( QString& cmd, QStringList& input_options, QStringList& output_options, float& fps );
     static float getFPSFromSettings();
+    // If false, movies are written as temporary jpegs and encoded afterward.
+    static bool getStreamFromSettings();
     static void setConsole( Console* console ) { _console = console; }
 
 public slots:
@@ -111,8 +111,8 @@ signals:
     void playbackStopped();
 
 protected:
+    bool startMovieStream();
     void convertReplayFramesToMovie();
-    void interpolateScreenshotFrames();
     void cleanUpPlayback();
 
 protected:
@@ -122,14 +122,19 @@ protected:
 	Ui::MainWindow*		 _ui_mainwindow;
 
 	vector<SessionFrame> _frames;
+    SessionFile          _file;
     int                  _current_frame;
     bool                 _has_dumped_current_frame;
+    // The frame playback started from, and its recorded time.
+    int                  _first_frame;
+    float                _first_frame_time;
 
     timestamp            _session_timer;
 
     QString              _final_filename;
     QString              _screenshot_file_pattern;
     vector<QString>      _screenshot_filenames;
+    FrameExporter        _exporter;
 
     static Console*      _console;
 };
@@ -0,0 +1,342 @@
+/*****************************************************************************\
+
+SessionFile.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SessionFile.h"
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+static const char SESSION_FILE_MAGIC[4] = { 'D', 'P', 'S', 'B' };
+static const int  SESSION_FILE_VERSION = 2;
+
+// The elements of the column-major camera matrix that are stored; the 
+// rest are the bottom row, (0 0 0 1).
+static const int CAMERA_ELEMENTS[SessionFile::CAMERA_VALUES] = 
+    { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14 };
+
+enum RecordFlags
+{
+    CUTAWAY_ENABLE  = 1,
+    CUTAWAY_VISIBLE = 2,
+    ANIM_PLAYING    = 4
+};
+
+const int SessionFile::FRAMES_PER_KEY;
+const int SessionFile::CAMERA_VALUES;
+
+SessionFile::SessionFile()
+{
+    _data = 0;
+    _header = 0;
+    _records = 0;
+    _keys = 0;
+    _buckets = 0;
+}
+
+SessionFile::~SessionFile()
+{
+    close();
+}
+
+bool SessionFile::open( const QString& filename )
+{
+    close();
+
+    _file.setFileName(filename);
+    if (!_file.open(QIODevice::ReadOnly))
+    {
+        qWarning("SessionFile::open: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    qint64 size = _file.size();
+    if (size < (qint64)sizeof(Header))
+    {
+        qWarning("SessionFile::open: %s is too short", qPrintable(filename));
+        _file.close();
+        return false;
+    }
+
+    _data = _file.map(0, size);
+    if (!_data)
+    {
+        qWarning("SessionFile::open: could not map %s", qPrintable(filename));
+        _file.close();
+        return false;
+    }
+
+    const Header* header = (const Header*)_data;
+    bool valid = memcmp(header->magic, SESSION_FILE_MAGIC, 4) == 0 &&
+                 header->version == SESSION_FILE_VERSION &&
+                 header->header_size == (int)sizeof(Header) &&
+                 header->record_size == (int)sizeof(Record) &&
+                 header->frames_per_key == FRAMES_PER_KEY &&
+                 header->num_frames >= 0 && header->num_buckets >= 0 &&
+                 header->num_keys == (header->num_frames + FRAMES_PER_KEY - 1) / FRAMES_PER_KEY &&
+                 header->keys_offset == (qint64)sizeof(Header) + 
+                                        (qint64)header->num_frames * sizeof(Record) &&
+                 header->buckets_offset == header->keys_offset + 
+                                           (qint64)header->num_keys * CAMERA_VALUES * sizeof(double) &&
+                 header->buckets_offset + (qint64)header->num_buckets * sizeof(int) <= size;
+
+    // frameAtTime indexes the records with the buckets.
+    const int* buckets = (const int*)(_data + header->buckets_offset);
+    for (int i = 0; valid && i < header->num_buckets; i++)
+        valid = buckets[i] >= 0 && buckets[i] <= header->num_frames;
+
+    if (!valid)
+    {
+        if (memcmp(header->magic, SESSION_FILE_MAGIC, 4) == 0 &&
+            header->version != SESSION_FILE_VERSION)
+        {
+            qWarning("Obsolete file version %d (current is %d)", header->version, 
+                     SESSION_FILE_VERSION);
+        }
+        else
+        {
+            qWarning("SessionFile::open: %s is not a valid session file", 
+                     qPrintable(filename));
+        }
+        _file.unmap((uchar*)_data);
+        _file.close();
+        _data = 0;
+        return false;
+    }
+
+    _header = header;
+    _records = (const Record*)(_data + sizeof(Header));
+    _keys = (const double*)(_data + header->keys_offset);
+    _buckets = buckets;
+
+    return true;
+}
+
+void SessionFile::close()
+{
+    if (_data)
+        _file.unmap((uchar*)_data);
+    if (_file.isOpen())
+        _file.close();
+
+    _data = 0;
+    _header = 0;
+    _records = 0;
+    _keys = 0;
+    _buckets = 0;
+}
+
+const SessionFile::Record* SessionFile::record( int which ) const
+{
+    assert(_header && which >= 0 && which < _header->num_frames);
+    return _records + which;
+}
+
+float SessionFile::frameTime( int which ) const
+{
+    return record(which)->time;
+}
+
+SessionFrame SessionFile::frame( int which ) const
+{
+    const Record* r = record(which);
+    const double* key = _keys + CAMERA_VALUES * (which / FRAMES_PER_KEY);
+
+    SessionFrame frame;
+    frame._time = r->time;
+    frame._camera_mat[3] = frame._camera_mat[7] = frame._camera_mat[11] = 0;
+    frame._camera_mat[15] = 1;
+    for (int i = 0; i < CAMERA_VALUES; i++)
+        frame._camera_mat[CAMERA_ELEMENTS[i]] = key[i] + r->camera_delta[i];
+    frame._active_partition = r->active_partition;
+    frame._cutaway_angle = r->cutaway_angle;
+    frame._cutaway_depth = r->cutaway_depth;
+    frame._cutaway_enable = (r->flags & CUTAWAY_ENABLE) != 0;
+    frame._cutaway_visible = (r->flags & CUTAWAY_VISIBLE) != 0;
+    frame._anim_playing = (r->flags & ANIM_PLAYING) != 0;
+    return frame;
+}
+
+int SessionFile::frameAtTime( float time ) const
+{
+    if (!_header || _header->num_frames == 0)
+        return 0;
+
+    int which = 0;
+    if (_header->num_buckets > 0 && _header->bucket_width > 0)
+    {
+        int bucket = (int)floorf(time / _header->bucket_width);
+        if (bucket >= _header->num_buckets)
+            return _header->num_frames - 1;
+        if (bucket > 0)
+            which = _buckets[bucket];
+    }
+
+    // The bucket gives the first frame at or after the start of the 
+    // bucket, so step back once and then forward within the bucket.
+    if (which > 0 && which >= _header->num_frames)
+        which = _header->num_frames - 1;
+    while (which > 0 && _records[which].time > time)
+        which--;
+    while (which + 1 < _header->num_frames && _records[which + 1].time <= time)
+        which++;
+    return which;
+}
+
+bool SessionFile::isSessionFile( const QString& filename )
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    char magic[4];
+    return file.read(magic, 4) == 4 && memcmp(magic, SESSION_FILE_MAGIC, 4) == 0;
+}
+
+bool SessionFile::write( const QString& filename, const SessionFrame* frames,
+                         int num_frames )
+{
+    SessionFileWriter writer;
+    if (!writer.open(filename))
+        return false;
+
+    for (int i = 0; i < num_frames; i++)
+        writer.append(frames[i]);
+
+    return writer.close();
+}
+
+SessionFileWriter::SessionFileWriter()
+{
+    _failed = false;
+}
+
+SessionFileWriter::~SessionFileWriter()
+{
+    if (isOpen())
+        close();
+}
+
+bool SessionFileWriter::open( const QString& filename )
+{
+    _file.setFileName(filename);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("SessionFileWriter::open: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    _times.clear();
+    _keys.clear();
+    _failed = false;
+
+    // Placeholder, rewritten by close().
+    SessionFile::Header header;
+    memset(&header, 0, sizeof(header));
+    if (_file.write((const char*)&header, sizeof(header)) != sizeof(header))
+        _failed = true;
+
+    return !_failed;
+}
+
+bool SessionFileWriter::append( const SessionFrame& frame )
+{
+    assert(isOpen());
+
+    int which = _times.size();
+    if (which % SessionFile::FRAMES_PER_KEY == 0)
+    {
+        for (int i = 0; i < SessionFile::CAMERA_VALUES; i++)
+            _keys.append(frame._camera_mat[CAMERA_ELEMENTS[i]]);
+    }
+    const double* key = _keys.data() + _keys.size() - SessionFile::CAMERA_VALUES;
+
+    SessionFile::Record record;
+    memset(&record, 0, sizeof(record));
+    record.time = frame._time;
+    for (int i = 0; i < SessionFile::CAMERA_VALUES; i++)
+    {
+        record.camera_delta[i] = 
+            (float)(frame._camera_mat[CAMERA_ELEMENTS[i]] - key[i]);
+    }
+    record.cutaway_angle = frame._cutaway_angle;
+    record.cutaway_depth = frame._cutaway_depth;
+    record.active_partition = (short)frame._active_partition;
+    record.flags = (frame._cutaway_enable ? CUTAWAY_ENABLE : 0) |
+                   (frame._cutaway_visible ? CUTAWAY_VISIBLE : 0) |
+                   (frame._anim_playing ? ANIM_PLAYING : 0);
+
+    if (_file.write((const char*)&record, sizeof(record)) != sizeof(record))
+        _failed = true;
+
+    _times.append(frame._time);
+    return !_failed;
+}
+
+bool SessionFileWriter::close()
+{
+    assert(isOpen());
+
+    SessionFile::Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SESSION_FILE_MAGIC, 4);
+    header.version = SESSION_FILE_VERSION;
+    header.header_size = sizeof(SessionFile::Header);
+    header.record_size = sizeof(SessionFile::Record);
+    header.frames_per_key = SessionFile::FRAMES_PER_KEY;
+    header.num_frames = _times.size();
+    header.num_keys = _keys.size() / SessionFile::CAMERA_VALUES;
+    header.length = _times.isEmpty() ? 0 : _times.last();
+
+    // One bucket per average frame interval, so a lookup scans about one
+    // frame unless the recording rate varied a lot.
+    QVector<int> buckets;
+    if (header.num_frames > 1 && header.length > 0)
+    {
+        int num_buckets = header.num_frames + 1;
+        header.bucket_width = header.length / header.num_frames;
+        buckets.resize(num_buckets);
+
+        int which = 0;
+        for (int b = 0; b < num_buckets; b++)
+        {
+            float start = b * header.bucket_width;
+            while (which < header.num_frames && _times[which] < start)
+                which++;
+            buckets[b] = which;
+        }
+    }
+    header.num_buckets = buckets.size();
+
+    header.keys_offset = sizeof(SessionFile::Header) + 
+                         (qint64)header.num_frames * sizeof(SessionFile::Record);
+    header.buckets_offset = header.keys_offset + 
+                            (qint64)_keys.size() * sizeof(double);
+
+    qint64 keys_size = _keys.size() * sizeof(double);
+    qint64 buckets_size = buckets.size() * sizeof(int);
+    if (_file.write((const char*)_keys.data(), keys_size) != keys_size ||
+        _file.write((const char*)buckets.data(), buckets_size) != buckets_size ||
+        !_file.seek(0) ||
+        _file.write((const char*)&header, sizeof(header)) != sizeof(header))
+    {
+        _failed = true;
+    }
+
+    _file.close();
+    _times.clear();
+    _keys.clear();
+
+    if (_failed)
+    {
+        qWarning("SessionFileWriter::close: could not write %s", 
+                 qPrintable(_file.fileName()));
+    }
+    return !_failed;
+}
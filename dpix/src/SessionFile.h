@@ -0,0 +1,138 @@
+/*****************************************************************************\
+
+SessionFile.h
+Copyright (c) 2009 Forrester Cole
+
+Binary session recordings (.dpsb). A session file is a fixed header, one
+fixed-size record per frame, and two tables written when the file is 
+closed:
+
+  header    magic "DPSB", version, counts, and the offsets of the tables
+  records   time, camera matrix as float deltas from the block's key 
+            matrix, and the cutaway, partition and animation state
+            (64 bytes)
+  keys      the double precision camera matrix of the first frame of 
+            every block of FRAMES_PER_KEY frames
+  buckets   for time bucket b, the first frame with time >= b * width
+
+The camera matrix is a modelview matrix, whose bottom row is always 
+(0 0 0 1), so only the top three rows are stored. The deltas keep the
+precision of the double matrix for cameras far from the origin; they do
+not make the record smaller.
+
+Any frame can be decoded from its record and one key, and the frame at a
+given time is found from its bucket with a short forward scan, so 
+playback can map the file and read frames lazily. All values are stored
+in the byte order of the machine that wrote the file.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SESSION_FILE_H_
+#define SESSION_FILE_H_
+
+#include "SessionFrame.h"
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+class SessionFile
+{
+public:
+    static const int FRAMES_PER_KEY = 64;
+    // The top three rows of the column-major camera matrix.
+    static const int CAMERA_VALUES = 12;
+
+    struct Header
+    {
+        char   magic[4];
+        int    version;
+        int    header_size;
+        int    record_size;
+        int    frames_per_key;
+        int    num_frames;
+        int    num_keys;
+        int    num_buckets;
+        float  length;
+        float  bucket_width;
+        qint64 keys_offset;
+        qint64 buckets_offset;
+    };
+
+    struct Record
+    {
+        float          time;
+        float          camera_delta[CAMERA_VALUES];
+        float          cutaway_angle;
+        float          cutaway_depth;
+        short          active_partition;
+        unsigned char  flags;
+        unsigned char  padding;
+    };
+
+public:
+    SessionFile();
+    ~SessionFile();
+
+    // Maps the file. Returns false (with a warning) if it is not a valid
+    // session file.
+    bool open( const QString& filename );
+    void close();
+
+    bool    isOpen() const { return _header != 0; }
+    QString filename() const { return _file.fileName(); }
+
+    int     numFrames() const { return _header ? _header->num_frames : 0; }
+    float   length() const { return _header ? _header->length : 0; }
+
+    SessionFrame frame( int which ) const;
+    float        frameTime( int which ) const;
+
+    // The last frame with time <= time (0 if time is before the first).
+    int          frameAtTime( float time ) const;
+
+    // True if filename starts with the session file magic.
+    static bool  isSessionFile( const QString& filename );
+
+    // Writes frames to filename in one pass.
+    static bool  write( const QString& filename, const SessionFrame* frames, 
+                        int num_frames );
+
+protected:
+    const Record* record( int which ) const;
+
+protected:
+    QFile         _file;
+    const uchar*  _data;
+    const Header* _header;
+    const Record* _records;
+    const double* _keys;
+    const int*    _buckets;
+};
+
+// Writes a session file a frame at a time, e.g. while recording. Only the
+// frame times are kept in memory until close().
+class SessionFileWriter
+{
+public:
+    SessionFileWriter();
+    ~SessionFileWriter();
+
+    bool open( const QString& filename );
+    bool append( const SessionFrame& frame );
+    bool close();
+
+    bool isOpen() const { return _file.isOpen(); }
+    int  numFrames() const { return _times.size(); }
+
+protected:
+    QFile           _file;
+    QVector<float>  _times;
+    QVector<double> _keys;
+    bool            _failed;
+};
+
+#endif // SESSION_FILE_H_
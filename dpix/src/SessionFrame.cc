@@ -0,0 +1,72 @@
+/*****************************************************************************\
+
+SessionFrame.cc
+Copyright (c) 2009 Forrester Cole
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "SessionFrame.h"
+#include <QDomDocument>
+#include <QDomText>
+#include <QString>
+#include <QTextStream>
+#include <assert.h>
+
+SessionFrame::SessionFrame()
+{
+    _time = 0;
+    _active_partition = 0;
+    _cutaway_angle = 0;
+    _cutaway_depth = 0;
+    _cutaway_enable = false;
+    _cutaway_visible = false;
+    _anim_playing = false;
+}
+
+SessionFrame::~SessionFrame()
+{
+}
+
+void SessionFrame::load( const QDomElement& element )
+{
+	QDomElement t = element.firstChildElement("time");
+	assert(!t.isNull());
+	_time = t.text().toFloat();
+
+	QDomElement cam = element.firstChildElement("camera_mat");
+	assert(!cam.isNull());
+
+	QString es = cam.text();
+	QTextStream stream(&es);
+
+	stream	>> _camera_mat[0] >> _camera_mat[4] >> _camera_mat[8] >> _camera_mat[12]
+			>> _camera_mat[1] >> _camera_mat[5] >> _camera_mat[9] >> _camera_mat[13]
+			>> _camera_mat[2] >> _camera_mat[6] >> _camera_mat[10] >> _camera_mat[14]
+			>> _camera_mat[3] >> _camera_mat[7] >> _camera_mat[11] >> _camera_mat[15];	
+}
+
+void SessionFrame::save( QDomDocument& doc, QDomElement& element )
+{
+	QDomElement t = doc.createElement("time");
+	QDomText ttext = doc.createTextNode(QString("%1").arg(_time) );
+
+	element.appendChild(t);
+	t.appendChild(ttext);
+
+	QDomElement cam = doc.createElement("camera_mat");
+	QString cam_string;
+	QTextStream stream(&cam_string);
+	
+	stream	<< "\n" << _camera_mat[0] << " " << _camera_mat[4] << " " << _camera_mat[8] << " " << _camera_mat[12]
+			<< "\n" << _camera_mat[1] << " " << _camera_mat[5] << " " << _camera_mat[9] << " " << _camera_mat[13]
+			<< "\n" << _camera_mat[2] << " " << _camera_mat[6] << " " << _camera_mat[10] << " " << _camera_mat[14]
+			<< "\n" << _camera_mat[3] << " " << _camera_mat[7] << " " << _camera_mat[11] << " " << _camera_mat[15] 
+			<< "\n";
+
+	QDomText camtext = doc.createTextNode(cam_string);
+	element.appendChild(cam);
+	cam.appendChild(camtext);
+}
@@ -0,0 +1,40 @@
+/*****************************************************************************\
+
+SessionFrame.h
+Copyright (c) 2009 Forrester Cole
+
+One recorded frame of an editing session. Kept apart from Session so that
+tools without a user interface (e.g., dpix-batch) can read session files.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef SESSION_FRAME_H_
+#define SESSION_FRAME_H_
+
+#include "XForm.h"
+
+#include <QDomElement>
+
+class SessionFrame
+{
+public:
+    SessionFrame();
+    ~SessionFrame();
+	void load( const QDomElement& element );
+	void save( QDomDocument& doc, QDomElement& element );
+
+public:
+	float	_time;
+	xform	_camera_mat;
+	int     _active_partition;
+	float   _cutaway_angle;
+	float	_cutaway_depth;
+	bool	_cutaway_enable;
+	bool	_cutaway_visible;
+	bool	_anim_playing;
+};
+
+#endif // SESSION_FRAME_H_
@@ -21,6 +21,8 @@ See the COPYING file for details.
 #include "NPRRenderer.h"
 #include "NPRSettings.h"
 #include "GQShaderManager.h"
+#include "GQStats.h"
+#include "GQSampler.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,6 +36,12 @@ void printUsage(const char *myname)
 
     fprintf(stderr, " options: -h | --help   : print this message\n");
     fprintf(stderr, "        : -saveandquit <filename> : save one screen shot and quit\n");
+    fprintf(stderr, "        : -stats <basename>  : record a performance trace and save it on exit,\n");
+    fprintf(stderr, "                               with per-frame timers and percentiles\n");
+    fprintf(stderr, "        : -profile <filename> : sample the CPU from startup and save the\n");
+    fprintf(stderr, "                                collapsed stacks on exit, for flame graphs\n");
+    fprintf(stderr, "        : -profilerate <hz>   : samples per second of CPU time (default %d)\n",
+            (int)GQSampler::DEFAULT_FREQUENCY);
 
     fprintf(stderr, "\n        : DEBUGGING OPTIONS:\n");
     fprintf(stderr, "        : -nolines      : turn off line drawing\n");
@@ -74,6 +82,9 @@ int main( int argc, char** argv )
 {
     QString scene_name;
     QString save_and_quit_file;
+    QString stats_basename;
+    QString profile_file;
+    int profile_rate = GQSampler::DEFAULT_FREQUENCY;
 
     QApplication app(argc, argv);
     QDir shaders_dir = findShadersDirectory(app.applicationDirPath());
@@ -106,6 +117,24 @@ int main( int argc, char** argv )
                 printUsage(argv[0]);
             save_and_quit_file = arguments[i];
         }
+        else if ( arg == "-stats" )
+        {
+            if (++i >= arguments.size())
+                printUsage(argv[0]);
+            stats_basename = arguments[i];
+        }
+        else if ( arg == "-profile" )
+        {
+            if (++i >= arguments.size())
+                printUsage(argv[0]);
+            profile_file = arguments[i];
+        }
+        else if ( arg == "-profilerate" )
+        {
+            if (++i >= arguments.size())
+                printUsage(argv[0]);
+            profile_rate = arguments[i].toInt();
+        }
         else if ( arg == "-nolines" )
         {
             NPRSettings::instance().set(NPR_ENABLE_LINES, false);
@@ -116,14 +145,31 @@ int main( int argc, char** argv )
 
 
     MainWindow window;
+    // The snapshot is taken as soon as init returns, so load in the foreground.
+    window.setLoadInBackground(save_and_quit_file.isEmpty());
+    if (!stats_basename.isEmpty())
+        GQStats::instance().beginTrace();
+    // Started before init, so the profile covers loading the scene.
+    if (!profile_file.isEmpty() && !GQSampler::instance().start(profile_rate))
+        profile_file = QString();
+
     window.init( working_dir, scene_name );	
     window.show();
 
+    int result = 0;
     if (!save_and_quit_file.isEmpty())
-    {
         window.getGLViewer()->saveSnapshot(save_and_quit_file);
-        return 0;
+    else
+        result = app.exec();
+
+    if (!stats_basename.isEmpty() && !GQStats::instance().saveStats(stats_basename))
+        result = 1;
+    if (!profile_file.isEmpty())
+    {
+        GQSampler::instance().stop();
+        if (!GQSampler::instance().save(profile_file))
+            result = 1;
     }
 
-    return app.exec();
+    return result;
 }
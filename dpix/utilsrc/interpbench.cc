@@ -0,0 +1,200 @@
+/*****************************************************************************\
+
+interpbench.cc
+Copyright (c) 2009 Forrester Cole
+
+Measures FrameInterpolator on synthetic sessions at 1080p and 4K. A 
+session is a sequence of key frames with irregular time stamps, like a 
+replay that renders at a varying rate; it is resampled to a fixed frame 
+rate exactly as FrameExporter does. Each size is run with one thread and 
+with all threads, and blend() is checked against blendReference().
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "FrameInterpolator.h"
+#include "GQImage.h"
+#include "GQProfiler.h"
+
+QString usage = "usage: interpbench [-keys n] [-fps f] [-size WxH]\n";
+
+struct SessionSize
+{
+    const char* name;
+    int         width;
+    int         height;
+};
+
+// Key frames are generated on the fly from a few distinct images, so the
+// benchmark does not need gigabytes of memory.
+const int NUM_DISTINCT_KEYS = 3;
+
+void makeKeyFrame( int width, int height, int seed, GQImage& image )
+{
+    image.resize(width, height, 4);
+    srand(seed);
+    unsigned char* raster = image.raster();
+    for (int i = 0; i < width * height * 4; i++)
+        raster[i] = rand() & 0xff;
+}
+
+// Replays num_keys key frames rendered at about 20 fps with some jitter 
+// and returns the number of output frames. Times only the blends, in 
+// nanoseconds, since a single blend can take less than a millisecond.
+int runSession( const GQImage* keys, int num_keys, float fps, float& blend_ms )
+{
+    FrameInterpolator interpolator(fps);
+    GQImage output;
+
+    srand(1000);
+    float time = 0;
+    int num_outputs_total = 0;
+    quint64 elapsed = 0;
+    for (int k = 0; k < num_keys; k++)
+    {
+        int first, num_outputs;
+        interpolator.addKeyFrame(time, first, num_outputs);
+
+        const GQImage& current = keys[k % NUM_DISTINCT_KEYS];
+        const GQImage& previous = keys[(k + NUM_DISTINCT_KEYS - 1) % NUM_DISTINCT_KEYS];
+        quint64 start = GQProfiler::ticks();
+        for (int i = 0; i < num_outputs; i++)
+        {
+            int weight = (k == 0) ? (int)FrameInterpolator::MAX_WEIGHT 
+                                  : interpolator.weight(first + i);
+            FrameInterpolator::blend(previous, current, weight, output);
+        }
+        elapsed += GQProfiler::ticks() - start;
+        num_outputs_total += num_outputs;
+
+        time += 0.03f + 0.04f * (rand() / (float)RAND_MAX);
+    }
+
+    blend_ms = (float)(elapsed * 1e-6);
+    return num_outputs_total;
+}
+
+bool checkBlend( const GQImage& a, const GQImage& b )
+{
+    GQImage fast_result, reference_result;
+    int weights[] = { 0, 1, 77, 128, 200, 255, 256 };
+    for (int i = 0; i < (int)(sizeof(weights) / sizeof(int)); i++)
+    {
+        FrameInterpolator::blend(a, b, weights[i], fast_result);
+        FrameInterpolator::blendReference(a, b, weights[i], reference_result);
+        if (memcmp(fast_result.raster(), reference_result.raster(), 
+                   a.width() * a.height() * a.chan()) != 0)
+        {
+            printf("blend differs from reference at weight %d\n", weights[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+void setNumThreads( int num_threads )
+{
+#ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    int num_keys = 200;
+    float fps = 29.97f;
+    QList<SessionSize> sizes;
+
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        if (arguments[i] == "-keys" && i+1 < arguments.size())
+            num_keys = arguments[++i].toInt();
+        else if (arguments[i] == "-fps" && i+1 < arguments.size())
+            fps = arguments[++i].toFloat();
+        else if (arguments[i] == "-size" && i+1 < arguments.size())
+        {
+            QStringList size = arguments[++i].split('x');
+            if (size.size() != 2)
+            {
+                printf("%s", qPrintable(usage));
+                return 1;
+            }
+            SessionSize custom = { "custom", size[0].toInt(), size[1].toInt() };
+            sizes.append(custom);
+        }
+        else
+        {
+            printf("%s", qPrintable(usage));
+            return 0;
+        }
+    }
+
+    if (sizes.isEmpty())
+    {
+        SessionSize hd = { "1080p", 1920, 1080 };
+        SessionSize uhd = { "4K", 3840, 2160 };
+        sizes << hd << uhd;
+    }
+
+    if (num_keys <= 1 || fps <= 0)
+    {
+        printf("%s", qPrintable(usage));
+        return 1;
+    }
+
+    int max_threads = FrameInterpolator::maxThreads();
+    printf("%d key frames resampled to %.2f fps, up to %d threads\n", 
+           num_keys, fps, max_threads);
+
+    bool all_match = true;
+    for (int s = 0; s < sizes.size(); s++)
+    {
+        const SessionSize& size = sizes[s];
+        GQImage keys[NUM_DISTINCT_KEYS];
+        for (int k = 0; k < NUM_DISTINCT_KEYS; k++)
+            makeKeyFrame(size.width, size.height, k + 1, keys[k]);
+
+        bool match = checkBlend(keys[0], keys[1]);
+        all_match = all_match && match;
+
+        int thread_counts[2] = { 1, max_threads };
+        int num_runs = (max_threads > 1) ? 2 : 1;
+        for (int t = 0; t < num_runs; t++)
+        {
+            setNumThreads(thread_counts[t]);
+
+            float blend_ms;
+            int num_outputs = runSession(keys, num_keys, fps, blend_ms);
+            float ms_per_frame = blend_ms / qMax(num_outputs, 1);
+            float megabytes = size.width * size.height * 4 * 3 / (1024.0f * 1024.0f);
+
+            printf("%-6s %dx%d, %2d threads: %d output frames, %7.2f ms/frame, "
+                   "%7.1f fps, %6.0f MB/s%s\n",
+                   size.name, size.width, size.height, thread_counts[t],
+                   num_outputs, ms_per_frame, 
+                   1000.0f / qMax(ms_per_frame, 1e-3f),
+                   megabytes * 1000.0f / qMax(ms_per_frame, 1e-3f),
+                   match ? "" : " MISMATCH");
+        }
+        setNumThreads(max_threads);
+    }
+
+    return all_match ? 0 : 1;
+}
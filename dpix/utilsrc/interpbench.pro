@@ -0,0 +1,28 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+
+TEMPLATE = app
+TARGET = interpbench
+CONFIG += console
+
+unix {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+    QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
+}
+# clock_gettime, for GQProfiler.
+unix:!macx: LIBS += -lrt
+
+INCLUDEPATH += ../src ../../libgq/include
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+
+# Input
+HEADERS += ../src/FrameInterpolator.h
+SOURCES += interpbench.cc ../src/FrameInterpolator.cc
@@ -0,0 +1,236 @@
+/*****************************************************************************\
+
+sessiontest.cc
+Copyright (c) 2009 Forrester Cole
+
+Checks the binary session format (SessionFile). A synthetic session is
+written to a .dpsb file and read back. Every field of every frame must
+survive the round trip, and the camera must keep close to double
+precision even though the camera sits far from the origin. frameAtTime
+is then checked against a linear search at random times, at the recorded
+times themselves and outside the session, and timed.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "SessionFile.h"
+#include "GQProfiler.h"
+
+QString usage = "usage: sessiontest [-frames n] [-seeks n] [-keep filename]\n";
+
+// Far enough from the origin that a float matrix would lose about 1e-3.
+const double CAMERA_OFFSET = 1e4;
+const double CAMERA_TOLERANCE = 1e-5;
+
+// A camera walking slowly through the scene at an irregular frame rate.
+void makeSession( int num_frames, QVector<SessionFrame>& frames )
+{
+    frames.resize(num_frames);
+    srand(1000);
+    float time = 0;
+    for (int i = 0; i < num_frames; i++)
+    {
+        SessionFrame& frame = frames[i];
+        frame._time = time;
+        frame._camera_mat = xform::rot(1e-5 * i, 0.0, 1.0, 0.0) *
+                            xform::trans(CAMERA_OFFSET + 0.01 * i,
+                                         -CAMERA_OFFSET, 0.5 * sin(0.01 * i));
+        frame._active_partition = rand() % 4;
+        frame._cutaway_angle = rand() / (float)RAND_MAX;
+        frame._cutaway_depth = rand() / (float)RAND_MAX;
+        frame._cutaway_enable = (rand() % 2) != 0;
+        frame._cutaway_visible = (rand() % 2) != 0;
+        frame._anim_playing = (rand() % 2) != 0;
+
+        // Mostly display rate, with the occasional stall.
+        time += (rand() % 50 == 0) ? 0.5f : 0.01f + 0.04f * (rand() / (float)RAND_MAX);
+    }
+}
+
+bool checkFrames( const QVector<SessionFrame>& frames, const SessionFile& file )
+{
+    if (file.numFrames() != frames.size() ||
+        file.length() != frames.last()._time)
+    {
+        printf("read %d frames, %g s; wrote %d frames, %g s\n",
+               file.numFrames(), file.length(), frames.size(),
+               frames.last()._time);
+        return false;
+    }
+
+    double max_error = 0;
+    for (int i = 0; i < frames.size(); i++)
+    {
+        const SessionFrame& a = frames[i];
+        SessionFrame b = file.frame(i);
+
+        if (a._time != b._time || file.frameTime(i) != a._time ||
+            a._active_partition != b._active_partition ||
+            a._cutaway_angle != b._cutaway_angle ||
+            a._cutaway_depth != b._cutaway_depth ||
+            a._cutaway_enable != b._cutaway_enable ||
+            a._cutaway_visible != b._cutaway_visible ||
+            a._anim_playing != b._anim_playing)
+        {
+            printf("frame %d differs\n", i);
+            return false;
+        }
+
+        for (int j = 0; j < 16; j++)
+            max_error = qMax(max_error, fabs(a._camera_mat[j] - b._camera_mat[j]));
+    }
+
+    printf("round trip: %d frames, max camera error %g\n", frames.size(), max_error);
+    if (max_error > CAMERA_TOLERANCE)
+    {
+        printf("camera error is over %g\n", CAMERA_TOLERANCE);
+        return false;
+    }
+    return true;
+}
+
+// The last frame with time <= time, or 0, by linear search.
+int frameAtTimeReference( const QVector<SessionFrame>& frames, float time )
+{
+    int which = 0;
+    while (which + 1 < frames.size() && frames[which + 1]._time <= time)
+        which++;
+    return which;
+}
+
+bool checkSeek( const QVector<SessionFrame>& frames, const SessionFile& file,
+                int num_seeks )
+{
+    float length = frames.last()._time;
+
+    QVector<float> times;
+    times << -1.0f << 0.0f << length << length + 1.0f;
+    for (int i = 0; i < frames.size(); i += qMax(1, frames.size() / 1000))
+        times << frames[i]._time;
+    for (int i = 0; i < 1000; i++)
+        times << length * (rand() / (float)RAND_MAX);
+
+    for (int i = 0; i < times.size(); i++)
+    {
+        int expected = frameAtTimeReference(frames, times[i]);
+        int found = file.frameAtTime(times[i]);
+        if (found != expected)
+        {
+            printf("frameAtTime(%g) is %d, expected %d\n", times[i], found,
+                   expected);
+            return false;
+        }
+    }
+
+    QVector<float> seek_times(num_seeks);
+    for (int i = 0; i < num_seeks; i++)
+        seek_times[i] = length * (rand() / (float)RAND_MAX);
+
+    quint64 start = GQProfiler::ticks();
+    qint64 sum = 0;
+    for (int i = 0; i < num_seeks; i++)
+        sum += file.frameAtTime(seek_times[i]);
+    quint64 elapsed = GQProfiler::ticks() - start;
+
+    printf("seek: %d lookups checked, %.0f ns per seek (checksum %lld)\n",
+           times.size(), (double)elapsed / qMax(num_seeks, 1), (long long)sum);
+    return true;
+}
+
+// A file cut short must be rejected rather than read past its end.
+bool checkTruncated( const QString& filename )
+{
+    QString truncated_name = filename + ".truncated";
+    QFile source(filename);
+    QFile truncated(truncated_name);
+    if (!source.open(QIODevice::ReadOnly) ||
+        !truncated.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        printf("could not copy %s\n", qPrintable(filename));
+        return false;
+    }
+    truncated.write(source.read(source.size() / 2));
+    truncated.close();
+
+    SessionFile file;
+    bool opened = file.open(truncated_name);
+    file.close();
+    QFile::remove(truncated_name);
+
+    if (opened)
+        printf("truncated file was accepted\n");
+    return !opened;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    int num_frames = 100000;
+    int num_seeks = 1000000;
+    QString keep_filename;
+
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        if (arguments[i] == "-frames" && i+1 < arguments.size())
+            num_frames = arguments[++i].toInt();
+        else if (arguments[i] == "-seeks" && i+1 < arguments.size())
+            num_seeks = arguments[++i].toInt();
+        else if (arguments[i] == "-keep" && i+1 < arguments.size())
+            keep_filename = arguments[++i];
+        else
+        {
+            printf("%s", qPrintable(usage));
+            return 0;
+        }
+    }
+
+    if (num_frames <= 1 || num_seeks < 0)
+    {
+        printf("%s", qPrintable(usage));
+        return 1;
+    }
+
+    QString filename = keep_filename.isEmpty() ?
+        QDir::temp().filePath("sessiontest.dpsb") : keep_filename;
+
+    QVector<SessionFrame> frames;
+    makeSession(num_frames, frames);
+
+    if (!SessionFile::write(filename, frames.data(), frames.size()))
+    {
+        printf("could not write %s\n", qPrintable(filename));
+        return 1;
+    }
+    qint64 size = QFile(filename).size();
+    printf("%s: %lld bytes, %.1f bytes per frame\n", qPrintable(filename),
+           (long long)size, size / (double)num_frames);
+
+    bool success = SessionFile::isSessionFile(filename);
+    SessionFile file;
+    success = success && file.open(filename);
+    success = success && checkFrames(frames, file);
+    success = success && checkSeek(frames, file, num_seeks);
+    file.close();
+    success = success && checkTruncated(filename);
+
+    if (keep_filename.isEmpty())
+        QFile::remove(filename);
+
+    printf("%s\n", success ? "passed" : "FAILED");
+    return success ? 0 : 1;
+}
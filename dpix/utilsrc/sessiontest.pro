@@ -0,0 +1,26 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+
+QT -= gui
+QT += xml
+
+TEMPLATE = app
+TARGET = sessiontest
+CONFIG += console
+
+# clock_gettime, for GQProfiler.
+unix:!macx: LIBS += -lrt
+
+INCLUDEPATH += ../src ../../libgq/include ../../libcda/include
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+
+# Input
+HEADERS += ../src/SessionFrame.h ../src/SessionFile.h
+SOURCES += sessiontest.cc ../src/SessionFrame.cc ../src/SessionFile.cc
@@ -0,0 +1,108 @@
+/*****************************************************************************\
+
+streamsink.cc
+Copyright (c) 2009 Forrester Cole
+
+Stand-in for ffmpeg when testing streamed movie export. Accepts the same
+command line that Session passes to ffmpeg, reads the raw rgb24 frames from
+standard input, and reports the frame count and adler32 checksum of the
+stream, which should match the numbers FrameExporter prints. The report is
+also written to the output file (the last argument). To use it, set the
+ffmpeg command in the session settings to the streamsink executable.
+
+dpix is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+#include <QFile>
+#include <QTextStream>
+#include <QTime>
+#include <QVector>
+
+#include <stdio.h>
+#include <zlib.h>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+QString usage = "usage: streamsink [ffmpeg options] -s WxH [-i -] [ffmpeg options] output\n";
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    int width = 0, height = 0;
+    for (int i = 1; i < arguments.size() - 1; i++)
+    {
+        if (arguments[i] == "-s")
+        {
+            QStringList size = arguments[i+1].split('x');
+            if (size.size() == 2)
+            {
+                width = size[0].toInt();
+                height = size[1].toInt();
+            }
+        }
+    }
+
+    if (width <= 0 || height <= 0 || arguments.size() < 2)
+    {
+        fprintf(stderr, "%s", qPrintable(usage));
+        return 1;
+    }
+    QString output_filename = arguments.last();
+
+#ifdef WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+    int frame_size = width * height * 3;
+    QVector<unsigned char> frame(frame_size);
+    unsigned long checksum = adler32(0L, Z_NULL, 0);
+    double total_bytes = 0;
+    int num_frames = 0;
+
+    QTime timer;
+    timer.start();
+
+    size_t read;
+    while ((read = fread(frame.data(), 1, frame_size, stdin)) > 0)
+    {
+        checksum = adler32(checksum, frame.data(), read);
+        total_bytes += read;
+        if ((int)read == frame_size)
+            num_frames++;
+    }
+    float elapsed = timer.elapsed() / 1000.0f;
+
+    QString report;
+    QTextStream(&report) 
+        << "streamsink: " << num_frames << " frames of " << width << "x" << height
+        << ", " << QString::number(total_bytes / (1024.0 * 1024.0), 'f', 1) << " MB"
+        << " in " << QString::number(elapsed, 'f', 2) << " s"
+        << ", adler32 " << QString("%1").arg((qulonglong)checksum, 8, 16, QChar('0'))
+        << "\n";
+
+    bool partial = total_bytes != (double)num_frames * frame_size;
+    if (partial)
+        report += "streamsink: stream ended with a partial frame\n";
+
+    fprintf(stderr, "%s", qPrintable(report));
+
+    QFile file(output_filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        fprintf(stderr, "streamsink: could not write %s\n", qPrintable(output_filename));
+        return 1;
+    }
+    file.write(report.toAscii());
+
+    return partial ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+
+QT -= gui
+
+TEMPLATE = app
+TARGET = streamsink
+CONFIG += console
+
+# adler32 from libgq's copy of zlib, so the checksum matches FrameExporter.
+INCLUDEPATH += ../../libgq/zlib
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+
+# Input
+SOURCES += streamsink.cc
@@ -86,6 +86,9 @@ class CdaGeometry
         CdaGeometry(const QDomElement& element);
         
         void clear();
+
+        // Bytes held by the sources and index lists.
+        qint64 byteSize() const;
         
     public:
         const QString& id() const { return _id; }
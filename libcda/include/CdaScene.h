@@ -30,6 +30,31 @@ class CdaLight;
 class CdaMaterial;
 class CdaEffect;
 
+typedef enum
+{
+    CDA_LOAD_READ,          // reading the file, or unzipping it from a .kmz
+    CDA_LOAD_XML,           // building the DOM
+    CDA_LOAD_EFFECTS,
+    CDA_LOAD_MATERIALS,
+    CDA_LOAD_LIGHTS,        // lights and cameras
+    CDA_LOAD_GEOMETRIES,
+    CDA_LOAD_NODES,         // library nodes and the visual scene
+    CDA_NUM_LOAD_PHASES
+} CdaLoadPhase;
+
+// Told as each phase of a load starts and finishes, from the loading 
+// thread. A .kmz goes through the phases once for each .dae it contains.
+// phaseProgress is called at the end of each phase (done == total) and 
+// for each geometry read; returning false cancels the load.
+class CdaLoadCallback
+{
+    public:
+        virtual ~CdaLoadCallback() { }
+        virtual void phaseStarted( CdaLoadPhase phase ) = 0;
+        virtual void phaseFinished( CdaLoadPhase phase ) = 0;
+        virtual bool phaseProgress( CdaLoadPhase, int, int ) { return true; }
+};
+
 class CdaScene
 {
 public:
@@ -40,6 +65,13 @@ public:
     bool load( const QString& filename );
     static bool isColladaFile( const QString& filename );
 
+    void setLoadCallback( CdaLoadCallback* callback ) { _load_callback = callback; }
+    // The last load was cancelled by the callback.
+    bool wasLoadCancelled() const { return _load_cancelled; }
+    // Size of the COLLADA documents parsed since the last clear, after
+    // unzipping.
+    qint64 documentSize() const { return _document_size; }
+
     const CdaNode*		root() const { return _root; }
     const CdaNode*		findSceneNode(QString id) const;
     CdaNode*            getNode(int uid) const { return _node_list[uid]; }
@@ -92,6 +124,12 @@ protected:
 
     bool				parseDAE(const QByteArray& data);
 
+    void                beginLoadPhase( CdaLoadPhase phase ) 
+        { if (_load_callback) _load_callback->phaseStarted(phase); }
+    // Both return false if the load has been cancelled.
+    bool                endLoadPhase( CdaLoadPhase phase );
+    bool                loadProgress( CdaLoadPhase phase, int done, int total );
+
 protected:
     // collada scene root node
     CdaNode*				_root;
@@ -107,6 +145,10 @@ protected:
     // node list
     QList<CdaNode*>     _node_list;
 
+    CdaLoadCallback*    _load_callback;
+    bool                _load_cancelled;
+    qint64              _document_size;
+
 };
 
 #endif
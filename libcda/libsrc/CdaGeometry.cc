@@ -66,6 +66,24 @@ void CdaGeometry::clear()
     }
 }
 
+qint64 CdaGeometry::byteSize() const
+{
+    qint64 bytes = sizeof(CdaGeometry);
+    for (int i = 0; i < _sources.size(); i++) {
+        bytes += sizeof(CdaSource) + _sources[i]->capacity() * sizeof(float);
+    }
+
+    for (int i = 0; i < CDA_NUM_PRIMITIVES; i++) {
+        for (int j = 0; j < _primitives[i].size(); j++) {
+            bytes += sizeof(CdaPrimitive);
+            for (int k = 0; k < CDA_NUM_SEMANTICS; k++) {
+                bytes += _primitives[i][j].indices((CdaSourceSemantic)k).capacity() * sizeof(int);
+            }
+        }
+    }
+    return bytes;
+}
+
 CdaSource* CdaGeometry::findSource(const QString &id)
 {
     for (int i = 0; i < _sources.size(); i++) {
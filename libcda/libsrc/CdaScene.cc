@@ -32,6 +32,8 @@ See the COPYING file for details.
 CdaScene::CdaScene()
 {
     _root = NULL;
+    _load_callback = NULL;
+    _load_cancelled = false;
     clear();
 }
 
@@ -65,6 +67,8 @@ void CdaScene::clear()
 
     while (!_library_effects.isEmpty())
         delete _library_effects.takeFirst();
+
+    _document_size = 0;
 };
 
 
@@ -72,6 +76,8 @@ void CdaScene::clear()
 
 bool CdaScene::load( const QString& filename )
 {
+    _load_cancelled = false;
+
     if (filename.endsWith("kmz", Qt::CaseInsensitive))
     {
         return loadKMZ(filename);
@@ -128,6 +134,7 @@ bool CdaScene::loadKMZ(const QString& filename)
         if (name.endsWith("dae", Qt::CaseInsensitive))
         {
             // parse the dae file
+            beginLoadPhase(CDA_LOAD_READ);
             QByteArray ba = QByteArray(file_info.uncompressed_size, '0');
             unzOpenCurrentFile(uf);
             int bytes_read = unzReadCurrentFile(uf, ba.data(), file_info.uncompressed_size);
@@ -138,7 +145,12 @@ bool CdaScene::loadKMZ(const QString& filename)
             }
             unzCloseCurrentFile(uf);
 
-            parseDAE(ba);
+            if (!endLoadPhase(CDA_LOAD_READ) || 
+                (!parseDAE(ba) && _load_cancelled))
+            {
+                unzClose(uf);
+                return false;
+            }
         }
         unzGoToNextFile(uf);
     }
@@ -156,7 +168,10 @@ bool CdaScene::loadDAE(const QString& filename)
 
     qDebug("CdaScene::load: Opened %s", qPrintable(filename));
 
+    beginLoadPhase(CDA_LOAD_READ);
     QByteArray data = file.readAll();
+    if (!endLoadPhase(CDA_LOAD_READ))
+        return false;
 
     return parseDAE( data );
 }
@@ -165,6 +180,9 @@ bool CdaScene::parseDAE(const QByteArray& data)
 {    
     // open the file and read into memory
 
+    _document_size += data.size();
+
+    beginLoadPhase(CDA_LOAD_XML);
     QDomDocument doc("collada");
     QString error_str;
     int error_line;
@@ -179,10 +197,13 @@ bool CdaScene::parseDAE(const QByteArray& data)
         debug_dump.close();
         return false;
     }
+    if (!endLoadPhase(CDA_LOAD_XML))
+        return false;
 
     QDomElement doc_e = doc.documentElement();
 
     // start reading the libraries
+    beginLoadPhase(CDA_LOAD_EFFECTS);
     QDomElement lib_effects = doc_e.firstChildElement("library_effects");
     if (!lib_effects.isNull())
     {
@@ -195,9 +216,13 @@ bool CdaScene::parseDAE(const QByteArray& data)
         }
     }
 
+    if (!endLoadPhase(CDA_LOAD_EFFECTS))
+        return false;
+
     qDebug("CdaScene::load: Read %d effects", (int)_library_effects.size());
 
     // materials must be read after effects because they can include "instance_effect" nodes
+    beginLoadPhase(CDA_LOAD_MATERIALS);
     QDomElement lib_materials = doc_e.firstChildElement("library_materials");
     if (!lib_materials.isNull())
     {
@@ -210,8 +235,12 @@ bool CdaScene::parseDAE(const QByteArray& data)
         }
     }
 
+    if (!endLoadPhase(CDA_LOAD_MATERIALS))
+        return false;
+
     qDebug("CdaScene::load: Read %d materials", (int)_library_materials.size());
 
+    beginLoadPhase(CDA_LOAD_LIGHTS);
     QDomElement lib_lights = doc_e.firstChildElement("library_lights");
     if (!lib_lights.isNull())
     {
@@ -238,22 +267,39 @@ bool CdaScene::parseDAE(const QByteArray& data)
         }
     }
 
+    if (!endLoadPhase(CDA_LOAD_LIGHTS))
+        return false;
+
     qDebug("CdaScene::load: Read %d cameras", (int)_library_cameras.size());
 
+    beginLoadPhase(CDA_LOAD_GEOMETRIES);
     QDomElement lib_geometries = doc_e.firstChildElement("library_geometries");
     if (!lib_geometries.isNull())
     {
+        int num_geometries = 0;
         QDomElement geometry_e = lib_geometries.firstChildElement("geometry");
+        for (; !geometry_e.isNull(); geometry_e = geometry_e.nextSiblingElement("geometry"))
+            num_geometries++;
+
+        int geometries_read = 0;
+        geometry_e = lib_geometries.firstChildElement("geometry");
         while(!geometry_e.isNull())
         {
             CdaGeometry* new_geometry = new CdaGeometry(geometry_e);
             _library_geometries.push_back(new_geometry);
             geometry_e = geometry_e.nextSiblingElement("geometry");
+
+            if (!loadProgress(CDA_LOAD_GEOMETRIES, ++geometries_read, num_geometries))
+                return false;
         }
     }
 
+    if (!endLoadPhase(CDA_LOAD_GEOMETRIES))
+        return false;
+
     qDebug("CdaScene::load: Read %d geometries", (int)_library_geometries.size());
 
+    beginLoadPhase(CDA_LOAD_NODES);
     QDomElement lib_nodes = doc_e.firstChildElement("library_nodes");
     if (!lib_nodes.isNull())
     {
@@ -282,12 +328,28 @@ bool CdaScene::parseDAE(const QByteArray& data)
     for (int i = 0; i < _library_nodes.size(); i++) {
         traverseAndAssignUid(_library_nodes[i]);
     }
+    if (!endLoadPhase(CDA_LOAD_NODES))
+        return false;
     
     qDebug("CdaScene::load: success!\n");
 
     return true;
 }
 
+bool CdaScene::endLoadPhase( CdaLoadPhase phase )
+{
+    if (_load_callback) 
+        _load_callback->phaseFinished(phase);
+    return loadProgress(phase, 1, 1);
+}
+
+bool CdaScene::loadProgress( CdaLoadPhase phase, int done, int total )
+{
+    if (_load_callback && !_load_callback->phaseProgress(phase, done, total))
+        _load_cancelled = true;
+    return !_load_cancelled;
+}
+
 const CdaNode* CdaScene::findLibraryNode(QString id) const
 {
     for (int i = 0; i < _library_nodes.size(); i++)
@@ -0,0 +1,155 @@
+/*****************************************************************************\
+
+cdagen.cc
+Copyright (c) 2009 Forrester Cole
+
+Writes synthetic COLLADA scenes of any size, for scaling and stress tests
+of the loader and renderer. Each geometry is a grid height field with
+per-vertex normals, triangles split between the materials, feature lines
+along some grid rows and columns, crease line strips, and DPIX contours in
+the mesh <extra>. Geometries are wrapped in levels of library nodes that
+instance the level below (instance_node), and the visual scene instances
+the top level, optionally moving along animation paths (DPIX
+instance_path).
+
+The file is streamed as it is generated, so the instanced primitive count
+is limited only by disk space. A single geometry holds at most
+MAXIMUM_TRIANGLES triangles, since CdaGeometry indexes with int; larger
+scenes come from instancing.
+
+libcda is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+#include <QFile>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "cdagenerator.h"
+
+QString usage =
+    "usage: cdagen [options] <output.dae>\n"
+    "  -triangles n  : triangles in each geometry (default: 100000)\n"
+    "  -geometries n : distinct geometries (default: 1)\n"
+    "  -lines f      : fraction of grid rows and columns with feature lines (default: 0.1)\n"
+    "  -creases f    : fraction of grid columns with crease line strips (default: 0.02)\n"
+    "  -contours f   : fraction of grid rows with contours (default: 0.05)\n"
+    "  -materials n  : materials, each covering a band of every mesh (default: 1)\n"
+    "  -depth n      : levels of library node instancing (default: 0)\n"
+    "  -branching n  : instances in each level of library nodes (default: 4)\n"
+    "  -instances n  : instances in the visual scene (default: 1)\n"
+    "  -paths n      : visual scene instances that move along a path (default: 0)\n";
+
+const int   MAXIMUM_TRIANGLES = 300000000;
+
+bool generate( const QString& filename, const GeneratorSettings& settings )
+{
+    GridLayout layout = gridLayout(settings);
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        fprintf(stderr, "Could not open %s for writing.\n", qPrintable(filename));
+        return false;
+    }
+
+    ColladaWriter out(&file);
+    writeScene(out, settings, layout);
+
+    qint64 bytes = out.bytesWritten();
+    if (!out.flush() || !file.flush())
+    {
+        fprintf(stderr, "Could not write %s.\n", qPrintable(filename));
+        return false;
+    }
+
+    double leaves = settings.instances * pow((double)settings.branching, settings.depth);
+    printf("%s: %.1f MB\n", qPrintable(filename), bytes / (1024.0 * 1024.0));
+    printf("Per geometry: %d vertices, %lld triangles, %lld line segments, "
+           "%d crease strips, %lld contour segments\n",
+        layout.side * layout.side, layout.triangles(), layout.lineSegments(),
+        layout.creaseStrips(), layout.contourSegments());
+    printf("Geometries: %d, materials: %d, animation paths: %d, instances: %.0f\n",
+        settings.geometries, settings.materials, settings.paths, leaves);
+    printf("Total triangles: %.0f\n", leaves * layout.triangles());
+    printf("Total lines: %.0f\n", leaves * layout.lineSegments());
+    printf("Total contours: %.0f\n", leaves * layout.contourSegments());
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    GeneratorSettings settings;
+    settings.triangles = 100000;
+    settings.geometries = 1;
+    settings.lines = 0.1f;
+    settings.creases = 0.02f;
+    settings.contours = 0.05f;
+    settings.materials = 1;
+    settings.depth = 0;
+    settings.branching = 4;
+    settings.instances = 1;
+    settings.paths = 0;
+
+    QString filename;
+
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        const QString& arg = arguments[i];
+        bool has_value = i+1 < arguments.size();
+
+        if (arg == "-triangles" && has_value)
+            settings.triangles = arguments[++i].toInt();
+        else if (arg == "-geometries" && has_value)
+            settings.geometries = arguments[++i].toInt();
+        else if (arg == "-lines" && has_value)
+            settings.lines = arguments[++i].toFloat();
+        else if (arg == "-creases" && has_value)
+            settings.creases = arguments[++i].toFloat();
+        else if (arg == "-contours" && has_value)
+            settings.contours = arguments[++i].toFloat();
+        else if (arg == "-materials" && has_value)
+            settings.materials = arguments[++i].toInt();
+        else if (arg == "-depth" && has_value)
+            settings.depth = arguments[++i].toInt();
+        else if (arg == "-branching" && has_value)
+            settings.branching = arguments[++i].toInt();
+        else if (arg == "-instances" && has_value)
+            settings.instances = arguments[++i].toInt();
+        else if (arg == "-paths" && has_value)
+            settings.paths = arguments[++i].toInt();
+        else if (!arg.startsWith("-") && filename.isEmpty())
+            filename = arg;
+        else
+        {
+            printf("%s", qPrintable(usage));
+            return 0;
+        }
+    }
+
+    if (filename.isEmpty() ||
+        settings.triangles < 2 || settings.triangles > MAXIMUM_TRIANGLES ||
+        settings.geometries < 1 || settings.materials < 1 ||
+        settings.lines < 0.0f || settings.lines > 1.0f ||
+        settings.creases < 0.0f || settings.creases > 1.0f ||
+        settings.contours < 0.0f || settings.contours > 1.0f ||
+        settings.depth < 0 || settings.branching < 1 ||
+        settings.instances < 1 || settings.paths < 0 ||
+        settings.paths > settings.instances)
+    {
+        printf("%s", qPrintable(usage));
+        return 1;
+    }
+
+    return generate(filename, settings) ? 0 : 1;
+}
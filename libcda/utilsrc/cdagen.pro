@@ -0,0 +1,18 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+
+QT -= gui
+
+TEMPLATE = app
+TARGET = 
+CONFIG += console
+
+# Input
+HEADERS += cdagenerator.h
+SOURCES += cdagen.cc
@@ -0,0 +1,505 @@
+/*****************************************************************************\
+
+cdagenerator.h
+Copyright (c) 2009 Forrester Cole
+
+The synthetic COLLADA scenes of cdagen (see cdagen.cc for their
+contents), written to any device: cdagen streams them to a file, and
+loadbench in libnpr builds its model in memory. Include this header from
+a single source file of each tool.
+
+libcda is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _CDA_GENERATOR_H_
+#define _CDA_GENERATOR_H_
+
+#include <QIODevice>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+const int   PATH_POINTS = 64;
+const float GRID_EXTENT = 10.0f;
+const float INSTANCE_SPACING = 1.2f;
+
+// Buffered output with fast number formatting; fprintf is the bottleneck
+// at hundreds of millions of indices. The device must be open for writing
+// and outlive the writer.
+class ColladaWriter
+{
+public:
+    ColladaWriter( QIODevice* device )
+        : _device(device), _used(0), _written(0), _failed(false)
+    {
+        _buffer.resize(1 << 20);
+    }
+
+    // Writes out the buffer. Returns false if any write failed.
+    bool flush()
+    {
+        write(_buffer.constData(), _used);
+        _used = 0;
+        return !_failed;
+    }
+
+    qint64 bytesWritten() const { return _written + _used; }
+
+    ColladaWriter& operator<<( const char* string )
+    {
+        append(string, strlen(string));
+        return *this;
+    }
+
+    ColladaWriter& operator<<( const QString& string )
+    {
+        QByteArray utf8 = string.toUtf8();
+        append(utf8.constData(), utf8.size());
+        return *this;
+    }
+
+    ColladaWriter& operator<<( qint64 value )
+    {
+        char digits[24];
+        int length = 0;
+        quint64 magnitude = value < 0 ? -value : value;
+        do
+        {
+            digits[length++] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0)
+            digits[length++] = '-';
+
+        reserve(length);
+        char* end = _buffer.data() + _used;
+        _used += length;
+        while (length > 0)
+            *end++ = digits[--length];
+        return *this;
+    }
+
+    ColladaWriter& operator<<( int value ) { return *this << (qint64)value; }
+
+    ColladaWriter& operator<<( float value )
+    {
+        char text[32];
+        int length = snprintf(text, sizeof(text), "%g", value);
+        append(text, length);
+        return *this;
+    }
+
+    // An index followed by a space, the common case.
+    void index( int value )
+    {
+        *this << value;
+        reserve(1);
+        _buffer.data()[_used++] = ' ';
+    }
+
+protected:
+    void reserve( int size )
+    {
+        if (_used + size > _buffer.size())
+            flush();
+    }
+
+    void append( const char* data, int size )
+    {
+        if (size > _buffer.size())
+        {
+            flush();
+            write(data, size);
+            return;
+        }
+        reserve(size);
+        memcpy(_buffer.data() + _used, data, size);
+        _used += size;
+    }
+
+    void write( const char* data, int size )
+    {
+        if (size > 0 && _device->write(data, size) != size)
+            _failed = true;
+        _written += size;
+    }
+
+protected:
+    QIODevice*  _device;
+    QByteArray  _buffer;
+    int         _used;
+    qint64      _written;
+    bool        _failed;
+};
+
+struct GeneratorSettings
+{
+    int   triangles;
+    int   geometries;
+    float lines;
+    float creases;
+    float contours;
+    int   materials;
+    int   depth;
+    int   branching;
+    int   instances;
+    int   paths;
+};
+
+// The layout of one grid geometry, the same for all of them.
+struct GridLayout
+{
+    int side;          // vertices along each side
+    int cells;         // side - 1
+    int line_spacing;  // 0 if there are no lines of the type
+    int crease_spacing;
+    int contour_spacing;
+
+    qint64 triangles() const { return 2 * (qint64)cells * cells; }
+    qint64 lineSegments() const
+        { return line_spacing ? 2 * (qint64)lineCount(line_spacing, 0, side) * cells : 0; }
+    int    creaseStrips() const
+        { return crease_spacing ? lineCount(crease_spacing, crease_spacing / 2, side) : 0; }
+    qint64 contourSegments() const
+        { return contour_spacing ?
+              (qint64)lineCount(contour_spacing, contour_spacing / 2, side) * cells : 0; }
+
+    // Rows (or columns) offset, offset + spacing, ... below limit.
+    static int lineCount( int spacing, int offset, int limit )
+        { return offset < limit ? (limit - 1 - offset) / spacing + 1 : 0; }
+};
+
+static int spacingForFraction( float fraction )
+{
+    if (fraction <= 0.0f)
+        return 0;
+    return qMax(1, (int)(1.0f / fraction + 0.5f));
+}
+
+static void writeSource( ColladaWriter& out, const QString& id, int count, int stride,
+                         const char* params, int geometry, int side, bool normals )
+{
+    out << "<source id=\"" << id << "\">\n";
+    out << "<float_array id=\"" << id << "-array\" count=\"" << (qint64)count * stride << "\">\n";
+
+    const float cell = GRID_EXTENT / (side - 1);
+    const float phase = 0.7f * geometry;
+    for (int j = 0; j < side; j++)
+    {
+        for (int i = 0; i < side; i++)
+        {
+            float x = i * cell;
+            float y = j * cell;
+            if (!normals)
+            {
+                float z = 0.5f * sinf(x + phase) * cosf(y);
+                out << x << " " << y << " " << z << " ";
+            }
+            else
+            {
+                float dx = 0.5f * cosf(x + phase) * cosf(y);
+                float dy = -0.5f * sinf(x + phase) * sinf(y);
+                float length = sqrtf(dx*dx + dy*dy + 1.0f);
+                out << -dx / length << " " << -dy / length << " " << 1.0f / length << " ";
+            }
+        }
+        out << "\n";
+    }
+    out << "</float_array>\n";
+    out << "<technique_common>\n";
+    out << "<accessor source=\"#" << id << "-array\" count=\"" << count
+        << "\" stride=\"" << stride << "\">\n" << params << "</accessor>\n";
+    out << "</technique_common>\n";
+    out << "</source>\n";
+}
+
+static const char* xyz_params =
+    "<param name=\"X\" type=\"float\"/>\n"
+    "<param name=\"Y\" type=\"float\"/>\n"
+    "<param name=\"Z\" type=\"float\"/>\n";
+
+static void writeGeometry( ColladaWriter& out, int geometry, const GridLayout& layout,
+                           const GeneratorSettings& settings )
+{
+    const int side = layout.side;
+    const int cells = layout.cells;
+    QString id = QString("geometry%1").arg(geometry);
+
+    out << "<geometry id=\"" << id << "\">\n<mesh>\n";
+    writeSource(out, id + "-position", side * side, 3, xyz_params, geometry, side, false);
+    writeSource(out, id + "-normal", side * side, 3, xyz_params, geometry, side, true);
+    out << "<vertices id=\"" << id << "-vertex\">\n";
+    out << "<input semantic=\"POSITION\" source=\"#" << id << "-position\"/>\n";
+    out << "</vertices>\n";
+
+    // Each material covers a band of cell rows.
+    for (int m = 0; m < settings.materials; m++)
+    {
+        int first_row = (qint64)cells * m / settings.materials;
+        int end_row = (qint64)cells * (m + 1) / settings.materials;
+        if (end_row == first_row)
+            continue;
+
+        out << "<triangles material=\"material" << m << "\" count=\""
+            << 2 * (qint64)(end_row - first_row) * cells << "\">\n";
+        out << "<input semantic=\"VERTEX\" source=\"#" << id << "-vertex\" offset=\"0\"/>\n";
+        out << "<input semantic=\"NORMAL\" source=\"#" << id << "-normal\" offset=\"1\"/>\n";
+        out << "<p>\n";
+        for (int j = first_row; j < end_row; j++)
+        {
+            for (int i = 0; i < cells; i++)
+            {
+                int a = j * side + i;
+                int b = a + 1;
+                int c = a + side;
+                int d = c + 1;
+                out.index(a); out.index(a); out.index(b); out.index(b); out.index(d); out.index(d);
+                out.index(a); out.index(a); out.index(d); out.index(d); out.index(c); out.index(c);
+            }
+            out << "\n";
+        }
+        out << "</p>\n</triangles>\n";
+    }
+
+    if (layout.line_spacing)
+    {
+        out << "<lines count=\"" << layout.lineSegments() << "\">\n";
+        out << "<input semantic=\"VERTEX\" source=\"#" << id << "-vertex\" offset=\"0\"/>\n";
+        out << "<p>\n";
+        for (int j = 0; j < side; j += layout.line_spacing)
+        {
+            for (int i = 0; i < cells; i++)
+            {
+                out.index(j * side + i);
+                out.index(j * side + i + 1);
+                out.index(i * side + j);
+                out.index((i + 1) * side + j);
+            }
+            out << "\n";
+        }
+        out << "</p>\n</lines>\n";
+    }
+
+    // CdaGeometry reads one <p> from each <linestrips>, so every crease
+    // gets its own element.
+    if (layout.crease_spacing)
+    {
+        for (int i = layout.crease_spacing / 2; i < side; i += layout.crease_spacing)
+        {
+            out << "<linestrips count=\"1\">\n";
+            out << "<input semantic=\"VERTEX\" source=\"#" << id << "-vertex\" offset=\"0\"/>\n";
+            out << "<p>\n";
+            for (int j = 0; j < side; j++)
+                out.index(j * side + i);
+            out << "\n</p>\n</linestrips>\n";
+        }
+    }
+
+    if (layout.contour_spacing)
+    {
+        out << "<extra>\n<technique profile=\"DPIX\">\n";
+        out << "<contours count=\"" << layout.contourSegments() << "\">\n";
+        out << "<input semantic=\"VERTEX\" source=\"#" << id << "-vertex\" offset=\"0\"/>\n";
+        out << "<input semantic=\"NORMAL\" source=\"#" << id << "-normal\" offset=\"1\"/>\n";
+        out << "<p>\n";
+        for (int j = layout.contour_spacing / 2; j < side; j += layout.contour_spacing)
+        {
+            for (int i = 0; i < cells; i++)
+            {
+                int a = j * side + i;
+                out.index(a); out.index(a); out.index(a + 1); out.index(a + 1);
+            }
+            out << "\n";
+        }
+        out << "</p>\n</contours>\n";
+        out << "</technique>\n</extra>\n";
+    }
+
+    out << "</mesh>\n</geometry>\n";
+}
+
+// A closed loop around (cx, cy), in a linestrip like the ones the
+// SketchUp exporter writes for animation paths.
+static void writePath( ColladaWriter& out, int path, float cx, float cy, float radius )
+{
+    QString id = QString("path%1-geometry").arg(path);
+
+    out << "<geometry id=\"" << id << "\">\n<mesh>\n";
+    out << "<source id=\"" << id << "-position\">\n";
+    out << "<float_array id=\"" << id << "-position-array\" count=\"" << 3 * PATH_POINTS << "\">\n";
+    for (int i = 0; i < PATH_POINTS; i++)
+    {
+        float angle = 2.0f * (float)M_PI * i / PATH_POINTS;
+        out << cx + radius * cosf(angle) << " " << cy + radius * sinf(angle) << " 0 ";
+    }
+    out << "\n</float_array>\n";
+    out << "<technique_common>\n";
+    out << "<accessor source=\"#" << id << "-position-array\" count=\"" << PATH_POINTS
+        << "\" stride=\"3\">\n" << xyz_params << "</accessor>\n";
+    out << "</technique_common>\n";
+    out << "</source>\n";
+    out << "<vertices id=\"" << id << "-vertex\">\n";
+    out << "<input semantic=\"POSITION\" source=\"#" << id << "-position\"/>\n";
+    out << "</vertices>\n";
+    out << "<linestrips count=\"1\">\n";
+    out << "<input semantic=\"VERTEX\" source=\"#" << id << "-vertex\" offset=\"0\"/>\n";
+    out << "<p>\n";
+    for (int i = 0; i <= PATH_POINTS; i++)
+        out.index(i % PATH_POINTS);
+    out << "\n</p>\n</linestrips>\n";
+    out << "</mesh>\n</geometry>\n";
+}
+
+static void writeTranslation( ColladaWriter& out, float x, float y )
+{
+    out << "<matrix>1 0 0 " << x << " 0 1 0 " << y << " 0 0 1 0 0 0 0 1</matrix>\n";
+}
+
+static QString levelNodeId( int geometry, int level )
+{
+    return QString("geometry%1-level%2").arg(geometry).arg(level);
+}
+
+static GridLayout gridLayout( const GeneratorSettings& settings )
+{
+    GridLayout layout;
+    layout.side = (int)ceil(sqrt(settings.triangles * 0.5)) + 1;
+    layout.cells = layout.side - 1;
+    layout.line_spacing = spacingForFraction(settings.lines);
+    layout.crease_spacing = spacingForFraction(settings.creases);
+    layout.contour_spacing = spacingForFraction(settings.contours);
+    return layout;
+}
+
+// Writes the whole document. The settings must be valid (see cdagen's
+// main).
+static void writeScene( ColladaWriter& out, const GeneratorSettings& settings,
+                        const GridLayout& layout )
+{
+    out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    out << "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n";
+    out << "<asset>\n<contributor>\n<authoring_tool>cdagen</authoring_tool>\n</contributor>\n";
+    out << "<created>2009-01-01T00:00:00Z</created>\n<modified>2009-01-01T00:00:00Z</modified>\n";
+    out << "<up_axis>Z_UP</up_axis>\n</asset>\n";
+
+    out << "<library_effects>\n";
+    for (int m = 0; m < settings.materials; m++)
+    {
+        float hue = 6.0f * m / settings.materials;
+        float r = qBound(0.0f, fabsf(hue - 3.0f) - 1.0f, 1.0f);
+        float g = qBound(0.0f, 2.0f - fabsf(hue - 2.0f), 1.0f);
+        float b = qBound(0.0f, 2.0f - fabsf(hue - 4.0f), 1.0f);
+        out << "<effect id=\"material" << m << "-effect\">\n<profile_COMMON>\n";
+        out << "<technique sid=\"COMMON\">\n<phong>\n";
+        out << "<diffuse>\n<color>" << r << " " << g << " " << b << " 1</color>\n</diffuse>\n";
+        out << "</phong>\n</technique>\n</profile_COMMON>\n</effect>\n";
+    }
+    out << "</library_effects>\n";
+
+    out << "<library_materials>\n";
+    for (int m = 0; m < settings.materials; m++)
+    {
+        out << "<material id=\"material" << m << "\" name=\"material" << m << "\">\n";
+        out << "<instance_effect url=\"#material" << m << "-effect\"/>\n";
+        out << "</material>\n";
+    }
+    out << "</library_materials>\n";
+
+    // Extent of one instance of each level of library nodes. Levels
+    // alternate between spreading along x and along y.
+    QList<float> extent_x, extent_y;
+    extent_x << GRID_EXTENT;
+    extent_y << GRID_EXTENT;
+    for (int level = 1; level <= settings.depth; level++)
+    {
+        if (level % 2)
+        {
+            extent_x << INSTANCE_SPACING * extent_x.last() * settings.branching;
+            extent_y << extent_y.last();
+        }
+        else
+        {
+            extent_x << extent_x.last();
+            extent_y << INSTANCE_SPACING * extent_y.last() * settings.branching;
+        }
+    }
+    const float top_x = extent_x.last();
+    const float top_y = extent_y.last();
+
+    int columns = (int)ceil(sqrt((double)settings.instances));
+    float spacing = INSTANCE_SPACING * qMax(top_x, top_y);
+
+    out << "<library_geometries>\n";
+    for (int g = 0; g < settings.geometries; g++)
+        writeGeometry(out, g, layout, settings);
+    for (int k = 0; k < settings.paths; k++)
+    {
+        float x = (k % columns) * spacing + 0.5f * top_x;
+        float y = (k / columns) * spacing + 0.5f * top_y;
+        writePath(out, k, x, y, 0.5f * qMax(top_x, top_y));
+    }
+    out << "</library_geometries>\n";
+
+    out << "<library_nodes>\n";
+    for (int g = 0; g < settings.geometries; g++)
+    {
+        out << "<node id=\"" << levelNodeId(g, 0) << "\" name=\"" << levelNodeId(g, 0) << "\">\n";
+        out << "<instance_geometry url=\"#geometry" << g << "\">\n";
+        out << "<bind_material>\n<technique_common>\n";
+        for (int m = 0; m < settings.materials; m++)
+        {
+            out << "<instance_material symbol=\"material" << m
+                << "\" target=\"#material" << m << "\"/>\n";
+        }
+        out << "</technique_common>\n</bind_material>\n";
+        out << "</instance_geometry>\n";
+        out << "</node>\n";
+
+        for (int level = 1; level <= settings.depth; level++)
+        {
+            QString id = levelNodeId(g, level);
+            out << "<node id=\"" << id << "\" name=\"" << id << "\">\n";
+            for (int c = 0; c < settings.branching; c++)
+            {
+                out << "<node>\n";
+                if (level % 2)
+                    writeTranslation(out, c * INSTANCE_SPACING * extent_x[level - 1], 0.0f);
+                else
+                    writeTranslation(out, 0.0f, c * INSTANCE_SPACING * extent_y[level - 1]);
+                out << "<instance_node url=\"#" << levelNodeId(g, level - 1) << "\"/>\n";
+                out << "</node>\n";
+            }
+            out << "</node>\n";
+        }
+    }
+    out << "</library_nodes>\n";
+
+    out << "<library_visual_scenes>\n";
+    out << "<visual_scene id=\"scene\" name=\"scene\">\n";
+    for (int k = 0; k < settings.instances; k++)
+    {
+        out << "<node id=\"instance" << k << "\" name=\"instance" << k << "\">\n";
+        writeTranslation(out, (k % columns) * spacing, (k / columns) * spacing);
+        out << "<instance_node url=\"#"
+            << levelNodeId(k % settings.geometries, settings.depth) << "\"/>\n";
+        if (k < settings.paths)
+        {
+            out << "<extra>\n<technique profile=\"DPIX\">\n";
+            out << "<instance_path url=\"#path" << k << "-geometry\"/>\n";
+            out << "</technique>\n</extra>\n";
+        }
+        out << "</node>\n";
+    }
+    out << "</visual_scene>\n";
+    out << "</library_visual_scenes>\n";
+    out << "<scene>\n<instance_visual_scene url=\"#scene\"/>\n</scene>\n";
+    out << "</COLLADA>\n";
+}
+
+#endif // _CDA_GENERATOR_H_
@@ -1,10 +1,15 @@
 /*****************************************************************************\
 
-CdaGeometry.cc
+cdastats.cc
 Author: Forrester Cole (fcole@cs.princeton.edu)
 Copyright (c) 2009 Forrester Cole
 
-A simple program to write out some statistics of a COLLADA scene file.
+Writes out statistics of COLLADA scene files, and profiles how they load:
+the time, heap allocations (counted on glibc only) and throughput of each
+parse phase, and the peak resident size of the process. Built with
+"qmake CONFIG+=npr", it can also time the libnpr conversion and line
+stitching of each geometry. With -json the results for all the files are
+written as one JSON document, for comparing runs over many models.
 
 libcda is distributed under the terms of the GNU General Public License.
 See the COPYING file for details.
@@ -14,18 +19,146 @@ See the COPYING file for details.
 #include <QCoreApplication>
 #include <QString>
 #include <QStringList>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QList>
 
 #include <CdaScene.h>
 #include <CdaNode.h>
 #include <CdaGeometry.h>
 
-QString usage = "usage: cdastats <filename>\n";
+#ifdef CDASTATS_NPR
+#include "NPRGeometry.h"
+#include "NPRFixedPathSet.h"
+#endif
 
-int instanced_triangles = 0;
-int instanced_lines = 0;
-int instanced_contours = 0;
+#include <stdio.h>
+#include <stdlib.h>
 
-void traverseAndCountGeometry(const CdaScene* scene, const CdaNode* root)
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+#include "stagetimer.h"
+
+QString usage =
+    "usage: cdastats [-json] [-o <output>] [-npr] <filename> [filename ...]\n"
+    "  -json        write JSON instead of text\n"
+    "  -o <output>  write to a file instead of stdout\n"
+    "  -npr         also time the libnpr conversion and path stitching\n"
+    "               (needs a build with qmake CONFIG+=npr)\n";
+
+// Peak resident size of the process so far, or -1 where it is not known.
+// It only grows, so with several files it is the peak over all of them.
+long long peakRSSKilobytes()
+{
+#ifdef WIN32
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef DARWIN
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// The statistics of one file.
+
+struct StageStats
+{
+    QString     name;
+    double      seconds;
+    long long   allocations;
+    long long   allocated_bytes;
+};
+
+struct FileStats
+{
+    QString     filename;
+    bool        loaded;
+    long long   file_bytes;
+    long long   document_bytes;
+    long long   peak_rss_kb;
+
+    QList<StageStats> stages;
+
+    int         effects;
+    int         materials;
+    int         lights;
+    int         cameras;
+    int         geometries;
+    int         library_nodes;
+    int         scene_nodes;
+    long long   vertices;
+    long long   triangles;
+    long long   lines;
+    long long   contours;
+    long long   linestrips;
+
+    long long   instanced_triangles;
+    long long   instanced_lines;
+    long long   instanced_contours;
+
+    int         npr_vertices;
+    int         npr_paths;
+};
+
+double loadSeconds( const FileStats& stats )
+{
+    double seconds = 0;
+    for (int i = 0; i < CDA_NUM_LOAD_PHASES && i < stats.stages.size(); i++)
+        seconds += stats.stages[i].seconds;
+    return seconds;
+}
+
+const char* phase_names[CDA_NUM_LOAD_PHASES] =
+    { "read", "xml", "effects", "materials", "lights", "geometries", "nodes" };
+
+// A phase that runs more than once (the phases of each .dae in a .kmz)
+// accumulates.
+class PhaseTimer : public CdaLoadCallback
+{
+public:
+    void phaseStarted( CdaLoadPhase phase )
+    {
+        _timers[phase].start();
+    }
+    void phaseFinished( CdaLoadPhase phase )
+    {
+        _timers[phase].stop();
+    }
+
+    const StageTimer& timer( int phase ) const { return _timers[phase]; }
+
+protected:
+    StageTimer  _timers[CDA_NUM_LOAD_PHASES];
+};
+
+void addStage( FileStats& stats, const QString& name, const StageTimer& timer )
+{
+    StageStats stage;
+    stage.name = name;
+    stage.seconds = timer.totalSeconds();
+    stage.allocations = timer.allocations();
+    stage.allocated_bytes = timer.allocatedBytes();
+    stats.stages.append(stage);
+}
+
+long long countPrimitives( const CdaPrimitiveList& prims )
+{
+    long long count = 0;
+    for (int i = 0; i < prims.size(); i++)
+        count += prims[i].count();
+    return count;
+}
+
+void traverseAndCountGeometry(const CdaScene* scene, const CdaNode* root,
+                              FileStats& stats)
 {
     if (!root)
         return;
@@ -33,32 +166,246 @@ void traverseAndCountGeometry(const CdaScene* scene, const CdaNode* root)
     const CdaGeometry* geom = root->geometry();
     if (geom)
     {
-        const CdaPrimitiveList& triangles = geom->primList(CDA_TRIANGLES);
-        const CdaPrimitiveList& lines = geom->primList(CDA_LINES);
-        const CdaPrimitiveList& contours = geom->primList(CDA_CONTOURS);
-
-        for (int i = 0; i < triangles.size(); i++)
-        {
-            instanced_triangles += triangles[i].count();
-        }
-        for (int i = 0; i < lines.size(); i++)
-        {
-            instanced_lines += lines[i].count();
-        }
-        for (int i = 0; i < contours.size(); i++)
-        {
-            instanced_contours += contours[i].count();
-        }
+        stats.instanced_triangles += countPrimitives(geom->primList(CDA_TRIANGLES));
+        stats.instanced_lines += countPrimitives(geom->primList(CDA_LINES));
+        stats.instanced_contours += countPrimitives(geom->primList(CDA_CONTOURS));
     }
     if (!root->nodeId().isEmpty())
     {
         const CdaNode* inst_node = scene->findLibraryNode(root->nodeId());
-        traverseAndCountGeometry(scene, inst_node);
+        traverseAndCountGeometry(scene, inst_node, stats);
     }
     for (int i = 0; i < root->numChildren(); i++)
     {
-        traverseAndCountGeometry(scene, root->child(i));
+        traverseAndCountGeometry(scene, root->child(i), stats);
+    }
+}
+
+#ifdef CDASTATS_NPR
+void runNPRStages( const CdaScene& scene, FileStats& stats )
+{
+    StageTimer convert_timer, stitch_timer, free_timer;
+    QList<NPRGeometry*> geometries;
+    QList<NPRFixedPathSet*> path_sets;
+
+    convert_timer.start();
+    for (int i = 0; i < scene.numLibraryGeometries(); i++)
+        geometries.append(new NPRGeometry(scene.libraryGeometry(i)));
+    convert_timer.stop();
+    addStage(stats, "npr convert", convert_timer);
+
+    // Each path set stitches the lines of its geometry into paths.
+    stitch_timer.start();
+    for (int i = 0; i < geometries.size(); i++)
+        path_sets.append(new NPRFixedPathSet(geometries[i]));
+    stitch_timer.stop();
+    addStage(stats, "npr stitch", stitch_timer);
+
+    for (int i = 0; i < geometries.size(); i++)
+    {
+        if (geometries[i]->data(GQ_VERTEX))
+            stats.npr_vertices += geometries[i]->numVertices();
+        stats.npr_paths += path_sets[i]->size();
+    }
+
+    free_timer.start();
+    while (!path_sets.isEmpty())
+        delete path_sets.takeLast();
+    while (!geometries.isEmpty())
+        delete geometries.takeLast();
+    free_timer.stop();
+    addStage(stats, "npr free", free_timer);
+}
+#endif
+
+bool analyzeFile( const QString& filename, bool run_npr, FileStats& stats )
+{
+    stats.filename = filename;
+    stats.file_bytes = QFileInfo(filename).size();
+    stats.document_bytes = 0;
+    stats.effects = stats.materials = stats.lights = stats.cameras = 0;
+    stats.geometries = stats.library_nodes = stats.scene_nodes = 0;
+    stats.vertices = stats.triangles = stats.lines = 0;
+    stats.contours = stats.linestrips = 0;
+    stats.instanced_triangles = stats.instanced_lines = stats.instanced_contours = 0;
+    stats.npr_vertices = stats.npr_paths = 0;
+
+    CdaScene* scene = new CdaScene;
+    PhaseTimer phase_timer;
+    scene->setLoadCallback(&phase_timer);
+    stats.loaded = scene->load(filename);
+    scene->setLoadCallback(NULL);
+    stats.document_bytes = scene->documentSize();
+
+    // The phases come first (see loadSeconds).
+    for (int i = 0; i < CDA_NUM_LOAD_PHASES; i++)
+        addStage(stats, phase_names[i], phase_timer.timer(i));
+
+    if (stats.loaded)
+    {
+        stats.effects = scene->numLibraryEffects();
+        stats.materials = scene->numLibraryMaterials();
+        stats.lights = scene->numLibraryLights();
+        stats.cameras = scene->numLibraryCameras();
+        stats.geometries = scene->numLibraryGeometries();
+        stats.library_nodes = scene->numLibraryNodes();
+        stats.scene_nodes = scene->numNodes();
+
+        for (int i = 0; i < scene->numLibraryGeometries(); i++)
+        {
+            const CdaGeometry* geom = scene->libraryGeometry(i);
+            if (geom->hasData(CDA_VERTEX))
+                stats.vertices += geom->data(CDA_VERTEX).length();
+            stats.triangles += countPrimitives(geom->primList(CDA_TRIANGLES));
+            stats.lines += countPrimitives(geom->primList(CDA_LINES));
+            stats.contours += countPrimitives(geom->primList(CDA_CONTOURS));
+            stats.linestrips += countPrimitives(geom->primList(CDA_LINESTRIPS));
+        }
+
+        traverseAndCountGeometry(scene, scene->root(), stats);
+
+#ifdef CDASTATS_NPR
+        if (run_npr)
+            runNPRStages(*scene, stats);
+#else
+        Q_UNUSED(run_npr);
+#endif
+    }
+
+    StageTimer free_timer;
+    free_timer.start();
+    delete scene;
+    free_timer.stop();
+    addStage(stats, "free", free_timer);
+
+    stats.peak_rss_kb = peakRSSKilobytes();
+    return stats.loaded;
+}
+
+// Output
+
+QString jsonString( const QString& str )
+{
+    QString escaped;
+    for (int i = 0; i < str.size(); i++)
+    {
+        QChar c = str[i];
+        if (c == '"' || c == '\\')
+            escaped += QString("\\") + c;
+        else if (c.unicode() < 0x20)
+            escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        else
+            escaped += c;
+    }
+    return QString("\"%1\"").arg(escaped);
+}
+
+double megabytesPerSecond( long long bytes, double seconds )
+{
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+void writeText( QTextStream& out, const FileStats& stats )
+{
+    out << stats.filename << "\n";
+    if (!stats.loaded)
+    {
+        out << "failed to load (not a Collada file?)\n\n";
+        return;
+    }
+
+    out << "Total triangles: " << stats.instanced_triangles << "\n";
+    out << "Total lines: " << stats.instanced_lines << "\n";
+    out << "Total contours: " << stats.instanced_contours << "\n";
+    out << "Library: " << stats.geometries << " geometries, "
+        << stats.vertices << " vertices, " << stats.triangles << " triangles, "
+        << stats.lines << " lines, " << stats.contours << " contours, "
+        << stats.linestrips << " line strips\n";
+    out << "         " << stats.effects << " effects, " << stats.materials
+        << " materials, " << stats.lights << " lights, " << stats.cameras
+        << " cameras, " << stats.library_nodes << " library nodes, "
+        << stats.scene_nodes << " scene nodes\n";
+    if (stats.npr_vertices > 0 || stats.npr_paths > 0)
+        out << "NPR: " << stats.npr_vertices << " vertices, "
+            << stats.npr_paths << " paths\n";
+
+    out << QString("%1 %2 %3 %4\n").arg("stage", -12).arg("ms", 10).
+        arg("allocs", 10).arg("alloc KB", 10);
+    for (int i = 0; i < stats.stages.size(); i++)
+    {
+        const StageStats& stage = stats.stages[i];
+        out << QString("%1 %2 %3 %4\n").arg(stage.name, -12).
+            arg(stage.seconds * 1000.0, 10, 'f', 2).
+            arg(allocations_counted ? QString::number(stage.allocations) : "-", 10).
+            arg(allocations_counted ? QString::number(stage.allocated_bytes / 1024) : "-", 10);
+    }
+
+    double seconds = loadSeconds(stats);
+    out << QString("Load: %1 ms, %2 MB/s of file, %3 MB/s of XML\n").
+        arg(seconds * 1000.0, 0, 'f', 2).
+        arg(megabytesPerSecond(stats.file_bytes, seconds), 0, 'f', 2).
+        arg(megabytesPerSecond(stats.document_bytes, seconds), 0, 'f', 2);
+    if (stats.peak_rss_kb >= 0)
+        out << "Peak RSS: " << stats.peak_rss_kb << " KB\n";
+    out << "\n";
+}
+
+void writeJSON( QTextStream& out, const QList<FileStats>& all_stats )
+{
+    out << "{\n  \"allocations_counted\": "
+        << (allocations_counted ? "true" : "false") << ",\n";
+    out << "  \"files\": [";
+    for (int f = 0; f < all_stats.size(); f++)
+    {
+        const FileStats& stats = all_stats[f];
+        double seconds = loadSeconds(stats);
+
+        out << (f > 0 ? ",\n" : "\n");
+        out << "    {\n";
+        out << "      \"file\": " << jsonString(stats.filename) << ",\n";
+        out << "      \"loaded\": " << (stats.loaded ? "true" : "false") << ",\n";
+        out << "      \"file_bytes\": " << stats.file_bytes << ",\n";
+        out << "      \"document_bytes\": " << stats.document_bytes << ",\n";
+        out << "      \"load_ms\": " << QString::number(seconds * 1000.0, 'f', 3) << ",\n";
+        out << "      \"file_mb_per_s\": "
+            << QString::number(megabytesPerSecond(stats.file_bytes, seconds), 'f', 3) << ",\n";
+        out << "      \"document_mb_per_s\": "
+            << QString::number(megabytesPerSecond(stats.document_bytes, seconds), 'f', 3) << ",\n";
+        out << "      \"peak_rss_kb\": " << stats.peak_rss_kb << ",\n";
+
+        out << "      \"counts\": {"
+            << "\"effects\": " << stats.effects
+            << ", \"materials\": " << stats.materials
+            << ", \"lights\": " << stats.lights
+            << ", \"cameras\": " << stats.cameras
+            << ", \"geometries\": " << stats.geometries
+            << ", \"library_nodes\": " << stats.library_nodes
+            << ", \"scene_nodes\": " << stats.scene_nodes
+            << ", \"vertices\": " << stats.vertices
+            << ", \"triangles\": " << stats.triangles
+            << ", \"lines\": " << stats.lines
+            << ", \"contours\": " << stats.contours
+            << ", \"linestrips\": " << stats.linestrips
+            << ", \"instanced_triangles\": " << stats.instanced_triangles
+            << ", \"instanced_lines\": " << stats.instanced_lines
+            << ", \"instanced_contours\": " << stats.instanced_contours
+            << ", \"npr_vertices\": " << stats.npr_vertices
+            << ", \"npr_paths\": " << stats.npr_paths << "},\n";
+
+        out << "      \"stages\": [";
+        for (int i = 0; i < stats.stages.size(); i++)
+        {
+            const StageStats& stage = stats.stages[i];
+            out << (i > 0 ? ",\n" : "\n");
+            out << "        {\"name\": " << jsonString(stage.name)
+                << ", \"ms\": " << QString::number(stage.seconds * 1000.0, 'f', 3)
+                << ", \"allocations\": " << stage.allocations
+                << ", \"allocated_bytes\": " << stage.allocated_bytes << "}";
+        }
+        out << "\n      ]\n";
+        out << "    }";
     }
+    out << "\n  ]\n}\n";
 }
 
 void myMessageOutput(QtMsgType type, const char *msg)
@@ -86,27 +433,78 @@ int main(int argc, char* argv[])
     QCoreApplication application(argc, argv);
     QStringList arguments = application.arguments();
 
-    if (arguments.size() < 2)
+    bool json = false;
+    bool run_npr = false;
+    QString output_filename;
+    QStringList filenames;
+
+    for (int i = 1; i < arguments.size(); i++)
     {
-        printf(qPrintable(usage));
-        return 0;
+        const QString& arg = arguments[i];
+        if (arg == "-json")
+            json = true;
+        else if (arg == "-npr")
+            run_npr = true;
+        else if (arg == "-o" && i+1 < arguments.size())
+            output_filename = arguments[++i];
+        else if (arg.startsWith("-"))
+        {
+            printf("%s", qPrintable(usage));
+            return 1;
+        }
+        else
+            filenames << arg;
     }
 
-    CdaScene scene;
-    bool ret = scene.load(arguments.at(1));
-    if (!ret)
+    if (filenames.isEmpty())
     {
-        printf("failed to load %s (not a Collada file?)\n", 
-            qPrintable(arguments.at(1)));
+        printf("%s", qPrintable(usage));
         return 0;
     }
 
-    traverseAndCountGeometry(&scene, scene.root());
+#ifndef CDASTATS_NPR
+    if (run_npr)
+    {
+        fprintf(stderr, "cdastats: -npr needs a build with qmake CONFIG+=npr\n");
+        return 1;
+    }
+#endif
+
+    QFile output;
+    if (output_filename.isEmpty())
+    {
+        output.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    else
+    {
+        output.setFileName(output_filename);
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            fprintf(stderr, "cdastats: could not open %s\n", qPrintable(output_filename));
+            return 1;
+        }
+    }
+    QTextStream out(&output);
+
+    // One bad file does not stop the run, but is reported in the exit code.
+    QList<FileStats> all_stats;
+    bool all_loaded = true;
+    for (int i = 0; i < filenames.size(); i++)
+    {
+        FileStats stats;
+        all_loaded = analyzeFile(filenames[i], run_npr, stats) && all_loaded;
+        if (json)
+            all_stats.append(stats);
+        else
+        {
+            writeText(out, stats);
+            out.flush();
+        }
+    }
 
-    printf("%s\n", qPrintable(arguments.at(1)));
-    printf("Total triangles: %d\n", instanced_triangles);
-    printf("Total lines: %d\n", instanced_lines);
-    printf("Total contours: %d\n", instanced_contours);
+    if (json)
+        writeJSON(out, all_stats);
+    out.flush();
 
-    return 0;
+    return all_loaded ? 0 : 2;
 }
@@ -17,8 +17,34 @@ TARGET =
 DEPENDPATH += ../include 
 INCLUDEPATH += ../include 
 
+unix:!macx {
+	DEFINES += LINUX
+	# clock_gettime
+	LIBS += -lrt
+}
+macx {
+	DEFINES += DARWIN
+}
+
+# Build with "qmake CONFIG+=npr" to link libnpr and libgq (build them 
+# first), for the -npr option. They come before libcda, which they use.
+npr {
+	DEFINES += CDASTATS_NPR
+	QT += opengl
+	unix {
+		QMAKE_CXXFLAGS += -fopenmp
+		QMAKE_LFLAGS += -fopenmp
+	}
+	INCLUDEPATH += ../../libnpr/include ../../libgq/include
+	PRE_TARGETDEPS += ../../libnpr/$${DBGNAME}/libnpr.a
+	LIBS += -L../../libnpr/$${DBGNAME} -lnpr
+	PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+	LIBS += -L../../libgq/$${DBGNAME} -lgq
+}
+
 PRE_TARGETDEPS += ../$${DBGNAME}/libcda.a
 LIBS += -L../$${DBGNAME} -lcda
 
 # Input
-SOURCES += cdastats.cc
+HEADERS += stagetimer.h
+SOURCES += cdastats.cc stagetimer.cc
@@ -0,0 +1,66 @@
+/*****************************************************************************\
+
+stagetimer.cc
+Copyright (c) 2009 Forrester Cole
+
+The allocation counters of stagetimer.h, and the malloc replacements that
+update them. Linked into each tool exactly once.
+
+libcda is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "stagetimer.h"
+
+#include <stdlib.h>
+
+volatile int counting_allocations = 0;
+long long    num_allocations = 0;
+long long    allocated_bytes = 0;
+
+#ifdef __GLIBC__
+extern "C"
+{
+void* __libc_malloc( size_t size );
+void* __libc_calloc( size_t count, size_t size );
+void* __libc_realloc( void* pointer, size_t size );
+void  __libc_free( void* pointer );
+}
+
+static inline void countAllocation( size_t size )
+{
+    if (counting_allocations)
+    {
+        __sync_fetch_and_add(&num_allocations, 1LL);
+        __sync_fetch_and_add(&allocated_bytes, (long long)size);
+    }
+}
+
+extern "C" void* malloc( size_t size ) __THROW
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc( size_t count, size_t size ) __THROW
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc( void* pointer, size_t size ) __THROW
+{
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free( void* pointer ) __THROW
+{
+    __libc_free(pointer);
+}
+
+const bool allocations_counted = true;
+#else
+const bool allocations_counted = false;
+#endif
@@ -0,0 +1,107 @@
+/*****************************************************************************\
+
+stagetimer.h
+Copyright (c) 2009 Forrester Cole
+
+Times the stages of a load and counts the heap allocations made during
+them, for the profiling tools (cdastats, and loadbench in libnpr).
+Allocations are counted on glibc only, by replacing malloc in the
+executable, which catches the allocations made by Qt and the C++ runtime
+as well as our own. The replacements are defined in stagetimer.cc, which
+each tool adds to its SOURCES.
+
+libcda is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _STAGE_TIMER_H_
+#define _STAGE_TIMER_H_
+
+#include <QtGlobal>
+
+#include <float.h>
+
+#ifdef WIN32
+#include <windows.h>
+#elif defined(DARWIN)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+// Allocation counting, defined in stagetimer.cc.
+
+extern volatile int counting_allocations;
+extern long long    num_allocations;
+extern long long    allocated_bytes;
+// False where malloc is not replaced, so the counts stay zero.
+extern const bool   allocations_counted;
+
+// Monotonic time in seconds.
+inline double monotonicSeconds()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency;
+    static BOOL has_frequency = QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER count;
+    if (!has_frequency || !QueryPerformanceCounter(&count))
+        return 0;
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+#elif defined(DARWIN)
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return mach_absolute_time() * 1e-9 * timebase.numer / timebase.denom;
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+// Accumulates the time and allocations of every run of one stage. Only
+// one stage can be timed at once, since the allocation counts are global.
+class StageTimer
+{
+public:
+    StageTimer() : _runs(0), _total_seconds(0), _min_seconds(DBL_MAX),
+                   _allocations(0), _bytes(0) {}
+
+    void start()
+    {
+        num_allocations = 0;
+        allocated_bytes = 0;
+        counting_allocations = 1;
+        _start = monotonicSeconds();
+    }
+
+    void stop()
+    {
+        double seconds = monotonicSeconds() - _start;
+        counting_allocations = 0;
+
+        _runs++;
+        _total_seconds += seconds;
+        _min_seconds = qMin(_min_seconds, seconds);
+        _allocations += num_allocations;
+        _bytes += allocated_bytes;
+    }
+
+    int       runs() const { return _runs; }
+    double    totalSeconds() const { return _total_seconds; }
+    double    minSeconds() const { return _runs > 0 ? _min_seconds : 0; }
+    // Totals over all the runs.
+    long long allocations() const { return _allocations; }
+    long long allocatedBytes() const { return _bytes; }
+
+protected:
+    double    _start;
+    int       _runs;
+    double    _total_seconds;
+    double    _min_seconds;
+    long long _allocations;
+    long long _bytes;
+};
+
+#endif // _STAGE_TIMER_H_
@@ -16,6 +16,7 @@ See the COPYING file for details.
 
 #include "GQImage.h"
 #include "GQTexture.h"
+#include "GQMemory.h"
 #include <QString>
 
 const uint32 GQ_ATTACH_NONE = 0x0;
@@ -93,6 +94,10 @@ public:
 
     void loadColorTexturei( int which, const GQImage& image );
     void loadColorTexturef( int which, const GQFloatImage& image );
+    // The image is either the size of the whole texture, or exactly
+    // width x height.
+    void loadSubColorTexturef( int which, int x, int y, int width, int height,
+                               const GQFloatImage& image );
 
     void saveColorTextureToFile( int which, const QString& filename ) const;
     void saveDepthBufferToFile( const QString& filename ) const;
@@ -119,6 +124,9 @@ protected:
 
     int	_depth_attachment;
 
+    // The color textures are counted in the same "Framebuffers" category.
+    GQMemoryUse _depth_memory;
+
 
 };
 
@@ -0,0 +1,102 @@
+/*****************************************************************************\
+
+GQGPUTimer.h
+Copyright (c) 2009 Forrester Cole
+
+Times GPU work with GL_EXT_timer_query, without stalling the pipeline.
+Each scope issues elapsed-time queries; the results are read back a few
+frames later (endFrame) and handed to GQStats, which shows them under a
+"GPU" branch of the timer tree with a " (GPU)" suffix on each name. Use
+the __GPU_TIME_CODE_BLOCK and __GPU_START/STOP_TIMER macros in GQStats.h,
+which time the CPU side of the same scope as well.
+
+Only one elapsed-time query can be active at once, so nested scopes split
+the time into segments: every begin or end closes the running query and
+opens a new one, and a scope's time is the sum of the segments issued
+while it was open.
+
+GL context thread only. Does nothing if the extension is missing.
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _GQ_GPU_TIMER_H_
+#define _GQ_GPU_TIMER_H_
+
+#include "GQInclude.h"
+#include "GQProfiler.h"
+
+#include <QVector>
+#include <QList>
+
+class GQGPUTimer
+{
+public:
+    GQGPUTimer();
+
+    void begin( int id );
+    void end( int id );
+
+    // Call once a frame, with the context current. Reads back the frames
+    // whose queries have finished, without waiting for the others.
+    void endFrame();
+
+    // Takes the scopes read back since the last call. Makes no GL calls.
+    // Returns false if there were none.
+    bool collect( GQProfileBatch& batch );
+
+    static GQGPUTimer& instance();
+
+protected:
+    struct OpenScope
+    {
+        int id;
+        int first_query;
+    };
+
+    struct ClosedScope
+    {
+        int id;
+        int depth;
+        int first_query;
+        int end_query;
+    };
+
+    struct Frame
+    {
+        QVector<GLuint>      queries;
+        QVector<ClosedScope> scopes;
+    };
+
+    bool isSupported();
+    void beginQuery();
+    void endQuery();
+    bool readFrame( const Frame& frame );
+    void releaseFrame( const Frame& frame );
+
+protected:
+    int                     _supported;
+    bool                    _query_active;
+
+    QVector<OpenScope>      _stack;
+    Frame                   _current;
+    QList<Frame>            _pending;
+    QVector<GLuint>         _free_queries;
+
+    QVector<GQProfileEvent> _results;
+    int                     _dropped;
+};
+
+// Starts a GPU scope when created and ends it when it passes out of scope.
+class GQGPUScopeTimer
+{
+public:
+    GQGPUScopeTimer( int id ) : _id(id) { GQGPUTimer::instance().begin(id); }
+    ~GQGPUScopeTimer() { GQGPUTimer::instance().end(_id); }
+protected:
+    int _id;
+};
+
+#endif // _GQ_GPU_TIMER_H_
@@ -14,6 +14,7 @@
 #define _GQ_IMAGE_H_
 
 #include <QString>
+#include "GQMemory.h"
 
 class GQImage
 {
@@ -49,6 +50,7 @@ private:
     int _height;
     int _num_chan;
     unsigned char* _raster;
+    GQMemoryUse _memory;
 };
 
 // This really should be a templated version of above, but QImage 
@@ -96,6 +98,7 @@ private:
     int _height;
     int _num_chan;
     float* _raster;
+    GQMemoryUse _memory;
 };
 
 
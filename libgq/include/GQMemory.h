@@ -0,0 +1,85 @@
+/*****************************************************************************\
+
+GQMemory.h
+Copyright (c) 2009 Forrester Cole
+
+Accounting of the memory held by the larger structures, by category: CPU
+memory for images, geometry and paths, and an estimate of the GPU memory
+for textures, framebuffers and vertex buffers. Categories are registered
+by name once (keep the id in a static) and then only add and subtract
+bytes, from any thread.
+
+Each category keeps its peak, so short-lived allocations (such as the
+staging images used to fill a texture) show up even though they are gone
+by the time the stats are displayed. GQStats shows the categories in its
+"Memory" group and records them with the timers and counters.
+
+GQMemoryUse holds the bytes of one object in a category and releases them
+when the object is destroyed.
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _GQ_MEMORY_H_
+#define _GQ_MEMORY_H_
+
+#include <QString>
+#include <QList>
+
+class GQMemory
+{
+public:
+    enum Kind { CPU, GPU, NUM_KINDS };
+
+    struct Usage
+    {
+        QString name;
+        Kind    kind;
+        qint64  current;
+        qint64  peak;
+    };
+
+    // Returns the id of the category, registering it the first time.
+    static int  category( const QString& name, Kind kind );
+
+    static void allocate( int category, qint64 bytes );
+    static void release( int category, qint64 bytes );
+
+    // Every category, in the order they were registered.
+    static void usage( QList<Usage>& usage );
+    // The sum over every category of one kind, and the peak of that sum.
+    static void total( Kind kind, qint64& current, qint64& peak );
+
+    // Sets each peak to the current value.
+    static void resetPeaks();
+
+    static QString kindName( Kind kind ) { return kind == CPU ? "CPU" : "GPU"; }
+};
+
+class GQMemoryUse
+{
+public:
+    GQMemoryUse( int category ) : _category(category), _bytes(0) {}
+    // A copy does not take over the bytes of the original.
+    GQMemoryUse( const GQMemoryUse& other ) : _category(other._category), _bytes(0) {}
+    ~GQMemoryUse() { set(0); }
+
+    GQMemoryUse& operator=( const GQMemoryUse& other )
+        { Q_UNUSED(other); return *this; }
+
+    void    set( qint64 bytes );
+    void    add( qint64 bytes ) { set(_bytes + bytes); }
+    qint64  bytes() const { return _bytes; }
+
+    // Moves the bytes already held to the new category.
+    void    setCategory( int category );
+    int     category() const { return _category; }
+
+protected:
+    int     _category;
+    qint64  _bytes;
+};
+
+#endif // _GQ_MEMORY_H_
@@ -0,0 +1,245 @@
+/*****************************************************************************\
+
+GQProfiler.h
+Copyright (c) 2009 Forrester Cole
+
+The recording side of GQStats. Timed scopes and counter updates are
+written as events into a ring buffer owned by the calling thread, so any
+thread can be timed without locks. Names are interned once per call site:
+the __TIME_CODE_BLOCK and counter macros keep the id in a function-local
+static, so afterwards a scope costs two reads of a monotonic nanosecond
+clock and one buffer write.
+
+GQStats drains the buffers (collect) when it is displayed or queried, and
+builds its timer tree from the events. Each buffer has one writer, its
+thread, and one reader, the collecting thread. Events recorded while a
+buffer is full are dropped and counted.
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _GQ_PROFILER_H_
+#define _GQ_PROFILER_H_
+
+#include <QString>
+#include <QVector>
+#include <QList>
+#include <QAtomicInt>
+
+// Apple's gcc 4.2 has no __thread, so on Mac OS X each thread's buffer is
+// found with pthread_getspecific instead, at the cost of a function call 
+// per event. GQ_THREAD_LOCAL is left undefined there.
+#ifdef WIN32
+#define GQ_THREAD_LOCAL __declspec(thread)
+#elif !defined(DARWIN)
+#define GQ_THREAD_LOCAL __thread
+#endif
+
+struct GQProfileEvent
+{
+    enum Type { SCOPE, SET_COUNTER, ADD_TO_COUNTER };
+
+    int     id;
+    short   type;
+    // Nesting depth of a scope in its thread, 0 for the outermost.
+    short   depth;
+    quint64 start;
+    quint64 end;
+    float   value;
+};
+
+// The events of one thread, as returned by GQProfiler::collect.
+struct GQProfileBatch
+{
+    int                     thread;
+    QString                 thread_name;
+    bool                    is_main_thread;
+    int                     dropped;
+    QVector<GQProfileEvent> events;
+};
+
+class GQProfileThread
+{
+public:
+    GQProfileThread( int index, const QString& name, bool is_main );
+    ~GQProfileThread();
+
+    void begin( int id );
+    void end( int id );
+    void record( int type, int id, float value );
+
+    // Reader side.
+    void take( GQProfileBatch& batch );
+    bool hasExited();
+    void setExited() { _exited.fetchAndStoreRelease(1); }
+
+    void setName( const QString& name ) { _name = name; }
+    const QString& name() const { return _name; }
+    int  index() const { return _index; }
+
+    // Copies the ids of the open scopes, outermost first. Only reads 
+    // memory owned by the thread, so it is safe in a signal handler that 
+    // interrupted this thread.
+    int  scopeStack( int* ids, int max_ids ) const;
+
+protected:
+    void push( const GQProfileEvent& event );
+
+protected:
+    enum { CAPACITY = 1 << 15, MAX_DEPTH = 64 };
+
+    struct OpenScope
+    {
+        int     id;
+        quint64 start;
+    };
+
+    // Written only by the owning thread.
+    OpenScope               _stack[MAX_DEPTH];
+    int                     _depth;
+    int                     _write;
+    int                     _cached_read;
+
+    GQProfileEvent*         _events;
+    QAtomicInt              _published;
+    QAtomicInt              _read;
+    QAtomicInt              _dropped;
+    QAtomicInt              _exited;
+
+    int                     _index;
+    QString                 _name;
+    bool                    _is_main;
+};
+
+class GQProfiler
+{
+public:
+    // Monotonic time in nanoseconds.
+    static quint64  ticks();
+
+    // Returns the id for name, creating it on first use. Takes a lock, so
+    // call sites keep the id (the macros below do).
+    static int      scopeId( const QString& name );
+    static QString  scopeName( int id );
+
+    static void     begin( int id ) { currentThread()->begin(id); }
+    static void     end( int id ) { currentThread()->end(id); }
+    static void     setCounter( int id, float value )
+                        { currentThread()->record(GQProfileEvent::SET_COUNTER, id, value); }
+    static void     addToCounter( int id, float value )
+                        { currentThread()->record(GQProfileEvent::ADD_TO_COUNTER, id, value); }
+
+    // Names the calling thread in the stats tree. The main thread's scopes
+    // are shown at the top level; other threads get a branch each.
+    static void     setThreadName( const QString& name );
+
+    // The name of a thread with the given index, or an empty string if 
+    // its buffer is gone.
+    static QString  threadName( int index );
+
+    // The open scopes of the calling thread (see scopeStack) and its index,
+    // or -1 if the thread has not recorded anything. Never registers the 
+    // thread, so it may be called from a signal handler.
+    static int      currentScopes( int* ids, int max_ids, int* thread );
+
+    // Takes the events recorded since the last call, from every thread.
+    // Buffers of threads that have exited are freed once drained.
+    static void     collect( QList<GQProfileBatch>& batches );
+
+    // Measured cost of one timed scope, in nanoseconds.
+    static double   scopeOverhead();
+
+protected:
+    static GQProfileThread* currentThread()
+    {
+        GQProfileThread* current = localThread();
+        if (!current)
+            current = registerThread();
+        return current;
+    }
+    static GQProfileThread* registerThread();
+
+#ifdef GQ_THREAD_LOCAL
+    static GQProfileThread* localThread() { return _current; }
+    static void     setLocalThread( GQProfileThread* thread ) { _current = thread; }
+
+protected:
+    static GQ_THREAD_LOCAL GQProfileThread* _current;
+#else
+    static GQProfileThread* localThread();
+    static void     setLocalThread( GQProfileThread* thread );
+#endif
+};
+
+inline void GQProfileThread::begin( int id )
+{
+    if (_depth < MAX_DEPTH)
+    {
+        _stack[_depth].id = id;
+        _stack[_depth].start = GQProfiler::ticks();
+    }
+    _depth++;
+}
+
+inline void GQProfileThread::end( int id )
+{
+    Q_UNUSED(id);
+    if (_depth == 0)
+        return;
+    _depth--;
+    if (_depth >= MAX_DEPTH)
+        return;
+
+    const OpenScope& scope = _stack[_depth];
+    Q_ASSERT(scope.id == id);
+
+    GQProfileEvent event;
+    event.id = scope.id;
+    event.type = GQProfileEvent::SCOPE;
+    event.depth = _depth;
+    event.start = scope.start;
+    event.end = GQProfiler::ticks();
+    event.value = 0;
+    push(event);
+}
+
+inline int GQProfileThread::scopeStack( int* ids, int max_ids ) const
+{
+    int depth = qMin(qMin(_depth, (int)MAX_DEPTH), max_ids);
+    for (int i = 0; i < depth; i++)
+        ids[i] = _stack[i].id;
+    return depth;
+}
+
+inline void GQProfileThread::record( int type, int id, float value )
+{
+    GQProfileEvent event;
+    event.id = id;
+    event.type = type;
+    event.depth = _depth;
+    event.start = 0;
+    event.end = 0;
+    event.value = value;
+    push(event);
+}
+
+inline void GQProfileThread::push( const GQProfileEvent& event )
+{
+    int next = (_write + 1) & (CAPACITY - 1);
+    if (next == _cached_read)
+    {
+        _cached_read = _read.fetchAndAddAcquire(0);
+        if (next == _cached_read)
+        {
+            _dropped.fetchAndAddRelaxed(1);
+            return;
+        }
+    }
+    _events[_write] = event;
+    _write = next;
+    _published.fetchAndStoreRelease(next);
+}
+
+#endif // _GQ_PROFILER_H_
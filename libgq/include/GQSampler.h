@@ -0,0 +1,92 @@
+/*****************************************************************************\
+
+GQSampler.h
+Copyright (c) 2009 Forrester Cole
+
+A sampling CPU profiler, for profiling a release build without
+instrumenting it further. While running, a SIGPROF interval timer
+interrupts whichever thread is using the CPU; the handler records the
+call stack and the GQStats scopes open on that thread into a fixed pool
+of slots. The pool is drained a few times a second on the thread that
+started the sampler, where identical stacks are merged and counted.
+
+save() symbolizes the stacks and writes them in the collapsed format
+read by flamegraph.pl and speedscope, one stack per line, root first:
+
+    main;[Draw Scene];[Sample Buffer Draw];main;GLViewer::paintGL();... 12
+
+The first frame is the thread name, followed by the open GQStats scopes
+in brackets and then the native frames. Functions in the executable only
+have names if it is linked with -rdynamic.
+
+The handler walks the stack through frame pointers, since backtrace() is
+not safe in a signal handler. A stack ends at the first frame of code
+built without them (the default at -O2 on x86-64, including most system
+libraries), so the libraries and dpix are built with
+-fno-omit-frame-pointer. A sample that interrupts a function before it
+has set up its frame misses the function's caller.
+
+Linux and Mac OS X only; elsewhere start() fails with a warning. The stack
+walk supports x86, x86-64 and (on Linux) ARM64; on other processors the
+samples have only their scopes.
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _GQ_SAMPLER_H_
+#define _GQ_SAMPLER_H_
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QByteArray>
+#include <QTimer>
+
+class GQSampler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum { DEFAULT_FREQUENCY = 500 };
+
+    // Starts sampling at frequency samples per second of CPU time. Call
+    // from a thread with an event loop. Samples taken earlier are kept.
+    // Any SIGPROF handler and ITIMER_PROF timer already set are replaced
+    // until stop().
+    bool    start( int frequency = DEFAULT_FREQUENCY );
+    void    stop();
+    bool    isRunning() const { return _running; }
+
+    // Forgets the samples taken so far.
+    void    clear();
+
+    int     numSamples() const { return _num_samples; }
+    // Samples lost because every slot was full.
+    int     numDropped() const;
+
+    // Writes the samples taken so far as collapsed stacks.
+    bool    save( const QString& filename );
+
+    static GQSampler& instance();
+
+public slots:
+    // Merges the recorded samples into the stack counts.
+    void    collect();
+
+protected:
+    GQSampler();
+
+    QString frameName( void* address, bool is_return_address );
+
+protected:
+    bool                    _running;
+    int                     _num_samples;
+    QTimer                  _collect_timer;
+    // Keyed by the raw thread, scope ids and addresses of a sample.
+    QHash<QByteArray, int>  _stacks;
+    QHash<void*, QString>   _frame_names;
+};
+
+#endif // _GQ_SAMPLER_H_
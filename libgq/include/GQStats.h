@@ -7,6 +7,21 @@ Copyright (c) 2009 Forrester Cole
 Keeps track of performance timers and counters. Inherits QAbstractItemModel
 so the statistics can be viewed in a Qt TreeView.
 
+Timers and the counter macros are recorded by GQProfiler, on any thread,
+and merged into the tree when the stats are displayed or queried (flush).
+The GQStats methods themselves belong to the GUI thread. GPU timers come
+from GQGPUTimer, a few frames late.
+
+reset() marks the end of a frame: the frame's timer and counter values are
+kept in a rolling history, for percentiles (timerPercentile, saveSummary)
+and per-frame series (saveFrameSeries). Between beginTrace and endTrace,
+every CPU scope is also kept with its start and end time, and saveTrace
+writes them in the Chrome trace event format (chrome://tracing).
+
+The "Memory" group shows the categories of GQMemory, current and peak, by
+CPU and GPU. Each frame records the current megabytes like a counter, and
+saveSummary adds the peaks, which beginTrace resets.
+
 libgq is distributed under the terms of the GNU General Public License.
 See the COPYING file for details.
 
@@ -17,10 +32,16 @@ See the COPYING file for details.
 
 #include <QString>
 #include <QList>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
 #include <timestamp.h>
 #include <vector>
 #include <QAbstractItemModel>
 #include "GQInclude.h"
+#include "GQProfiler.h"
+#include "GQGPUTimer.h"
+#include "GQMemory.h"
 
 class GQStats : public QAbstractItemModel
 {
@@ -39,6 +60,10 @@ public:
 
     void updateView();
 
+    // Merges the events recorded by every thread since the last flush.
+    void flush();
+
+    // Slower than the macros, which look the name up only once.
 	void startTimer( const QString& name );
 	void stopTimer( const QString& name );
 
@@ -53,6 +78,9 @@ public:
 	int				numTimers() const { return _records[TIMER].size(); }
 	const QString&	timerName( int which ) const { return _records[TIMER][which].name; }
 	float			timerValue( int which ) const { return _records[TIMER][which].value; }
+    // Total of every timer with this name, wherever it is in the hierarchy.
+    // Flushes first.
+    float           timerValue( const QString& name );
 	
 	int				numCounters() const { return _records[COUNTER].size(); }
 	const QString&	counterName( int which ) const { return _records[COUNTER][which].name; }
@@ -60,6 +88,39 @@ public:
 
     QString timerStatistics( const QString& name );
 
+    // Frames kept in the history. Older frames are dropped.
+    void    setHistoryLength( int frames );
+    int     historyLength() const { return _history_length; }
+    int     numHistoryFrames() const { return _history.size(); }
+
+    // Percentile (0 to 100) over the history of the per-frame total of 
+    // every timer with this name. Returns 0 if it never ran.
+    float   timerPercentile( const QString& name, float percentile );
+    // The per-frame totals of every timer with any of these names, for the
+    // frames where at least one of them ran.
+    void    timerHistory( const QStringList& names, QVector<float>& values );
+    void    clearHistory();
+
+    // Sets the peak of each memory category to its current value.
+    void    resetMemoryPeaks();
+
+    // Starting a trace also clears the history, so the files saved 
+    // afterwards cover the same frames.
+    void    beginTrace();
+    void    endTrace();
+    bool    isTracing() const { return _tracing; }
+
+    // Chrome trace event JSON.
+    bool    saveTrace( const QString& filename );
+    // CSV with one row per frame of the history, times in ms.
+    bool    saveFrameSeries( const QString& filename );
+    // CSV with the mean, p50, p90, p99 and max of each timer, counter and
+    // memory category, then the peak of each memory category.
+    bool    saveSummary( const QString& filename );
+    // All three, as <basename>.json, <basename>_frames.csv and 
+    // <basename>_summary.csv.
+    bool    saveStats( const QString& basename );
+
     // implementation of QAbstractItemModel
     QVariant        data( const QModelIndex& index, int role ) const;
     Qt::ItemFlags   flags( const QModelIndex& index ) const;
@@ -72,17 +133,16 @@ public:
     static GQStats& instance() { return _global_instance; }
 
 protected:
-    enum Category { TIMER, COUNTER, CONSTANT, NUM_CATEGORIES };
+    enum Category { TIMER, COUNTER, CONSTANT, MEMORY, NUM_CATEGORIES };
     class Record
     {
     public:
-        Record() : name(), category(NUM_CATEGORIES), stamp(), 
+        Record() : name(), category(NUM_CATEGORIES), 
                    value(0), str_value(), touches_since_last_reset(0),
                    parent(0), children() {}
     public:
         QString     name;
         Category    category;
-        timestamp   stamp;
         float       value;
         QString     str_value;
         int         touches_since_last_reset;
@@ -103,13 +163,73 @@ protected:
     void    removeTimer( int which );
     void    removeCounter( int which );
 
+    // A finished scope whose parent has not finished yet.
+    struct PendingScope
+    {
+        int                 id;
+        float               seconds;
+        QList<PendingScope> children;
+    };
+    // Scopes waiting for their parents, by depth, for one thread.
+    typedef QList< QList<PendingScope> > PendingScopes;
+
+    // A timer (by path from the top of the tree), counter or memory category
+    // in the history.
+    struct Series
+    {
+        QString     path;
+        QString     name;
+        Category    category;
+    };
+
+    // A finished CPU scope, or a counter value at the end of a frame.
+    struct TraceEvent
+    {
+        int         id;
+        int         thread;
+        bool        is_counter;
+        quint64     start;
+        quint64     end;
+        float       value;
+    };
+
+    void    recordFrame();
+    void    traceCounter( const QString& name, float value, quint64 time );
+    int     seriesIndex( Category category, const QString& path, 
+                         const QString& name );
+    QString timerPath( const Record* timer ) const;
+    void    historyValues( const QList<int>& series, QVector<float>& values ) const;
+
+    void    mergeBatch( const GQProfileBatch& batch );
+    void    addScope( const PendingScope& scope, Record* parent );
+    Record* findOrAddTimer( const QString& name, Record* parent );
+    const QString& scopeName( int id );
+
+    void    updateMemory();
+    Record* findOrAddMemory( const QString& name, Record* parent );
+
 protected:
     QList<Record>       _records[NUM_CATEGORIES];
     Record              _headers[NUM_CATEGORIES];
 
-    QList<Record*>      _timer_stack;
     QList<Record*>      _constant_stack;
 
+    QHash<int, PendingScopes> _pending_scopes;
+    QVector<QString>    _scope_names;
+    int                 _scopes_since_reset;
+
+    QList<Series>       _series;
+    QHash<QString, int> _series_index;
+    // Per frame, the value of each series, or NaN where it did not run.
+    QList< QVector<float> > _history;
+    int                 _history_length;
+
+    bool                _tracing;
+    bool                _trace_full;
+    quint64             _trace_start;
+    QVector<TraceEvent> _trace;
+    QHash<int, QString> _trace_threads;
+
     Record              _dummy_root;
 
     bool                _layout_changed;
@@ -122,55 +242,40 @@ protected:
 // Helper classes, functions, and defines
 //
 
-inline void waitForGLAndStartTimer( const QString& name)
-{
-    glFinish();
-    GQStats::instance().startTimer(name + " (wait GL)");
-}
-inline void waitForGLAndStopTimer( const QString& name)
-{
-    glFinish();
-    GQStats::instance().stopTimer(name + " (wait GL)");
-}
-
 // When this object is created, it starts a timer.
 // When it passes out of scope, it stops the timer.
 class GQScopeTimer
 {
 public:
-    GQScopeTimer( const QString& name ) { _name = name; GQStats::instance().startTimer(name); }
-    ~GQScopeTimer() { GQStats::instance().stopTimer(_name); }
-protected:
-    QString _name;
-};
-
-class GQScopeTimerWaitGL
-{
-public:
-    GQScopeTimerWaitGL( const QString& name ) { _name = name; waitForGLAndStartTimer(name); }
-    ~GQScopeTimerWaitGL() { waitForGLAndStopTimer(_name); }
+    GQScopeTimer( int id ) : _id(id) { GQProfiler::begin(id); }
+    GQScopeTimer( const QString& name ) : _id(GQProfiler::scopeId(name)) 
+        { GQProfiler::begin(_id); }
+    ~GQScopeTimer() { GQProfiler::end(_id); }
 protected:
-    QString _name;
+    int _id;
 };
 
+// The names given to these macros must be constants: each call site looks
+// its name up once and keeps the id. The __GPU variants time the same 
+// scope on the CPU and, without waiting for it, on the GPU.
 #ifndef GQ_NO_TIMERS
-#define __START_TIMER(X) GQStats::instance().startTimer(X);
-#define __STOP_TIMER(X) GQStats::instance().stopTimer(X);
-#define __START_TIMER_AFTER_GL_FINISH(X) waitForGLAndStartTimer(X);
-#define __STOP_TIMER_AFTER_GL_FINISH(X) waitForGLAndStopTimer(X);
-#define __SET_COUNTER(X,Y) GQStats::instance().setCounter((X),(Y));
-#define __ADD_TO_COUNTER(X,Y) GQStats::instance().addToCounter((X),(Y));
-#define __TIME_CODE_BLOCK(X) GQScopeTimer __scope_timer(X);
-#define __TIME_CODE_BLOCK_AFTER_GL_FINISH(X) GQScopeTimerWaitGL __scope_timer(X);
+#define __START_TIMER(X) { static const int __scope_id = GQProfiler::scopeId(X); GQProfiler::begin(__scope_id); }
+#define __STOP_TIMER(X) { static const int __scope_id = GQProfiler::scopeId(X); GQProfiler::end(__scope_id); }
+#define __GPU_START_TIMER(X) { __START_TIMER(X) static const int __gpu_scope_id = GQProfiler::scopeId(QString(X) + " (GPU)"); GQGPUTimer::instance().begin(__gpu_scope_id); }
+#define __GPU_STOP_TIMER(X) { static const int __gpu_scope_id = GQProfiler::scopeId(QString(X) + " (GPU)"); GQGPUTimer::instance().end(__gpu_scope_id); __STOP_TIMER(X) }
+#define __SET_COUNTER(X,Y) { static const int __counter_id = GQProfiler::scopeId(X); GQProfiler::setCounter(__counter_id, (Y)); }
+#define __ADD_TO_COUNTER(X,Y) { static const int __counter_id = GQProfiler::scopeId(X); GQProfiler::addToCounter(__counter_id, (Y)); }
+#define __TIME_CODE_BLOCK(X) static const int __scope_id = GQProfiler::scopeId(X); GQScopeTimer __scope_timer(__scope_id);
+#define __GPU_TIME_CODE_BLOCK(X) __TIME_CODE_BLOCK(X) static const int __gpu_scope_id = GQProfiler::scopeId(QString(X) + " (GPU)"); GQGPUScopeTimer __gpu_scope_timer(__gpu_scope_id);
 #else
 #define __START_TIMER(X) ;
 #define __STOP_TIMER(X) ;
-#define __START_TIMER_AFTER_GL_FINISH(X) ;
-#define __STOP_TIMER_AFTER_GL_FINISH(X) ;
+#define __GPU_START_TIMER(X) ;
+#define __GPU_STOP_TIMER(X) ;
 #define __SET_COUNTER(X,Y) ;
 #define __ADD_TO_COUNTER(X,Y) ;
 #define __TIME_CODE_BLOCK(X) ; 
-#define __TIME_CODE_BLOCK_AFTER_GL_FINISH(X) ;
+#define __GPU_TIME_CODE_BLOCK(X) ;
 #endif
 
 #endif // _GQ_STATS_H_
@@ -16,6 +16,7 @@ See the COPYING file for details.
 
 #include "GQImage.h"
 #include "GQInclude.h"
+#include "GQMemory.h"
 
 #include <QString>
 
@@ -41,8 +42,16 @@ class GQTexture
         
         void clear();
 
+        // Textures are counted as "Textures" in GQMemory unless their
+        // owner gives them another category.
+        void setMemoryCategory( int category ) { _memory.setCategory(category); }
+
     protected:
         int _id;
+
+        // Estimated size of the first level, and of all levels.
+        qint64      _level_bytes;
+        GQMemoryUse _memory;
 };
 
 class GQTexture2D : public GQTexture
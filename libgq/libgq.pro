@@ -22,6 +22,15 @@ else {
 	else {
 		DEFINES += LINUX
 	}
+
+    # Frame pointers, for the stacks in GQSampler's CPU profiles.
+    QMAKE_CXXFLAGS += -fno-omit-frame-pointer
+}
+
+# Build with "qmake CONFIG+=osmesa" to resolve GL extensions through OSMesa,
+# for running dpix-batch without a display.
+osmesa {
+    DEFINES += GQ_USE_OSMESA
 }
 
 CONFIG += staticlib
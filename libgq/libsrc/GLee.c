@@ -46,6 +46,10 @@
 	#include <Carbon/Carbon.h>
 #endif
 
+#ifdef GQ_USE_OSMESA
+	#include <GL/osmesa.h>
+#endif
+
 typedef GLuint(*GLEE_LINK_FUNCTION)(void);
 
 GLboolean __GLeeInited=GL_FALSE;
@@ -76,6 +80,8 @@ void * __GLeeGetProcAddress(const char *extname)
     CFRelease(bundle);
 
     return function;
+#elif defined(GQ_USE_OSMESA)
+	return (void*)OSMesaGetProcAddress(extname);
 #else
 	return (void*)glXGetProcAddressARB((const GLubyte *)extname);
 #endif
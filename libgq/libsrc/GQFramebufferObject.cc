@@ -10,6 +10,7 @@ See the COPYING file for details.
 \*****************************************************************************/
 
 #include "GQFramebufferObject.h"
+#include "GQStats.h"
 
 #include <QtGlobal>
 #include <QFile>
@@ -18,7 +19,13 @@ See the COPYING file for details.
 int GQFramebufferObject::_bound_guid = 0;
 int GQFramebufferObject::_last_used_guid = 1;
 
-GQFramebufferObject::GQFramebufferObject()
+static int framebufferMemory()
+{
+    static const int category = GQMemory::category("Framebuffers", GQMemory::GPU);
+    return category;
+}
+
+GQFramebufferObject::GQFramebufferObject() : _depth_memory(framebufferMemory())
 {
     _fbo = -1;
     clear();
@@ -43,6 +50,7 @@ void GQFramebufferObject::clear()
         {
             glDeleteRenderbuffersEXT(1, (GLuint*)(&_depth_attachment));
         }
+        _depth_memory.set(0);
 
         glDeleteFramebuffersEXT(1, (GLuint*)(&_fbo));
 
@@ -143,6 +151,7 @@ bool GQFramebufferObject::initGL(int target, int format,
         for (int i = 0; i < _num_color_attachments; i++)
         {
             _color_attachments[i] = new GQTexture2D;
+            _color_attachments[i]->setMemoryCategory(framebufferMemory());
             _color_attachments[i]->create(_width, _height, _gl_format, 
                     GL_RGBA, GL_UNSIGNED_BYTE, NULL, _gl_target);
 
@@ -159,6 +168,7 @@ bool GQFramebufferObject::initGL(int target, int format,
             glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, _depth_attachment);
             glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, 
                     _width, _height);
+            _depth_memory.set((qint64)_width * _height * 4);
             glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, 
                     GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, 
                     _depth_attachment);
@@ -342,6 +352,7 @@ void GQFramebufferObject::loadColorTexturei( int which, const GQImage& image )
     glTexSubImage2D( _gl_target, 0, 0,0,_width,_height, format, GL_UNSIGNED_BYTE, 
                    image.raster());
     _color_attachments[which]->unbind();
+    __ADD_TO_COUNTER("bytes uploaded", (float)_width * _height * image.chan());
 }
 
 
@@ -355,6 +366,42 @@ void GQFramebufferObject::loadColorTexturef( int which, const GQFloatImage& imag
     glTexSubImage2D( _gl_target, 0, 0,0,_width,_height, format, GL_FLOAT, 
                    image.raster());
     _color_attachments[which]->unbind();
+    __ADD_TO_COUNTER("bytes uploaded", 
+                     (float)_width * _height * image.chan() * sizeof(float));
+}
+
+// Uploads the region (x, y, width, height) of the texture, leaving the rest
+// untouched. image is either the size of the texture, and the region is
+// read from the same place in it, or the size of the region.
+void GQFramebufferObject::loadSubColorTexturef( int which, int x, int y, int width, int height,
+                                                const GQFloatImage& image )
+{
+    assert( which >= 0 && which < _num_color_attachments );
+    assert( x >= 0 && y >= 0 && x + width <= _width && y + height <= _height );
+    if (width <= 0 || height <= 0)
+        return;
+
+    bool full_size = image.width() == _width && image.height() == _height;
+    assert( full_size || (image.width() == width && image.height() == height) );
+
+    _color_attachments[which]->bind();
+    int format = GL_RGBA;
+    if (image.chan() == 3)
+        format = GL_RGB;
+    if (full_size)
+    {
+        glPixelStorei( GL_UNPACK_ROW_LENGTH, _width );
+        glPixelStorei( GL_UNPACK_SKIP_PIXELS, x );
+        glPixelStorei( GL_UNPACK_SKIP_ROWS, y );
+    }
+    glTexSubImage2D( _gl_target, 0, x, y, width, height, format, GL_FLOAT, 
+                   image.raster());
+    glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+    glPixelStorei( GL_UNPACK_SKIP_PIXELS, 0 );
+    glPixelStorei( GL_UNPACK_SKIP_ROWS, 0 );
+    _color_attachments[which]->unbind();
+    __ADD_TO_COUNTER("bytes uploaded", 
+                     (float)width * height * image.chan() * sizeof(float));
 }
 
 void GQFramebufferObject::readSubColorTexturei( int which, int x, int y, int width, int height,
@@ -489,6 +536,7 @@ bool GQSingleFBO::init( int target, int format, uint32 attachments,
         for (int i = 0; i < _num_color_attachments; i++)
         {
             _color_attachments[i] = new GQTexture2D;
+            _color_attachments[i]->setMemoryCategory(framebufferMemory());
             _color_attachments[i]->create(_width, _height, _gl_format, GL_RGBA, GL_UNSIGNED_BYTE, NULL, _gl_target);
         }
 
@@ -503,6 +551,7 @@ bool GQSingleFBO::init( int target, int format, uint32 attachments,
             glGenRenderbuffersEXT(1, (GLuint*)(&_depth_attachment));
             glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, _depth_attachment);
             glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, _width, _height);
+            _depth_memory.set((qint64)_width * _height * 4);
             glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, _depth_attachment);
         }
         else
@@ -0,0 +1,184 @@
+/*****************************************************************************\
+
+GQGPUTimer.cc
+Copyright (c) 2009 Forrester Cole
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQGPUTimer.h"
+
+// Frames waiting for their queries. Results usually arrive within two or
+// three frames; past this the oldest frame is dropped rather than waited
+// for, so the timers never stall the pipeline.
+const int MAX_PENDING_FRAMES = 8;
+
+// Queries created at a time when the pool runs out.
+const int QUERY_POOL_GROWTH = 64;
+
+GQGPUTimer::GQGPUTimer()
+{
+    _supported = -1;
+    _query_active = false;
+    _dropped = 0;
+}
+
+GQGPUTimer& GQGPUTimer::instance()
+{
+    static GQGPUTimer the_instance;
+    return the_instance;
+}
+
+bool GQGPUTimer::isSupported()
+{
+    if (_supported < 0)
+    {
+        _supported = GLEE_EXT_timer_query ? 1 : 0;
+        if (!_supported)
+            qWarning("GQGPUTimer: GL_EXT_timer_query not supported, GPU timers disabled.");
+    }
+    return _supported == 1;
+}
+
+void GQGPUTimer::begin( int id )
+{
+    if (!isSupported())
+        return;
+
+    endQuery();
+
+    OpenScope scope;
+    scope.id = id;
+    scope.first_query = _current.queries.size();
+    _stack.append(scope);
+
+    beginQuery();
+}
+
+void GQGPUTimer::end( int id )
+{
+    Q_UNUSED(id);
+    if (_stack.isEmpty())
+        return;
+
+    endQuery();
+
+    const OpenScope& open = _stack.last();
+    Q_ASSERT(open.id == id);
+
+    ClosedScope scope;
+    scope.id = open.id;
+    scope.first_query = open.first_query;
+    scope.end_query = _current.queries.size();
+    _stack.removeLast();
+    scope.depth = _stack.size();
+    _current.scopes.append(scope);
+
+    if (!_stack.isEmpty())
+        beginQuery();
+}
+
+void GQGPUTimer::beginQuery()
+{
+    if (_free_queries.isEmpty())
+    {
+        _free_queries.resize(QUERY_POOL_GROWTH);
+        glGenQueries(QUERY_POOL_GROWTH, _free_queries.data());
+    }
+
+    GLuint query = _free_queries.last();
+    _free_queries.removeLast();
+    _current.queries.append(query);
+
+    glBeginQuery(GL_TIME_ELAPSED_EXT, query);
+    _query_active = true;
+}
+
+void GQGPUTimer::endQuery()
+{
+    if (_query_active)
+    {
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        _query_active = false;
+    }
+}
+
+void GQGPUTimer::endFrame()
+{
+    // A scope still open carries the frame over.
+    if (!_stack.isEmpty())
+        return;
+
+    if (!_current.queries.isEmpty())
+    {
+        _pending.append(_current);
+        _current = Frame();
+    }
+
+    // Queries finish in order, so only the oldest frame needs checking.
+    while (!_pending.isEmpty())
+    {
+        const Frame& frame = _pending.first();
+        if (!readFrame(frame))
+        {
+            if (_pending.size() <= MAX_PENDING_FRAMES)
+                break;
+            _dropped += frame.scopes.size();
+        }
+        releaseFrame(frame);
+        _pending.removeFirst();
+    }
+}
+
+bool GQGPUTimer::readFrame( const Frame& frame )
+{
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries.last(), GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+
+    QVector<GLuint64EXT> elapsed(frame.queries.size());
+    for (int i = 0; i < frame.queries.size(); i++)
+        glGetQueryObjectui64vEXT(frame.queries[i], GL_QUERY_RESULT, &elapsed[i]);
+
+    for (int i = 0; i < frame.scopes.size(); i++)
+    {
+        const ClosedScope& scope = frame.scopes[i];
+
+        GQProfileEvent event;
+        event.id = scope.id;
+        event.type = GQProfileEvent::SCOPE;
+        event.depth = scope.depth;
+        event.start = 0;
+        event.end = 0;
+        event.value = 0;
+        for (int j = scope.first_query; j < scope.end_query; j++)
+            event.end += elapsed[j];
+
+        _results.append(event);
+    }
+    return true;
+}
+
+void GQGPUTimer::releaseFrame( const Frame& frame )
+{
+    _free_queries += frame.queries;
+}
+
+bool GQGPUTimer::collect( GQProfileBatch& batch )
+{
+    if (_results.isEmpty() && _dropped == 0)
+        return false;
+
+    batch.thread = -1;
+    batch.thread_name = "GPU";
+    batch.is_main_thread = false;
+    batch.dropped = _dropped;
+    batch.events = _results;
+
+    _results.clear();
+    _dropped = 0;
+    return true;
+}
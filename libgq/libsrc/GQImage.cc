@@ -7,6 +7,13 @@
 #include <string.h>
 #include <stdio.h>
 
+// GQImage and GQFloatImage together.
+static int imageMemory()
+{
+    static const int category = GQMemory::category("Images", GQMemory::CPU);
+    return category;
+}
+
 inline float clamp( float f, float min, float max )
 {
     if (f > max)
@@ -25,20 +32,22 @@ void GQImage::clear()
         delete [] _raster;
         _raster = NULL;
     }
+    _memory.set(0);
 }
 
-GQImage::GQImage() 
+GQImage::GQImage() : _memory(imageMemory())
 { 
     _width = _height = _num_chan = 0; 
     _raster = NULL; 
 }
 
-GQImage::GQImage(int w, int h, int c)
+GQImage::GQImage(int w, int h, int c) : _memory(imageMemory())
 {
     _width    = w;
     _num_chan = c;
     _height   = h;
     _raster   = new uint8[w*h*c];
+    _memory.set((qint64)w*h*c);
 
     if (!_raster)
     {
@@ -63,6 +72,7 @@ bool GQImage::resize(int w, int h, int c)
 
     if (_raster) delete [] _raster;
     _raster = new uint8[w*h*c];
+    _memory.set((qint64)w*h*c);
 
     if (!_raster)
     {
@@ -150,7 +160,7 @@ bool GQImage::load(const QString& filename)
 	return false;
 }
 
-GQFloatImage::GQFloatImage() 
+GQFloatImage::GQFloatImage() : _memory(imageMemory())
 { 
     _width = _height = _num_chan = 0; 
     _raster = NULL; 
@@ -164,14 +174,16 @@ void GQFloatImage::clear()
         delete [] _raster;
         _raster = NULL;
     }
+    _memory.set(0);
 }
 
-GQFloatImage::GQFloatImage(int w, int h, int c)
+GQFloatImage::GQFloatImage(int w, int h, int c) : _memory(imageMemory())
 {
     _width    = w;
     _num_chan = c;
     _height   = h;
     _raster   = new float[w*h*c];
+    _memory.set((qint64)w*h*c*sizeof(float));
 
     if (!_raster)
     {
@@ -196,6 +208,7 @@ bool GQFloatImage::resize(int w, int h, int c)
 
     if (_raster) delete [] _raster;
     _raster = new float[w*h*c];
+    _memory.set((qint64)w*h*c*sizeof(float));
 
     if (!_raster)
     {
@@ -0,0 +1,169 @@
+/*****************************************************************************\
+
+GQMemory.cc
+Copyright (c) 2009 Forrester Cole
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQMemory.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+namespace
+{
+    struct Category
+    {
+        QString         name;
+        GQMemory::Kind  kind;
+        qint64          current;
+        qint64          peak;
+    };
+
+    struct MemoryState
+    {
+        QMutex              mutex;
+        QVector<Category>   categories;
+        QHash<QString, int> index;
+        qint64              total[GQMemory::NUM_KINDS];
+        qint64              total_peak[GQMemory::NUM_KINDS];
+    };
+
+    MemoryState* newState()
+    {
+        MemoryState* memory_state = new MemoryState;
+        for (int i = 0; i < GQMemory::NUM_KINDS; i++)
+        {
+            memory_state->total[i] = 0;
+            memory_state->total_peak[i] = 0;
+        }
+        return memory_state;
+    }
+
+    // Never deleted, so objects destroyed at exit can still release their
+    // memory.
+    MemoryState& state()
+    {
+        static MemoryState* memory_state = newState();
+        return *memory_state;
+    }
+}
+
+int GQMemory::category( const QString& name, Kind kind )
+{
+    MemoryState& memory = state();
+    QMutexLocker lock(&memory.mutex);
+
+    QString key = kindName(kind) + "/" + name;
+    QHash<QString, int>::const_iterator it = memory.index.find(key);
+    if (it != memory.index.end())
+        return it.value();
+
+    Category category;
+    category.name = name;
+    category.kind = kind;
+    category.current = 0;
+    category.peak = 0;
+    memory.categories.append(category);
+    memory.index.insert(key, memory.categories.size() - 1);
+    return memory.categories.size() - 1;
+}
+
+void GQMemory::allocate( int category, qint64 bytes )
+{
+    if (category < 0 || bytes == 0)
+        return;
+
+    MemoryState& memory = state();
+    QMutexLocker lock(&memory.mutex);
+
+    Category& entry = memory.categories[category];
+    entry.current += bytes;
+    entry.peak = qMax(entry.peak, entry.current);
+
+    memory.total[entry.kind] += bytes;
+    memory.total_peak[entry.kind] = qMax(memory.total_peak[entry.kind],
+                                         memory.total[entry.kind]);
+}
+
+void GQMemory::release( int category, qint64 bytes )
+{
+    if (category < 0 || bytes == 0)
+        return;
+
+    MemoryState& memory = state();
+    QMutexLocker lock(&memory.mutex);
+
+    Category& entry = memory.categories[category];
+    if (bytes > entry.current)
+    {
+        qWarning("GQMemory::release: %s released more than it allocated",
+                 qPrintable(entry.name));
+        bytes = entry.current;
+    }
+    entry.current -= bytes;
+    memory.total[entry.kind] -= bytes;
+}
+
+void GQMemory::usage( QList<Usage>& usage )
+{
+    MemoryState& memory = state();
+    QMutexLocker lock(&memory.mutex);
+
+    usage.clear();
+    for (int i = 0; i < memory.categories.size(); i++)
+    {
+        const Category& entry = memory.categories[i];
+        Usage category_usage;
+        category_usage.name = entry.name;
+        category_usage.kind = entry.kind;
+        category_usage.current = entry.current;
+        category_usage.peak = entry.peak;
+        usage.append(category_usage);
+    }
+}
+
+void GQMemory::total( Kind kind, qint64& current, qint64& peak )
+{
+    MemoryState& memory = state();
+    QMutexLocker lock(&memory.mutex);
+
+    current = memory.total[kind];
+    peak = memory.total_peak[kind];
+}
+
+void GQMemory::resetPeaks()
+{
+    MemoryState& memory = state();
+    QMutexLocker lock(&memory.mutex);
+
+    for (int i = 0; i < memory.categories.size(); i++)
+        memory.categories[i].peak = memory.categories[i].current;
+    for (int i = 0; i < NUM_KINDS; i++)
+        memory.total_peak[i] = memory.total[i];
+}
+
+void GQMemoryUse::set( qint64 bytes )
+{
+    if (bytes > _bytes)
+        GQMemory::allocate(_category, bytes - _bytes);
+    else if (bytes < _bytes)
+        GQMemory::release(_category, _bytes - bytes);
+    _bytes = bytes;
+}
+
+void GQMemoryUse::setCategory( int category )
+{
+    if (category == _category)
+        return;
+
+    qint64 bytes = _bytes;
+    set(0);
+    _category = category;
+    set(bytes);
+}
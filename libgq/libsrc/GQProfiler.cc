@@ -0,0 +1,284 @@
+/*****************************************************************************\
+
+GQProfiler.cc
+Copyright (c) 2009 Forrester Cole
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQProfiler.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadStorage>
+#include <QCoreApplication>
+
+#ifdef WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#elif defined(DARWIN)
+# include <mach/mach_time.h>
+# include <pthread.h>
+#else
+# include <time.h>
+#endif
+
+#ifdef GQ_THREAD_LOCAL
+
+GQ_THREAD_LOCAL GQProfileThread* GQProfiler::_current = 0;
+
+#else
+
+// The key is created on first use, since GQStats' static instance may 
+// record before this file's statics are initialized. Once created, 
+// pthread_once is a single check and pthread_getspecific reads a slot of 
+// the thread's own data, so localThread may still be called from a signal
+// handler.
+static pthread_key_t current_key;
+static pthread_once_t current_key_once = PTHREAD_ONCE_INIT;
+
+static void createCurrentKey()
+{
+    pthread_key_create(&current_key, 0);
+}
+
+GQProfileThread* GQProfiler::localThread()
+{
+    pthread_once(&current_key_once, createCurrentKey);
+    return (GQProfileThread*)pthread_getspecific(current_key);
+}
+
+void GQProfiler::setLocalThread( GQProfileThread* thread )
+{
+    pthread_once(&current_key_once, createCurrentKey);
+    pthread_setspecific(current_key, thread);
+}
+
+#endif
+
+// Scopes timed to measure the overhead.
+const int OVERHEAD_SAMPLES = 100000;
+
+// The name table and the list of thread buffers. Built on first use, 
+// since GQStats' static instance may use it before other statics exist.
+struct GQProfileRegistry
+{
+    GQProfileRegistry() : next_thread_index(0) {}
+
+    QMutex                   mutex;
+    QVector<QString>         scope_names;
+    QHash<QString, int>      scope_ids;
+    QList<GQProfileThread*>  threads;
+    int                      next_thread_index;
+};
+
+static GQProfileRegistry& registry()
+{
+    static GQProfileRegistry the_registry;
+    return the_registry;
+}
+
+// Qt deletes the contents of a QThreadStorage when its thread finishes,
+// which tells the collector that the thread's buffer can go once drained.
+class GQProfileThreadExit
+{
+public:
+    GQProfileThreadExit( GQProfileThread* thread ) : _thread(thread) {}
+    ~GQProfileThreadExit() { _thread->setExited(); }
+protected:
+    GQProfileThread* _thread;
+};
+
+static QThreadStorage<GQProfileThreadExit*> thread_exits;
+
+GQProfileThread::GQProfileThread( int index, const QString& name, bool is_main )
+{
+    _depth = 0;
+    _write = 0;
+    _cached_read = 0;
+    _events = new GQProfileEvent[CAPACITY];
+    _index = index;
+    _name = name;
+    _is_main = is_main;
+}
+
+GQProfileThread::~GQProfileThread()
+{
+    delete [] _events;
+}
+
+bool GQProfileThread::hasExited()
+{
+    return _exited.fetchAndAddAcquire(0) != 0;
+}
+
+void GQProfileThread::take( GQProfileBatch& batch )
+{
+    batch.thread = _index;
+    batch.thread_name = _name;
+    batch.is_main_thread = _is_main;
+    batch.dropped = _dropped.fetchAndStoreRelaxed(0);
+    batch.events.clear();
+
+    int read = _read.fetchAndAddAcquire(0);
+    int write = _published.fetchAndAddAcquire(0);
+    int count = (write - read) & (CAPACITY - 1);
+    batch.events.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        batch.events[i] = _events[read];
+        read = (read + 1) & (CAPACITY - 1);
+    }
+    _read.fetchAndStoreRelease(read);
+}
+
+quint64 GQProfiler::ticks()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency;
+    static BOOL has_frequency = QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER count;
+    if (!has_frequency || !QueryPerformanceCounter(&count))
+        return 0;
+    quint64 seconds = count.QuadPart / frequency.QuadPart;
+    quint64 remainder = count.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000ULL + remainder * 1000000000ULL / frequency.QuadPart;
+#elif defined(DARWIN)
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (quint64)t.tv_sec * 1000000000ULL + t.tv_nsec;
+#endif
+}
+
+int GQProfiler::scopeId( const QString& name )
+{
+    GQProfileRegistry& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+    QHash<QString, int>::const_iterator it = reg.scope_ids.find(name);
+    if (it != reg.scope_ids.end())
+        return it.value();
+
+    int id = reg.scope_names.size();
+    reg.scope_names.append(name);
+    reg.scope_ids.insert(name, id);
+    return id;
+}
+
+QString GQProfiler::scopeName( int id )
+{
+    GQProfileRegistry& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+    if (id < 0 || id >= reg.scope_names.size())
+        return QString();
+    return reg.scope_names[id];
+}
+
+GQProfileThread* GQProfiler::registerThread()
+{
+    GQProfileRegistry& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+
+    QCoreApplication* app = QCoreApplication::instance();
+    bool is_main = app && QThread::currentThread() == app->thread();
+
+    int index = reg.next_thread_index++;
+    QString name = is_main ? QString("main") : QString("thread %1").arg(index);
+    GQProfileThread* current = new GQProfileThread(index, name, is_main);
+    reg.threads.append(current);
+    setLocalThread(current);
+
+    // The main thread's buffer lives as long as the program.
+    if (!is_main)
+        thread_exits.setLocalData(new GQProfileThreadExit(current));
+    return current;
+}
+
+void GQProfiler::setThreadName( const QString& name )
+{
+    GQProfileThread* thread = currentThread();
+    QMutexLocker locker(&registry().mutex);
+    thread->setName(name);
+}
+
+QString GQProfiler::threadName( int index )
+{
+    GQProfileRegistry& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+    for (int i = 0; i < reg.threads.size(); i++)
+    {
+        if (reg.threads[i]->index() == index)
+            return reg.threads[i]->name();
+    }
+    return QString();
+}
+
+int GQProfiler::currentScopes( int* ids, int max_ids, int* thread )
+{
+    GQProfileThread* current = localThread();
+    if (!current)
+    {
+        *thread = -1;
+        return 0;
+    }
+    *thread = current->index();
+    return current->scopeStack(ids, max_ids);
+}
+
+void GQProfiler::collect( QList<GQProfileBatch>& batches )
+{
+    GQProfileRegistry& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+
+    batches.clear();
+    for (int i = reg.threads.size() - 1; i >= 0; i--)
+    {
+        GQProfileThread* thread = reg.threads[i];
+        // Check before draining, so nothing the thread wrote is lost.
+        bool exited = thread->hasExited();
+
+        GQProfileBatch batch;
+        thread->take(batch);
+        if (!batch.events.isEmpty() || batch.dropped > 0)
+            batches.prepend(batch);
+
+        if (exited)
+        {
+            delete thread;
+            reg.threads.removeAt(i);
+        }
+    }
+}
+
+double GQProfiler::scopeOverhead()
+{
+    static double overhead = -1;
+    if (overhead >= 0)
+        return overhead;
+
+    // Time scopes in a private buffer, so nothing shows up in the stats.
+    GQProfileThread scratch(-1, QString(), false);
+    quint64 start = ticks();
+    for (int i = 0; i < OVERHEAD_SAMPLES; i++)
+    {
+        scratch.begin(0);
+        scratch.end(0);
+        if ((i & 1023) == 1023)
+        {
+            GQProfileBatch batch;
+            scratch.take(batch);
+        }
+    }
+    quint64 elapsed = ticks() - start;
+
+    overhead = (double)elapsed / OVERHEAD_SAMPLES;
+    return overhead;
+}
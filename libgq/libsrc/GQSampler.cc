@@ -0,0 +1,400 @@
+/*****************************************************************************\
+
+GQSampler.cc
+Copyright (c) 2009 Forrester Cole
+
+libgq is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "GQSampler.h"
+#include "GQProfiler.h"
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QTextStream>
+#include <QVector>
+
+#include <string.h>
+
+#ifndef WIN32
+# include <errno.h>
+# include <signal.h>
+# include <sys/time.h>
+# ifdef DARWIN
+#  include <sys/ucontext.h>
+# else
+#  include <ucontext.h>
+# endif
+# include <dlfcn.h>
+# include <cxxabi.h>
+# include <stdlib.h>
+#endif
+
+// Stack depth recorded per sample; deeper stacks lose their outermost
+// frames.
+const int MAX_FRAMES = 64;
+const int MAX_SCOPES = 16;
+// The largest stack frame the frame pointer walk steps over. Anything
+// further is taken to be a register that does not hold a frame pointer.
+const int MAX_FRAME_BYTES = 1 << 17;
+// Must be a power of two. Enough for several threads at the highest
+// frequency between two collections.
+const int SAMPLE_SLOTS = 1 << 12;
+const int COLLECT_INTERVAL_MS = 250;
+const int MAX_FREQUENCY = 10000;
+
+namespace
+{
+    enum { SLOT_EMPTY, SLOT_WRITING, SLOT_FULL };
+
+    struct Sample
+    {
+        QAtomicInt  state;
+        int         thread;
+        int         num_frames;
+        int         num_scopes;
+        void*       frames[MAX_FRAMES];
+        int         scopes[MAX_SCOPES];
+    };
+
+    // Allocated on the first start and never freed, since a handler may
+    // still be running on another thread after the timer is stopped.
+    Sample*     sample_slots = 0;
+    QAtomicInt  next_slot;
+    QAtomicInt  dropped_samples;
+}
+
+#ifndef WIN32
+
+static struct sigaction old_action;
+static struct itimerval old_timer;
+
+// The program counter, frame pointer and stack pointer of the interrupted
+// code. Returns false on processors the walk does not support.
+static bool contextRegisters( void* context, void** pc, void*** fp, void*** sp )
+{
+    ucontext_t* uc = (ucontext_t*)context;
+#if defined(DARWIN) && defined(__x86_64__)
+    *pc = (void*)uc->uc_mcontext->__ss.__rip;
+    *fp = (void**)uc->uc_mcontext->__ss.__rbp;
+    *sp = (void**)uc->uc_mcontext->__ss.__rsp;
+#elif defined(DARWIN) && defined(__i386__)
+    *pc = (void*)uc->uc_mcontext->__ss.__eip;
+    *fp = (void**)uc->uc_mcontext->__ss.__ebp;
+    *sp = (void**)uc->uc_mcontext->__ss.__esp;
+#elif defined(DARWIN)
+    Q_UNUSED(uc);
+    return false;
+#elif defined(__x86_64__)
+    *pc = (void*)uc->uc_mcontext.gregs[REG_RIP];
+    *fp = (void**)uc->uc_mcontext.gregs[REG_RBP];
+    *sp = (void**)uc->uc_mcontext.gregs[REG_RSP];
+#elif defined(__i386__)
+    *pc = (void*)uc->uc_mcontext.gregs[REG_EIP];
+    *fp = (void**)uc->uc_mcontext.gregs[REG_EBP];
+    *sp = (void**)uc->uc_mcontext.gregs[REG_ESP];
+#elif defined(__aarch64__)
+    *pc = (void*)uc->uc_mcontext.pc;
+    *fp = (void**)uc->uc_mcontext.regs[29];
+    *sp = (void**)uc->uc_mcontext.sp;
+#else
+    Q_UNUSED(uc);
+    return false;
+#endif
+    return true;
+}
+
+// Records the interrupted pc and the return addresses of the frame pointer
+// chain. backtrace() would be simpler, but it is not async-signal-safe: it
+// can take the dynamic loader's lock, and deadlock if the signal arrives
+// while the thread holds it. Each frame starts with the caller's frame
+// pointer and the return address, and must lie above the one before it
+// on the stack; the walk ends at the first that does not, as in code built
+// without frame pointers.
+static int walkStack( void* context, void** frames, int max_frames )
+{
+    void* pc;
+    void** fp;
+    void** sp;
+    if (!contextRegisters(context, &pc, &fp, &sp))
+        return 0;
+
+    int num_frames = 0;
+    frames[num_frames++] = pc;
+
+    void** bound = sp;
+    while (num_frames < max_frames && fp >= bound &&
+           (quintptr)fp - (quintptr)bound < (quintptr)MAX_FRAME_BYTES &&
+           ((quintptr)fp & (sizeof(void*) - 1)) == 0)
+    {
+        void* return_address = fp[1];
+        if (!return_address)
+            break;
+        frames[num_frames++] = return_address;
+        bound = fp + 2;
+        fp = (void**)fp[0];
+    }
+    return num_frames;
+}
+
+static void sampleHandler( int sig, siginfo_t* info, void* context )
+{
+    Q_UNUSED(sig);
+    Q_UNUSED(info);
+
+    int saved_errno = errno;
+
+    int slot = next_slot.fetchAndAddRelaxed(1) & (SAMPLE_SLOTS - 1);
+    Sample& sample = sample_slots[slot];
+    if (!sample.state.testAndSetAcquire(SLOT_EMPTY, SLOT_WRITING))
+    {
+        dropped_samples.fetchAndAddRelaxed(1);
+        errno = saved_errno;
+        return;
+    }
+
+    sample.num_frames = walkStack(context, sample.frames, MAX_FRAMES);
+
+    sample.num_scopes = GQProfiler::currentScopes(sample.scopes, MAX_SCOPES,
+                                                  &sample.thread);
+
+    sample.state.fetchAndStoreRelease(SLOT_FULL);
+    errno = saved_errno;
+}
+
+#endif
+
+GQSampler::GQSampler()
+{
+    _running = false;
+    _num_samples = 0;
+    connect(&_collect_timer, SIGNAL(timeout()), this, SLOT(collect()));
+}
+
+GQSampler& GQSampler::instance()
+{
+    static GQSampler the_instance;
+    return the_instance;
+}
+
+bool GQSampler::start( int frequency )
+{
+#ifdef WIN32
+    Q_UNUSED(frequency);
+    qWarning("GQSampler::start: sampling is not supported on this platform.");
+    return false;
+#else
+    if (_running)
+        return true;
+
+    if (frequency <= 0 || frequency > MAX_FREQUENCY)
+    {
+        qWarning("GQSampler::start: frequency must be between 1 and %d Hz (got %d).",
+                 MAX_FREQUENCY, frequency);
+        return false;
+    }
+
+    if (!sample_slots)
+    {
+        sample_slots = new Sample[SAMPLE_SLOTS];
+        for (int i = 0; i < SAMPLE_SLOTS; i++)
+            sample_slots[i].state = SLOT_EMPTY;
+    }
+
+    // The profiler's thread key on Mac OS X is created on first use, which
+    // must not happen inside the handler (see GQProfiler.h).
+    int scope, thread;
+    GQProfiler::currentScopes(&scope, 1, &thread);
+
+    struct sigaction action;
+    action.sa_sigaction = sampleHandler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &old_action) != 0)
+    {
+        qWarning("GQSampler::start: could not install the SIGPROF handler.");
+        return false;
+    }
+
+    struct itimerval timer;
+    // tv_usec must stay below one second, or setitimer fails at 1 Hz.
+    int period_usec = 1000000 / frequency;
+    timer.it_interval.tv_sec = period_usec / 1000000;
+    timer.it_interval.tv_usec = period_usec % 1000000;
+    timer.it_value = timer.it_interval;
+    // The timer this replaces, if any, is restored by stop().
+    if (setitimer(ITIMER_PROF, &timer, &old_timer) != 0)
+    {
+        qWarning("GQSampler::start: could not start the profiling timer.");
+        sigaction(SIGPROF, &old_action, 0);
+        return false;
+    }
+
+    _collect_timer.start(COLLECT_INTERVAL_MS);
+    _running = true;
+    return true;
+#endif
+}
+
+void GQSampler::stop()
+{
+#ifndef WIN32
+    if (!_running)
+        return;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 0;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, 0);
+    sigaction(SIGPROF, &old_action, 0);
+    setitimer(ITIMER_PROF, &old_timer, 0);
+
+    _collect_timer.stop();
+    _running = false;
+    collect();
+#endif
+}
+
+void GQSampler::clear()
+{
+    collect();
+    _stacks.clear();
+    _num_samples = 0;
+    dropped_samples.fetchAndStoreRelaxed(0);
+}
+
+int GQSampler::numDropped() const
+{
+    return dropped_samples.fetchAndAddRelaxed(0);
+}
+
+void GQSampler::collect()
+{
+    if (!sample_slots)
+        return;
+
+    QByteArray key;
+    for (int i = 0; i < SAMPLE_SLOTS; i++)
+    {
+        Sample& sample = sample_slots[i];
+        if (sample.state.fetchAndAddAcquire(0) != SLOT_FULL)
+            continue;
+
+        key.clear();
+        key.append((const char*)&sample.thread, sizeof(int));
+        key.append((const char*)&sample.num_scopes, sizeof(int));
+        key.append((const char*)sample.scopes, sample.num_scopes * sizeof(int));
+        key.append((const char*)sample.frames, sample.num_frames * sizeof(void*));
+        _stacks[key]++;
+        _num_samples++;
+
+        sample.state.fetchAndStoreRelease(SLOT_EMPTY);
+    }
+}
+
+// The function containing address, or the module and offset if it has
+// no symbol. Return addresses point past the call, so one byte is
+// subtracted to stay within the calling function.
+QString GQSampler::frameName( void* address, bool is_return_address )
+{
+    QHash<void*, QString>::const_iterator it = _frame_names.find(address);
+    if (it != _frame_names.end())
+        return it.value();
+
+    QString name;
+#ifndef WIN32
+    const char* lookup = (const char*)address - (is_return_address ? 1 : 0);
+    Dl_info dl_info;
+    bool found = dladdr(lookup, &dl_info) != 0;
+    if (found && dl_info.dli_sname)
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(dl_info.dli_sname, 0, 0, &status);
+        name = (status == 0 && demangled) ? QString(demangled)
+                                          : QString(dl_info.dli_sname);
+        free(demangled);
+    }
+    else if (found && dl_info.dli_fname)
+    {
+        name = QString("%1+0x%2").arg(QFileInfo(dl_info.dli_fname).fileName())
+            .arg((quintptr)lookup - (quintptr)dl_info.dli_fbase, 0, 16);
+    }
+    else
+    {
+        name = QString("0x%1").arg((quintptr)address, 0, 16);
+    }
+#else
+    Q_UNUSED(is_return_address);
+    name = QString("0x%1").arg((quintptr)address, 0, 16);
+#endif
+    // Semicolons separate the frames of a collapsed stack.
+    name.replace(';', ':');
+
+    _frame_names.insert(address, name);
+    return name;
+}
+
+bool GQSampler::save( const QString& filename )
+{
+    collect();
+
+    // Stacks that differ only in return addresses within the same
+    // functions are merged once they are symbolized.
+    QMap<QString, int> lines;
+    QHash<int, QString> thread_names;
+    int scopes[MAX_SCOPES];
+    void* frames[MAX_FRAMES];
+    QHash<QByteArray, int>::const_iterator it;
+    for (it = _stacks.begin(); it != _stacks.end(); ++it)
+    {
+        // The key is not aligned for pointers, so copy it out (see collect).
+        const char* data = it.key().constData();
+        int thread, num_scopes;
+        memcpy(&thread, data, sizeof(int));
+        memcpy(&num_scopes, data + sizeof(int), sizeof(int));
+        int scopes_size = num_scopes * sizeof(int);
+        memcpy(scopes, data + 2*sizeof(int), scopes_size);
+        int frames_size = it.key().size() - 2*sizeof(int) - scopes_size;
+        memcpy(frames, data + 2*sizeof(int) + scopes_size, frames_size);
+        int num_frames = frames_size / sizeof(void*);
+
+        if (!thread_names.contains(thread))
+        {
+            QString name = thread >= 0 ? GQProfiler::threadName(thread)
+                                       : QString("unregistered thread");
+            if (name.isEmpty())
+                name = QString("thread %1").arg(thread);
+            thread_names[thread] = name.replace(';', ':');
+        }
+
+        QString line = thread_names[thread];
+        for (int i = 0; i < num_scopes; i++)
+            line += ";[" + GQProfiler::scopeName(scopes[i]).replace(';', ':') + "]";
+        for (int i = num_frames - 1; i >= 0; i--)
+            line += ";" + frameName(frames[i], i > 0);
+
+        lines[line] += it.value();
+    }
+
+    QFile file(filename);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qWarning("GQSampler::save: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QTextStream out(&file);
+    QMap<QString, int>::const_iterator line;
+    for (line = lines.begin(); line != lines.end(); ++line)
+        out << line.key() << " " << line.value() << "\n";
+
+    if (numDropped() > 0)
+        qWarning("GQSampler::save: %d samples were dropped.", numDropped());
+
+    return true;
+}
@@ -12,12 +12,66 @@ See the COPYING file for details.
 #include "GQStats.h"
 #include "timestamp.h"
 #include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#include <QFile>
+#include <QTextStream>
 
 GQStats GQStats::_global_instance;
 
+const int DEFAULT_HISTORY_LENGTH = 1000;
+
+// Keeps a forgotten trace from eating all the memory (about 40 MB).
+const int MAX_TRACE_EVENTS = 1 << 20;
+
+// Nearest-rank percentile of sorted values.
+static float sortedPercentile( const QVector<float>& sorted, float percentile )
+{
+    if (sorted.isEmpty())
+        return 0;
+    int rank = (int)ceil(percentile * 0.01f * sorted.size()) - 1;
+    rank = qBound(0, rank, sorted.size() - 1);
+    return sorted[rank];
+}
+
+static QString csvString( const QString& str )
+{
+    QString escaped = str;
+    escaped.replace("\"", "\"\"");
+    return QString("\"%1\"").arg(escaped);
+}
+
+static float megabytes( qint64 bytes )
+{
+    return bytes / (1024.0f * 1024.0f);
+}
+
+static QString jsonString( const QString& str )
+{
+    QString escaped;
+    for (int i = 0; i < str.size(); i++)
+    {
+        QChar c = str[i];
+        if (c == '"' || c == '\\')
+            escaped += QString("\\") + c;
+        else if (c.unicode() < 0x20)
+            escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        else
+            escaped += c;
+    }
+    return QString("\"%1\"").arg(escaped);
+}
+
 bool GQStats::init()
 {
     _dummy_root.children.clear();
+    _scopes_since_reset = 0;
+    _history_length = DEFAULT_HISTORY_LENGTH;
+    _tracing = false;
+    _trace_full = false;
+    _trace_start = 0;
 
     for (int i = 0; i < NUM_CATEGORIES; i++)
     {
@@ -34,6 +88,9 @@ bool GQStats::init()
     _headers[CONSTANT].name = "Constants";
     _headers[CONSTANT].category = CONSTANT;
 
+    _headers[MEMORY].name = "Memory";
+    _headers[MEMORY].category = MEMORY;
+
     clear();
 
     return true;
@@ -41,14 +98,17 @@ bool GQStats::init()
 
 void GQStats::clear()
 {
+    // Merge first, so the events recorded so far are not counted again.
+    flush();
+
     for (int i = 0; i < NUM_CATEGORIES; i++)
     {
         _records[i].clear();
         _headers[i].children.clear();
     }
 
-    _timer_stack.clear();
     _constant_stack.clear();
+    _scopes_since_reset = 0;
 
     _layout_changed = false;
     _data_changed = false;
@@ -57,12 +117,14 @@ void GQStats::clear()
 
 void GQStats::clearCategory( GQStats::Category which )
 {
+    flush();
+
     _records[which].clear();
     _headers[which].children.clear();
 
     switch (which)
     {
-        case TIMER : _timer_stack.clear(); break;
+        case TIMER : _scopes_since_reset = 0; break;
         case CONSTANT : _constant_stack.clear(); break;
         default : break; 
     }
@@ -74,8 +136,11 @@ void GQStats::clearCategory( GQStats::Category which )
 
 void GQStats::reset()
 {
-    //assert( _timer_stack.size() == 0 );
-    _timer_stack.clear();
+    // Scopes still open carry over to the next frame.
+    flush();
+    updateMemory();
+    recordFrame();
+    _scopes_since_reset = 0;
 
     // remove any timers or counters that were not used since the last reset.
 
@@ -113,6 +178,14 @@ void GQStats::reset()
 
 void GQStats::updateView()
 {
+    flush();
+    if (_scopes_since_reset > 0)
+    {
+        float overhead = _scopes_since_reset * GQProfiler::scopeOverhead() * 1e-6;
+        setCounter("profiler overhead (ms)", overhead);
+    }
+    updateMemory();
+
     if (_layout_changed)
     {
         QAbstractItemModel::reset();
@@ -158,6 +231,19 @@ int GQStats::findTimer( const QString& name, const Record* parent )
 	return index;
 }
 
+float GQStats::timerValue( const QString& name )
+{
+    flush();
+
+    float total = 0;
+    for (int i = 0; i < _records[TIMER].size(); i++)
+    {
+        if (_records[TIMER][i].name == name)
+            total += _records[TIMER][i].value;
+    }
+    return total;
+}
+
 int GQStats::findTimer( const Record* pointer )
 {
 	int index = -1;
@@ -227,53 +313,136 @@ void GQStats::removeCounter( int which )
 
 void GQStats::startTimer( const QString& name )
 {
-    int index = findTimer(name, _timer_stack.isEmpty() ? 0 : _timer_stack.last());	
-    if (index == -1)
-	{
-        index = _records[TIMER].size();
-        Record newtimer;
-        newtimer.name = name;
-        newtimer.category = TIMER;
-        newtimer.stamp = now();
-        newtimer.value = 0;
-        _records[TIMER].append(newtimer);
-        Record* pointer = &(_records[TIMER].last());
-
-        if (_timer_stack.size() > 0)
+    GQProfiler::begin(GQProfiler::scopeId(name));
+}
+
+void GQStats::stopTimer( const QString& name )
+{
+    GQProfiler::end(GQProfiler::scopeId(name));
+}
+
+void GQStats::flush()
+{
+    QList<GQProfileBatch> batches;
+    GQProfiler::collect(batches);
+    for (int i = 0; i < batches.size(); i++)
+        mergeBatch(batches[i]);
+
+    GQProfileBatch gpu_batch;
+    if (GQGPUTimer::instance().collect(gpu_batch))
+        mergeBatch(gpu_batch);
+}
+
+// Events arrive in the order the scopes ended, so a scope's children
+// (one level deeper) are all pending when it ends. A scope whose parent
+// is still open waits, possibly until a later flush.
+void GQStats::mergeBatch( const GQProfileBatch& batch )
+{
+    PendingScopes& pending = _pending_scopes[batch.thread];
+    Record* root = &_headers[TIMER];
+    if (!batch.is_main_thread)
+        root = 0;
+
+    for (int i = 0; i < batch.events.size(); i++)
+    {
+        const GQProfileEvent& event = batch.events[i];
+        if (event.type == GQProfileEvent::SET_COUNTER)
         {
-            assert( findTimer(_timer_stack.last()) < findTimer(pointer) );
-            pointer->parent = _timer_stack.last();
-            _timer_stack.last()->children.append(pointer);
+            setCounter(scopeName(event.id), event.value);
+            continue;
         }
-        else
+        else if (event.type == GQProfileEvent::ADD_TO_COUNTER)
         {
-            pointer->parent = &_headers[TIMER];
-            _headers[TIMER].children.append(pointer);
+            addToCounter(scopeName(event.id), event.value);
+            continue;
         }
 
-        _layout_changed = true;
-	}
-	else
-	{
-		_records[TIMER][index].stamp = now();
-	}
+        int depth = event.depth;
+        while (pending.size() < depth + 2)
+            pending.append(QList<PendingScope>());
+
+        // GPU scopes have no start time and are left out of traces.
+        if (_tracing && !_trace_full && event.start >= _trace_start)
+        {
+            TraceEvent trace_event;
+            trace_event.id = event.id;
+            trace_event.thread = batch.thread;
+            trace_event.is_counter = false;
+            trace_event.start = event.start;
+            trace_event.end = event.end;
+            trace_event.value = 0;
+            _trace.append(trace_event);
+            _trace_threads[batch.thread] = batch.thread_name;
+        }
+
+        PendingScope scope;
+        scope.id = event.id;
+        scope.seconds = (event.end - event.start) * 1e-9;
+        scope.children = pending[depth + 1];
+        pending[depth + 1].clear();
+        _scopes_since_reset++;
+
+        if (depth > 0)
+        {
+            pending[depth].append(scope);
+            continue;
+        }
 
-    _records[TIMER][index].touches_since_last_reset++;
-    _timer_stack.append(&(_records[TIMER][index]));
+        // Other threads' scopes go under a timer named for the thread.
+        if (!root)
+            root = findOrAddTimer(batch.thread_name, &_headers[TIMER]);
+        if (root != &_headers[TIMER])
+        {
+            root->value += scope.seconds;
+            root->touches_since_last_reset++;
+        }
+        addScope(scope, root);
+    }
+
+    if (batch.dropped > 0)
+        addToCounter("profiler dropped events", batch.dropped);
 }
 
-void GQStats::stopTimer( const QString& name )
+void GQStats::addScope( const PendingScope& scope, Record* parent )
 {
-#ifdef QT_NO_DEBUG
-    Q_UNUSED(name);
-#endif
-    assert( _timer_stack.size() > 0 && _timer_stack.last()->name == name );
-    Record* rec = _timer_stack.last();
-
-    rec->value += now() - rec->stamp;
+    Record* timer = findOrAddTimer(scopeName(scope.id), parent);
+    timer->value += scope.seconds;
+    timer->touches_since_last_reset++;
     _data_changed = true;
 
-    _timer_stack.removeLast();
+    for (int i = 0; i < scope.children.size(); i++)
+        addScope(scope.children[i], timer);
+}
+
+GQStats::Record* GQStats::findOrAddTimer( const QString& name, Record* parent )
+{
+    for (int i = 0; i < parent->children.size(); i++)
+    {
+        if (parent->children[i]->name == name)
+            return parent->children[i];
+    }
+
+    Record newtimer;
+    newtimer.name = name;
+    newtimer.category = TIMER;
+    newtimer.value = 0;
+    _records[TIMER].append(newtimer);
+    Record* pointer = &(_records[TIMER].last());
+
+    pointer->parent = parent;
+    parent->children.append(pointer);
+    _layout_changed = true;
+
+    return pointer;
+}
+
+// Names are copied from the profiler once, to avoid taking its lock for 
+// every event.
+const QString& GQStats::scopeName( int id )
+{
+    while (_scope_names.size() <= id)
+        _scope_names.append(GQProfiler::scopeName(_scope_names.size()));
+    return _scope_names[id];
 }
 
 void GQStats::setCounter( const QString& name, float value )
@@ -401,13 +570,73 @@ void GQStats::endConstantGroup()
     _constant_stack.removeLast();
 }
 
+// Copies the current and peak bytes of each memory category into the
+// records, under a group for CPU or GPU.
+void GQStats::updateMemory()
+{
+    for (int i = 0; i < GQMemory::NUM_KINDS; i++)
+    {
+        GQMemory::Kind kind = (GQMemory::Kind)i;
+        qint64 current, peak;
+        GQMemory::total(kind, current, peak);
+
+        Record* group = findOrAddMemory(GQMemory::kindName(kind), &_headers[MEMORY]);
+        group->value = megabytes(current);
+        group->str_value = QString("%1 MB (peak %2)").
+            arg(megabytes(current), 0, 'f', 2).arg(megabytes(peak), 0, 'f', 2);
+    }
+
+    QList<GQMemory::Usage> usage;
+    GQMemory::usage(usage);
+    for (int i = 0; i < usage.size(); i++)
+    {
+        Record* group = findOrAddMemory(GQMemory::kindName(usage[i].kind), 
+                                        &_headers[MEMORY]);
+        Record* record = findOrAddMemory(usage[i].name, group);
+        record->value = megabytes(usage[i].current);
+        record->str_value = QString("%1 MB (peak %2)").
+            arg(megabytes(usage[i].current), 0, 'f', 2).
+            arg(megabytes(usage[i].peak), 0, 'f', 2);
+    }
+    _data_changed = true;
+}
+
+GQStats::Record* GQStats::findOrAddMemory( const QString& name, Record* parent )
+{
+    for (int i = 0; i < parent->children.size(); i++)
+    {
+        if (parent->children[i]->name == name)
+            return parent->children[i];
+    }
+
+    Record newrecord;
+    newrecord.name = name;
+    newrecord.category = MEMORY;
+    _records[MEMORY].append(newrecord);
+    Record* pointer = &(_records[MEMORY].last());
+
+    pointer->parent = parent;
+    parent->children.append(pointer);
+    _layout_changed = true;
+
+    return pointer;
+}
+
+void GQStats::resetMemoryPeaks()
+{
+    GQMemory::resetPeaks();
+    updateMemory();
+}
+
 
 QString GQStats::timerStatistics( const QString& name )
 {
+    flush();
+
     int timer_index = findTimer(name, 0);
     if (timer_index < 0)
     {
-        timer_index = findTimer(name + " (wait GL)", 0);
+        timer_index = findTimer(name + " (GPU)", 0);
         if (timer_index < 0)
             return QString("Timer not found (%1).").arg(name);
     }
@@ -418,10 +647,365 @@ QString GQStats::timerStatistics( const QString& name )
         average = timer.value / (float)timer.touches_since_last_reset;
     QString output = QString("%1: %2 total time, %3 calls, %4 average").
         arg(name).arg(timer.value).arg(timer.touches_since_last_reset).arg(average);
+
+    if (!_history.isEmpty())
+    {
+        output += QString("; per frame over %1 frames: p50 %2, p90 %3, p99 %4, max %5").
+            arg(_history.size()).
+            arg(timerPercentile(timer.name, 50)).arg(timerPercentile(timer.name, 90)).
+            arg(timerPercentile(timer.name, 99)).arg(timerPercentile(timer.name, 100));
+    }
     return output;
 }
 
 
+void GQStats::setHistoryLength( int frames )
+{
+    _history_length = qMax(frames, 1);
+    while (_history.size() > _history_length)
+        _history.removeFirst();
+}
+
+void GQStats::clearHistory()
+{
+    _series.clear();
+    _series_index.clear();
+    _history.clear();
+}
+
+QString GQStats::timerPath( const Record* timer ) const
+{
+    QString path = timer->name;
+    for (const Record* parent = timer->parent; 
+         parent && parent != &_headers[TIMER]; parent = parent->parent)
+        path = parent->name + "/" + path;
+    return path;
+}
+
+int GQStats::seriesIndex( Category category, const QString& path, 
+                          const QString& name )
+{
+    QString key = QString::number(category) + path;
+    QHash<QString, int>::const_iterator it = _series_index.find(key);
+    if (it != _series_index.end())
+        return it.value();
+
+    Series series;
+    series.path = path;
+    series.name = name;
+    series.category = category;
+    _series.append(series);
+    _series_index.insert(key, _series.size() - 1);
+    return _series.size() - 1;
+}
+
+// Called by reset, before the values are zeroed.
+void GQStats::recordFrame()
+{
+    QList< QPair<int, float> > values;
+    for (int i = 0; i < _records[TIMER].size(); i++)
+    {
+        const Record& timer = _records[TIMER][i];
+        if (timer.touches_since_last_reset > 0)
+        {
+            int index = seriesIndex(TIMER, timerPath(&timer), timer.name);
+            values.append(qMakePair(index, timer.value));
+        }
+    }
+
+    quint64 frame_end = GQProfiler::ticks();
+    for (int i = 0; i < _records[COUNTER].size(); i++)
+    {
+        const Record& counter = _records[COUNTER][i];
+        if (counter.touches_since_last_reset == 0)
+            continue;
+
+        int index = seriesIndex(COUNTER, counter.name, counter.name);
+        values.append(qMakePair(index, counter.value));
+        traceCounter(counter.name, counter.value, frame_end);
+    }
+
+    for (int i = 0; i < _records[MEMORY].size(); i++)
+    {
+        const Record& memory = _records[MEMORY][i];
+        QString path = memory.name;
+        for (const Record* parent = memory.parent; 
+             parent && parent != &_dummy_root; parent = parent->parent)
+            path = parent->name + "/" + path;
+
+        int index = seriesIndex(MEMORY, path, memory.name);
+        values.append(qMakePair(index, memory.value));
+        traceCounter(path + " (MB)", memory.value, frame_end);
+    }
+
+    if (_tracing && !_trace_full && _trace.size() >= MAX_TRACE_EVENTS)
+    {
+        qWarning("GQStats: trace is full, no more events will be recorded.");
+        _trace_full = true;
+    }
+
+    if (values.isEmpty())
+        return;
+
+    QVector<float> row(_series.size(), std::numeric_limits<float>::quiet_NaN());
+    for (int i = 0; i < values.size(); i++)
+        row[values[i].first] = values[i].second;
+
+    _history.append(row);
+    while (_history.size() > _history_length)
+        _history.removeFirst();
+}
+
+void GQStats::traceCounter( const QString& name, float value, quint64 time )
+{
+    if (!_tracing || _trace_full)
+        return;
+
+    TraceEvent trace_event;
+    trace_event.id = GQProfiler::scopeId(name);
+    trace_event.thread = 0;
+    trace_event.is_counter = true;
+    trace_event.start = time;
+    trace_event.end = time;
+    trace_event.value = value;
+    _trace.append(trace_event);
+}
+
+// The per-frame totals of the given series, over the frames where at least
+// one of them ran.
+void GQStats::historyValues( const QList<int>& series, QVector<float>& values ) const
+{
+    values.clear();
+    for (int i = 0; i < _history.size(); i++)
+    {
+        const QVector<float>& row = _history[i];
+        float total = 0;
+        bool ran = false;
+        for (int j = 0; j < series.size(); j++)
+        {
+            if (series[j] < row.size() && !isnan(row[series[j]]))
+            {
+                total += row[series[j]];
+                ran = true;
+            }
+        }
+        if (ran)
+            values.append(total);
+    }
+}
+
+void GQStats::timerHistory( const QStringList& names, QVector<float>& values )
+{
+    flush();
+
+    QList<int> series;
+    for (int i = 0; i < _series.size(); i++)
+    {
+        if (_series[i].category == TIMER && names.contains(_series[i].name))
+            series.append(i);
+    }
+    historyValues(series, values);
+}
+
+float GQStats::timerPercentile( const QString& name, float percentile )
+{
+    QVector<float> values;
+    timerHistory(QStringList() << name, values);
+    std::sort(values.begin(), values.end());
+    return sortedPercentile(values, percentile);
+}
+
+void GQStats::beginTrace()
+{
+    flush();
+    clearHistory();
+    resetMemoryPeaks();
+    _trace.clear();
+    _trace_threads.clear();
+    _trace_full = false;
+    _trace_start = GQProfiler::ticks();
+    _tracing = true;
+}
+
+void GQStats::endTrace()
+{
+    flush();
+    _tracing = false;
+}
+
+bool GQStats::saveTrace( const QString& filename )
+{
+    flush();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning("GQStats::saveTrace: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "{\"traceEvents\":[\n";
+
+    bool first = true;
+    QHash<int, QString>::const_iterator it;
+    for (it = _trace_threads.begin(); it != _trace_threads.end(); ++it)
+    {
+        out << (first ? "" : ",\n");
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it.key()
+            << ",\"args\":{\"name\":" << jsonString(it.value()) << "}}";
+        first = false;
+    }
+
+    // Times in microseconds from the start of the trace.
+    for (int i = 0; i < _trace.size(); i++)
+    {
+        const TraceEvent& event = _trace[i];
+        double start = (event.start - _trace_start) * 1e-3;
+        out << (first ? "" : ",\n");
+        if (event.is_counter)
+        {
+            out << "{\"name\":" << jsonString(scopeName(event.id))
+                << ",\"ph\":\"C\",\"pid\":1,\"ts\":" << QString::number(start, 'f', 3)
+                << ",\"args\":{\"value\":" << event.value << "}}";
+        }
+        else
+        {
+            double duration = (event.end - event.start) * 1e-3;
+            out << "{\"name\":" << jsonString(scopeName(event.id))
+                << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+                << ",\"ts\":" << QString::number(start, 'f', 3)
+                << ",\"dur\":" << QString::number(duration, 'f', 3) << "}";
+        }
+        first = false;
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    out.flush();
+
+    return file.error() == QFile::NoError;
+}
+
+bool GQStats::saveFrameSeries( const QString& filename )
+{
+    flush();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning("GQStats::saveFrameSeries: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "frame";
+    for (int i = 0; i < _series.size(); i++)
+    {
+        const Series& series = _series[i];
+        QString units;
+        if (series.category == TIMER)
+            units = " (ms)";
+        else if (series.category == MEMORY)
+            units = " (MB)";
+        out << "," << csvString(series.path + units);
+    }
+    out << "\n";
+
+    for (int i = 0; i < _history.size(); i++)
+    {
+        const QVector<float>& row = _history[i];
+        out << i;
+        for (int j = 0; j < _series.size(); j++)
+        {
+            out << ",";
+            if (j < row.size() && !isnan(row[j]))
+            {
+                float scale = _series[j].category == TIMER ? 1000.0f : 1.0f;
+                out << row[j] * scale;
+            }
+        }
+        out << "\n";
+    }
+    out.flush();
+
+    return file.error() == QFile::NoError;
+}
+
+bool GQStats::saveSummary( const QString& filename )
+{
+    flush();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning("GQStats::saveSummary: could not open %s", qPrintable(filename));
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "name,type,frames,mean,p50,p90,p99,max\n";
+    for (int i = 0; i < _series.size(); i++)
+    {
+        const Series& series = _series[i];
+        QVector<float> values;
+        historyValues(QList<int>() << i, values);
+        if (values.isEmpty())
+            continue;
+        std::sort(values.begin(), values.end());
+
+        float scale = series.category == TIMER ? 1000.0f : 1.0f;
+        float sum = 0;
+        for (int j = 0; j < values.size(); j++)
+            sum += values[j];
+
+        QString type = "counter";
+        if (series.category == TIMER)
+            type = "timer (ms)";
+        else if (series.category == MEMORY)
+            type = "memory (MB)";
+
+        out << csvString(series.path) << ","
+            << type << ","
+            << values.size() << ","
+            << sum / values.size() * scale << ","
+            << sortedPercentile(values, 50) * scale << ","
+            << sortedPercentile(values, 90) * scale << ","
+            << sortedPercentile(values, 99) * scale << ","
+            << values.last() * scale << "\n";
+    }
+
+    // The peaks also count memory that was allocated and released within 
+    // a frame, so they can be higher than the max over the frames.
+    for (int i = 0; i < GQMemory::NUM_KINDS; i++)
+    {
+        GQMemory::Kind kind = (GQMemory::Kind)i;
+        qint64 current, peak;
+        GQMemory::total(kind, current, peak);
+        out << csvString(_headers[MEMORY].name + "/" + GQMemory::kindName(kind))
+            << ",memory peak (MB),,,,,," << megabytes(peak) << "\n";
+    }
+
+    QList<GQMemory::Usage> usage;
+    GQMemory::usage(usage);
+    for (int i = 0; i < usage.size(); i++)
+    {
+        out << csvString(_headers[MEMORY].name + "/" + 
+                         GQMemory::kindName(usage[i].kind) + "/" + usage[i].name)
+            << ",memory peak (MB),,,,,," << megabytes(usage[i].peak) << "\n";
+    }
+    out.flush();
+
+    return file.error() == QFile::NoError;
+}
+
+bool GQStats::saveStats( const QString& basename )
+{
+    bool saved = saveTrace(basename + ".json");
+    saved = saveFrameSeries(basename + "_frames.csv") && saved;
+    saved = saveSummary(basename + "_summary.csv") && saved;
+    return saved;
+}
+
+
 // QAbstractItemModel implementation
 
 QVariant GQStats::data( const QModelIndex& index, int role ) const
@@ -451,7 +1035,7 @@ QVariant GQStats::data( const QModelIndex& index, int role ) const
         {
             ret = node->value;
         }
-        else if (node->category == CONSTANT)
+        else if (node->category == CONSTANT || node->category == MEMORY)
         {
             ret = node->str_value;
         }
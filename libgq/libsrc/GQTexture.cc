@@ -11,6 +11,7 @@ See the COPYING file for details.
 
 #include "GQTexture.h"
 #include "GQInclude.h"
+#include "GQStats.h"
 #include <assert.h>
 
 #include <QFile>
@@ -23,9 +24,41 @@ See the COPYING file for details.
 
 #include "GQMatlabArray.h"
 
-GQTexture::GQTexture()
+static int textureMemory()
+{
+    static const int category = GQMemory::category("Textures", GQMemory::GPU);
+    return category;
+}
+
+// An estimate, since the driver may pad or convert the texels.
+static int bytesPerTexel( int internal_format )
+{
+    switch (internal_format)
+    {
+        case GL_ALPHA : 
+        case GL_LUMINANCE : 
+            return 1;
+        case GL_LUMINANCE_ALPHA : 
+        case GL_ALPHA16F_ARB :
+        case GL_LUMINANCE16F_ARB :
+            return 2;
+        case GL_RGBA16F_ARB :
+        case GL_RGB16F_ARB :
+            return 8;
+        case GL_RGBA32F_ARB :
+        case GL_RGB32F_ARB :
+            return 16;
+        default : 
+            // GL_RGB and GL_RGBA (usually padded to four bytes), and the
+            // one-channel float formats.
+            return 4;
+    }
+}
+
+GQTexture::GQTexture() : _memory(textureMemory())
 {
     _id = -1;
+    _level_bytes = 0;
 }
 
 GQTexture::~GQTexture()
@@ -40,6 +73,8 @@ void GQTexture::clear()
         glDeleteTextures(1, (GLuint*)(&_id) );
     }
     _id = -1;
+    _level_bytes = 0;
+    _memory.set(0);
 }
         
 bool GQTexture2D::load( const QString& filename )
@@ -109,6 +144,8 @@ bool GQTexture2D::create( const GQFloatImage& image, int target )
 bool GQTexture2D::create(int width, int height, int internal_format, int format, 
                          int type, const void *data, int target)
 {
+    clear();
+
     _target = target;
     _width = width;
     _height = height;
@@ -122,6 +159,10 @@ bool GQTexture2D::create(int width, int height, int internal_format, int format,
 	
 	glTexImage2D(_target, 0, internal_format, width, height, 0, 
 				 format, type, data);
+    _level_bytes = (qint64)width * height * bytesPerTexel(internal_format);
+    _memory.set(_level_bytes);
+    if (data)
+        __ADD_TO_COUNTER("bytes uploaded", (float)_level_bytes);
     
     glTexParameteri(_target, GL_TEXTURE_WRAP_S, wrap_mode);
     glTexParameteri(_target, GL_TEXTURE_WRAP_T, wrap_mode);
@@ -187,6 +228,7 @@ void GQTexture2D::generateMipmaps()
 	glGenerateMipmap(_target);
 	setMipmapping(true);
 	unbind();
+    _memory.set(_level_bytes + _level_bytes / 3);
 }
 
 bool GQTexture3D::load( const QString& filename )
@@ -331,11 +373,17 @@ bool GQTexture3D::genTexture(int internal_format, int format,
     int filter_mag_mode = GL_LINEAR;
     int filter_min_mode = GL_LINEAR;
 
+    clear();
+
     glGenTextures(1, (GLuint*)(&_id));
     glBindTexture(target, _id);
     
 	glTexImage3D(target, 0, internal_format, _width, _height, _depth, 0, 
                  format, type, data);
+    _level_bytes = (qint64)_width * _height * _depth * bytesPerTexel(internal_format);
+    _memory.set(_level_bytes);
+    if (data)
+        __ADD_TO_COUNTER("bytes uploaded", (float)_level_bytes);
     
     glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap_mode);
     glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap_mode);
@@ -398,4 +446,5 @@ void GQTexture3D::generateMipmaps()
 	glGenerateMipmap(GL_TEXTURE_3D);
 	setMipmapping(true);
 	unbind();
+    _memory.set(_level_bytes + _level_bytes / 7);
 }
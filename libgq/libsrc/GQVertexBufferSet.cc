@@ -11,12 +11,20 @@ See the COPYING file for details.
 
 #include "GQInclude.h"
 #include "GQVertexBufferSet.h"
+#include "GQMemory.h"
+#include "GQStats.h"
 #include <assert.h>
 
 int                 GQVertexBufferSet::_last_used_guid = 1;
 QHash<int,int>      GQVertexBufferSet::_bound_guids;
 QHash<QString,int>  GQVertexBufferSet::_bound_buffers;
 
+static int vertexBufferMemory()
+{
+    static const int category = GQMemory::category("Vertex buffers", GQMemory::GPU);
+    return category;
+}
+
 GLenum kGlArrays[GQ_NUM_VERTEX_BUFFER_TYPES] = { GL_VERTEX_ARRAY, 
                                        GL_NORMAL_ARRAY, 
                                        GL_COLOR_ARRAY,
@@ -272,7 +280,8 @@ void GQVertexBufferSet::copyToVBOs()
     {
         BufferInfo& buf = _buffers[i];
 
-        if (buf._vbo_id < 0)
+        bool is_new = buf._vbo_id < 0;
+        if (is_new)
         {
             GLuint id;
             glGenBuffers(1, &id);
@@ -286,6 +295,8 @@ void GQVertexBufferSet::copyToVBOs()
         {
             buf._vbo_size = buf.dataSize();
         }
+        if (is_new)
+            GQMemory::allocate(vertexBufferMemory(), buf._vbo_size);
 		int target = GL_ARRAY_BUFFER;
 		if (buf._semantic == GQ_INDEX)
 			target = GL_ELEMENT_ARRAY_BUFFER;
@@ -294,6 +305,8 @@ void GQVertexBufferSet::copyToVBOs()
         glBufferData(target, buf._vbo_size, 
                      buf.dataPointer(), buf._gl_usage_mode);
         glBindBuffer(target, 0);
+        if (buf.dataPointer())
+            __ADD_TO_COUNTER("bytes uploaded", buf._vbo_size);
     }
     reportGLError();
 }
@@ -577,6 +590,7 @@ void GQVertexBufferSet::BufferInfo::deleteVBO()
     if (_vbo_id >= 0)
     {
         glDeleteBuffers(1, (GLuint*)(&_vbo_id));
+        GQMemory::release(vertexBufferMemory(), _vbo_size);
     }
     _vbo_id = -1;
 }
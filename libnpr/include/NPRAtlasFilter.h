@@ -0,0 +1,46 @@
+/*****************************************************************************\
+
+NPRAtlasFilter.h
+Copyright (c) 2009 Forrester Cole
+
+CPU versions of the segment atlas filters (bilateral_filter_atlas,
+median_filter_atlas, and smooth_and_threshold_atlas). Like the shaders,
+each filter works along the rows of the atlas and only mixes samples that
+belong to the same path. Each row is converted to separate id and value
+arrays, so that the inner loops are branch free and can be vectorized, and
+rows are distributed across threads with OpenMP. Runs of empty samples are
+skipped.
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _NPR_ATLAS_FILTER_H_
+#define _NPR_ATLAS_FILTER_H_
+
+#include "NPRSegmentAtlas.h"
+
+class GQImage;
+class GQFloatImage;
+
+class NPRAtlasFilter
+{
+    public:
+        // Filters the first num_rows rows of an RGBA readback of the segment
+        // atlas. The result is an RGBA float image with num_rows rows,
+        // matching what the shader writes to the filtered atlas.
+        static void filter( NPRSegmentAtlas::AtlasFilterType type,
+                            const GQImage& source, int num_rows,
+                            GQFloatImage& result );
+
+        // Straightforward per-sample versions that follow the shaders line
+        // by line. Used to check the fast versions.
+        static void filterReference( NPRSegmentAtlas::AtlasFilterType type,
+                                     const GQImage& source, int num_rows,
+                                     GQFloatImage& result );
+
+        static int  maxThreads();
+};
+
+#endif // _NPR_ATLAS_FILTER_H_
@@ -0,0 +1,84 @@
+/*****************************************************************************\
+
+NPRDepthPyramid.h
+Copyright (c) 2009 Forrester Cole
+
+Hierarchical min/max depth buffer. Each texel of level i stores the minimum
+and maximum depth of a 2^(i+2) x 2^(i+2) block of the float depth buffer, so
+any region of the depth buffer can be bounded with four texture reads. The
+segment atlas and spine test shaders use these bounds to skip the
+supersampled visibility test for segments and samples that are trivially
+visible or hidden (see depth_pyramid_common.glsl).
+
+Even levels are stored side by side in color attachment 0 and odd levels in
+attachment 1, so each level is built from the previous one without reading
+and writing the same texture.
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _NPR_DEPTH_PYRAMID_H_
+#define _NPR_DEPTH_PYRAMID_H_
+
+#include "GQFramebufferObject.h"
+#include "GQImage.h"
+#include "GQInclude.h"
+
+#include <QVector>
+
+class GQShaderRef;
+
+class NPRDepthPyramid
+{
+    public:
+        typedef enum {
+            DEPTH_HIDDEN,
+            DEPTH_VISIBLE,
+            DEPTH_AMBIGUOUS
+        } Classification;
+
+    public:
+        NPRDepthPyramid();
+
+        void clear();
+
+        // Builds the pyramid on the GPU from the z channel of a float depth
+        // buffer (as drawn by NPRGLDraw::drawDepthBufferFBO).
+        bool build( const GQFramebufferObject& depth_buffer );
+
+        // Builds the same pyramid on the CPU from a depth buffer readback.
+        // Only a CPU-built pyramid can be queried with classify().
+        void build( const GQFloatImage& depth_image );
+
+        void setUniformParams( const GQShaderRef& shader ) const;
+
+        // CPU version of depthPyramidClassify() in depth_pyramid_common.glsl.
+        // lo and hi are the corners of a box in depth buffer texels.
+        Classification classify( const vec2& lo, const vec2& hi,
+                                 float min_z, float max_z ) const;
+
+        int  numLevels() const { return _num_levels; }
+
+    protected:
+        void computeLayout( int width, int height );
+        bool depthRange( const vec2& lo, const vec2& hi, float range[2] ) const;
+        bool checkAgainstCPU( const GQFramebufferObject& depth_buffer ) const;
+
+    protected:
+        int                 _num_levels;
+        int                 _strip_width;
+        int                 _strip_height;
+
+        // (x offset, width, height) of each level, in texels.
+        QVector<vec>        _level_info;
+
+        bool                _has_gpu_levels;
+        GQFramebufferObject _pyramid_fbo;
+
+        bool                _has_cpu_levels;
+        GQFloatImage        _cpu_levels[2];
+};
+
+#endif // _NPR_DEPTH_PYRAMID_H_
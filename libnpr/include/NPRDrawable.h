@@ -28,7 +28,8 @@ class NPRPrimitive;
 class NPRAnimController;
 class NPRStyle;
 
-// A drawable node in the scene graph.
+// A drawable node in the scene graph. Drawables start without paths; the
+// scene stitches them (see NPRScene::buildPaths).
 
 class NPRDrawable
 {
@@ -43,6 +44,7 @@ class NPRDrawable
         void composeTransform( xform& xf ) const;
         void composeTransformInverseTranspose( xform& xf ) const;
         const xform& transform() const { return _transform; }
+        bool isAnimated() const { return _anim_controller != 0; }
 
         const NPRGeometry*  geometry() const { return _geom; }
         const NPRFixedPathSet*   paths() const { return _const_path_set; }
@@ -56,6 +58,8 @@ class NPRDrawable
 
         // Interface to the application
         void clear();
+        // Takes ownership of the paths, and deletes the old ones.
+        void setPaths( NPRFixedPathSet* paths );
 
     protected:
         const NPRGeometry*       _geom;
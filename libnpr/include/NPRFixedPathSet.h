@@ -130,11 +130,15 @@ class NPRFixedPathSet
     protected:
         void init();
         void stitchLinesIntoPaths( const NPRPrimitive* lines, const NPRFixedPathAttr& attr );
+        // Counts the paths in the "NPRFixedPathSet" category.
+        void updateMemoryUse();
 
     protected:
         NPRFixedPathPointerList   _paths;
         const NPRDrawable*        _drawable;
         const NPRGeometry*        _const_geom;
+
+        GQMemoryUse               _memory;
 };
 
 #endif
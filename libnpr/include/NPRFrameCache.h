@@ -0,0 +1,90 @@
+/*****************************************************************************\
+
+NPRFrameCache.h
+Copyright (c) 2009 Forrester Cole
+
+Dependency tracking for the line visibility stages of the renderer. Each
+stage records a key built from the inputs it consumed during its last run.
+If the key has not changed, the stage's output buffers are still valid and
+the stage can be skipped. Downstream stages include the generation number
+of their upstream stages in their keys, so recomputing one stage also
+invalidates everything that depends on it.
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _NPR_FRAME_CACHE_H_
+#define _NPR_FRAME_CACHE_H_
+
+#include <QByteArray>
+
+class NPRScene;
+
+class NPRStageKey
+{
+    public:
+        void clear() { _data.clear(); }
+
+        void add( int value );
+        void add( unsigned int value );
+        void add( float value );
+        void add( bool value );
+        void add( const void* pointer );
+        void add( const float* values, int count );
+        void add( const double* values, int count );
+
+        // Current GL modelview, projection, and viewport.
+        void addGLViewParams();
+
+        bool operator==( const NPRStageKey& other ) const
+            { return _data == other._data; }
+        bool operator!=( const NPRStageKey& other ) const
+            { return _data != other._data; }
+
+    protected:
+        QByteArray _data;
+};
+
+class NPRFrameCache
+{
+    public:
+        typedef enum {
+            DEPTH_STAGE,
+            CLIP_STAGE,
+            SCAN_STAGE,
+            ATLAS_STAGE,
+            FILTER_STAGE,
+            PRIORITY_STAGE,
+            NUM_STAGES
+        } Stage;
+
+    public:
+        NPRFrameCache();
+
+        void clear();
+        void invalidate( Stage stage );
+
+        // Returns true if the stage must be recomputed, i.e. if the cache
+        // is disabled, the stage was invalidated, or the key differs from
+        // the key of the last run. The new key is recorded either way.
+        bool needsUpdate( Stage stage, const NPRStageKey& key );
+
+        unsigned int generation( Stage stage ) const { return _generations[stage]; }
+
+        void setEnabled( bool enabled );
+        bool isEnabled() const { return _enabled; }
+
+        int  numSkippedStages() const { return _num_skipped; }
+        void resetSkippedStages() { _num_skipped = 0; }
+
+    protected:
+        NPRStageKey  _keys[NUM_STAGES];
+        bool         _valid[NUM_STAGES];
+        unsigned int _generations[NUM_STAGES];
+        bool         _enabled;
+        int          _num_skipped;
+};
+
+#endif // _NPR_FRAME_CACHE_H_
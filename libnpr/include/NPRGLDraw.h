@@ -23,6 +23,7 @@ class GQTexture2D;
 class GQFramebufferObject;
 class GQShaderRef;
 class NPRDrawable;
+class NPRDepthPyramid;
 class CdaMaterial;
 
 const int NPR_OPAQUE = 0x1;
@@ -63,7 +64,8 @@ class NPRGLDraw
         static void clearGLDepth(float depth); 
 
         static void setUniformSSParams(const GQShaderRef& shader,
-                                       const GQTexture2D& depth_buffer);
+                                       const GQTexture2D& depth_buffer,
+                                       const NPRDepthPyramid* depth_pyramid = 0);
         static void setUniformViewParams(const GQShaderRef& shader);
         static void setUniformPolygonParams(const GQShaderRef& shader, 
                                             const NPRScene& scene);
@@ -74,6 +76,21 @@ class NPRGLDraw
 
         static void handleGLError(const char* file = 0, int line = 0);
 
+        // Tiled rendering: the current viewport is one tile of a larger
+        // image whose lower left corner is at (x, y) in image pixels. The
+        // tile origin may be negative, since tiles include a guard band.
+        // Screen-space effects (paper, background, screen focus, and the
+        // pen texture parameterization) then match the untiled image.
+        static void setImageRegion( int image_width, int image_height,
+                                    int x, int y );
+        static void clearImageRegion();
+        static bool hasImageRegion() { return _has_image_region; }
+        static float imageAspectRatio();
+
+        // Scale (xy) and offset (zw) from the NDC of the current viewport
+        // to the NDC of the whole image. (1,1,0,0) without a region.
+        static void imageNDCTransform( float transform[4] );
+
     protected:
         static void drawPrimList(int mode, const NPRDrawable* drawable, 
                                  const NPRPrimPointerList& prims, int draw_mode );
@@ -88,6 +105,10 @@ class NPRGLDraw
         static bool _is_initialized;
         static GQTexture2D* _supersample_texture;
 
+        static bool _has_image_region;
+        static int  _image_size[2];
+        static int  _image_origin[2];
+
 };
 
 #endif /*NPR_GL_DRAW_H_*/
@@ -20,6 +20,7 @@ See the COPYING file for details.
 #include <QList>
 #include "GQInclude.h"
 #include "GQVertexBufferSet.h"
+#include "GQMemory.h"
 
 // NPRPrimitive
 
@@ -80,6 +81,7 @@ class NPRGeometry
     public:
         NPRGeometry();
         NPRGeometry( const CdaGeometry* cda_geometry );
+        ~NPRGeometry() { clear(); }
 
         void clear(); // clears the geometry to an uninitialized state
         void reset(); // removes data, but leaves the semantic structure intact
@@ -122,6 +124,8 @@ class NPRGeometry
 
     protected:
         void findBoundingSphere();
+        // Counts the sources and primitives in the "NPRGeometry" category.
+        void updateMemoryUse();
 
     protected:
         // pointer list to allow storing descendants of NPRPrimitive (e.g. LnPath)
@@ -135,6 +139,8 @@ class NPRGeometry
         vec                 _bsphere_center;
         float               _bsphere_radius;
 
+        GQMemoryUse         _memory;
+
         static const NPRGeometry*  _currently_bound_geom;
 };
 
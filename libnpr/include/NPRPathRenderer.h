@@ -23,6 +23,7 @@ See the COPYING file for details.
 
 class NPRScene;
 class NPRStyle;
+class NPRDepthPyramid;
 
 class NPRPathRenderer
 {
@@ -34,7 +35,8 @@ class NPRPathRenderer
         void drawSimpleLines(const NPRScene& scene);
 
         void drawStrokes(const NPRScene& scene,
-                         const GQTexture2D& depth_buffer);
+                         const GQTexture2D& depth_buffer,
+                         const NPRDepthPyramid* depth_pyramid = 0);
         void drawStrokes(const NPRScene& scene, 
                          const NPRSegmentAtlas& atlas );
         void drawPriorityBuffer(const NPRScene& scene, 
@@ -30,6 +30,9 @@ class NPRRenderer
     virtual void drawSceneDepth( const NPRScene& scene ) = 0;
 
     virtual void resize( int width, int height ) = 0;
+
+    // Drops anything kept from earlier frames.
+    virtual void invalidateCache() { }
 };
 
 #endif // _NPR_RENDERER_H_
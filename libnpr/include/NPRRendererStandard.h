@@ -18,6 +18,11 @@ See the COPYING file for details.
 #include "NPRSegmentAtlas.h"
 #include "NPRPathRenderer.h"
 #include "NPRPathSet.h"
+#include "NPRFrameCache.h"
+#include "NPRDepthPyramid.h"
+#include "NPRView.h"
+
+#include <QVector>
 
 class NPRScene;
 class NPRStyle;
@@ -40,15 +45,35 @@ class NPRRendererStandard : public NPRRenderer
     void drawScene( const NPRScene& scene );
     void drawSceneDepth( const NPRScene& scene );
 
+    // Draws the scene from each view in turn, into the current viewport,
+    // and calls the callback after each one (e.g., to read it back). The
+    // setup that does not depend on the camera (shaders, static path data,
+    // path transforms, drawable bounds) is done once for the whole batch.
+    // The scene's light is applied in each view. Returns the number of
+    // views drawn, which is less than views.size() if the callback 
+    // returned false.
+    int  drawViews( NPRScene& scene, const QVector<NPRView>& views,
+                    NPRViewCallback* callback );
+
     void resize( int width, int height );
 
+    // The line visibility buffers are reused across frames when their
+    // inputs have not changed. Call invalidateCache if something the cache
+    // cannot see has changed (e.g., the shaders were reloaded).
+    void invalidateCache() { _frame_cache.clear(); }
+    void setCacheEnabled( bool enabled ) { _frame_cache.setEnabled(enabled); }
+
   protected:
     void setLineVisibilityMethod( NPRLineVisibilityMethod method );
 
+    bool beginFrame();
+    void drawFrame( const NPRScene& scene );
+
     void drawPolygons(const NPRScene& scene);
 
     void drawDepthBuffer( const NPRScene& scene );
     void drawPriorityBuffer( const NPRScene& scene );
+    void makePriorityStageKey( const NPRScene& scene, NPRStageKey& key );
     void visualizeDepthBuffer();
     void visualizePriorityBuffer();
 
@@ -64,7 +89,10 @@ class NPRRendererStandard : public NPRRenderer
     NPRPathRenderer     _path_renderer;
 
     GQFramebufferObject _depth_buffer;
+    NPRDepthPyramid     _depth_pyramid;
     GQFramebufferObject _priority_buffer;
+
+    NPRFrameCache       _frame_cache;
 };
 
 #endif // _NPR_RENDERER_STANDARD_H_
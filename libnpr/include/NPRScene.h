@@ -41,6 +41,24 @@ class NPRAnimController;
 class NPRFixedPathSet;
 class NPRGeometry;
 
+// Stages of NPRScene::load, for progress reports.
+typedef enum
+{
+    NPR_LOAD_PARSE,
+    NPR_LOAD_GEOMETRY,
+    NPR_LOAD_INSTANCES,
+    NPR_LOAD_PATHS,
+    NPR_NUM_LOAD_STAGES
+} NPRLoadStage;
+
+// Called as a scene loads, from the loading thread. Return false to 
+// cancel the load.
+class NPRLoadCallback
+{
+    public:
+        virtual ~NPRLoadCallback() { }
+        virtual bool loadProgress( NPRLoadStage stage, int done, int total ) = 0;
+};
 
 class NPRScene
 {
@@ -87,6 +105,19 @@ class NPRScene
 
         bool                hasViewDependentPaths() const { return _has_view_dependent_paths; }
 
+        // Incremented whenever the drawn geometry may have changed without 
+        // the camera moving (animation, partitions, style). Used by the 
+        // renderer to decide whether cached buffers are still valid.
+        unsigned int        changeStamp() const { return _change_stamp; }
+
+        // Incremented whenever the sorted path list is rebuilt, for instance
+        // as paths arrive while the scene loads.
+        unsigned int        pathsStamp() const { return _paths_stamp; }
+
+        // Incremented whenever the drawables are deleted, so that holders 
+        // of drawable pointers know a new drawable may reuse an old address.
+        unsigned int        drawablesStamp() const { return _drawables_stamp; }
+
         int				    numLights() const { return 1; }
         const NPRLight*     light(int which) const { Q_UNUSED(which); return &_light; }
 
@@ -96,10 +127,26 @@ class NPRScene
         
         const NPRStyle*     globalStyle() const { return _global_style; }
 
+        const QString&      modelFilename() const { return _model_filename; }
+
         // Interface to the application
         void        clear();
         bool        load( const QString& filename );
-        bool        load( const QDomElement& element, const QDir& path );
+        bool        load( const QDomElement& element, const QDir& path, 
+                          bool load_model = true );
+
+        // load() in stages, so the scene can be loaded on another thread 
+        // and drawn before its paths are stitched. beginLoad clears the 
+        // scene and sets the model file. loadModel parses the model and 
+        // makes the drawables, without paths; nothing else may touch the 
+        // scene while it runs. buildPaths stitches the paths of one 
+        // drawable and only reads the scene, so it may run while the scene 
+        // is drawn. addPaths gives them to the drawable; call it on the 
+        // drawing thread, then updateSortedPaths.
+        void        beginLoad( const QString& filename );
+        bool        loadModel( NPRLoadCallback* callback = 0 );
+        NPRFixedPathSet* buildPaths( int which ) const;
+        void        addPaths( int which, NPRFixedPathSet* paths );
         bool        save( QDomDocument& doc, QDomElement& element, const QDir& path );
 
         NPRLight*   light(int which) { Q_UNUSED(which); return &_light; }
@@ -109,6 +156,8 @@ class NPRScene
 
         void	    setLight( const NPRLight& light ) { _light = light; }
     	void	    setStyle( NPRStyle* style );
+        // Like setStyle, but returns the old style instead of deleting it.
+        NPRStyle*   swapStyle( NPRStyle* style );
 
         void        computePotentiallyVisibleSet();
 
@@ -123,7 +172,11 @@ class NPRScene
         bool        deletePartition(int index);
 
         void        updateDrawableLists();
-        void        updateVBOs();
+
+        // Copies geometry to VBOs, or deletes them, to match NPR_ENABLE_VBOS.
+        // With a budget, returns false once max_vertices vertices have been
+        // copied; call again to copy the rest.
+        bool        updateVBOs( int max_vertices = -1 );
 
         void        updateSortedPaths();
 
@@ -132,7 +185,7 @@ class NPRScene
         QAbstractItemModel* itemModel();
 
     protected:
-        bool loadCollada( const QString& filename );
+        bool loadCollada( const QString& filename, NPRLoadCallback* callback );
 
         void sortDrawables(); 
 
@@ -141,8 +194,12 @@ class NPRScene
 
         void debugPartitions();
 
+        void updateDrawableBounds();
+
     protected:
         CdaModelScene*      _cda_scene;
+        // The geometry of the COLLADA scene, which is kept after loading.
+        GQMemoryUse         _cda_memory;
         QString             _model_filename;
 
         DrawableList        _drawables;
@@ -159,6 +216,14 @@ class NPRScene
 
         QList<bool>         _drawables_pvs;
 
+        // World space bounding spheres of the drawables for the PVS test,
+        // recomputed only when the change stamp moves, so rendering many
+        // views of one scene does not redo them for every view.
+        QVector<vec>        _drawable_centers;
+        QVector<float>      _drawable_radii;
+        QVector<float>      _drawable_scaled_radii;
+        unsigned int        _drawable_bounds_stamp;
+
         QList<const NPRFixedPath*> _sorted_path_list;
 
         xform               _camera_transform;
@@ -171,6 +236,10 @@ class NPRScene
 
         bool                _has_view_dependent_paths;
 
+        unsigned int        _change_stamp;
+        unsigned int        _paths_stamp;
+        unsigned int        _drawables_stamp;
+
         vec3f               _bsphere_center;
         float               _bsphere_radius;
 
@@ -182,6 +251,7 @@ class NPRScene
         vec				    _focal_point;
 
         bool                _enable_vbos;
+        int                 _num_vbo_geometries;
 };
 
 
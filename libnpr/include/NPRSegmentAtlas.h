@@ -17,8 +17,15 @@ See the COPYING file for details.
 
 #include "GQFramebufferObject.h"
 #include "GQVertexBufferSet.h"
+#include "NPRFrameCache.h"
+
+#include <QVector>
+#include <QList>
 
 class NPRScene;
+class NPRDrawable;
+class NPRFixedPathSet;
+class NPRDepthPyramid;
 class NPRStyle;
 class GQTexture;
 
@@ -38,6 +45,7 @@ class NPRSegmentAtlas
             CLIP_VERTEX_0_ID,
             CLIP_VERTEX_1_ID,
             SEGMENT_LENGTHS_ID,
+            ARC_LENGTH_START_ID,
             NUM_CLIP_BUFFERS
         } ClipBufferId;
 
@@ -60,11 +68,25 @@ class NPRSegmentAtlas
 
         void clear();
 
-        void draw( const NPRScene& scene, const GQTexture2D& depth_buffer );
+        void draw( const NPRScene& scene, const GQTexture2D& depth_buffer,
+                   const NPRDepthPyramid* depth_pyramid = 0,
+                   NPRFrameCache* cache = 0 );
         void visualize( const NPRScene& scene, const GQTexture2D& depth_buffer );
 
+        // Between beginViews and endViews, the scene is drawn from several
+        // cameras at the same moment, so static path data and the path 
+        // transforms are brought up to date once, in beginViews, instead 
+        // of on every draw. View dependent paths are still refreshed.
+        bool beginViews( const NPRScene& scene );
+        void endViews() { _in_views = false; }
+
         void checkPriority( const GQTexture2D& priority_buffer );
         void filter(AtlasBufferId which, AtlasFilterType type, const NPRStyle* style);
+        void resetFilter(AtlasBufferId which) { _is_smoothed_atlas_current[which] = false; }
+
+        // Run the atlas filters on the CPU instead of as shader passes.
+        void setUseCPUFilters( bool use_cpu ) { _use_cpu_filters = use_cpu; }
+        bool useCPUFilters() const { return _use_cpu_filters; }
 
         void setDumpImagesNextFrame() { _dump_next_frame = true; }
 
@@ -72,8 +94,10 @@ class NPRSegmentAtlas
             { return _path_verts_fbo.colorTexture(which); }
         int  pathBufferWidth() const { return _path_verts_fbo.width(); }
 
+        // ARC_LENGTH_START_ID is 0 unless an image region is set.
         const GQTexture2D* clipBuffer(ClipBufferId which) const 
-            { return _clip_fbo.colorTexture(which); }
+            { return which < _clip_fbo.numColorAttachments() ? 
+                     _clip_fbo.colorTexture(which) : 0; }
         int  clipBufferWidth() const { return _clip_fbo.width(); }
 
         const GQTexture2D* offsetBuffer() const 
@@ -98,18 +122,31 @@ class NPRSegmentAtlas
         void setDrawProfiles( bool draw );
 
         void sumSegmentLengths();
+        int  occupiedAtlasRows() const;
+
+        void drawSegmentAtlas(AtlasBufferId target, const GQTexture2D& reference_texture,
+                              const NPRDepthPyramid* depth_pyramid = 0);
+        void filterCPU(AtlasBufferId which, AtlasFilterType type);
 
-        void drawSegmentAtlas(AtlasBufferId target, const GQTexture2D& reference_texture);
+        void recordCounters();
+        bool beginClipQuery();
+        void endClipQuery();
+        void readClipQueries();
         
         void refreshPathData( const NPRScene& scene );
 
         void makePathVertexTexture( const NPRScene& scene );
         bool makePathVertexFBO( const NPRScene& scene );
+        void fillPathBuffers( int first_block );
+        void makePathTransformTable( const QVector<const NPRDrawable*>& drawables );
+        void updatePathTransforms();
         void makeSegmentAtlasVBO();
 
     protected:
         float        _sample_step;
         int          _total_segments;
+        int          _total_profile_segments;
+        int          _total_non_profile_segments;
         int          _total_samples;
         int          _atlas_wrap_width;
 
@@ -118,10 +155,43 @@ class NPRSegmentAtlas
         bool         _path_data_dirty;
         bool         _is_initialized;
         bool         _is_smoothed_atlas_current[NUM_ATLAS_BUFFERS];
+        bool         _use_cpu_filters;
+        bool         _in_views;
+
+        // Number of rows of each atlas and filtered atlas buffer that may
+        // still hold samples from an earlier frame.
+        int          _atlas_written_rows[NUM_ATLAS_BUFFERS];
+        int          _filtered_written_rows[NUM_ATLAS_BUFFERS];
 
         GQFramebufferObject _path_verts_fbo;
+        // The consecutive segments of one drawable's paths in the path
+        // buffers. A block's index is its drawable's transform table entry.
+        struct PathBlock
+        {
+            const NPRDrawable*      drawable;
+            const NPRFixedPathSet*  path_set;
+            int                     num_paths;
+            int                     first_segment;
+            int                     num_segments;
+        };
+        QVector<PathBlock>  _path_blocks;
+        bool                _path_layout_dirty;
+        // The scene's drawables stamp when the blocks were laid out.
+        unsigned int        _scene_drawables_stamp;
         GQFramebufferObject _depth_fbo;
 
+        // Path vertices are stored in model space. Each drawable that owns
+        // paths has an entry in the transform table, and only the entries
+        // of animated drawables are refreshed each frame.
+        GQFramebufferObject _path_xform_fbo;
+        GQFloatImage        _path_xform_img;
+        QVector<const NPRDrawable*> _path_xform_drawables;
+        QVector<int>        _animated_xform_indices;
+        bool                _path_xforms_dirty;
+        unsigned int        _path_data_stamp;
+        // The scene's paths stamp when the buffers were sized.
+        unsigned int        _scene_paths_stamp;
+
         GQFramebufferObject _clip_fbo;
         GQFramebufferObject _sum_fbo;
         int                 _sum_result_buffer_id;
@@ -129,11 +199,26 @@ class NPRSegmentAtlas
         GQVertexBufferSet   _atlas_source_vbo;
         GQFramebufferObject _atlas_fbo;
         GQFramebufferObject _filtered_atlas_fbo;
+        GQImage             _cpu_atlas_img;
+        GQFloatImage        _cpu_filtered_img;
 
         GQFramebufferObject _clip_viz_fbo;
         GQVertexBufferSet   _clip_viz_vbo;
 
         GQVertexBufferSet   _quad_vertices_vbo;
+
+        // Primitive queries around the visibility atlas draw, which count
+        // the segments that survived clipping. They are read back a frame
+        // or more later, so the counter never stalls the pipeline.
+        struct ClipQuery
+        {
+            GLuint  query;
+            int     segments;
+        };
+        int                 _clip_queries_supported;
+        QList<ClipQuery>    _pending_clip_queries;
+        QVector<GLuint>     _free_clip_queries;
+        int                 _clipped_segments;
 };
 
 #endif /*NPR_SEGMENT_ATLAS_H_*/
@@ -83,6 +83,7 @@ typedef enum
     NPR_SEGMENT_ATLAS_DEPTH_SCALE,
     NPR_SEGMENT_ATLAS_KERNEL_SCALE_X,
     NPR_SEGMENT_ATLAS_KERNEL_SCALE_Y,
+    NPR_SEGMENT_ATLAS_SAMPLE_SPACING,
 
     NPR_N_DOT_V_BIAS,
 
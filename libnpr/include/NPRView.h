@@ -0,0 +1,59 @@
+/*****************************************************************************\
+
+NPRView.h
+Copyright (c) 2009 Forrester Cole
+
+One camera for NPRRendererStandard::drawViews, which draws a scene from a
+list of cameras (turntables, contact sheets) in one batch.
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#ifndef _NPR_VIEW_H_
+#define _NPR_VIEW_H_
+
+#include "GQInclude.h"
+#include "XForm.h"
+
+class NPRView
+{
+    public:
+        NPRView() : _field_of_view(0)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                _modelview[i] = (i % 5 == 0) ? 1.0 : 0.0;
+                _projection[i] = (i % 5 == 0) ? 1.0 : 0.0;
+            }
+        }
+
+        void applyToGL() const
+        {
+            glMatrixMode(GL_PROJECTION);
+            glLoadMatrixd(_projection);
+            glMatrixMode(GL_MODELVIEW);
+            glLoadMatrixd(_modelview);
+        }
+
+    public:
+        // Camera to world, as for NPRScene::setCameraTransform.
+        xform   _camera_transform;
+        float   _field_of_view;
+
+        // Loaded into OpenGL before the view is drawn.
+        GLdouble _modelview[16];
+        GLdouble _projection[16];
+};
+
+// Called by NPRRendererStandard::drawViews after each view is drawn,
+// while the view is still in the framebuffer. Return false to stop.
+class NPRViewCallback
+{
+    public:
+        virtual ~NPRViewCallback() { }
+        virtual bool viewDrawn( int which ) = 0;
+};
+
+#endif // _NPR_VIEW_H_
@@ -20,7 +20,14 @@ else {
 	}
 	else {
 		DEFINES += LINUX
+        QMAKE_CXXFLAGS += -fopenmp
 	}
+
+    # Frame pointers, for the stacks in GQSampler's CPU profiles.
+    QMAKE_CXXFLAGS += -fno-omit-frame-pointer
+
+    # The CPU atlas filters (NPRAtlasFilter.cc) rely on loop vectorization.
+    QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
 }
 
 CONFIG += staticlib
@@ -0,0 +1,392 @@
+/*****************************************************************************\
+
+NPRAtlasFilter.cc
+Copyright (c) 2009 Forrester Cole
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "NPRAtlasFilter.h"
+#include "GQImage.h"
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#include <QVector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// These must match the filter shaders.
+const int   BILATERAL_RADIUS = 4;
+const float BILATERAL_THRESHOLD = 1.0f;
+const int   MEDIAN_SAMPLES = 9;
+const int   MEDIAN_RADIUS = MEDIAN_SAMPLES / 2;
+const int   SMOOTH_RADIUS = 6;
+const float SMOOTH_OVERSHOOT_OFFSET = 1.0f;
+
+const int   MAX_RADIUS = 6;
+
+// Sorting network for 9 values (25 comparisons).
+const int MEDIAN_NETWORK_SIZE = 25;
+const int MEDIAN_NETWORK[MEDIAN_NETWORK_SIZE][2] =
+{
+    {0,1}, {3,4}, {6,7}, {1,2}, {4,5}, {7,8}, {0,1}, {3,4}, {6,7},
+    {0,3}, {3,6}, {0,3}, {1,4}, {4,7}, {1,4}, {2,5}, {5,8}, {2,5},
+    {1,3}, {5,7}, {2,6}, {4,6}, {2,4}, {2,3}, {5,6}
+};
+
+// Per-thread scratch space for one atlas row. The id and value arrays are
+// padded by MAX_RADIUS samples on each side, so neighbor lookups never
+// need bounds checks.
+class AtlasRow
+{
+    public:
+        AtlasRow( int width )
+        {
+            _ids.resize(width + 2*MAX_RADIUS);
+            _values.resize(width + 2*MAX_RADIUS);
+            _counts.resize(width);
+            _sums.resize(width);
+            for (int i = 0; i < MEDIAN_SAMPLES; i++)
+                _sorted[i].resize(width);
+            _width = width;
+        }
+
+        void load( const GQImage& source, int row );
+
+        void bilateral( float* out );
+        void median( float* out );
+        void smoothAndThreshold( float* out );
+
+        int  firstOccupied() const { return _first; }
+        int  lastOccupied() const { return _last; }
+
+    protected:
+        void accumulate( int radius, float threshold );
+
+        const unsigned int* ids() const { return _ids.constData() + MAX_RADIUS; }
+        const float* values() const { return _values.constData() + MAX_RADIUS; }
+
+    protected:
+        int _width;
+        int _first;
+        int _last;
+        QVector<unsigned int> _ids;
+        QVector<float> _values;
+        QVector<float> _counts;
+        QVector<float> _sums;
+        QVector<float> _sorted[MEDIAN_SAMPLES];
+};
+
+void AtlasRow::load( const GQImage& source, int row )
+{
+    const unsigned char* texel = source.raster() + row * _width * 4;
+    unsigned int* ids = _ids.data() + MAX_RADIUS;
+    float* values = _values.data() + MAX_RADIUS;
+
+    _first = _width;
+    _last = -1;
+    for (int x = 0; x < _width; x++, texel += 4)
+    {
+        ids[x] = texel[0] | (texel[1] << 8) | (texel[2] << 16);
+        values[x] = texel[3] / 255.0f;
+        if (ids[x] != 0)
+        {
+            _first = qMin(_first, x);
+            _last = x;
+        }
+    }
+
+    // The atlas textures are clamped, so reads past the ends of a row
+    // return the first or last sample.
+    for (int i = 1; i <= MAX_RADIUS; i++)
+    {
+        ids[-i] = ids[0];
+        values[-i] = values[0];
+        ids[_width - 1 + i] = ids[_width - 1];
+        values[_width - 1 + i] = values[_width - 1];
+    }
+}
+
+// Counts and sums the neighbors of each occupied sample that belong to
+// the same path and differ in value by less than threshold. The loops over
+// x have no branches, so they vectorize.
+void AtlasRow::accumulate( int radius, float threshold )
+{
+    const unsigned int* center_ids = ids();
+    const float* center_values = values();
+    float* counts = _counts.data();
+    float* sums = _sums.data();
+
+    for (int x = _first; x <= _last; x++)
+    {
+        counts[x] = 0.0f;
+        sums[x] = 0.0f;
+    }
+
+    for (int i = -radius; i <= radius; i++)
+    {
+        const unsigned int* neighbor_ids = center_ids + i;
+        const float* neighbor_values = center_values + i;
+        for (int x = _first; x <= _last; x++)
+        {
+            float difference = fabsf(neighbor_values[x] - center_values[x]);
+            float weight = (neighbor_ids[x] == center_ids[x]) ? 1.0f : 0.0f;
+            weight = (difference < threshold) ? weight : 0.0f;
+            counts[x] += weight;
+            sums[x] += weight * neighbor_values[x];
+        }
+    }
+}
+
+void AtlasRow::bilateral( float* out )
+{
+    accumulate(BILATERAL_RADIUS, BILATERAL_THRESHOLD);
+
+    const float* counts = _counts.constData();
+    const float* sums = _sums.constData();
+    for (int x = _first; x <= _last; x++)
+    {
+        float rolloff = qMax(qMin(counts[x] / 4.0f - 0.2f, 1.0f), 0.0f);
+        out[x] = (sums[x] * rolloff) / counts[x];
+    }
+}
+
+void AtlasRow::smoothAndThreshold( float* out )
+{
+    accumulate(SMOOTH_RADIUS, FLT_MAX);
+
+    const float* counts = _counts.constData();
+    const float* sums = _sums.constData();
+    for (int x = _first; x <= _last; x++)
+    {
+        float rolloff = qMin(counts[x] / 4.0f, 1.0f);
+        float smoothed = rolloff * sums[x] / counts[x];
+        float alpha = (smoothed - SMOOTH_OVERSHOOT_OFFSET) / 0.2f;
+        out[x] = qMax(qMin(alpha, 1.0f), 0.0f);
+    }
+}
+
+// Samples from other paths are replaced by FLT_MAX before sorting, so they
+// end up at the top of the sorted list and the median of the remaining
+// samples can be picked out by index.
+void AtlasRow::median( float* out )
+{
+    const unsigned int* center_ids = ids();
+    const float* center_values = values();
+    float* counts = _counts.data();
+    float* picks = _sums.data();
+
+    for (int x = _first; x <= _last; x++)
+        counts[x] = 0.0f;
+
+    for (int k = 0; k < MEDIAN_SAMPLES; k++)
+    {
+        const unsigned int* neighbor_ids = center_ids + k - MEDIAN_RADIUS;
+        const float* neighbor_values = center_values + k - MEDIAN_RADIUS;
+        float* sorted = _sorted[k].data();
+        for (int x = _first; x <= _last; x++)
+        {
+            bool same = neighbor_ids[x] == center_ids[x];
+            sorted[x] = same ? neighbor_values[x] : FLT_MAX;
+            counts[x] += same ? 1.0f : 0.0f;
+        }
+    }
+
+    for (int n = 0; n < MEDIAN_NETWORK_SIZE; n++)
+    {
+        float* a = _sorted[MEDIAN_NETWORK[n][0]].data();
+        float* b = _sorted[MEDIAN_NETWORK[n][1]].data();
+        for (int x = _first; x <= _last; x++)
+        {
+            float lo = qMin(a[x], b[x]);
+            float hi = qMax(a[x], b[x]);
+            a[x] = lo;
+            b[x] = hi;
+        }
+    }
+
+    // The shader sorts in descending order and takes element count/2.
+    // Empty samples get no median.
+    for (int x = _first; x <= _last; x++)
+    {
+        int count = (int)counts[x];
+        picks[x] = (center_ids[x] != 0) ? count - 1 - count / 2 : -1;
+        out[x] = 0.0f;
+    }
+    for (int k = 0; k < MEDIAN_SAMPLES; k++)
+    {
+        const float* sorted = _sorted[k].constData();
+        for (int x = _first; x <= _last; x++)
+            out[x] = (picks[x] == k) ? sorted[x] : out[x];
+    }
+}
+
+static void writeRow( const GQImage& source, int row, const float* filtered,
+                      int first, int last, GQFloatImage& result )
+{
+    int width = source.width();
+    const unsigned char* texel = source.raster() + row * width * 4;
+    float* out = result.raster() + row * width * 4;
+
+    for (int x = 0; x < width; x++, texel += 4, out += 4)
+    {
+        bool occupied = x >= first && x <= last;
+        out[0] = texel[0] / 255.0f;
+        out[1] = texel[1] / 255.0f;
+        out[2] = texel[2] / 255.0f;
+        out[3] = occupied ? filtered[x] : 0.0f;
+    }
+}
+
+void NPRAtlasFilter::filter( NPRSegmentAtlas::AtlasFilterType type,
+                             const GQImage& source, int num_rows,
+                             GQFloatImage& result )
+{
+    assert(source.chan() == 4);
+    assert(num_rows <= source.height());
+
+    int width = source.width();
+    result.resize(width, num_rows, 4);
+
+#pragma omp parallel
+    {
+        AtlasRow row_buffer(width);
+        QVector<float> filtered(width);
+
+#pragma omp for schedule(dynamic, 4)
+        for (int row = 0; row < num_rows; row++)
+        {
+            row_buffer.load(source, row);
+            int first = row_buffer.firstOccupied();
+            int last = row_buffer.lastOccupied();
+
+            if (first <= last)
+            {
+                switch (type)
+                {
+                    case NPRSegmentAtlas::BILATERAL_FILTER :
+                        row_buffer.bilateral(filtered.data()); break;
+                    case NPRSegmentAtlas::MEDIAN_FILTER :
+                        row_buffer.median(filtered.data()); break;
+                    case NPRSegmentAtlas::SMOOTH_AND_THRESHOLD_FILTER :
+                        row_buffer.smoothAndThreshold(filtered.data()); break;
+                    default:
+                        assert(0); break;
+                }
+            }
+
+            writeRow(source, row, filtered.constData(), first, last, result);
+        }
+    }
+}
+
+static unsigned int referenceId( const GQImage& source, int x, int y )
+{
+    x = qBound(0, x, source.width() - 1);
+    return source.pixel(x, y, 0) | (source.pixel(x, y, 1) << 8) |
+           (source.pixel(x, y, 2) << 16);
+}
+
+static float referenceValue( const GQImage& source, int x, int y )
+{
+    x = qBound(0, x, source.width() - 1);
+    return source.pixel(x, y, 3) / 255.0f;
+}
+
+void NPRAtlasFilter::filterReference( NPRSegmentAtlas::AtlasFilterType type,
+                                      const GQImage& source, int num_rows,
+                                      GQFloatImage& result )
+{
+    assert(source.chan() == 4);
+
+    int width = source.width();
+    result.resize(width, num_rows, 4);
+
+    for (int y = 0; y < num_rows; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            unsigned int center_id = referenceId(source, x, y);
+            float center_value = referenceValue(source, x, y);
+            float sample_count = 0.0f;
+            float sample_sum = 0.0f;
+            float filtered = 0.0f;
+
+            if (type == NPRSegmentAtlas::BILATERAL_FILTER)
+            {
+                for (int i = -BILATERAL_RADIUS; i <= BILATERAL_RADIUS; i++)
+                {
+                    float value = referenceValue(source, x + i, y);
+                    if (referenceId(source, x + i, y) == center_id &&
+                        fabsf(value - center_value) < BILATERAL_THRESHOLD)
+                    {
+                        sample_count++;
+                        sample_sum += value;
+                    }
+                }
+                sample_sum = sample_sum *
+                    qMax(qMin(sample_count/4.0f - 0.2f, 1.0f), 0.0f);
+                filtered = sample_sum / sample_count;
+            }
+            else if (type == NPRSegmentAtlas::MEDIAN_FILTER)
+            {
+                float samples[MEDIAN_SAMPLES];
+                int count = 0;
+                if (center_id != 0)
+                {
+                    for (int i = 0; i < MEDIAN_SAMPLES; i++)
+                    {
+                        int sx = x + i - MEDIAN_RADIUS;
+                        if (referenceId(source, sx, y) == center_id)
+                            samples[count++] = referenceValue(source, sx, y);
+                    }
+                    for (int i = 0; i < count; i++)
+                    {
+                        for (int j = 0; j < count-1; j++)
+                        {
+                            float temp = samples[i];
+                            samples[i] = qMin(samples[i], samples[j]);
+                            samples[j] = qMax(temp, samples[j]);
+                        }
+                    }
+                    filtered = samples[count / 2];
+                }
+            }
+            else if (type == NPRSegmentAtlas::SMOOTH_AND_THRESHOLD_FILTER)
+            {
+                for (int i = -SMOOTH_RADIUS; i <= SMOOTH_RADIUS; i++)
+                {
+                    if (referenceId(source, x + i, y) == center_id)
+                    {
+                        sample_count++;
+                        sample_sum += referenceValue(source, x + i, y);
+                    }
+                }
+                float short_rolloff = qMin(sample_count / 4.0f, 1.0f);
+                float smoothed = short_rolloff * sample_sum / sample_count;
+                float alpha = (smoothed - SMOOTH_OVERSHOOT_OFFSET) / 0.2f;
+                filtered = qMax(qMin(alpha, 1.0f), 0.0f);
+            }
+
+            float* out = result.raster() + (y * width + x) * 4;
+            out[0] = source.pixel(x, y, 0) / 255.0f;
+            out[1] = source.pixel(x, y, 1) / 255.0f;
+            out[2] = source.pixel(x, y, 2) / 255.0f;
+            out[3] = filtered;
+        }
+    }
+}
+
+int NPRAtlasFilter::maxThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
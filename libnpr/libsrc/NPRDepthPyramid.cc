@@ -0,0 +1,322 @@
+/*****************************************************************************\
+
+NPRDepthPyramid.cc
+Copyright (c) 2009 Forrester Cole
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "NPRDepthPyramid.h"
+#include "NPRGLDraw.h"
+#include "GQShaderManager.h"
+#include "GQStats.h"
+#include <assert.h>
+
+// The first level of the pyramid covers 4x4 blocks of the depth buffer.
+// This keeps the pyramid small even for supersampled depth buffers, and
+// is large enough to cover the default supersampling kernel.
+const int BASE_LEVEL = 2;
+
+// Must match DEPTH_PYRAMID_MAX_LEVELS in depth_pyramid_common.glsl.
+const int MAX_LEVELS = 12;
+
+// Set to 1 to rebuild each pyramid on the CPU and compare the results.
+static int CHECK_AGAINST_CPU = 0;
+
+NPRDepthPyramid::NPRDepthPyramid()
+{
+    clear();
+}
+
+void NPRDepthPyramid::clear()
+{
+    _num_levels = 0;
+    _strip_width = 0;
+    _strip_height = 0;
+    _level_info.clear();
+
+    _has_gpu_levels = false;
+    _has_cpu_levels = false;
+    _pyramid_fbo.clear();
+    _cpu_levels[0].clear();
+    _cpu_levels[1].clear();
+}
+
+void NPRDepthPyramid::computeLayout( int width, int height )
+{
+    _level_info.clear();
+    _strip_height = 0;
+
+    int offsets[2] = { 0, 0 };
+    int texel_size = 1 << BASE_LEVEL;
+    while (_level_info.size() < MAX_LEVELS)
+    {
+        int level_width = (width + texel_size - 1) / texel_size;
+        int level_height = (height + texel_size - 1) / texel_size;
+        int parity = _level_info.size() % 2;
+
+        _level_info.push_back(vec(offsets[parity], level_width, level_height));
+        offsets[parity] += level_width;
+        _strip_height = qMax(_strip_height, level_height);
+
+        if (level_width == 1 && level_height == 1)
+            break;
+
+        texel_size *= 2;
+    }
+
+    _strip_width = qMax(offsets[0], offsets[1]);
+    _num_levels = _level_info.size();
+}
+
+bool NPRDepthPyramid::build( const GQFramebufferObject& depth_buffer )
+{
+    __TIME_CODE_BLOCK("Build depth pyramid");
+
+    if (depth_buffer.id() < 0)
+    {
+        clear();
+        return false;
+    }
+
+    _has_gpu_levels = false;
+    _has_cpu_levels = false;
+    computeLayout(depth_buffer.width(), depth_buffer.height());
+
+    bool success = _pyramid_fbo.init(_strip_width, _strip_height, 2,
+                                     GQ_ATTACH_NONE, GQ_COORDS_PIXEL,
+                                     GQ_FORMAT_RGBA_FLOAT);
+    if (!success)
+    {
+        qCritical("NPRDepthPyramid::build: failed to initialize pyramid fbo.\n");
+        _num_levels = 0;
+        return false;
+    }
+    _pyramid_fbo.setTextureWrap(GL_CLAMP, GL_CLAMP);
+    _pyramid_fbo.setTextureFilter(GL_NEAREST, GL_NEAREST);
+
+    NPRGLDraw::clearGLState();
+    GQShaderRef shader = GQShaderManager::bindProgram("depth_pyramid");
+
+    _pyramid_fbo.bind();
+
+    glPushAttrib(GL_VIEWPORT_BIT);
+    glDisable(GL_DEPTH_TEST);
+
+    for (int i = 0; i < _num_levels; i++)
+    {
+        const vec& level = _level_info[i];
+
+        if (i == 0)
+        {
+            shader.bindNamedTexture("source_buffer",
+                                    depth_buffer.colorTexture(0));
+            shader.setUniform1f("source_offset", 0);
+            shader.setUniform2f("source_size", depth_buffer.width(),
+                                depth_buffer.height());
+            shader.setUniform1f("reduction", 1 << BASE_LEVEL);
+            shader.setUniform1i("from_depth_buffer", 1);
+        }
+        else
+        {
+            const vec& source = _level_info[i-1];
+            shader.bindNamedTexture("source_buffer",
+                                    _pyramid_fbo.colorTexture((i-1) % 2));
+            shader.setUniform1f("source_offset", source[0]);
+            shader.setUniform2f("source_size", source[1], source[2]);
+            shader.setUniform1f("reduction", 2);
+            shader.setUniform1i("from_depth_buffer", 0);
+        }
+        shader.setUniform1f("dest_offset", level[0]);
+
+        _pyramid_fbo.drawBuffer(i % 2);
+        glViewport(level[0], 0, level[1], level[2]);
+
+        NPRGLDraw::drawFullScreenQuad(GL_TEXTURE_RECTANGLE_ARB);
+    }
+
+    glPopAttrib();
+
+    _pyramid_fbo.unbind();
+
+    _has_gpu_levels = true;
+
+    if (CHECK_AGAINST_CPU)
+        checkAgainstCPU(depth_buffer);
+
+    return true;
+}
+
+void NPRDepthPyramid::build( const GQFloatImage& depth_image )
+{
+    assert(depth_image.chan() >= 3);
+
+    _has_gpu_levels = false;
+    computeLayout(depth_image.width(), depth_image.height());
+
+    for (int i = 0; i < 2; i++)
+        _cpu_levels[i].resize(_strip_width, _strip_height, 2);
+
+    // Same reduction as depth_pyramid.frag.
+    for (int i = 0; i < _num_levels; i++)
+    {
+        const vec& level = _level_info[i];
+        GQFloatImage& dest = _cpu_levels[i % 2];
+
+        int reduction = (i == 0) ? (1 << BASE_LEVEL) : 2;
+        int source_width = (i == 0) ? depth_image.width() : _level_info[i-1][1];
+        int source_height = (i == 0) ? depth_image.height() : _level_info[i-1][2];
+
+        for (int y = 0; y < level[2]; y++)
+        {
+            for (int x = 0; x < level[1]; x++)
+            {
+                float min_z = FLT_MAX;
+                float max_z = -FLT_MAX;
+                for (int sy = 0; sy < reduction; sy++)
+                {
+                    for (int sx = 0; sx < reduction; sx++)
+                    {
+                        int source_x = qMin(x*reduction + sx, source_width - 1);
+                        int source_y = qMin(y*reduction + sy, source_height - 1);
+                        if (i == 0)
+                        {
+                            float z = depth_image.pixel(source_x, source_y, 2);
+                            min_z = qMin(min_z, z);
+                            max_z = qMax(max_z, z);
+                        }
+                        else
+                        {
+                            const GQFloatImage& source = _cpu_levels[(i-1) % 2];
+                            source_x += _level_info[i-1][0];
+                            min_z = qMin(min_z, source.pixel(source_x, source_y, 0));
+                            max_z = qMax(max_z, source.pixel(source_x, source_y, 1));
+                        }
+                    }
+                }
+
+                dest.setPixelChannel(level[0] + x, y, 0, min_z);
+                dest.setPixelChannel(level[0] + x, y, 1, max_z);
+            }
+        }
+    }
+
+    _has_cpu_levels = true;
+}
+
+void NPRDepthPyramid::setUniformParams( const GQShaderRef& shader ) const
+{
+    if (!_has_gpu_levels)
+    {
+        shader.setUniform1i("dp_params.num_levels", 0);
+        return;
+    }
+
+    shader.setUniform1i("dp_params.num_levels", _num_levels);
+    shader.setUniform1f("dp_params.base_texel_size", 1 << BASE_LEVEL);
+    shader.setUniformVec3Array("depth_pyramid_levels", _level_info);
+    shader.bindNamedTexture("depth_pyramid_even",
+                            _pyramid_fbo.colorTexture(0));
+    shader.bindNamedTexture("depth_pyramid_odd",
+                            _pyramid_fbo.colorTexture(1));
+}
+
+// Finds the finest level whose texels are at least as large as the box, so
+// that the box overlaps at most 2x2 texels, and returns the combined
+// depth range of those texels. Mirrors depthPyramidRange() in
+// depth_pyramid_common.glsl.
+bool NPRDepthPyramid::depthRange( const vec2& lo, const vec2& hi,
+                                  float range[2] ) const
+{
+    if (!_has_cpu_levels)
+        return false;
+
+    float size = qMax(qMax(hi[0] - lo[0], hi[1] - lo[1]), 1.0f);
+    float texel_size = 1 << BASE_LEVEL;
+    int which = 0;
+    while (which < MAX_LEVELS && texel_size < size)
+    {
+        which++;
+        texel_size *= 2.0f;
+    }
+    if (which >= _num_levels)
+        return false;
+
+    const vec& level = _level_info[which];
+    const GQFloatImage& image = _cpu_levels[which % 2];
+
+    int x[2], y[2];
+    x[0] = qBound(0, (int)floorf(lo[0] / texel_size), (int)level[1] - 1);
+    x[1] = qBound(0, (int)floorf(hi[0] / texel_size), (int)level[1] - 1);
+    y[0] = qBound(0, (int)floorf(lo[1] / texel_size), (int)level[2] - 1);
+    y[1] = qBound(0, (int)floorf(hi[1] / texel_size), (int)level[2] - 1);
+
+    range[0] = FLT_MAX;
+    range[1] = -FLT_MAX;
+    for (int j = 0; j < 2; j++)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            int image_x = level[0] + x[i];
+            range[0] = qMin(range[0], image.pixel(image_x, y[j], 0));
+            range[1] = qMax(range[1], image.pixel(image_x, y[j], 1));
+        }
+    }
+    return true;
+}
+
+NPRDepthPyramid::Classification NPRDepthPyramid::classify(
+    const vec2& lo, const vec2& hi, float min_z, float max_z ) const
+{
+    float range[2];
+    if (!depthRange(lo, hi, range))
+        return DEPTH_AMBIGUOUS;
+
+    if (max_z <= range[0])
+        return DEPTH_VISIBLE;
+    if (min_z > range[1])
+        return DEPTH_HIDDEN;
+    return DEPTH_AMBIGUOUS;
+}
+
+bool NPRDepthPyramid::checkAgainstCPU( const GQFramebufferObject& depth_buffer ) const
+{
+    GQFloatImage depth_image;
+    depth_buffer.readColorTexturef(0, depth_image);
+
+    NPRDepthPyramid reference;
+    reference.build(depth_image);
+
+    int num_errors = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        GQFloatImage gpu_image;
+        _pyramid_fbo.readColorTexturef(i, gpu_image);
+
+        for (int which = i; which < _num_levels; which += 2)
+        {
+            const vec& level = _level_info[which];
+            for (int y = 0; y < level[2]; y++)
+            {
+                for (int x = level[0]; x < level[0] + level[1]; x++)
+                {
+                    for (int c = 0; c < 2; c++)
+                    {
+                        if (gpu_image.pixel(x, y, c) !=
+                            reference._cpu_levels[i].pixel(x, y, c))
+                            num_errors++;
+                    }
+                }
+            }
+        }
+    }
+
+    if (num_errors > 0)
+    {
+        qWarning("NPRDepthPyramid::checkAgainstCPU: %d texels differ from the CPU pyramid\n",
+                 num_errors);
+    }
+    return num_errors == 0;
+}
@@ -26,8 +26,8 @@ NPRDrawable::NPRDrawable( const xform& transform, const NPRGeometry* geom )
     _geom = geom;
     _node = 0;
     _anim_controller = 0;
-    _path_set = new NPRFixedPathSet(this);
-    _const_path_set = _path_set;
+    _path_set = 0;
+    _const_path_set = 0;
 }
 
 NPRDrawable::NPRDrawable( const xform& transform, const NPRGeometry* geom, 
@@ -37,8 +37,15 @@ NPRDrawable::NPRDrawable( const xform& transform, const NPRGeometry* geom,
     _geom = geom;
     _node = node;
     _anim_controller = path;
-    _path_set = new NPRFixedPathSet(this);
-    _const_path_set = _path_set;
+    _path_set = 0;
+    _const_path_set = 0;
+}
+
+void NPRDrawable::setPaths( NPRFixedPathSet* paths )
+{
+    delete _path_set;
+    _path_set = paths;
+    _const_path_set = paths;
 }
 
 void NPRDrawable::clear()
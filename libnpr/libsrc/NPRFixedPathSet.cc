@@ -126,14 +126,22 @@ void NPRFixedPath::debugDump() const
 
 // NPRFixedPathSet
 
-NPRFixedPathSet::NPRFixedPathSet( const NPRDrawable* drawable )
+static int pathSetMemory()
+{
+    static const int category = GQMemory::category("NPRFixedPathSet", GQMemory::CPU);
+    return category;
+}
+
+NPRFixedPathSet::NPRFixedPathSet( const NPRDrawable* drawable ) 
+    : _memory(pathSetMemory())
 {
     _drawable = drawable;
     _const_geom = drawable->geometry();
     init();
 }
 
-NPRFixedPathSet::NPRFixedPathSet( const NPRGeometry* geom )
+NPRFixedPathSet::NPRFixedPathSet( const NPRGeometry* geom ) 
+    : _memory(pathSetMemory())
 {
     _drawable = 0;
     _const_geom = geom;
@@ -178,6 +186,7 @@ void NPRFixedPathSet::init()
     assignStaticIDs();
     assignStaticLengths();
     orientPaths();
+    updateMemoryUse();
 }
 
 void NPRFixedPathSet::clear()
@@ -186,6 +195,16 @@ void NPRFixedPathSet::clear()
     _drawable = 0;
     while (!_paths.isEmpty())
         delete _paths.takeFirst();
+    _memory.set(0);
+}
+
+void NPRFixedPathSet::updateMemoryUse()
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < _paths.size(); i++)
+        bytes += sizeof(NPRFixedPath*) + sizeof(NPRFixedPath) + 
+                 _paths[i]->capacity() * sizeof(int);
+    _memory.set(bytes);
 }
 
 void NPRFixedPathSet::assignStaticIDs()
@@ -0,0 +1,105 @@
+/*****************************************************************************\
+
+NPRFrameCache.cc
+Copyright (c) 2009 Forrester Cole
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include "NPRFrameCache.h"
+#include "GQInclude.h"
+
+void NPRStageKey::add( int value )
+{
+    _data.append((const char*)&value, sizeof(value));
+}
+
+void NPRStageKey::add( unsigned int value )
+{
+    _data.append((const char*)&value, sizeof(value));
+}
+
+void NPRStageKey::add( float value )
+{
+    _data.append((const char*)&value, sizeof(value));
+}
+
+void NPRStageKey::add( bool value )
+{
+    _data.append(value ? '\1' : '\0');
+}
+
+void NPRStageKey::add( const void* pointer )
+{
+    _data.append((const char*)&pointer, sizeof(pointer));
+}
+
+void NPRStageKey::add( const float* values, int count )
+{
+    _data.append((const char*)values, sizeof(float)*count);
+}
+
+void NPRStageKey::add( const double* values, int count )
+{
+    _data.append((const char*)values, sizeof(double)*count);
+}
+
+void NPRStageKey::addGLViewParams()
+{
+    GLfloat viewport[4];
+    GLfloat mv[16], proj[16];
+    glGetFloatv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+
+    add(viewport, 4);
+    add(mv, 16);
+    add(proj, 16);
+}
+
+NPRFrameCache::NPRFrameCache()
+{
+    _enabled = true;
+    for (int i = 0; i < NUM_STAGES; i++)
+        _generations[i] = 0;
+
+    clear();
+}
+
+void NPRFrameCache::clear()
+{
+    for (int i = 0; i < NUM_STAGES; i++)
+    {
+        _keys[i].clear();
+        _valid[i] = false;
+    }
+    _num_skipped = 0;
+}
+
+void NPRFrameCache::invalidate( Stage stage )
+{
+    _valid[stage] = false;
+}
+
+bool NPRFrameCache::needsUpdate( Stage stage, const NPRStageKey& key )
+{
+    if (_enabled && _valid[stage] && _keys[stage] == key)
+    {
+        _num_skipped++;
+        return false;
+    }
+
+    _keys[stage] = key;
+    _valid[stage] = true;
+    _generations[stage]++;
+    return true;
+}
+
+void NPRFrameCache::setEnabled( bool enabled )
+{
+    _enabled = enabled;
+    if (!_enabled)
+        clear();
+}
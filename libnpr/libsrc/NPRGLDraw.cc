@@ -22,6 +22,7 @@ See the COPYING file for details.
 #include "NPRGeometry.h"
 #include "NPRDrawable.h"
 #include "NPRFixedPathSet.h"
+#include "NPRDepthPyramid.h"
 
 #include "CdaMaterial.h"
 #include "CdaEffect.h"
@@ -31,6 +32,9 @@ See the COPYING file for details.
 
 bool NPRGLDraw::_is_initialized = false;
 GQTexture2D* NPRGLDraw::_supersample_texture = NULL;
+bool NPRGLDraw::_has_image_region = false;
+int NPRGLDraw::_image_size[2] = { 0, 0 };
+int NPRGLDraw::_image_origin[2] = { 0, 0 };
 
 void NPRGLDraw::handleGLError(const char* file, int line)
 {
@@ -95,7 +99,7 @@ void NPRGLDraw::drawMeshes(const NPRScene& scene, const QList<int>* list, int dr
                         current_geom->unbind();
                     current_geom = drawable->geometry();
                     current_geom->bind();
-                    GQStats::instance().addToCounter("Polygon binds", 1);
+                    __ADD_TO_COUNTER("Polygon binds", 1);
                 }
 
                 if (triangles_to_draw)
@@ -218,7 +222,7 @@ void NPRGLDraw::drawDrawablePolygons( const NPRDrawable* drawable, int draw_mode
         glMatrixMode(GL_MODELVIEW);
         drawable->pushTransform();
 
-        GQStats::instance().addToCounter("Polygon binds", 1);
+        __ADD_TO_COUNTER("Polygon binds", 1);
 
         drawable->geometry()->bind();
 
@@ -272,15 +276,23 @@ void NPRGLDraw::drawPaperQuad( const NPRStyle* style )
     float viewport[4];
     glGetFloatv(GL_VIEWPORT, viewport);
     
+    float scale = 1 - transfer[1]*0.875f;
     float scaled_width = viewport[2] / (float)(paper_texture->width()); 
     float scaled_height = viewport[3] / (float)(paper_texture->height());
-    scaled_width *= 1 - transfer[1]*0.875f;
-    scaled_height *= 1 - transfer[1]*0.875f;
+    scaled_width *= scale;
+    scaled_height *= scale;
     
-    // scale texture appropriately
+    // scale texture appropriately, continuing it from the neighboring
+    // tiles if this is one tile of a larger image
     glMatrixMode(GL_TEXTURE);
     glPushMatrix();
     glLoadIdentity();
+    if (_has_image_region)
+    {
+        glTranslatef(_image_origin[0] * scale / (float)(paper_texture->width()),
+                     _image_origin[1] * scale / (float)(paper_texture->height()), 
+                     0.0f);
+    }
     glScalef(scaled_width, scaled_height, 1.0f);
 
     glEnable(GL_BLEND);
@@ -333,6 +345,12 @@ void NPRGLDraw::drawBackgroundTex( const NPRStyle* style )
     glMatrixMode(GL_TEXTURE);
     glPushMatrix();
     glLoadIdentity();
+    if (_has_image_region)
+    {
+        glTranslatef(_image_origin[0] * rescale / (float)(background_tex->width()),
+                     _image_origin[1] * rescale / (float)(background_tex->height()), 
+                     0.0f);
+    }
     glScalef(scaled_width*rescale, scaled_height*rescale, 1.0f);
 
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
@@ -592,7 +610,8 @@ void NPRGLDraw::clearGLState()
 }
 
 void NPRGLDraw::setUniformSSParams(const GQShaderRef& shader,
-                                   const GQTexture2D& depth_buffer)
+                                   const GQTexture2D& depth_buffer,
+                                   const NPRDepthPyramid* depth_pyramid)
 {
     if (!_is_initialized)
         init();
@@ -617,6 +636,12 @@ void NPRGLDraw::setUniformSSParams(const GQShaderRef& shader,
                             _supersample_texture);
     shader.bindNamedTexture("depth_buffer", 
                             &depth_buffer);
+
+    // Without a pyramid, every sample gets the full supersampled test.
+    if (depth_pyramid)
+        depth_pyramid->setUniformParams(shader);
+    else
+        shader.setUniform1i("dp_params.num_levels", 0);
 }
 
 void NPRGLDraw::setUniformViewParams(const GQShaderRef& shader)
@@ -698,11 +723,63 @@ void NPRGLDraw::setUniformFocusParams(const GQShaderRef& shader,
 
     GLint viewport[4];
     glGetIntegerv(GL_VIEWPORT, viewport);
-    shader.setUniform1f("screen_aspect_ratio", (float)viewport[2] / (float)viewport[3]);
-    // transform screen to clip coordinates
-    float cx = scene.focalPoint()[0] / ((float)viewport[2]*0.5) - 1;
-    float cy = scene.focalPoint()[1] / ((float)viewport[3]*0.5) - 1;
+    shader.setUniform1f("screen_aspect_ratio", imageAspectRatio());
+    // transform screen to clip coordinates (of the whole image, when tiled)
+    float image_width = _has_image_region ? _image_size[0] : viewport[2];
+    float image_height = _has_image_region ? _image_size[1] : viewport[3];
+    float cx = scene.focalPoint()[0] / (image_width*0.5) - 1;
+    float cy = scene.focalPoint()[1] / (image_height*0.5) - 1;
     shader.setUniform2f("focus_2d_poa", cx, cy );
+
+    float transform[4];
+    imageNDCTransform(transform);
+    shader.setUniform4fv("image_ndc_transform", transform);
+}
+
+void NPRGLDraw::setImageRegion( int image_width, int image_height, 
+                                int x, int y )
+{
+    _has_image_region = true;
+    _image_size[0] = image_width;
+    _image_size[1] = image_height;
+    _image_origin[0] = x;
+    _image_origin[1] = y;
+}
+
+void NPRGLDraw::clearImageRegion()
+{
+    _has_image_region = false;
+}
+
+float NPRGLDraw::imageAspectRatio()
+{
+    if (_has_image_region)
+        return (float)_image_size[0] / (float)_image_size[1];
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    return (float)viewport[2] / (float)viewport[3];
+}
+
+void NPRGLDraw::imageNDCTransform( float transform[4] )
+{
+    if (!_has_image_region)
+    {
+        transform[0] = 1.0f;
+        transform[1] = 1.0f;
+        transform[2] = 0.0f;
+        transform[3] = 0.0f;
+        return;
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    for (int i = 0; i < 2; i++)
+    {
+        transform[i] = (float)viewport[2+i] / (float)_image_size[i];
+        transform[2+i] = (float)(2*_image_origin[i] + viewport[2+i]) / 
+                         (float)_image_size[i] - 1.0f;
+    }
 }
 
 void NPRGLDraw::init()
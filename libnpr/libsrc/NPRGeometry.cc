@@ -19,12 +19,19 @@ See the COPYING file for details.
 
 const NPRGeometry*  NPRGeometry::_currently_bound_geom = 0;
 
-NPRGeometry::NPRGeometry()
+static int geometryMemory()
+{
+    static const int category = GQMemory::category("NPRGeometry", GQMemory::CPU);
+    return category;
+}
+
+NPRGeometry::NPRGeometry() : _memory(geometryMemory())
 {
     clear();
 }
 
-NPRGeometry::NPRGeometry( const CdaGeometry* cda_geometry )
+NPRGeometry::NPRGeometry( const CdaGeometry* cda_geometry ) 
+    : _memory(geometryMemory())
 {
     clear();
     convertFromCdaGeometry( this, cda_geometry );
@@ -51,6 +58,7 @@ void NPRGeometry::clear()
     _bsphere_radius = -1;
 
     _vertex_buffer_set.clear();
+    _memory.set(0);
 }
 
 void NPRGeometry::reset()
@@ -64,6 +72,21 @@ void NPRGeometry::reset()
             delete _primitives[i].takeFirst();
     }
     _vertex_buffer_set.deleteVBOs();
+    updateMemoryUse();
+}
+
+void NPRGeometry::updateMemoryUse()
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < _sources.size(); i++)
+        bytes += sizeof(NPRDataSource) + _sources[i]->capacity() * sizeof(float);
+
+    for (int i = 0; i < NPR_NUM_PRIMITIVES; i++)
+    {
+        for (int j = 0; j < _primitives[i].size(); j++)
+            bytes += sizeof(NPRPrimitive) + _primitives[i][j]->capacity() * sizeof(int);
+    }
+    _memory.set(bytes);
 }
 
 void NPRGeometry::addData( const QString& name, int width )
@@ -86,6 +109,7 @@ void NPRGeometry::addData( const QString& name, int width )
     }
 
     _vertex_buffer_set.add(name, newsource->width(), *newsource);
+    updateMemoryUse();
 }
 
 void NPRGeometry::addData( const QString& name, NPRDataSource* source )
@@ -107,6 +131,7 @@ void NPRGeometry::addData( const QString& name, NPRDataSource* source )
         }
     }
     _vertex_buffer_set.add(name, source->width(), *source);
+    updateMemoryUse();
 }
 
 void NPRGeometry::addData( GQVertexBufferType semantic, int width )
@@ -19,16 +19,6 @@ See the COPYING file for details.
 #include "GQStats.h"
 #include <assert.h>
 
-#if 1
-#define __MY_START_TIMER __START_TIMER
-#define __MY_STOP_TIMER __STOP_TIMER
-#define __MY_TIME_CODE_BLOCK __TIME_CODE_BLOCK
-#else
-#define __MY_START_TIMER __START_TIMER_AFTER_GL_FINISH
-#define __MY_STOP_TIMER __STOP_TIMER_AFTER_GL_FINISH
-#define __MY_TIME_CODE_BLOCK __TIME_CODE_BLOCK_AFTER_GL_FINISH
-#endif
-
 const int DRAW_STROKES_WITH_PRIORITY = 0;
 const int DRAW_STROKES_NO_PRIORITY = 1;
 const int DRAW_PRIORITY_WITH_VISIBILITY = 2;
@@ -75,7 +65,8 @@ void NPRPathRenderer::drawSimpleLines(const NPRScene& scene)
 // Drawing strokes without access to a segment atlas. This
 // is algorithm 1 in the TVCG paper. 
 void NPRPathRenderer::drawStrokes(const NPRScene& scene,
-                                  const GQTexture2D& depth_buffer)
+                                  const GQTexture2D& depth_buffer,
+                                  const NPRDepthPyramid* depth_pyramid)
 {
     if (!_is_initialized)
         init();
@@ -90,7 +81,7 @@ void NPRPathRenderer::drawStrokes(const NPRScene& scene,
         settings.get(NPR_CHECK_LINE_VISIBILITY_AT_SPINE));
     setUniformPenStyleParams(shader, *(scene.globalStyle()));
     NPRGLDraw::setUniformFocusParams(shader, scene);
-    NPRGLDraw::setUniformSSParams(shader, depth_buffer);
+    NPRGLDraw::setUniformSSParams(shader, depth_buffer, depth_pyramid);
     NPRGLDraw::setUniformViewParams(shader);
 
     glDisable(GL_DEPTH_TEST);
@@ -256,7 +247,7 @@ void NPRPathRenderer::drawQuads(const GQShaderRef& shader,
     if (atlas.totalSegments() == 0)
         return;
 
-    __MY_START_TIMER("Draw Quads");
+    __GPU_START_TIMER("Draw Quads");
 
     const NPRSettings& settings = NPRSettings::instance();
 
@@ -323,6 +314,15 @@ void NPRPathRenderer::drawQuads(const GQShaderRef& shader,
     {
         shader.setUniform1f("sample_spacing", atlas.sampleSpacing() );
     }
+    if (shader.uniformLocation("use_arc_length_region") >= 0)
+    {
+        shader.setUniform1i("use_arc_length_region", NPRGLDraw::hasImageRegion());
+        if (NPRGLDraw::hasImageRegion())
+        {
+            shader.bindNamedTexture("arc_length_start_buffer", 
+                atlas.clipBuffer(NPRSegmentAtlas::ARC_LENGTH_START_ID));
+        }
+    }
 
     _quad_vertices_vbo.bind();
 
@@ -349,7 +349,7 @@ void NPRPathRenderer::drawQuads(const GQShaderRef& shader,
         glPolygonMode(GL_FRONT, GL_FILL);
     }
 
-    __MY_STOP_TIMER("Draw Quads");
+    __GPU_STOP_TIMER("Draw Quads");
 }
         
 // Creates a blank dummy texture for rendering quads when the user
@@ -29,6 +29,8 @@ NPRRendererStandard::NPRRendererStandard()
 void NPRRendererStandard::clear()
 {
     _segment_atlas.clear();
+    _depth_pyramid.clear();
+    _frame_cache.clear();
 }
 
 void NPRRendererStandard::setLineVisibilityMethod( NPRLineVisibilityMethod method )
@@ -40,17 +42,62 @@ void NPRRendererStandard::drawScene( const NPRScene& scene )
 {
     __TIME_CODE_BLOCK("Draw Scene");
 
-    NPRSettings& settings = NPRSettings::instance();
-    const NPRStyle* style = scene.globalStyle();
+    if (!beginFrame())
+        return;
 
-    bool skip_stylized_lines = !settings.get(NPR_ENABLE_LINES) || 
-                               !settings.get(NPR_ENABLE_STYLIZED_LINES);
-    bool skip_lines = !settings.get(NPR_ENABLE_LINES);
-    bool skip_polygons = !settings.get(NPR_ENABLE_POLYGONS);
-    bool use_priority_buffer = settings.get(NPR_CHECK_LINE_PRIORITY) &&
-                               style->enableLineElision();
+    drawFrame(scene);
+}
+
+int NPRRendererStandard::drawViews( NPRScene& scene, 
+                                    const QVector<NPRView>& views,
+                                    NPRViewCallback* callback )
+{
+    __TIME_CODE_BLOCK("Draw Views");
+
+    if (!beginFrame())
+        return 0;
+
+    bool use_atlas = _line_viz_method == NPR_SEGMENT_ATLAS &&
+                     NPRSettings::instance().get(NPR_ENABLE_LINES) &&
+                     NPRSettings::instance().get(NPR_ENABLE_STYLIZED_LINES) &&
+                     !scene.sortedPaths().isEmpty();
+    if (use_atlas && !_segment_atlas.beginViews(scene))
+        return 0;
+
+    int num_drawn = 0;
+    for (int i = 0; i < views.size(); i++)
+    {
+        __TIME_CODE_BLOCK("Draw View");
 
-    int viz_method = settings.get(NPR_LINE_VISIBILITY_METHOD);
+        const NPRView& view = views[i];
+        view.applyToGL();
+        scene.light(0)->applyToGL(0);
+
+        scene.setCameraTransform(view._camera_transform);
+        scene.setFieldOfView(view._field_of_view);
+        scene.computePotentiallyVisibleSet();
+
+        drawFrame(scene);
+        num_drawn++;
+
+        if (callback && !callback->viewDrawn(i))
+            break;
+    }
+
+    if (use_atlas)
+        _segment_atlas.endViews();
+
+    return num_drawn;
+}
+
+bool NPRRendererStandard::beginFrame()
+{
+    // The texture and buffer uploads in libgq add to this, so it is reset
+    // before any of the frame's uploads. Otherwise frames without uploads
+    // would leave gaps in the counter.
+    __SET_COUNTER("bytes uploaded", 0);
+
+    int viz_method = NPRSettings::instance().get(NPR_LINE_VISIBILITY_METHOD);
     setLineVisibilityMethod((NPRLineVisibilityMethod)viz_method);
 
     if (GQShaderManager::status() == GQ_SHADERS_NOT_LOADED)
@@ -61,53 +108,94 @@ void NPRRendererStandard::drawScene( const NPRScene& scene )
     if (!GQShaderManager::status() == GQ_SHADERS_OK)
     {
         NPRGLDraw::clearGLState();
-        return;
+        return false;
     }
+    return true;
+}
+
+void NPRRendererStandard::drawFrame( const NPRScene& scene )
+{
+    NPRSettings& settings = NPRSettings::instance();
+    const NPRStyle* style = scene.globalStyle();
+
+    // A scene still loading in the background may not have paths yet.
+    bool skip_stylized_lines = !settings.get(NPR_ENABLE_LINES) || 
+                               !settings.get(NPR_ENABLE_STYLIZED_LINES) ||
+                               scene.sortedPaths().isEmpty();
+    bool skip_lines = !settings.get(NPR_ENABLE_LINES);
+    bool skip_polygons = !settings.get(NPR_ENABLE_POLYGONS);
+    bool use_priority_buffer = settings.get(NPR_CHECK_LINE_PRIORITY) &&
+                               style->enableLineElision();
 
     if (!skip_stylized_lines)
     {
         __TIME_CODE_BLOCK("Compute Line Vis.");
+        _frame_cache.resetSkippedStages();
         drawDepthBuffer(scene);
         
         if (_line_viz_method == NPR_SEGMENT_ATLAS)
         {
             if (settings.get(NPR_VIEW_CLIP_BUFFER))
             {
+                _frame_cache.clear();
                 _segment_atlas.visualize( scene, *depthBuffer() );
                 NPRGLDraw::clearGLState();
                 return;
             }
 
-            _segment_atlas.draw( scene, *depthBuffer() );
+            _segment_atlas.draw( scene, *depthBuffer(), &_depth_pyramid,
+                                 &_frame_cache );
 
-            if (settings.get(NPR_FILTER_LINE_VISIBILITY))
+            NPRStageKey filter_key;
+            filter_key.add(_frame_cache.generation(NPRFrameCache::ATLAS_STAGE));
+            filter_key.add(settings.get(NPR_FILTER_LINE_VISIBILITY));
+            if (_frame_cache.needsUpdate(NPRFrameCache::FILTER_STAGE, filter_key))
             {
-                _segment_atlas.filter(NPRSegmentAtlas::VISIBILITY_ID, 
-                    NPRSegmentAtlas::SMOOTH_AND_THRESHOLD_FILTER,
-                    scene.globalStyle());
+                if (settings.get(NPR_FILTER_LINE_VISIBILITY))
+                {
+                    _segment_atlas.filter(NPRSegmentAtlas::VISIBILITY_ID, 
+                        NPRSegmentAtlas::SMOOTH_AND_THRESHOLD_FILTER,
+                        scene.globalStyle());
+                }
+                else
+                {
+                    _segment_atlas.resetFilter(NPRSegmentAtlas::VISIBILITY_ID);
+                }
             }
        
             if (use_priority_buffer)
             {
-                drawPriorityBuffer(scene);
-
-                if (settings.get(NPR_VIEW_PRIORITY_BUFFER))
+                NPRStageKey priority_key;
+                makePriorityStageKey(scene, priority_key);
+                if (_frame_cache.needsUpdate(NPRFrameCache::PRIORITY_STAGE, priority_key))
+                {
+                    drawPriorityBuffer(scene);
+
+                    if (settings.get(NPR_VIEW_PRIORITY_BUFFER))
+                    {
+                        visualizePriorityBuffer();
+                        NPRGLDraw::clearGLState();
+                        return;
+                    }
+
+                    _segment_atlas.checkPriority(*priorityBuffer());
+                    if (settings.get(NPR_FILTER_LINE_PRIORITY))
+                    {
+                        _segment_atlas.filter(NPRSegmentAtlas::PRIORITY_ID,
+                                              NPRSegmentAtlas::BILATERAL_FILTER, 
+                                              0);
+                    }
+                }
+                else if (settings.get(NPR_VIEW_PRIORITY_BUFFER))
                 {
                     visualizePriorityBuffer();
                     NPRGLDraw::clearGLState();
                     return;
                 }
-
-                _segment_atlas.checkPriority(*priorityBuffer());
-                if (settings.get(NPR_FILTER_LINE_PRIORITY))
-                {
-                    _segment_atlas.filter(NPRSegmentAtlas::PRIORITY_ID,
-                                          NPRSegmentAtlas::BILATERAL_FILTER, 
-                                          0);
-                }
-                
             }
         }
+
+        __SET_COUNTER("cached line vis. stages", _frame_cache.numSkippedStages());
     }
 
     NPRGLDraw::clearGLState();
@@ -136,7 +224,7 @@ void NPRRendererStandard::drawScene( const NPRScene& scene )
     if (!skip_stylized_lines) {
         if (_line_viz_method == NPR_SPINE_TEST)
         {
-            _path_renderer.drawStrokes(scene, *depthBuffer());
+            _path_renderer.drawStrokes(scene, *depthBuffer(), &_depth_pyramid);
         }
         else if (_line_viz_method == NPR_SEGMENT_ATLAS)
         {
@@ -151,6 +239,9 @@ void NPRRendererStandard::drawScene( const NPRScene& scene )
     }
 
     NPRGLDraw::clearGLState();
+
+    // Picks up the GPU timers of earlier frames that have finished.
+    GQGPUTimer::instance().endFrame();
 }
 
 void NPRRendererStandard::drawSceneDepth( const NPRScene& scene )
@@ -201,7 +292,25 @@ void NPRRendererStandard::drawPolygons(const NPRScene& scene)
 
 void NPRRendererStandard::drawDepthBuffer( const NPRScene& scene )
 {
-    float depth_scale = NPRSettings::instance().get(NPR_SEGMENT_ATLAS_DEPTH_SCALE);
+    NPRSettings& settings = NPRSettings::instance();
+    float depth_scale = settings.get(NPR_SEGMENT_ATLAS_DEPTH_SCALE);
+
+    // The depth buffer only changes if the view, the geometry, or the
+    // settings that affect which polygons are drawn have changed.
+    NPRStageKey depth_key;
+    depth_key.add((const void*)&scene);
+    depth_key.add(scene.changeStamp());
+    depth_key.addGLViewParams();
+    depth_key.add(depth_scale);
+    depth_key.add(settings.get(NPR_CHECK_LINE_VISIBILITY));
+    depth_key.add(settings.get(NPR_ENABLE_TRANSPARENT_POLYGONS));
+    depth_key.add(settings.get(NPR_COMPUTE_PVS));
+    if (_depth_buffer.id() >= 0 && 
+        !_frame_cache.needsUpdate(NPRFrameCache::DEPTH_STAGE, depth_key))
+    {
+        return;
+    }
+
     if (NPRSettings::instance().get(NPR_CHECK_LINE_VISIBILITY))
     {
         __TIME_CODE_BLOCK("Draw depth buffer");
@@ -220,6 +329,8 @@ void NPRRendererStandard::drawDepthBuffer( const NPRScene& scene )
         NPRGLDraw::clearGLScreen(vec(1,1,1), 1);
         _depth_buffer.unbind();
     }
+
+    _depth_pyramid.build(_depth_buffer);
 }
 
 void NPRRendererStandard::drawPriorityBuffer( const NPRScene& scene )
@@ -237,6 +348,36 @@ void NPRRendererStandard::drawPriorityBuffer( const NPRScene& scene )
     _priority_buffer.unbind();
 }
 
+// Collects everything the priority buffer, the priority atlas, and its
+// filter depend on.
+void NPRRendererStandard::makePriorityStageKey( const NPRScene& scene, 
+                                                NPRStageKey& key )
+{
+    NPRSettings& settings = NPRSettings::instance();
+    const NPRStyle* style = scene.globalStyle();
+    float transfer[4];
+
+    key.add(_frame_cache.generation(NPRFrameCache::ATLAS_STAGE));
+    key.add(_frame_cache.generation(NPRFrameCache::FILTER_STAGE));
+    key.addGLViewParams();
+
+    key.add(settings.get(NPR_FILTER_LINE_PRIORITY));
+    key.add(settings.get(NPR_VIEW_PRIORITY_BUFFER));
+    key.add(settings.get(NPR_FOCUS_MODE));
+
+    key.add((const void*)style);
+    key.add(style->drawInvisibleLines());
+    key.add(style->penStyle("Base Style")->elisionWidth());
+    key.add(style->penStyle("Defocused")->elisionWidth());
+    style->transfer(NPRStyle::LINE_ELISION).toArray(transfer);
+    key.add(transfer, 4);
+    style->transfer(NPRStyle::FOCUS_TRANSFER).toArray(transfer);
+    key.add(transfer, 4);
+
+    key.add(&(scene.focalPoint()[0]), 3);
+    key.add(scene.sceneRadius());
+}
+
 void NPRRendererStandard::visualizeDepthBuffer()
 {
     NPRGLDraw::visualizeFBO(_depth_buffer, 0);
@@ -29,10 +29,19 @@ See the COPYING file for details.
 
 const int CURRENT_VERSION = 1;
 
-NPRScene::NPRScene()
+static int cdaSceneMemory()
+{
+    static const int category = GQMemory::category("CdaScene", GQMemory::CPU);
+    return category;
+}
+
+NPRScene::NPRScene() : _cda_memory(cdaSceneMemory())
 {
     _global_style = NULL;
     _cda_scene = 0;    
+    _change_stamp = 0;
+    _paths_stamp = 0;
+    _drawables_stamp = 0;
 
     clear();
 
@@ -52,9 +61,11 @@ void NPRScene::clear()
         delete _cda_scene;
     }
     _cda_scene = 0;
+    _cda_memory.set(0);
 
     while (!_drawables.isEmpty())
         delete _drawables.takeLast();
+    _drawables_stamp++;
 
     while (!_geometries.isEmpty())
         delete _geometries.takeLast();
@@ -64,6 +75,8 @@ void NPRScene::clear()
 
     _id_to_geometry_map.clear();
     _id_to_drawables_list_map.clear();
+    _sorted_path_list.clear();
+    _drawables_pvs.clear();
 
     // clear partitions
     _partition_nodes_list.clear();
@@ -79,15 +92,24 @@ void NPRScene::clear()
 
     _has_view_dependent_paths = false;
 
+    _change_stamp++;
+    _paths_stamp++;
+
     _bsphere_center = vec(0,0,0);
     _bsphere_radius = -1;
 
     _enable_vbos = false;
+    _num_vbo_geometries = 0;
 
     _model_filename = QString();
 
     _fovy = 0;
 
+    _drawable_centers.clear();
+    _drawable_radii.clear();
+    _drawable_scaled_radii.clear();
+    _drawable_bounds_stamp = 0;
+
     if (_global_style)
         delete _global_style;
 
@@ -99,6 +121,15 @@ void NPRScene::setStyle( NPRStyle* style )
 	if (_global_style)
 		delete _global_style;
 	_global_style = style;
+	_change_stamp++;
+}
+
+NPRStyle* NPRScene::swapStyle( NPRStyle* style )
+{
+    NPRStyle* old_style = _global_style;
+    _global_style = style;
+    _change_stamp++;
+    return old_style;
 }
 
 void NPRScene::setFieldOfView( float rad ) 
@@ -114,6 +145,7 @@ bool NPRScene::isDrawablePotentiallyVisible( int which ) const
 void NPRScene::computePotentiallyVisibleSet()
 {
     int visible_count = 0;
+    int culled_paths = 0;
     if (NPRSettings::instance().get(NPR_COMPUTE_PVS))
     {
         __START_TIMER("Compute PVS");
@@ -121,7 +153,9 @@ void NPRScene::computePotentiallyVisibleSet()
         _drawables_pvs.clear();
         GLint viewport[4];
         glGetIntegerv(GL_VIEWPORT, viewport);
-        float aspect_ratio = (float)(viewport[2]) / (float)(viewport[3]);
+        // The field of view covers the whole image, even when only one
+        // tile of it is being drawn.
+        float aspect_ratio = NPRGLDraw::imageAspectRatio();
         float tan_fovy_2 = tanf(_fovy/2.0f); 
         // find radius of cone that extends to corner of screen
         float to_corner = sqrt(aspect_ratio*aspect_ratio + 1);
@@ -132,27 +166,18 @@ void NPRScene::computePotentiallyVisibleSet()
 
         const vec& viewpos = cameraPosition();
         const vec& viewdir = cameraDirection();
-        vec yardstick(1,1,1);
+
+        updateDrawableBounds();
 
         for (int i = 0; i < _drawables.size(); i++)
         {
             bool size_check_passed = false;
             bool cone_check_passed = false;
 
-            const NPRDrawable* drawable = _drawables[i];
-            xform xf, xf_rot;
-            drawable->composeTransform(xf);
-            xf_rot = rot_only(xf);
-
             // Very simple and approximate bounding sphere size check.
-            vec center = xf * drawable->geometry()->bsphereCenter();
-            float radius = drawable->geometry()->bsphereRadius();
-
-            vec scaled_yardstick = xf_rot * yardstick;
-            float max_scale = max(fabsf(scaled_yardstick[0]), 
-                                  max(fabsf(scaled_yardstick[1]), 
-                                      fabsf(scaled_yardstick[2])));
-            float scaled_radius = max_scale * radius;
+            const vec& center = _drawable_centers[i];
+            float radius = _drawable_radii[i];
+            float scaled_radius = _drawable_scaled_radii[i];
             float dist = len(viewpos - center);
             float width = dist * tan_fovy_2;
             float ratio = scaled_radius / width;
@@ -160,14 +185,11 @@ void NPRScene::computePotentiallyVisibleSet()
             float approx_pix = viewport[3] * ratio;
             size_check_passed = approx_pix > 0.0f;
 
-            if (!(scaled_radius < 100000 && scaled_radius > 0))
-            {
-                qWarning("Bogus drawable bounding sphere found.");
-            }
-
             if (!size_check_passed)
             {
                 _drawables_pvs.append(false);
+                if (_drawables[i]->paths())
+                    culled_paths += _drawables[i]->paths()->size();
                 continue;
             }
 
@@ -185,6 +207,8 @@ void NPRScene::computePotentiallyVisibleSet()
             if (!cone_check_passed)
             {
                 _drawables_pvs.append(false);
+                if (_drawables[i]->paths())
+                    culled_paths += _drawables[i]->paths()->size();
                 continue;
             }
 
@@ -195,9 +219,48 @@ void NPRScene::computePotentiallyVisibleSet()
         __STOP_TIMER("Compute PVS");
 
         __SET_COUNTER("PVS Drawables", visible_count);
+        __SET_COUNTER("PVS culled paths", culled_paths);
     }
 }
 
+void NPRScene::updateDrawableBounds()
+{
+    if (_drawable_centers.size() == _drawables.size() &&
+        _drawable_bounds_stamp == _change_stamp)
+        return;
+
+    _drawable_centers.resize(_drawables.size());
+    _drawable_radii.resize(_drawables.size());
+    _drawable_scaled_radii.resize(_drawables.size());
+
+    vec yardstick(1,1,1);
+    for (int i = 0; i < _drawables.size(); i++)
+    {
+        const NPRDrawable* drawable = _drawables[i];
+        xform xf, xf_rot;
+        drawable->composeTransform(xf);
+        xf_rot = rot_only(xf);
+
+        float radius = drawable->geometry()->bsphereRadius();
+        vec scaled_yardstick = xf_rot * yardstick;
+        float max_scale = max(fabsf(scaled_yardstick[0]), 
+                              max(fabsf(scaled_yardstick[1]), 
+                                  fabsf(scaled_yardstick[2])));
+        float scaled_radius = max_scale * radius;
+
+        if (!(scaled_radius < 100000 && scaled_radius > 0))
+        {
+            qWarning("Bogus drawable bounding sphere found.");
+        }
+
+        _drawable_centers[i] = xf * drawable->geometry()->bsphereCenter();
+        _drawable_radii[i] = radius;
+        _drawable_scaled_radii[i] = scaled_radius;
+    }
+
+    _drawable_bounds_stamp = _change_stamp;
+}
+
 bool NPRScene::save( QDomDocument& doc, QDomElement& element, const QDir& path )
 {
     element.setAttribute("version", CURRENT_VERSION);
@@ -224,7 +287,8 @@ bool NPRScene::save( QDomDocument& doc, QDomElement& element, const QDir& path )
     return true;
 }
 
-bool NPRScene::load( const QDomElement& element, const QDir& path )
+bool NPRScene::load( const QDomElement& element, const QDir& path, 
+                     bool load_model )
 {
     int version = element.attribute("version").toInt();
     if (version != CURRENT_VERSION)
@@ -239,12 +303,19 @@ bool NPRScene::load( const QDomElement& element, const QDir& path )
     QString relative_filename = model.attribute("filename");
     QString abs_filename = path.absoluteFilePath(relative_filename);
 
-    bool ret = load(abs_filename);
-    if (!ret)
+    if (load_model)
     {
-        qWarning("NPRScene::load: could not load %s\n", 
-            qPrintable(abs_filename));
-        return false;
+        bool ret = load(abs_filename);
+        if (!ret)
+        {
+            qWarning("NPRScene::load: could not load %s\n", 
+                qPrintable(abs_filename));
+            return false;
+        }
+    }
+    else
+    {
+        beginLoad(abs_filename);
     }
 
     QDomElement light = element.firstChildElement("light");
@@ -286,12 +357,31 @@ bool NPRScene::load( const QDomElement& element, const QDir& path )
 }
 
 bool NPRScene::load( const QString& filename )
+{
+    beginLoad(filename);
+    if (!loadModel())
+        return false;
+
+    for (int i = 0; i < _drawables.size(); i++)
+        addPaths(i, buildPaths(i));
+    updateSortedPaths();
+
+    return true;
+}
+
+void NPRScene::beginLoad( const QString& filename )
 {
     clear();
 
-    if (CdaScene::isColladaFile(filename))
+    _model_filename = filename;
+    _global_style = new NPRStyle();
+}
+
+bool NPRScene::loadModel( NPRLoadCallback* callback )
+{
+    if (CdaScene::isColladaFile(_model_filename))
     {
-        if (!loadCollada(filename))
+        if (!loadCollada(_model_filename, callback))
             return false;
     }
     else
@@ -299,29 +389,73 @@ bool NPRScene::load( const QString& filename )
         return false;
     }
 
-    _model_filename = filename;
-    _global_style = new NPRStyle();
-
     sortDrawables();
     updateDrawableLists();
-    updateSortedPaths();
 
     return true;
 }
 
-bool NPRScene::loadCollada( const QString& filename )
+NPRFixedPathSet* NPRScene::buildPaths( int which ) const
+{
+    return new NPRFixedPathSet(_drawables[which]);
+}
+
+void NPRScene::addPaths( int which, NPRFixedPathSet* paths )
+{
+    _drawables.at(which)->setPaths(paths);
+}
+
+// Reports the phases of CdaScene::load as NPR_LOAD_PARSE progress, one 
+// step per phase with the geometries counted within theirs, and passes
+// cancellation back to the parser.
+class ParseProgress : public CdaLoadCallback
+{
+    public:
+        ParseProgress( NPRLoadCallback* callback ) : _callback(callback) { }
+
+        void phaseStarted( CdaLoadPhase ) { }
+        void phaseFinished( CdaLoadPhase ) { }
+        bool phaseProgress( CdaLoadPhase phase, int done, int total )
+        {
+            total = qMax(total, 1);
+            return _callback->loadProgress(NPR_LOAD_PARSE, phase * total + done,
+                                           CDA_NUM_LOAD_PHASES * total);
+        }
+
+    protected:
+        NPRLoadCallback* _callback;
+};
+
+bool NPRScene::loadCollada( const QString& filename, NPRLoadCallback* callback )
 {
     _cda_scene = new CdaModelScene();
+    ParseProgress parse_progress(callback);
+    if (callback)
+        _cda_scene->setLoadCallback(&parse_progress);
     bool ret = _cda_scene->load(filename);
+    _cda_scene->setLoadCallback(NULL);
 
     if (ret)
     {
-        for (int i = 0; i < _cda_scene->numLibraryGeometries(); i++)
+        if (callback && !callback->loadProgress(NPR_LOAD_PARSE, 1, 1))
+            return false;
+
+        int num_geometries = _cda_scene->numLibraryGeometries();
+        qint64 cda_bytes = 0;
+        for (int i = 0; i < num_geometries; i++)
+            cda_bytes += _cda_scene->libraryGeometry(i)->byteSize();
+        _cda_memory.set(cda_bytes);
+
+        for (int i = 0; i < num_geometries; i++)
         {
             const CdaGeometry* geom = _cda_scene->libraryGeometry(i);
             NPRGeometry* newgeom = new NPRGeometry(geom);
             _geometries.push_back(newgeom);
             _id_to_geometry_map.insert(geom->_id, newgeom);
+
+            if (callback && 
+                !callback->loadProgress(NPR_LOAD_GEOMETRY, i + 1, num_geometries))
+                return false;
         }
 
         _max_scene_depth = 0;
@@ -336,6 +470,10 @@ bool NPRScene::loadCollada( const QString& filename )
             return false;
         }
 
+        if (callback && !callback->loadProgress(NPR_LOAD_INSTANCES, 
+                                 _drawables.size(), _drawables.size()))
+            return false;
+
         CdaScene::findBoundingSphere( _cda_scene, _cda_scene->root(), 
             _bsphere_center, _bsphere_radius );
 
@@ -457,12 +595,18 @@ void NPRScene::setAnimationSpeed(float speed)
 {
     for (int i = 0; i < _anim_controllers.size(); i++)
         _anim_controllers[i]->setSpeed(speed);
+
+    if (!_anim_controllers.isEmpty())
+        _change_stamp++;
 }
 
 void NPRScene::setAnimationFrame(unsigned int frame)
 {
     for (int i = 0; i < _anim_controllers.size(); i++)
         _anim_controllers[i]->setFrame(frame);
+
+    if (!_anim_controllers.isEmpty())
+        _change_stamp++;
 }
 
 void NPRScene::selectTrees(const NodeRefList &list)
@@ -544,6 +688,8 @@ void NPRScene::updateDrawableLists()
             _partitions_translucent[partition_num] << i;
     }
 
+    _change_stamp++;
+
     //    debugPartitions();
 }
 
@@ -562,6 +708,8 @@ bool comparePaths(const NPRFixedPath* lhs, const NPRFixedPath* rhs)
 
 void NPRScene::updateSortedPaths()
 {
+    _sorted_path_list.clear();
+
     // Get all the paths currently in the scene.
     for (int m = 0; m < numDrawables(); m++)
     {
@@ -580,6 +728,9 @@ void NPRScene::updateSortedPaths()
     // Sort the paths, currently by static length,
     // which is set in the path at construction time.
     std::sort(_sorted_path_list.begin(), _sorted_path_list.end(), comparePaths);
+
+    _paths_stamp++;
+    _change_stamp++;
 }
 
 void NPRScene::recordStats( GQStats& stats )
@@ -690,7 +841,7 @@ QAbstractItemModel* NPRScene::itemModel()
 }
 
 
-void NPRScene::updateVBOs()
+bool NPRScene::updateVBOs( int max_vertices )
 {
     // It appears that it is actually faster to *not* use VBOs for 
     // small bits of geometry, at least with some cards.
@@ -698,23 +849,35 @@ void NPRScene::updateVBOs()
 
     bool enable = NPRSettings::instance().get(NPR_ENABLE_VBOS);
 
-    if (!_enable_vbos && enable)
+    if (enable)
     {
-        for (int i = 0; i < _geometries.size(); i++)
+        // Geometries without VBOs yet are drawn from client memory, so a
+        // partly copied scene draws correctly.
+        _enable_vbos = true;
+        int copied = 0;
+        while (_num_vbo_geometries < _geometries.size())
         {
-            if (_geometries[i]->data(GQ_VERTEX)->size() > MINIMUM_VERTICES)
+            if (max_vertices >= 0 && copied >= max_vertices)
+                return false;
+
+            NPRGeometry* geom = _geometries[_num_vbo_geometries];
+            int num_vertices = geom->data(GQ_VERTEX)->size();
+            if (num_vertices > MINIMUM_VERTICES)
             {
-                _geometries[i]->copyToVBO();
+                geom->copyToVBO();
+                copied += num_vertices;
             }
+            _num_vbo_geometries++;
         }
-        _enable_vbos = true;
     }
     else if (_enable_vbos && !enable)
     {
-        for (int i = 0; i < _geometries.size(); i++)
+        for (int i = 0; i < _num_vbo_geometries; i++)
         {
             _geometries[i]->deleteVBO();
         }
+        _num_vbo_geometries = 0;
         _enable_vbos = false;
     }
+    return true;
 }
@@ -16,27 +16,38 @@ See the COPYING file for details.
 #include "NPRSettings.h"
 #include "NPRDrawable.h"
 #include "NPRStyle.h"
+#include "NPRAtlasFilter.h"
 #include <assert.h>
 
 #include <QVector>
+#include <QHash>
 
 //#define USE_NV_PERF_SDK
 #ifdef USE_NV_PERF_SDK
 #include "NVPerfSDK.h"
 #endif
 
-#if 1
-#define __MY_START_TIMER __START_TIMER
-#define __MY_STOP_TIMER __STOP_TIMER
-#define __MY_TIME_CODE_BLOCK __TIME_CODE_BLOCK
-#else
-#define __MY_START_TIMER __START_TIMER_AFTER_GL_FINISH
-#define __MY_STOP_TIMER __STOP_TIMER_AFTER_GL_FINISH
-#define __MY_TIME_CODE_BLOCK __TIME_CODE_BLOCK_AFTER_GL_FINISH
-#endif
-    
 const int MAXIMUM_SAMPLES = 1 << 20;
 const int MAXIMUM_SEGMENT_LENGTH = 1 << 10;
+// Screen space pixels between atlas samples (NPR_SEGMENT_ATLAS_SAMPLE_SPACING).
+// Closer samples than this only fill the atlas sooner.
+const float MINIMUM_SAMPLE_SPACING = 1.0f;
+
+// Layout of the path transform table. Each entry is the model transform
+// followed by its inverse transpose (4 texels each). Must match
+// PATH_XFORM_TEXELS in segment_atlas_common.glsl. The table width is a
+// multiple of the entry size so that entries never straddle rows.
+const int PATH_XFORM_TEXELS = 8;
+const int PATH_XFORM_TABLE_WIDTH = 1024;
+// The path buffers are square, with a side rounded up to a multiple of 
+// this.
+const int PATH_BUFFER_WIDTH_STEP = 32;
+
+// Lines emitted by segment_atlas.geom for each segment that has samples.
+const int ATLAS_LINES_PER_SEGMENT = 3;
+// Clip queries waiting for their results. Past this the oldest is dropped
+// rather than waited for.
+const int MAX_PENDING_CLIP_QUERIES = 8;
 
 static int DUMP_IMAGES = 0;
 
@@ -63,10 +74,32 @@ inline void copyToBuffer(QVector<uint8>& buffer, int offset, uint8 a, uint8 b, u
     buffer[offset + 2] = c;
 }
 
+inline void copyToBuffer(float* buffer, int offset, const xform& xf)
+{
+    for (int i = 0; i < 16; i++)
+        buffer[offset + i] = xf[i];
+}
+
+inline bool xformDiffers(const float* buffer, int offset, const xform& xf)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        if (buffer[offset + i] != (float)(xf[i]))
+            return true;
+    }
+    return false;
+}
+
 
 
 NPRSegmentAtlas::NPRSegmentAtlas()
 {
+    _path_data_stamp = 0;
+    _scene_paths_stamp = 0;
+    _scene_drawables_stamp = 0;
+    _use_cpu_filters = false;
+    _in_views = false;
+    _clip_queries_supported = -1;
     clear();
 
 #ifdef USE_NV_PERF_SDK
@@ -90,15 +123,36 @@ void NPRSegmentAtlas::clear()
     _sum_fbo.clear();
     _atlas_fbo.clear();
     _path_verts_fbo.clear();
+    _path_blocks.clear();
+    _path_layout_dirty = true;
+    _path_xform_fbo.clear();
     _clip_viz_fbo.clear();
 
+    _path_xform_img.clear();
+    _path_xform_drawables.clear();
+    _animated_xform_indices.clear();
+    _path_xforms_dirty = true;
+    _path_data_stamp++;
+
     _clip_viz_vbo.clear();
     _atlas_source_vbo.clear();
 
     _quad_vertices_vbo.clear();
 
+    for (int i = 0; i < _pending_clip_queries.size(); i++)
+        _free_clip_queries.append(_pending_clip_queries[i].query);
+    _pending_clip_queries.clear();
+    if (!_free_clip_queries.isEmpty())
+    {
+        glDeleteQueries(_free_clip_queries.size(), _free_clip_queries.data());
+        _free_clip_queries.clear();
+    }
+    _clipped_segments = -1;
+
     _sample_step = 2.0f;
     _total_segments = 0;
+    _total_profile_segments = 0;
+    _total_non_profile_segments = 0;
     _total_samples = 0;
 
     _dump_next_frame = false;
@@ -138,6 +192,29 @@ int NPRSegmentAtlas::maxSegments()
         return 0;
 }
 
+// Clears rows [first_row, end_row) of the bound draw buffer.
+static void clearRowsHelper(int width, int first_row, int end_row)
+{
+    if (end_row <= first_row)
+        return;
+
+    glPushAttrib(GL_SCISSOR_BIT | GL_COLOR_BUFFER_BIT);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, first_row, width, end_row - first_row);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glPopAttrib();
+}
+
+// The arc length start of each segment is only needed when drawing a tile
+// of a larger image (see NPRGLDraw::setImageRegion), so its attachment is
+// only allocated then.
+static int numClipBuffers()
+{
+    return NPRGLDraw::hasImageRegion() ? NPRSegmentAtlas::NUM_CLIP_BUFFERS 
+                                       : NPRSegmentAtlas::ARC_LENGTH_START_ID;
+}
+
 static bool initFBOHelper(QString name, GQFramebufferObject* fbo, 
                           int num_buffers, int width, int height, 
                           int format = GQ_FORMAT_RGBA_FLOAT)
@@ -161,6 +238,7 @@ bool NPRSegmentAtlas::init( const NPRScene& scene )
     int width = GQFramebufferObject::maxFramebufferSize();
     int height = ceil((float)MAXIMUM_SAMPLES / (float)width);
     _atlas_wrap_width = width - MAXIMUM_SEGMENT_LENGTH;
+    _scene_paths_stamp = scene.pathsStamp();
 
     bool success = makePathVertexFBO(scene);
     if (!success)
@@ -168,20 +246,42 @@ bool NPRSegmentAtlas::init( const NPRScene& scene )
 
     makeSegmentAtlasVBO();
 
-    initFBOHelper("clip_fbo", &_clip_fbo, 3, 
+    initFBOHelper("clip_fbo", &_clip_fbo, numClipBuffers(), 
                   _path_verts_fbo.width(), _path_verts_fbo.height());
     initFBOHelper("clip_length_sum_fbo", &_sum_fbo, 2, 
                   _path_verts_fbo.width(), _path_verts_fbo.height());
     initFBOHelper("segment_atlas", &_atlas_fbo, NUM_ATLAS_BUFFERS, 
                   width, height, GQ_FORMAT_RGBA_BYTE);
+    initFBOHelper("smoothed_segment_atlas", &_filtered_atlas_fbo, 
+                  NUM_ATLAS_BUFFERS, width, height);
+
+    // The contents of new buffers are undefined, so the first clear 
+    // covers every row.
+    for (int i = 0; i < NUM_ATLAS_BUFFERS; i++)
+    {
+        _atlas_written_rows[i] = height;
+        _filtered_written_rows[i] = height;
+    }
 
     _is_initialized = true;
     return true;
 }
 
-void NPRSegmentAtlas::draw( const NPRScene& scene, const GQTexture2D& depth_buffer )
+// Draws the clip buffer, the segment length sums, and the visibility atlas.
+// If a depth pyramid is given, segments and samples that it shows are 
+// trivially visible or hidden skip the supersampled depth test.
+// If a frame cache is given, each of these stages is skipped when its inputs
+// are unchanged since the last frame.
+void NPRSegmentAtlas::draw( const NPRScene& scene, const GQTexture2D& depth_buffer,
+                            const NPRDepthPyramid* depth_pyramid,
+                            NPRFrameCache* cache )
 {
-    __MY_TIME_CODE_BLOCK("Sample Buffer Draw");
+    __GPU_TIME_CODE_BLOCK("Sample Buffer Draw");
+
+    // The clip and sum buffers are sized for the paths, so paths added
+    // since (while the scene loads) need a new set.
+    if (scene.pathsStamp() != _scene_paths_stamp)
+        _is_initialized = false;
 
     if (!_is_initialized)
     {
@@ -190,19 +290,69 @@ void NPRSegmentAtlas::draw( const NPRScene& scene, const GQTexture2D& depth_buff
     }
 
     if (_dump_next_frame)
+    {
         DUMP_IMAGES = 1;
+        if (cache)
+            cache->clear();
+    }
 
     NPRSettings& settings = NPRSettings::instance();
-    setDrawProfiles(settings.get(NPR_EXTRACT_PROFILES));
-
-    if (scene.hasViewDependentPaths() || _path_data_dirty)
+    _sample_step = qMax(settings.get(NPR_SEGMENT_ATLAS_SAMPLE_SPACING), 
+                        MINIMUM_SAMPLE_SPACING);
+    if (!_in_views)
+    {
+        setDrawProfiles(settings.get(NPR_EXTRACT_PROFILES));
+        if (scene.hasViewDependentPaths() || _path_data_dirty)
+            refreshPathData(scene);
+        updatePathTransforms();
+    }
+    else if (scene.hasViewDependentPaths())
     {
+        // Refreshing the paths rebuilds the transform table.
         refreshPathData(scene);
+        updatePathTransforms();
     }
 
-    drawClipBuffer( scene );
-    sumSegmentLengths();
-    drawSegmentAtlas(VISIBILITY_ID, depth_buffer);
+    bool update_clip = true;
+    bool update_scan = true;
+    bool update_atlas = true;
+
+    if (cache)
+    {
+        NPRStageKey clip_key;
+        clip_key.add(_path_data_stamp);
+        clip_key.add(_sample_step);
+        clip_key.add(&(scene.cameraPosition()[0]), 3);
+        clip_key.add(&(scene.cameraDirection()[0]), 3);
+        clip_key.add(NPRGLDraw::hasImageRegion());
+        clip_key.addGLViewParams();
+        update_clip = cache->needsUpdate(NPRFrameCache::CLIP_STAGE, clip_key);
+
+        NPRStageKey scan_key;
+        scan_key.add(cache->generation(NPRFrameCache::CLIP_STAGE));
+        update_scan = cache->needsUpdate(NPRFrameCache::SCAN_STAGE, scan_key);
+
+        NPRStageKey atlas_key;
+        atlas_key.add(cache->generation(NPRFrameCache::SCAN_STAGE));
+        atlas_key.add(cache->generation(NPRFrameCache::DEPTH_STAGE));
+        atlas_key.add((const void*)&depth_buffer);
+        atlas_key.add((const void*)depth_pyramid);
+        atlas_key.add(settings.get(NPR_LINE_VISIBILITY_SUPERSAMPLE));
+        atlas_key.add(settings.get(NPR_SEGMENT_ATLAS_DEPTH_SCALE));
+        atlas_key.add(settings.get(NPR_SEGMENT_ATLAS_KERNEL_SCALE_X));
+        atlas_key.add(settings.get(NPR_SEGMENT_ATLAS_KERNEL_SCALE_Y));
+        atlas_key.addGLViewParams();
+        update_atlas = cache->needsUpdate(NPRFrameCache::ATLAS_STAGE, atlas_key);
+    }
+
+    if (update_clip)
+        drawClipBuffer( scene );
+    if (update_scan)
+        sumSegmentLengths();
+    if (update_atlas)
+        drawSegmentAtlas(VISIBILITY_ID, depth_buffer, depth_pyramid);
+
+    recordCounters();
 
     if (_dump_next_frame)
     {
@@ -211,14 +361,119 @@ void NPRSegmentAtlas::draw( const NPRScene& scene, const GQTexture2D& depth_buff
     }
 }
 
+// Sets the line counters in GQStats. Called every frame, so the counters
+// keep their values on frames where the cached buffers are reused.
+void NPRSegmentAtlas::recordCounters()
+{
+    readClipQueries();
+
+    __SET_COUNTER("line segments", _total_segments);
+    __SET_COUNTER("profile segments", 
+                  _draw_profiles ? _total_profile_segments : 0);
+    __SET_COUNTER("non-profile segments", _total_non_profile_segments);
+    if (_clipped_segments >= 0)
+        __SET_COUNTER("clipped segments", _clipped_segments);
+
+    __SET_COUNTER("total samples", _total_samples);
+
+    int num_rows = occupiedAtlasRows();
+    __SET_COUNTER("atlas rows", num_rows);
+    if (_atlas_fbo.height() > 0)
+        __SET_COUNTER("atlas occupancy (%)", 
+                      100.0f * num_rows / _atlas_fbo.height());
+}
+
+// Starts counting the lines written by the visibility atlas draw. Returns
+// false if primitive queries are not supported.
+bool NPRSegmentAtlas::beginClipQuery()
+{
+    if (_clip_queries_supported < 0)
+    {
+        _clip_queries_supported = (GLEE_VERSION_3_0 || 
+                                   GLEE_EXT_transform_feedback ||
+                                   GLEE_NV_transform_feedback) ? 1 : 0;
+    }
+    if (!_clip_queries_supported)
+        return false;
+
+    if (_free_clip_queries.isEmpty())
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        _free_clip_queries.append(query);
+    }
+
+    ClipQuery clip_query;
+    clip_query.query = _free_clip_queries.last();
+    clip_query.segments = _total_segments;
+    _free_clip_queries.removeLast();
+    _pending_clip_queries.append(clip_query);
+
+    glBeginQuery(GL_PRIMITIVES_GENERATED, clip_query.query);
+    return true;
+}
+
+void NPRSegmentAtlas::endClipQuery()
+{
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+}
+
+// Reads back the clip queries that have finished, without waiting for 
+// the others. Segments rejected by the clip buffer emit no lines.
+void NPRSegmentAtlas::readClipQueries()
+{
+    while (!_pending_clip_queries.isEmpty())
+    {
+        const ClipQuery& clip_query = _pending_clip_queries.first();
+
+        GLint available = 0;
+        glGetQueryObjectiv(clip_query.query, GL_QUERY_RESULT_AVAILABLE, 
+                           &available);
+        if (available)
+        {
+            GLuint lines = 0;
+            glGetQueryObjectuiv(clip_query.query, GL_QUERY_RESULT, &lines);
+            int drawn_segments = lines / ATLAS_LINES_PER_SEGMENT;
+            _clipped_segments = qMax(clip_query.segments - drawn_segments, 0);
+        }
+        else if (_pending_clip_queries.size() <= MAX_PENDING_CLIP_QUERIES)
+        {
+            break;
+        }
+
+        _free_clip_queries.append(clip_query.query);
+        _pending_clip_queries.removeFirst();
+    }
+}
+
+
+bool NPRSegmentAtlas::beginViews( const NPRScene& scene )
+{
+    if (scene.pathsStamp() != _scene_paths_stamp)
+        _is_initialized = false;
+
+    if (!_is_initialized)
+    {
+        if (!init(scene))
+            return false;
+    }
+
+    setDrawProfiles(NPRSettings::instance().get(NPR_EXTRACT_PROFILES));
+    if (_path_data_dirty && !scene.hasViewDependentPaths())
+        refreshPathData(scene);
+    updatePathTransforms();
+
+    _in_views = true;
+    return true;
+}
 
 void NPRSegmentAtlas::visualize( const NPRScene& scene, const GQTexture2D& depth_buffer )
 {
     draw(scene, depth_buffer);
 
-    __MY_START_TIMER("viz clipped lines");
+    __GPU_START_TIMER("viz clipped lines");
     visualizeClippedLines();
-    __MY_STOP_TIMER("viz clipped lines");
+    __GPU_STOP_TIMER("viz clipped lines");
 }
 
         
@@ -235,11 +490,15 @@ void NPRSegmentAtlas::filter(AtlasBufferId which, AtlasFilterType type, const NP
 {
     Q_UNUSED(style);
 
-    __MY_TIME_CODE_BLOCK("smooth atlas");
+    __ADD_TO_COUNTER("atlas filter passes", 1);
 
-    initFBOHelper("smoothed_segment_atlas", &_filtered_atlas_fbo, 
-        NUM_ATLAS_BUFFERS, _atlas_fbo.width(), _atlas_fbo.height(),
-        GL_RGBA);
+    if (_use_cpu_filters)
+    {
+        filterCPU(which, type);
+        return;
+    }
+
+    __GPU_TIME_CODE_BLOCK("smooth atlas");
 
     GQShaderRef shader;
     switch (type)
@@ -260,29 +519,79 @@ void NPRSegmentAtlas::filter(AtlasBufferId which, AtlasFilterType type, const NP
     shader.bindNamedTexture("source_buffer", 
                             _atlas_fbo.colorTexture(which));
 
+    // The quad covers whole rows, so only rows left over from a busier
+    // frame need to be cleared.
+    int num_rows = occupiedAtlasRows();
+
     _filtered_atlas_fbo.bind();
     _filtered_atlas_fbo.drawBuffer(which);
 
-    glViewport(0,0,_filtered_atlas_fbo.width(),
-               _filtered_atlas_fbo.height());
-
-    glClearColor(0.0,0.0,0.0,0.0);
-    glClear(GL_COLOR_BUFFER_BIT);
+    clearRowsHelper(_filtered_atlas_fbo.width(), num_rows, 
+                    _filtered_written_rows[which]);
+    _filtered_written_rows[which] = num_rows;
     glDisable(GL_DEPTH_TEST);
 
-    NPRGLDraw::drawFullScreenQuad( _filtered_atlas_fbo.glTarget() );
+    if (num_rows > 0)
+    {
+        glViewport(0,0,_filtered_atlas_fbo.width(), num_rows);
+        NPRGLDraw::drawFullScreenQuad( _filtered_atlas_fbo.glTarget() );
+    }
+
+    _filtered_atlas_fbo.unbind();
+
+    _is_smoothed_atlas_current[which] = true;
+}
+
+// CPU version of filter(). Only the rows of the atlas that hold samples
+// are read back, filtered, and uploaded.
+void NPRSegmentAtlas::filterCPU(AtlasBufferId which, AtlasFilterType type)
+{
+    __TIME_CODE_BLOCK("smooth atlas (cpu)");
+
+    int num_rows = occupiedAtlasRows();
 
+    _filtered_atlas_fbo.bind();
+    _filtered_atlas_fbo.drawBuffer(which);
+    clearRowsHelper(_filtered_atlas_fbo.width(), num_rows, 
+                    _filtered_written_rows[which]);
+    _filtered_written_rows[which] = num_rows;
     _filtered_atlas_fbo.unbind();
 
+    if (num_rows > 0)
+    {
+        _atlas_fbo.bind();
+        _atlas_fbo.readSubColorTexturei(which, 0, 0, _atlas_fbo.width(), 
+                                        num_rows, _cpu_atlas_img);
+        _atlas_fbo.unbind();
+
+        NPRAtlasFilter::filter(type, _cpu_atlas_img, num_rows, 
+                               _cpu_filtered_img);
+
+        _filtered_atlas_fbo.loadSubColorTexturef(which, 0, 0, 
+            _filtered_atlas_fbo.width(), num_rows, _cpu_filtered_img);
+    }
+
     _is_smoothed_atlas_current[which] = true;
 }
 
+// Number of atlas rows that hold samples, including the gutter of the 
+// last row.
+int NPRSegmentAtlas::occupiedAtlasRows() const
+{
+    if (_total_samples <= 0 || _atlas_wrap_width <= 0)
+        return 0;
+
+    int num_rows = (_total_samples + _atlas_wrap_width - 1) / _atlas_wrap_width;
+    return qMin(num_rows, _atlas_fbo.height());
+}
+
 void NPRSegmentAtlas::setDrawProfiles( bool draw )
 {
     if (draw != _draw_profiles)
     {
         _draw_profiles = draw;
         _path_data_dirty = true;
+        _path_layout_dirty = true;
     }
 }
 
@@ -294,12 +603,18 @@ void NPRSegmentAtlas::refreshPathData( const NPRScene& scene )
 
 void NPRSegmentAtlas::drawClipBuffer( const NPRScene& scene )
 {
-    __MY_TIME_CODE_BLOCK("draw clip buf");
+    __GPU_TIME_CODE_BLOCK("draw clip buf");
 
     NPRGLDraw::handleGLError();
     NPRGLDraw::clearGLState();
     NPRGLDraw::clearGLScreen(vec(0,0,0), 1.0);
 
+    if (_clip_fbo.numColorAttachments() != numClipBuffers())
+    {
+        initFBOHelper("clip_fbo", &_clip_fbo, numClipBuffers(), 
+                      _path_verts_fbo.width(), _path_verts_fbo.height());
+    }
+
     GQShaderRef shader = GQShaderManager::bindProgram("clip_buffer");
 
     NPRGLDraw::setUniformViewParams(shader);
@@ -308,6 +623,20 @@ void NPRSegmentAtlas::drawClipBuffer( const NPRScene& scene )
     shader.setUniform1f("sample_step", _sample_step );
     shader.setUniform1f("buffer_width", _clip_fbo.width());
 
+    // When drawing one tile of a larger image, measure arc lengths against
+    // the clip region of the whole image (+/-1.1 in its NDC).
+    shader.setUniform1i("use_arc_length_region", NPRGLDraw::hasImageRegion());
+    if (NPRGLDraw::hasImageRegion())
+    {
+        float transform[4];
+        NPRGLDraw::imageNDCTransform(transform);
+        shader.setUniform4f("arc_length_region", 
+                            (-1.1f - transform[2]) / transform[0],
+                            (-1.1f - transform[3]) / transform[1],
+                            (1.1f - transform[2]) / transform[0],
+                            (1.1f - transform[3]) / transform[1]);
+    }
+
     NPRGLDraw::handleGLError();
 
     shader.bindNamedTexture("vert0_tex", 
@@ -320,7 +649,10 @@ void NPRSegmentAtlas::drawClipBuffer( const NPRScene& scene )
         _path_verts_fbo.colorTexture(FACE_NORMAL_1_ID));
     shader.bindNamedTexture("path_start_end_ptrs", 
         _path_verts_fbo.colorTexture(PATH_START_END_ID)); 
-    
+    shader.bindNamedTexture("path_xform_tex", 
+        _path_xform_fbo.colorTexture(0));
+    shader.setUniform1f("path_xform_width", _path_xform_fbo.width());
+
     _clip_fbo.bind();
     _clip_fbo.drawToAllBuffers();
 
@@ -422,7 +754,7 @@ void NPRSegmentAtlas::visualizeClippedLines()
 
 void NPRSegmentAtlas::sumSegmentLengths()
 {
-    __MY_TIME_CODE_BLOCK("sum lengths");
+    __GPU_TIME_CODE_BLOCK("sum lengths");
     
     NPRGLDraw::handleGLError();
 
@@ -485,8 +817,6 @@ void NPRSegmentAtlas::sumSegmentLengths()
     assert(floor(returned_value) == returned_value);
     _total_samples = returned_value;
 
-    __SET_COUNTER("total samples", _total_samples);
-
     // Print a warning if we don't have enough room in the atlas.
     if (_total_samples + 1 >= MAXIMUM_SAMPLES)
     {
@@ -496,9 +826,10 @@ void NPRSegmentAtlas::sumSegmentLengths()
 }
 
 void NPRSegmentAtlas::drawSegmentAtlas(AtlasBufferId target, 
-                                       const GQTexture2D& reference_texture)
+                                       const GQTexture2D& reference_texture,
+                                       const NPRDepthPyramid* depth_pyramid)
 {
-    __MY_TIME_CODE_BLOCK("draw segment atlas");
+    __GPU_TIME_CODE_BLOCK("draw segment atlas");
     
     NPRGLDraw::handleGLError();
 
@@ -511,7 +842,8 @@ void NPRSegmentAtlas::drawSegmentAtlas(AtlasBufferId target,
     {
         case VISIBILITY_ID : 
             shader = GQShaderManager::bindProgram("segment_atlas"); 
-            NPRGLDraw::setUniformSSParams(shader, reference_texture);
+            NPRGLDraw::setUniformSSParams(shader, reference_texture, 
+                                          depth_pyramid);
             break;
         case PRIORITY_ID : 
             shader = GQShaderManager::bindProgram("segment_atlas_priority"); 
@@ -547,8 +879,14 @@ void NPRSegmentAtlas::drawSegmentAtlas(AtlasBufferId target,
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
     glLoadIdentity();
-    glClearColor(0.0, 0.0, 0.0, 0.0);
-    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Segments don't fill the gutter at the end of each row, so the 
+    // occupied rows are cleared along with any rows left from earlier frames.
+    int num_rows = occupiedAtlasRows();
+    clearRowsHelper(sample_buf_width, 0, 
+                    qMax(num_rows, _atlas_written_rows[target]));
+    _atlas_written_rows[target] = num_rows;
+
     glDisable(GL_DEPTH_TEST);
 
     glLineWidth(1.0f);
@@ -556,12 +894,15 @@ void NPRSegmentAtlas::drawSegmentAtlas(AtlasBufferId target,
 
     _atlas_source_vbo.bind(shader);
 
-    __MY_START_TIMER("draw sample row lines");
+    __GPU_START_TIMER("draw sample row lines");
 
     glMatrixMode(GL_PROJECTION);
+    bool count_clipped = target == VISIBILITY_ID && beginClipQuery();
     glDrawArrays(GL_POINTS, 0, _total_segments);
+    if (count_clipped)
+        endClipQuery();
 
-    __MY_STOP_TIMER("draw sample row lines");
+    __GPU_STOP_TIMER("draw sample row lines");
 
     _atlas_source_vbo.unbind();
 
@@ -589,35 +930,89 @@ void NPRSegmentAtlas::drawSegmentAtlas(AtlasBufferId target,
 
 // Creates the textures representing the 3D positions of the line vertices.
 // These positions will be projected and clipped using a fragment program.
+//
+// The segments of each drawable's paths occupy one block of the buffers,
+// in drawable order. While the scene loads, paths are added to drawables
+// in that order, so a refresh only lays out, fills and uploads the blocks
+// of drawables that gained paths since the last one. Everything is laid
+// out again when the scene is cleared, a drawable's paths are replaced,
+// profiles are toggled, the paths are view dependent, or the buffers
+// have to grow.
 bool NPRSegmentAtlas::makePathVertexFBO( const NPRScene& scene )
 {
     __TIME_CODE_BLOCK("Make Path Vertex FBO");
 
-    const QList<const NPRFixedPath*>& path_list = scene.sortedPaths();
+    bool relayout = _path_layout_dirty || scene.hasViewDependentPaths() ||
+                    scene.drawablesStamp() != _scene_drawables_stamp;
+    _scene_drawables_stamp = scene.drawablesStamp();
 
-    // Count the number of paths we need to include.
-    int total_profile_segments = 0;
-    int total_non_profile_segments = 0;
-    for (int i = 0; i < path_list.size(); i++)
+    QVector<const NPRDrawable*> drawables;
+    for (int m = 0; m < scene.numDrawables(); m++)
     {
-        int num_segments = path_list.at(i)->size() - 1;
-        if (path_list.at(i)->attributes().type == NPR_PROFILE)
-            total_profile_segments += num_segments;
-        else
-            total_non_profile_segments += num_segments;
+        const NPRFixedPathSet* path_set = scene.drawable(m)->paths();
+        if (path_set && path_set->size() > 0)
+            drawables.push_back(scene.drawable(m));
     }
 
-    _total_segments = total_non_profile_segments;
-    if (_draw_profiles)
-        _total_segments += total_profile_segments;
+    for (int i = 0; i < _path_blocks.size() && !relayout; i++)
+    {
+        const PathBlock& block = _path_blocks[i];
+        relayout = i >= drawables.size() || drawables[i] != block.drawable ||
+                   drawables[i]->paths() != block.path_set ||
+                   block.path_set->size() != block.num_paths;
+    }
+
+    if (relayout)
+    {
+        _path_blocks.clear();
+        _total_profile_segments = 0;
+        _total_non_profile_segments = 0;
+    }
+
+    // Lay out the new blocks.
+    int first_new_block = _path_blocks.size();
+    int segment_counter = 0;
+    if (!_path_blocks.isEmpty())
+        segment_counter = _path_blocks.last().first_segment + _path_blocks.last().num_segments;
+    for (int i = first_new_block; i < drawables.size(); i++)
+    {
+        PathBlock block;
+        block.drawable = drawables[i];
+        block.path_set = drawables[i]->paths();
+        block.num_paths = block.path_set->size();
+        block.first_segment = segment_counter;
+        block.num_segments = 0;
+        for (int j = 0; j < block.num_paths; j++)
+        {
+            const NPRFixedPath* path = (*block.path_set)[j];
+            int num_segments = path->size() - 1;
+            if (path->attributes().type == NPR_PROFILE)
+            {
+                _total_profile_segments += num_segments;
+                if (!_draw_profiles)
+                    continue;
+            }
+            else
+            {
+                _total_non_profile_segments += num_segments;
+            }
+            block.num_segments += num_segments;
+        }
+        segment_counter += block.num_segments;
+        _path_blocks.push_back(block);
+    }
+
+    _total_segments = segment_counter;
 
     // Set up the FBO to handle that number of paths. Return false if we can't
     // handle it due to texture size restrictions.
     //
     // Set up the buffer to be the smallest square texture that will fit the
-    // data.
-    float sqrt_total_segments = ceil(sqrt((float)_total_segments));
-    int clip_buf_width = sqrt_total_segments;
+    // data, rounded up so that the size (and with it the place of every 
+    // segment) stays the same while paths arrive.
+    int clip_buf_width = ceil(sqrt((float)_total_segments));
+    clip_buf_width = (clip_buf_width + PATH_BUFFER_WIDTH_STEP - 1) / 
+                     PATH_BUFFER_WIDTH_STEP * PATH_BUFFER_WIDTH_STEP;
     int clip_buf_height = clip_buf_width;
 
     if (clip_buf_height > clip_buf_width)
@@ -626,26 +1021,73 @@ bool NPRSegmentAtlas::makePathVertexFBO( const NPRScene& scene )
             _total_segments, clip_buf_width*clip_buf_width);
         return false;
     }
-    int max_segments = clip_buf_width*clip_buf_height;
 
+    if (_path_verts_fbo.width() != clip_buf_width || 
+        _path_verts_fbo.height() != clip_buf_height)
+    {
+        first_new_block = 0;
+    }
     _path_verts_fbo.init(clip_buf_width, clip_buf_height, NUM_PATH_BUFFERS);
 
     NPRGLDraw::handleGLError(__FILE__, __LINE__);
 
+    if (first_new_block < _path_blocks.size() || first_new_block == 0)
+        fillPathBuffers(first_new_block);
+    _path_verts_fbo.setTextureFilter(GL_NEAREST, GL_NEAREST);
+    _path_verts_fbo.setTextureWrap(GL_CLAMP, GL_CLAMP);
+
+    // The blocks are in the order of the transform table entries.
+    QVector<const NPRDrawable*> xform_drawables;
+    for (int i = 0; i < _path_blocks.size(); i++)
+        xform_drawables.push_back(_path_blocks[i].drawable);
+    makePathTransformTable(xform_drawables);
+    _path_data_stamp++;
+
+    _path_data_dirty = false;
+    _path_layout_dirty = false;
+
+    return true;
+}
+
+// Fills the path buffers with the blocks from first_block on, and uploads
+// the rows they cover. Earlier blocks that share the first of those rows
+// are filled again, so that whole rows can be sent. Filling from the first
+// block covers every row, clearing what an earlier layout left beyond the
+// last segment.
+void NPRSegmentAtlas::fillPathBuffers( int first_block )
+{
+    int width = _path_verts_fbo.width();
+    int first_row = 0;
+    int end_row = _path_verts_fbo.height();
+    if (first_block > 0)
+    {
+        first_row = _path_blocks[first_block].first_segment / width;
+        end_row = (_total_segments + width - 1) / width;
+    }
+    if (width <= 0 || end_row <= first_row)
+        return;
+
+    int first_segment = first_row * width;
+    while (first_block > 0 && 
+           _path_blocks[first_block-1].first_segment + 
+           _path_blocks[first_block-1].num_segments > first_segment)
+        first_block--;
+
+    int num_rows = end_row - first_row;
     GQFloatImage vertex_0_img, vertex_1_img, 
                  face_normal_0_img, face_normal_1_img, 
                  path_start_end_img;
-    vertex_0_img.resize(clip_buf_width, clip_buf_height, 4);
-    vertex_1_img.resize(clip_buf_width, clip_buf_height, 4);
-    face_normal_0_img.resize(clip_buf_width, clip_buf_height, 4);
-    face_normal_1_img.resize(clip_buf_width, clip_buf_height, 4);
-    path_start_end_img.resize(clip_buf_width, clip_buf_height, 4);
+    vertex_0_img.resize(width, num_rows, 4);
+    vertex_1_img.resize(width, num_rows, 4);
+    face_normal_0_img.resize(width, num_rows, 4);
+    face_normal_1_img.resize(width, num_rows, 4);
+    path_start_end_img.resize(width, num_rows, 4);
     float* vertex_0_buf = vertex_0_img.raster();
     float* vertex_1_buf = vertex_1_img.raster();
     float* face_normal_0_buf = face_normal_0_img.raster();
     float* face_normal_1_buf = face_normal_1_img.raster();
     float* path_start_end_buf = path_start_end_img.raster();
-    for (int i = 0; i < max_segments*4; i++)
+    for (int i = 0; i < width*num_rows*4; i++)
     {
         vertex_0_buf[i] = 0.0f;
         vertex_1_buf[i] = 0.0f;
@@ -654,74 +1096,149 @@ bool NPRSegmentAtlas::makePathVertexFBO( const NPRScene& scene )
         path_start_end_buf[i] = 0.0f;
     }
 
-    // Load the paths into the images. 
-    int segment_counter = 0;
-    for (int m = 0; m < path_list.size(); m++)
+    // Load the paths into the images. The vertices and normals stay in
+    // model space; the clip buffer shader applies the drawable transform
+    // from the transform table, so moving a drawable does not require 
+    // rebuilding these images.
+    for (int b = first_block; b < _path_blocks.size(); b++)
     {
-        const NPRFixedPath* path = path_list.at(m);
-
-        xform model_xform, model_inverse_transpose;
-        path->drawable()->composeTransform(model_xform);
-        path->drawable()->composeTransformInverseTranspose(model_inverse_transpose);
-
-        int nverts = path->size();
+        const PathBlock& block = _path_blocks[b];
+        float xform_index = b;
+        int segment_counter = block.first_segment;
 
-        if (path->attributes().type == NPR_PROFILE && _draw_profiles == false)
-            continue;
+        for (int m = 0; m < block.num_paths; m++)
+        {
+            const NPRFixedPath* path = (*block.path_set)[m];
 
-        int path_start = segment_counter;
-        int path_end = segment_counter + nverts - 2;
-        vec3 path_start_end_vec = vec3(path_start, path_end, 0);
+            int nverts = path->size();
 
-        for (int j = 0; j < nverts-1; j++)
-        {
-            int offset = segment_counter*4;
-            vec3 v0 = model_xform * path->vert(j);
-            vec3 v1 = model_xform * path->vert(j+1);
+            if (path->attributes().type == NPR_PROFILE && _draw_profiles == false)
+                continue;
 
-            float v1_w = 0.0f;
+            int path_start = segment_counter;
+            int path_end = segment_counter + nverts - 2;
+            vec3 path_start_end_vec = vec3(path_start, path_end, 0);
 
-            if (path->attributes().type == NPR_PROFILE)
+            for (int j = 0; j < nverts-1; j++, segment_counter++)
             {
-                v1_w = 1.0f;
+                if (segment_counter < first_segment)
+                    continue;
 
-                assert(nverts == 2);
-                vec3 n0 = model_inverse_transpose * path->normal(j);
-                vec3 n1 = model_inverse_transpose * path->normal(j+1);
+                int offset = (segment_counter - first_segment)*4;
+                const vec3& v0 = path->vert(j);
+                const vec3& v1 = path->vert(j+1);
 
-                // Hack: some (sketchup) models seem to have flipped normals.
-                // We therefore make sure that the two normals align with each
-                // other by checking the dot product. This will cause profiles
-                // along edges with angles > 90 to fail, but those edges are
-                // usually creases anyway.
+                float v1_w = 0.0f;
 
-                if ((n0 DOT n1) < 0)
-                    n0 *= -1.0f;
+                if (path->attributes().type == NPR_PROFILE)
+                {
+                    v1_w = 1.0f;
 
-                copyToBuffer(face_normal_0_buf, offset, n0, 0.0f);
-                copyToBuffer(face_normal_1_buf, offset, n1, 0.0f);
+                    // The flipped normal check happens in the shader, after
+                    // the normals are transformed.
+                    assert(nverts == 2);
+                    copyToBuffer(face_normal_0_buf, offset, path->normal(j), 0.0f);
+                    copyToBuffer(face_normal_1_buf, offset, path->normal(j+1), 0.0f);
+                }
+
+                copyToBuffer(vertex_0_buf, offset, v0, 1.0f);
+                copyToBuffer(vertex_1_buf, offset, v1, v1_w);
+                copyToBuffer(path_start_end_buf, offset, path_start_end_vec, xform_index);
             }
+        }
+    }
 
-            copyToBuffer(vertex_0_buf, offset, v0, 1.0f);
-            copyToBuffer(vertex_1_buf, offset, v1, v1_w);
-            copyToBuffer(path_start_end_buf, offset, path_start_end_vec, 0.0f);
+    _path_verts_fbo.loadSubColorTexturef(PATH_VERTEX_0_ID, 0, first_row, width, num_rows, vertex_0_img);
+    _path_verts_fbo.loadSubColorTexturef(PATH_VERTEX_1_ID, 0, first_row, width, num_rows, vertex_1_img);
+    _path_verts_fbo.loadSubColorTexturef(FACE_NORMAL_0_ID, 0, first_row, width, num_rows, face_normal_0_img);
+    _path_verts_fbo.loadSubColorTexturef(FACE_NORMAL_1_ID, 0, first_row, width, num_rows, face_normal_1_img);
+    _path_verts_fbo.loadSubColorTexturef(PATH_START_END_ID, 0, first_row, width, num_rows, path_start_end_img);
+}
 
-            segment_counter++;
-        }
+// Allocates the table of per-drawable transforms referenced by the path
+// vertex buffers. The table is filled by updatePathTransforms.
+void NPRSegmentAtlas::makePathTransformTable( const QVector<const NPRDrawable*>& drawables )
+{
+    _path_xform_drawables = drawables;
+    _animated_xform_indices.clear();
+    for (int i = 0; i < drawables.size(); i++)
+    {
+        if (drawables[i]->isAnimated())
+            _animated_xform_indices.push_back(i);
     }
 
-    _path_verts_fbo.loadColorTexturef(PATH_VERTEX_0_ID, vertex_0_img );
-    _path_verts_fbo.loadColorTexturef(PATH_VERTEX_1_ID, vertex_1_img );
-    _path_verts_fbo.loadColorTexturef(FACE_NORMAL_0_ID, face_normal_0_img );
-    _path_verts_fbo.loadColorTexturef(FACE_NORMAL_1_ID, face_normal_1_img );
-    _path_verts_fbo.loadColorTexturef(PATH_START_END_ID, path_start_end_img );
-    _path_verts_fbo.setTextureFilter(GL_NEAREST, GL_NEAREST);
-    _path_verts_fbo.setTextureWrap(GL_CLAMP, GL_CLAMP);
-   
+    int total_texels = qMax(drawables.size(), 1) * PATH_XFORM_TEXELS;
+    int table_width = PATH_XFORM_TABLE_WIDTH;
+    int table_height = (total_texels + table_width - 1) / table_width;
 
-    _path_data_dirty = false;
+    initFBOHelper("path_xform_fbo", &_path_xform_fbo, 1, 
+                  table_width, table_height);
 
-    return true;
+    _path_xform_img.resize(table_width, table_height, 4);
+    float* table = _path_xform_img.raster();
+    for (int i = 0; i < table_width*table_height*4; i++)
+        table[i] = 0.0f;
+
+    _path_xforms_dirty = true;
+}
+
+// Copies the current drawable transforms into the transform table. After
+// the first upload only animated drawables are checked, and only the rows
+// of the table that actually changed are sent to the GPU.
+void NPRSegmentAtlas::updatePathTransforms()
+{
+    __TIME_CODE_BLOCK("update path xforms");
+
+    float* table = _path_xform_img.raster();
+    const int entry_size = PATH_XFORM_TEXELS * 4;
+    int first_dirty = _path_xform_drawables.size();
+    int last_dirty = -1;
+
+    if (_path_xforms_dirty)
+    {
+        for (int i = 0; i < _path_xform_drawables.size(); i++)
+        {
+            xform model_xform, model_inverse_transpose;
+            _path_xform_drawables[i]->composeTransform(model_xform);
+            _path_xform_drawables[i]->composeTransformInverseTranspose(model_inverse_transpose);
+            copyToBuffer(table, i*entry_size, model_xform);
+            copyToBuffer(table, i*entry_size + 16, model_inverse_transpose);
+        }
+        first_dirty = 0;
+        last_dirty = _path_xform_drawables.size() - 1;
+    }
+    else
+    {
+        for (int k = 0; k < _animated_xform_indices.size(); k++)
+        {
+            int i = _animated_xform_indices[k];
+            xform model_xform;
+            _path_xform_drawables[i]->composeTransform(model_xform);
+            if (!xformDiffers(table, i*entry_size, model_xform))
+                continue;
+
+            xform model_inverse_transpose;
+            _path_xform_drawables[i]->composeTransformInverseTranspose(model_inverse_transpose);
+            copyToBuffer(table, i*entry_size, model_xform);
+            copyToBuffer(table, i*entry_size + 16, model_inverse_transpose);
+
+            first_dirty = qMin(first_dirty, i);
+            last_dirty = qMax(last_dirty, i);
+        }
+    }
+
+    if (last_dirty >= first_dirty)
+    {
+        int table_width = _path_xform_fbo.width();
+        int first_row = (first_dirty * PATH_XFORM_TEXELS) / table_width;
+        int last_row = (last_dirty * PATH_XFORM_TEXELS) / table_width;
+        _path_xform_fbo.loadSubColorTexturef(0, 0, first_row, table_width, 
+                                             last_row - first_row + 1,
+                                             _path_xform_img);
+        _path_data_stamp++;
+    }
+
+    _path_xforms_dirty = false;
 }
 
 // Creates the vertex array that will be used as the source data for rendering
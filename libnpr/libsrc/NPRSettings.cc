@@ -75,6 +75,7 @@ const QString g_float_names[NPR_NUM_FLOAT_SETTINGS] =
     "segment_atlas_depth_scale", /*NPR_SEGMENT_ATLAS_DEPTH_SCALE*/
     "segment_atlas_kernel_scale_x", /*NPR_SEGMENT_ATLAS_KERNEL_SCALE_X*/
     "segment_atlas_kernel_scale_y", /*NPR_SEGMENT_ATLAS_KERNEL_SCALE_Y*/
+    "segment_atlas_sample_spacing", /*NPR_SEGMENT_ATLAS_SAMPLE_SPACING*/
 
     "n_dot_v_bias", /*NPR_N_DOT_V_BIAS*/
 };
@@ -212,6 +213,7 @@ void NPRSettings::loadDefaults()
     _floats[NPR_SEGMENT_ATLAS_DEPTH_SCALE] = 1;
     _floats[NPR_SEGMENT_ATLAS_KERNEL_SCALE_X] = 1;
     _floats[NPR_SEGMENT_ATLAS_KERNEL_SCALE_Y] = 1;
+    _floats[NPR_SEGMENT_ATLAS_SAMPLE_SPACING] = 2;
 
     _floats[NPR_N_DOT_V_BIAS] = -0.05f;
 }
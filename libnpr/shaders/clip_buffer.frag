@@ -25,11 +25,22 @@ uniform sampler2DRect vert1_tex;
 uniform sampler2DRect face_normal0_tex;
 uniform sampler2DRect face_normal1_tex;
 uniform sampler2DRect path_start_end_ptrs;
+uniform sampler2DRect path_xform_tex;
+uniform float path_xform_width;
 uniform vec3 view_pos;
 uniform vec3 view_dir;
 uniform float sample_step;
 uniform float buffer_width;
 
+// When the viewport is one tile of a larger image, arc lengths (which
+// parameterize the pen textures) are measured against the clip region of
+// the whole image, given here in the NDC of the tile, so that strokes
+// crossing tile boundaries are textured the same in every tile.
+// The arc length start (gl_FragData[3]) is only attached and written when
+// use_arc_length_region is set.
+uniform int use_arc_length_region;
+uniform vec4 arc_length_region; // xmin, ymin, xmax, ymax
+
 
 
 struct segment
@@ -187,6 +198,49 @@ vec3 clipSegmentToNear(vec3 off_screen, vec3 on_screen)
     return clipped; 
 }
 
+void clipRange(float start, float delta, float lo, float hi, inout vec2 range)
+{
+    if (abs(delta) < epsilon)
+    {
+        if (start < lo || start > hi)
+            range = vec2(1.0, 0.0);
+    }
+    else
+    {
+        float a = (lo - start) / delta;
+        float b = (hi - start) / delta;
+        range.x = max(range.x, min(a, b));
+        range.y = min(range.y, max(a, b));
+    }
+}
+
+// Returns the window space length of the part of the segment p0-p1 inside
+// the arc length region, and the distance from the start of that part to
+// start_screen, the start of the segment as clipped to the viewport,
+// measured along the segment.
+vec2 regionArcLength(vec3 p0, vec3 p1, vec2 start_screen)
+{
+    vec2 range = vec2(0.0, 1.0);
+    clipRange(p0.x, p1.x - p0.x, arc_length_region.x, arc_length_region.z, range);
+    clipRange(p0.y, p1.y - p0.y, arc_length_region.y, arc_length_region.w, range);
+    if (range.x >= range.y)
+        return vec2(0.0, 0.0);
+
+    vec2 region_p0 = mix(p0.xy, p1.xy, range.x);
+    vec2 region_p1 = mix(p0.xy, p1.xy, range.y);
+    region_p0 = (region_p0 + vec2(1.0,1.0)) * 0.5 * viewport.zw;
+    region_p1 = (region_p1 + vec2(1.0,1.0)) * 0.5 * viewport.zw;
+
+    // Signed, in case the viewport extends past the region.
+    vec2 region_delta = region_p1 - region_p0;
+    float region_length = length(region_delta);
+    float start = 0.0;
+    if (region_length > epsilon)
+        start = dot(start_screen - region_p0, region_delta) / region_length;
+
+    return vec2(region_length, start);
+}
+
 bool pointBeyondNear(vec3 p)
 {
     vec3 offset = p - view_pos;
@@ -194,12 +248,25 @@ bool pointBeyondNear(vec3 p)
     return beyond; 
 }
 
-bool testProfileEdge( vec2 texcoord, vec3 world_position )
+bool testProfileEdge( vec2 texcoord, mat4 normal_xform, vec3 world_position )
 {
+    vec3 world_normal_0 = (normal_xform * 
+        vec4(texture2DRect(face_normal0_tex, texcoord).xyz, 0.0)).xyz;
+    vec3 world_normal_1 = (normal_xform * 
+        vec4(texture2DRect(face_normal1_tex, texcoord).xyz, 0.0)).xyz;
+
+    // Hack: some (sketchup) models seem to have flipped normals.
+    // We therefore make sure that the two normals align with each
+    // other by checking the dot product. This will cause profiles
+    // along edges with angles > 90 to fail, but those edges are
+    // usually creases anyway.
+    if (dot(world_normal_0, world_normal_1) < 0.0)
+        world_normal_0 = -world_normal_0;
+
     // This should really be the inverse transpose of the modelview matrix, but
     // that only matters if the camera has a weird anisotropic scale or skew.
-    vec4 face_normal_0 = modelview * texture2DRect(face_normal0_tex, texcoord);
-    vec4 face_normal_1 = modelview * texture2DRect(face_normal1_tex, texcoord);
+    vec4 face_normal_0 = modelview * vec4(world_normal_0, 0.0);
+    vec4 face_normal_1 = modelview * vec4(world_normal_1, 0.0);
     vec4 camera_to_line = modelview * vec4(world_position, 1.0);
 
     float dot0 = dot(camera_to_line, face_normal_0);
@@ -210,12 +277,12 @@ bool testProfileEdge( vec2 texcoord, vec3 world_position )
 
 void main()
 {
-    // look up the world positions of the segment vertices
+    // look up the model space positions of the segment vertices
     vec2 texcoord = gl_FragCoord.xy;
-    vec4 v0_world_pos = texture2DRect(vert0_tex, texcoord);
+    vec4 v0_model_pos = texture2DRect(vert0_tex, texcoord);
 
     // early exit if there are no vertices here to process
-    if (v0_world_pos.w < 0.5)
+    if (v0_model_pos.w < 0.5)
     {
         // no vertex data to process
         gl_FragData[0] = vec4(0.5,0.0,0.0,0.0);
@@ -223,10 +290,23 @@ void main()
         // must write something into fragdata[2] to prevent
         // buffer 2 from getting filled with garbage? (very weird)
         gl_FragData[2] = vec4(0.0,1.0,0.0,0.0);
+        if (use_arc_length_region != 0)
+            gl_FragData[3] = vec4(0.0,0.0,0.0,0.0);
         return;
     }
 
-    vec4 v1_world_pos = texture2DRect(vert1_tex, texcoord);
+    vec4 v1_model_pos = texture2DRect(vert1_tex, texcoord);
+
+    // move the vertices into world space using the current transform
+    // of the drawable that owns this path
+    vec4 path_texel = texture2DRect(path_start_end_ptrs, texcoord);
+    float xform_index = unpackTransformIndex(path_texel);
+    mat4 model_xform = pathTransform(path_xform_tex, path_xform_width, 
+                                     xform_index, 0.0);
+    vec4 v0_world_pos = vec4((model_xform * vec4(v0_model_pos.xyz, 1.0)).xyz, 
+                             v0_model_pos.w);
+    vec4 v1_world_pos = vec4((model_xform * vec4(v1_model_pos.xyz, 1.0)).xyz, 
+                             v1_model_pos.w);
 
     // clip to the near plane
     vec3 v0_clipped_near = v0_world_pos.xyz;
@@ -240,6 +320,8 @@ void main()
         gl_FragData[0] = vec4(0.0,1.0,0.0,0.0);
         gl_FragData[1] = vec4(0.0,0.0,1.0,0.0); 
         gl_FragData[2] = vec4(0.0,1.0,0.0,0.0);
+        if (use_arc_length_region != 0)
+            gl_FragData[3] = vec4(0.0,0.0,0.0,0.0);
         return;
     }
     else if ( !v0_beyond_near )
@@ -254,13 +336,17 @@ void main()
     // If this segment is a profile edge, test to see if it should be turned on.
     if (v1_world_pos.w > 0.5)
     {
-        bool profile_on = testProfileEdge(texcoord, v0_clipped_near);
+        mat4 normal_xform = pathTransform(path_xform_tex, path_xform_width, 
+                                          xform_index, 1.0);
+        bool profile_on = testProfileEdge(texcoord, normal_xform, v0_clipped_near);
         if (!profile_on)
         {
             // Profile edge should be off.
             gl_FragData[0] = vec4(0.0,1.0,0.5,0.0);
             gl_FragData[1] = vec4(0.0,0.5,1.0,0.0); 
             gl_FragData[2] = vec4(0.0,1.0,0.0,0.0);
+            if (use_arc_length_region != 0)
+                gl_FragData[3] = vec4(0.0,0.0,0.0,0.0);
             return;
         }
     }
@@ -273,6 +359,9 @@ void main()
     vec3 v0_clip_pos = v0_pre_div.xyz / v0_pre_div.w;
     vec3 v1_clip_pos = v1_pre_div.xyz / v1_pre_div.w;
 
+    vec3 v0_projected = v0_clip_pos;
+    vec3 v1_projected = v1_clip_pos;
+
     // clip to frustum
     bool v0_on_screen = !pointOffScreen( v0_clip_pos ); 
     bool v1_on_screen = !pointOffScreen( v1_clip_pos ); 
@@ -286,6 +375,16 @@ void main()
             gl_FragData[0] = vec4(0.0,0.0,1.0,0.0);
             gl_FragData[1] = vec4(1.0,0.0,1.0,0.0);
             gl_FragData[2] = vec4(0.0,0.0,0.0,0.0);
+            if (use_arc_length_region != 0)
+            {
+                // Off this tile, but it may still be part of the image and
+                // count toward the arc length of its path.
+                float region_length = regionArcLength(v0_projected, v1_projected, 
+                                                      vec2(0.0,0.0)).x;
+                gl_FragData[2] = packOffsetTexel(0.0, region_length, 
+                                                 0.0, region_length);
+                gl_FragData[3] = vec4(0.0,0.0,0.0,0.0);
+            }
             return;
         }
         v0_clip_pos = ret.p1;
@@ -305,6 +404,14 @@ void main()
     vec2 v1_screen = (v1_clip_pos.xy + vec2(1.0,1.0)) * 0.5 * viewport.zw;
 
     float segment_screen_length = length(v0_screen - v1_screen);
+    float arc_length = segment_screen_length;
+    float arc_length_start = 0.0;
+    if (use_arc_length_region != 0)
+    {
+        vec2 region = regionArcLength(v0_projected, v1_projected, v0_screen);
+        arc_length = region.x;
+        arc_length_start = region.y;
+    }
 
     // scale the length by sample_step to get the number of samples
     float num_samples = segment_screen_length / sample_step;
@@ -320,7 +427,6 @@ void main()
     // Add some padding to the number of samples so that filters
     // that work along the segment length (such as overshoot)
     // have some room to work with at the end of each segment.
-    vec4 path_texel = texture2DRect(path_start_end_ptrs, texcoord);
     vec2 padding = segmentPadding(num_samples, 
         coordinateToIndex(texcoord, buffer_width),
         unpackPathStart(path_texel),
@@ -329,7 +435,9 @@ void main()
 
     gl_FragData[0] = v0_clipped_pre_div;
     gl_FragData[1] = v1_clipped_pre_div;
-    gl_FragData[2] = packOffsetTexel(num_samples, segment_screen_length,
-                                     num_samples + total_padding, segment_screen_length);
+    gl_FragData[2] = packOffsetTexel(num_samples, arc_length,
+                                     num_samples + total_padding, arc_length);
+    if (use_arc_length_region != 0)
+        gl_FragData[3] = vec4(arc_length_start, 0.0, 0.0, 0.0);
 }
 
@@ -0,0 +1,55 @@
+/*****************************************************************************\
+
+depth_pyramid.frag
+Copyright (c) 2009 Forrester Cole
+
+Builds one level of the min/max depth pyramid (see NPRDepthPyramid.h).
+The viewport covers the destination level. Each texel is the min/max over 
+a reduction x reduction block of the source, which is either the float 
+depth buffer or the previous level of the pyramid.
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+uniform sampler2DRect source_buffer;
+uniform vec2 source_size;
+uniform float source_offset;
+uniform float dest_offset;
+uniform float reduction;
+uniform int from_depth_buffer;
+
+vec2 sourceRange(vec2 coord)
+{
+    coord = min(coord, source_size - vec2(1.0, 1.0));
+    coord += vec2(source_offset + 0.5, 0.5);
+
+    vec4 texel = texture2DRect(source_buffer, coord);
+    if (from_depth_buffer > 0)
+        return texel.zz;
+    else
+        return texel.xy;
+}
+
+void main()
+{
+    vec2 dest_coord = floor(gl_FragCoord.xy) - vec2(dest_offset, 0.0);
+    vec2 source_coord = dest_coord * reduction;
+
+    vec2 range = sourceRange(source_coord);
+    for (float y = 0.0; y < 4.0; y++)
+    {
+        for (float x = 0.0; x < 4.0; x++)
+        {
+            if (x < reduction && y < reduction)
+            {
+                vec2 sample_range = sourceRange(source_coord + vec2(x, y));
+                range.x = min(range.x, sample_range.x);
+                range.y = max(range.y, sample_range.y);
+            }
+        }
+    }
+
+    gl_FragColor = vec4(range, range);
+}
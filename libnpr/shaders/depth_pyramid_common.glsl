@@ -0,0 +1,151 @@
+/*****************************************************************************\
+
+depth_pyramid_common.glsl
+Copyright (c) 2009 Forrester Cole
+
+Conservative visibility tests against the min/max depth pyramid (see
+NPRDepthPyramid.h). Must come after supersample_common.glsl.
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+// Must match MAX_LEVELS in NPRDepthPyramid.cc.
+const int DEPTH_PYRAMID_MAX_LEVELS = 12;
+
+// Classifying a single sample costs four texture reads, so it only pays 
+// off when the supersampled test takes more.
+const int DEPTH_PYRAMID_MIN_SAMPLES = 5;
+
+const float DEPTH_HIDDEN = 0.0;
+const float DEPTH_VISIBLE = 1.0;
+const float DEPTH_AMBIGUOUS = -1.0;
+
+uniform sampler2DRect depth_pyramid_even;
+uniform sampler2DRect depth_pyramid_odd;
+
+struct DepthPyramidParams
+{
+    int num_levels;
+    float base_texel_size;
+};
+uniform DepthPyramidParams dp_params;
+
+// (x offset, width, height) of each level, in texels.
+uniform vec3 depth_pyramid_levels[DEPTH_PYRAMID_MAX_LEVELS];
+
+// Half the size of the box around a sample position that contains every
+// depth buffer texel getDepthVisibility can read, including the texels 
+// touched by linear filtering.
+float depthKernelRadius()
+{
+    return 0.5 * (abs(ss_params.t_scale) + abs(ss_params.s_scale)) + 0.5;
+}
+
+// Finds the finest level whose texels are at least as large as the box
+// [lo, hi], so that the box overlaps at most 2x2 texels, and returns the 
+// combined depth range of those texels. Returns false if the box is 
+// larger than the coarsest level.
+bool depthPyramidRange(vec2 lo, vec2 hi, out vec2 range)
+{
+    vec2 extent = hi - lo;
+    float size = max(max(extent.x, extent.y), 1.0);
+
+    float level = 0.0;
+    float texel_size = dp_params.base_texel_size;
+    for (int i = 0; i < DEPTH_PYRAMID_MAX_LEVELS; i++)
+    {
+        if (texel_size >= size)
+            break;
+        level += 1.0;
+        texel_size *= 2.0;
+    }
+
+    range = vec2(0.0, 1.0);
+    if (level >= float(dp_params.num_levels))
+        return false;
+
+    vec3 info = depth_pyramid_levels[int(level)];
+    vec2 last = info.yz - vec2(1.0, 1.0);
+    vec2 offset = vec2(info.x + 0.5, 0.5);
+    vec2 a = clamp(floor(lo / texel_size), vec2(0.0, 0.0), last) + offset;
+    vec2 b = clamp(floor(hi / texel_size), vec2(0.0, 0.0), last) + offset;
+
+    vec4 t0, t1, t2, t3;
+    if (mod(level, 2.0) < 0.5)
+    {
+        t0 = texture2DRect(depth_pyramid_even, a);
+        t1 = texture2DRect(depth_pyramid_even, vec2(b.x, a.y));
+        t2 = texture2DRect(depth_pyramid_even, vec2(a.x, b.y));
+        t3 = texture2DRect(depth_pyramid_even, b);
+    }
+    else
+    {
+        t0 = texture2DRect(depth_pyramid_odd, a);
+        t1 = texture2DRect(depth_pyramid_odd, vec2(b.x, a.y));
+        t2 = texture2DRect(depth_pyramid_odd, vec2(a.x, b.y));
+        t3 = texture2DRect(depth_pyramid_odd, b);
+    }
+
+    range.x = min(min(t0.x, t1.x), min(t2.x, t3.x));
+    range.y = max(max(t0.y, t1.y), max(t2.y, t3.y));
+    return true;
+}
+
+// Classifies everything inside the box [lo, hi] of the depth buffer 
+// with depth between min_z and max_z.
+float depthPyramidClassify(vec2 lo, vec2 hi, float min_z, float max_z)
+{
+    if (dp_params.num_levels <= 0)
+        return DEPTH_AMBIGUOUS;
+
+    vec2 range;
+    if (!depthPyramidRange(lo, hi, range))
+        return DEPTH_AMBIGUOUS;
+
+    if (max_z <= range.x)
+        return DEPTH_VISIBLE;
+    if (min_z > range.y)
+        return DEPTH_HIDDEN;
+    return DEPTH_AMBIGUOUS;
+}
+
+// Classifies a whole segment given its clip space end points. 
+float depthPyramidClassifySegment(vec4 clip_p, vec4 clip_q, vec4 viewport)
+{
+    // Segments that reach w = 0 have no bounded window extent.
+    if (clip_p.w <= 0.0 || clip_q.w <= 0.0)
+        return DEPTH_AMBIGUOUS;
+
+    vec3 p = clip_p.xyz / clip_p.w;
+    vec3 q = clip_q.xyz / clip_q.w;
+    vec2 scale = 0.5 * viewport.zw * ss_params.buffer_scale;
+    vec2 window_p = (p.xy + vec2(1.0, 1.0)) * scale;
+    vec2 window_q = (q.xy + vec2(1.0, 1.0)) * scale;
+
+    vec2 radius = vec2(depthKernelRadius());
+    vec2 lo = min(window_p, window_q) - radius;
+    vec2 hi = max(window_p, window_q) + radius;
+    float min_z = 0.5 * (min(p.z, q.z) + 1.0);
+    float max_z = 0.5 * (max(p.z, q.z) + 1.0);
+
+    return depthPyramidClassify(lo, hi, min_z, max_z);
+}
+
+// getDepthVisibility, but skips the supersampled test for samples that
+// the pyramid shows are trivially visible or hidden.
+float getHierarchicalDepthVisibility(vec3 screen_pos, vec3 screen_tangent)
+{
+    if (ss_params.sample_count >= DEPTH_PYRAMID_MIN_SAMPLES)
+    {
+        vec2 center = screen_pos.xy * ss_params.buffer_scale;
+        vec2 radius = vec2(depthKernelRadius());
+        float classification = depthPyramidClassify(center - radius, 
+            center + radius, screen_pos.z, screen_pos.z);
+        if (classification != DEPTH_AMBIGUOUS)
+            return classification;
+    }
+
+    return getDepthVisibility(screen_pos, screen_tangent);
+}
@@ -19,6 +19,7 @@ uniform vec4              focus_transfer;
 uniform vec2			  focus_2d_poa;
 uniform vec3			  focus_3d_poa;
 uniform float			  screen_aspect_ratio;
+uniform vec4              image_ndc_transform; // viewport to image NDC, for tiles
 uniform float			  model_size;
 uniform int     		  focus_mode;
 
@@ -61,7 +62,8 @@ float computeFocus( vec3 camera_pos, vec4 clip_pos )
     else if (focus_mode == NPR_FOCUS_SCREEN)
     {
         vec3 ndc = clip_pos.xyz / clip_pos.w;
-        vec2 offset = focus_2d_poa - ndc.xy;
+        vec2 image_ndc = ndc.xy * image_ndc_transform.xy + image_ndc_transform.zw;
+        vec2 offset = focus_2d_poa - image_ndc;
         offset.y /= screen_aspect_ratio;
 
         dist = length(offset) / 2.0;
@@ -15,6 +15,7 @@ uniform vec4 viewport;
 
 varying vec4 sample_clip_pos;
 varying float path_id;
+varying float segment_visibility;
 
 void main()
 {
@@ -28,7 +29,12 @@ void main()
     sample_window_tangent = normalize(dFdx(sample_window_pos));
 
     // Get the visibility and id for this sample.
-    float visibility = getDepthVisibility(sample_window_pos, sample_window_tangent);
+    float visibility = segment_visibility;
+    if (visibility < 0.0)
+    {
+        visibility = getHierarchicalDepthVisibility(sample_window_pos, 
+                                                    sample_window_tangent);
+    }
 
     float strength = visibility;
     vec3 id_color = idToColor(path_id);
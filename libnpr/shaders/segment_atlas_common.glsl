@@ -74,7 +74,7 @@ vec4 packOffsetTexel(float num_samples, float arc_length,
     return vec4(num_samples_offset, arc_length_offset, num_samples, arc_length);
 }
 
-// Packing and unpacking values in the 3D vertex positions:
+// Packing and unpacking values in the path start/end texture:
 
 float unpackPathStart(vec4 texel)
 {
@@ -91,6 +91,30 @@ float unpackPathLength(vec4 texel)
     return texel.b;
 }
 
+float unpackTransformIndex(vec4 texel)
+{
+    return texel.a;
+}
+
+// Per-drawable path transforms. Path vertices are stored in model space, and
+// each drawable owns PATH_XFORM_TEXELS texels of the transform table: the four
+// columns of its model transform followed by the four columns of the inverse 
+// transpose. which = 0.0 selects the model transform, 1.0 the inverse transpose.
+
+const float PATH_XFORM_TEXELS = 8.0;
+
+mat4 pathTransform(sampler2DRect xform_table, float table_width, 
+                   float index, float which)
+{
+    vec2 coord = indexToCoordinate(index * PATH_XFORM_TEXELS + which * 4.0, 
+                                   table_width);
+    coord += vec2(0.5, 0.5);
+    return mat4(texture2DRect(xform_table, coord),
+                texture2DRect(xform_table, coord + vec2(1.0, 0.0)),
+                texture2DRect(xform_table, coord + vec2(2.0, 0.0)),
+                texture2DRect(xform_table, coord + vec2(3.0, 0.0)));
+}
+
 // Projecting and unprojecting:
 
 vec2 clipToWindow(sampler2DRect clip_positions, vec4 viewport, vec2 coordinate)
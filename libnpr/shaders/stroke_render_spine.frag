@@ -28,7 +28,7 @@ void main(void)
 
     vec3 test_position = check_at_spine * spine_window + 
                          (1.0 - check_at_spine) * gl_FragCoord.xyz;
-    float visibility = getDepthVisibility(test_position, spine_tangent);
+    float visibility = getHierarchicalDepthVisibility(test_position, spine_tangent);
     float focus = computeFocus( camera_pos, spine_position);
 
     vec4 final_color = computePenColor( visibility, focus, vec3(tex_coord,0.0));
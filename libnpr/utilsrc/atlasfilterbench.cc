@@ -0,0 +1,340 @@
+/*****************************************************************************\
+
+atlasfilterbench.cc
+Copyright (c) 2009 Forrester Cole
+
+Times the CPU segment atlas filters (NPRAtlasFilter) on a synthetic atlas
+and checks them against the per-sample reference versions and against the
+filter shaders, which are run on the same atlas in a pixel buffer context
+and read back. The synthetic atlas is laid out like the real one: segments
+are placed one after another in rows of wrap_width samples and may run on
+into the gutter at the end of each row.
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QApplication>
+#include <QGLPixelBuffer>
+#include <QDir>
+#include <QFileInfo>
+#include <QString>
+#include <QStringList>
+#include <QTime>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "NPRAtlasFilter.h"
+#include "NPRGLDraw.h"
+#include "GQFramebufferObject.h"
+#include "GQShaderManager.h"
+#include "GQImage.h"
+
+QString usage = "usage: atlasfilterbench [-samples n] [-width n] [-iterations n]\n"
+                "                        [-shaders dir] [-cpu-only]\n";
+
+const int   MAXIMUM_SEGMENT_LENGTH = 1 << 10;
+const float TOLERANCE = 1e-5f;
+// The shaders run in single precision with the GPU's own exp() and
+// summation order, so they are only expected to agree to well under one
+// 8-bit step.
+const float GPU_TOLERANCE = 1e-3f;
+
+const char* filter_names[NPRSegmentAtlas::NUM_ATLAS_FILTER_TYPES] =
+{
+    "bilateral",
+    "median",
+    "smooth and threshold"
+};
+
+// Fills the atlas with paths of 2 to 400 samples, split into segments of
+// up to 100 samples. Visibility is mostly on or off with some noise,
+// roughly like a real visibility atlas.
+int makeSyntheticAtlas( int num_samples, int width, GQImage& atlas )
+{
+    int wrap_width = width - MAXIMUM_SEGMENT_LENGTH;
+    int num_rows = (num_samples + wrap_width - 1) / wrap_width;
+
+    atlas.resize(width, num_rows, 4);
+    memset(atlas.raster(), 0, width * num_rows * 4);
+
+    srand(1000);
+    int offset = 0;
+    int path_id = 1;
+    while (offset < num_samples)
+    {
+        int path_length = qMin(2 + rand() % 399, num_samples - offset);
+        unsigned char visibility = (rand() % 4) ? 255 : 0;
+
+        int path_end = offset + path_length;
+        while (offset < path_end)
+        {
+            int segment_length = qMin(1 + rand() % 100, path_end - offset);
+            int x = offset % wrap_width;
+            int y = offset / wrap_width;
+            for (int i = 0; i < segment_length; i++)
+            {
+                if (rand() % 20 == 0)
+                    visibility = rand() % 256;
+                else if (rand() % 50 == 0)
+                    visibility = 255 - visibility;
+
+                unsigned char* texel = atlas.raster() + (y * width + x + i) * 4;
+                texel[0] = path_id & 0xff;
+                texel[1] = (path_id >> 8) & 0xff;
+                texel[2] = (path_id >> 16) & 0xff;
+                texel[3] = visibility;
+            }
+            offset += segment_length;
+        }
+        path_id++;
+    }
+
+    return num_rows;
+}
+
+float maxDifference( const GQFloatImage& a, const GQFloatImage& b )
+{
+    float max_difference = 0.0f;
+    int size = a.width() * a.height() * a.chan();
+    for (int i = 0; i < size; i++)
+        max_difference = qMax(max_difference, fabsf(a.raster()[i] - b.raster()[i]));
+    return max_difference;
+}
+
+// Looks for shaders/programs.xml in the current directory and above the
+// executable, as dpix-bench does.
+bool findShadersDirectory( const QString& app_path, QDir& shaders_dir )
+{
+    QStringList candidates;
+    candidates << QDir::currentPath()
+    << QDir::cleanPath(app_path + "/..")
+    << QDir::cleanPath(app_path + "/../..");
+
+    for (int i = 0; i < candidates.size(); i++)
+    {
+        if (QFileInfo(candidates[i] + "/shaders/programs.xml").exists())
+        {
+            shaders_dir = QDir(candidates[i] + "/shaders");
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Could not find shaders/programs.xml. Tried:\n");
+    for (int i = 0; i < candidates.size(); i++)
+        fprintf(stderr, "  %s/shaders/programs.xml\n", qPrintable(candidates[i]));
+    return false;
+}
+
+// Runs the filter shader on the atlas the way NPRSegmentAtlas::filter
+// does, and reads back the filtered rows.
+bool filterGPU( NPRSegmentAtlas::AtlasFilterType type, const GQImage& atlas,
+                int num_rows, GQFloatImage& result )
+{
+    GQFramebufferObject source_fbo, filtered_fbo;
+    if (!source_fbo.init(atlas.width(), num_rows, 1, GQ_ATTACH_NONE,
+                         GQ_COORDS_PIXEL, GQ_FORMAT_RGBA_BYTE) ||
+        !filtered_fbo.init(atlas.width(), num_rows, 1, GQ_ATTACH_NONE,
+                           GQ_COORDS_PIXEL, GQ_FORMAT_RGBA_FLOAT))
+    {
+        qCritical("filterGPU: could not create the %d x %d atlas buffers.",
+                  atlas.width(), num_rows);
+        return false;
+    }
+    source_fbo.setTextureWrap(GL_CLAMP, GL_CLAMP);
+    source_fbo.setTextureFilter(GL_NEAREST, GL_NEAREST);
+    source_fbo.loadColorTexturei(0, atlas);
+
+    GQShaderRef shader;
+    switch (type)
+    {
+        case NPRSegmentAtlas::BILATERAL_FILTER :
+            shader = GQShaderManager::bindProgram("bilateral_filter_atlas"); break;
+        case NPRSegmentAtlas::MEDIAN_FILTER :
+            shader = GQShaderManager::bindProgram("median_filter_atlas"); break;
+        case NPRSegmentAtlas::SMOOTH_AND_THRESHOLD_FILTER :
+            shader = GQShaderManager::bindProgram("smooth_and_threshold_atlas");
+            shader.setUniform1f("overshoot_offset", 1.0);
+            break;
+
+        default:
+            return false;
+    }
+    shader.bindNamedTexture("source_buffer", source_fbo.colorTexture(0));
+
+    filtered_fbo.bind();
+    filtered_fbo.drawBuffer(0);
+    glDisable(GL_DEPTH_TEST);
+    glViewport(0, 0, filtered_fbo.width(), num_rows);
+    NPRGLDraw::drawFullScreenQuad(filtered_fbo.glTarget());
+    filtered_fbo.readSubColorTexturef(0, 0, 0, filtered_fbo.width(), num_rows,
+                                      result);
+    filtered_fbo.unbind();
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+void myMessageOutput(QtMsgType type, const char *msg)
+{
+    switch (type) {
+    case QtDebugMsg:
+        break;
+    case QtWarningMsg:
+        fprintf(stderr, "Warning: %s\n", msg);
+        break;
+    case QtCriticalMsg:
+        fprintf(stderr, "Critical: %s\n", msg);
+        break;
+    case QtFatalMsg:
+        fprintf(stderr, "Fatal: %s\n", msg);
+        abort();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    qInstallMsgHandler(myMessageOutput);
+
+    QApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    int num_samples = 1 << 20;
+    int width = 8192;
+    int iterations = 10;
+    QString shaders_path;
+    bool cpu_only = false;
+
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        if (arguments[i] == "-samples" && i+1 < arguments.size())
+            num_samples = arguments[++i].toInt();
+        else if (arguments[i] == "-width" && i+1 < arguments.size())
+            width = arguments[++i].toInt();
+        else if (arguments[i] == "-iterations" && i+1 < arguments.size())
+            iterations = arguments[++i].toInt();
+        else if (arguments[i] == "-shaders" && i+1 < arguments.size())
+            shaders_path = arguments[++i];
+        else if (arguments[i] == "-cpu-only")
+            cpu_only = true;
+        else
+        {
+            printf("%s", qPrintable(usage));
+            return 0;
+        }
+    }
+
+    if (num_samples <= 0 || width <= MAXIMUM_SEGMENT_LENGTH || iterations <= 0)
+    {
+        printf("%s", qPrintable(usage));
+        return 1;
+    }
+
+    // The GPU check needs a current context and the filter shaders.
+    // The pixel buffer is only there to own the context; the shaders
+    // draw into framebuffer objects.
+    QGLPixelBuffer* pbuffer = NULL;
+    if (!cpu_only)
+    {
+        QDir shaders_dir(shaders_path);
+        if (shaders_path.isEmpty() &&
+            !findShadersDirectory(application.applicationDirPath(), shaders_dir))
+            return 1;
+        GQShaderManager::setShaderDirectory(shaders_dir);
+
+        if (!QGLPixelBuffer::hasOpenGLPbuffers())
+        {
+            fprintf(stderr, "Pixel buffers are not supported on this display. "
+                            "Use -cpu-only to skip the GPU check.\n");
+            return 1;
+        }
+        pbuffer = new QGLPixelBuffer(QSize(16, 16));
+        if (!pbuffer->isValid() || !pbuffer->makeCurrent())
+        {
+            fprintf(stderr, "Could not create a pixel buffer context.\n");
+            delete pbuffer;
+            return 1;
+        }
+
+        GQShaderManager::initialize();
+        if (GQShaderManager::status() != GQ_SHADERS_OK)
+        {
+            fprintf(stderr, "Could not load the shaders.\n");
+            delete pbuffer;
+            return 1;
+        }
+        if (width > GQFramebufferObject::maxFramebufferSize())
+        {
+            fprintf(stderr, "-width %d is larger than the maximum framebuffer "
+                            "size (%d).\n", width,
+                    GQFramebufferObject::maxFramebufferSize());
+            delete pbuffer;
+            return 1;
+        }
+    }
+
+    GQImage atlas;
+    int num_rows = makeSyntheticAtlas(num_samples, width, atlas);
+
+    printf("%d samples, %d x %d atlas, %d threads, %d iterations\n",
+        num_samples, width, num_rows, NPRAtlasFilter::maxThreads(), iterations);
+
+    bool all_match = true;
+    for (int i = 0; i < NPRSegmentAtlas::NUM_ATLAS_FILTER_TYPES; i++)
+    {
+        NPRSegmentAtlas::AtlasFilterType type = (NPRSegmentAtlas::AtlasFilterType)i;
+        GQFloatImage fast_result, reference_result;
+
+        // The first pass allocates the result.
+        NPRAtlasFilter::filter(type, atlas, num_rows, fast_result);
+
+        QTime timer;
+        timer.start();
+        for (int j = 0; j < iterations; j++)
+            NPRAtlasFilter::filter(type, atlas, num_rows, fast_result);
+        float fast_ms = (float)timer.elapsed() / (float)iterations;
+
+        timer.start();
+        NPRAtlasFilter::filterReference(type, atlas, num_rows, reference_result);
+        float reference_ms = (float)timer.elapsed();
+
+        float difference = maxDifference(fast_result, reference_result);
+        bool match = difference <= TOLERANCE;
+        all_match = all_match && match;
+
+        printf("%-21s %8.2f ms (%6.1f Msamples/s), reference %8.2f ms, "
+               "max difference %g%s\n",
+            filter_names[i], fast_ms,
+            num_samples / (fast_ms * 1000.0f), reference_ms,
+            difference, match ? "" : " MISMATCH");
+
+        if (pbuffer)
+        {
+            GQFloatImage gpu_result;
+            if (!filterGPU(type, atlas, num_rows, gpu_result))
+            {
+                printf("%-21s shader FAILED\n", "");
+                all_match = false;
+                continue;
+            }
+
+            float gpu_difference = maxDifference(fast_result, gpu_result);
+            bool gpu_match = gpu_difference <= GPU_TOLERANCE;
+            all_match = all_match && gpu_match;
+
+            printf("%-21s shader max difference %g%s\n", "",
+                gpu_difference, gpu_match ? "" : " MISMATCH");
+        }
+    }
+
+    if (pbuffer)
+    {
+        GQShaderManager::deinitialize();
+        delete pbuffer;
+    }
+
+    return all_match ? 0 : 1;
+}
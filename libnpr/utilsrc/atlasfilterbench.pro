@@ -0,0 +1,32 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+
+QT += opengl xml
+
+TEMPLATE = app
+TARGET = 
+CONFIG += console
+
+unix {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+# clock_gettime, for GQProfiler.
+unix:!macx: LIBS += -lrt
+
+DEPENDPATH += ../include 
+INCLUDEPATH += ../include ../../libgq/include ../../libcda/include
+
+PRE_TARGETDEPS += ../$${DBGNAME}/libnpr.a
+LIBS += -L../$${DBGNAME} -lnpr
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+
+# Input
+SOURCES += atlasfilterbench.cc
@@ -0,0 +1,377 @@
+/*****************************************************************************\
+
+loadbench.cc
+Copyright (c) 2009 Forrester Cole
+
+Times the CPU stages of scene loading one at a time, on a synthetic model,
+without a GL context. The model is a grid mesh with per-vertex normals,
+feature lines along every few grid rows and columns, and any number of
+instances of the mesh in the visual scene. For each stage the benchmark
+reports the time per run, the throughput, and the heap allocations made
+during the run (counted on glibc only).
+
+libnpr is distributed under the terms of the GNU General Public License.
+See the COPYING file for details.
+
+\*****************************************************************************/
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QBuffer>
+#include <QDomDocument>
+#include <QFile>
+#include <QDir>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "CdaGeometry.h"
+#include "CdaScene.h"
+#include "NPRGeometry.h"
+#include "NPRFixedPathSet.h"
+#include "NPRScene.h"
+
+#include "stagetimer.h"
+#include "cdagenerator.h"
+
+QString usage = "usage: loadbench [-grid n] [-lines fraction] [-instances n] [-iterations n]\n";
+
+// items is the amount of work in one run, in units of unit.
+void printStage( const StageTimer& timer, const char* name, double items,
+                 const char* unit )
+{
+    int runs = qMax(timer.runs(), 1);
+    double mean_ms = timer.totalSeconds() * 1000.0 / runs;
+    double min_ms = timer.minSeconds() * 1000.0;
+    double rate = min_ms > 0 ? items / (min_ms * 1000.0) : 0;
+
+    printf("%-40s %9.2f %9.2f %9.2f M%s/s", name, mean_ms, min_ms, rate, unit);
+    if (allocations_counted)
+    {
+        printf(" %10.0f %10.1f", (double)timer.allocations() / runs,
+            (double)timer.allocatedBytes() / runs / 1024.0);
+    }
+    printf("\n");
+}
+
+// Exposes the protected stages of the libraries.
+
+class BenchGeometry : public CdaGeometry
+{
+public:
+    ~BenchGeometry() { clear(); }
+
+    // Reads a source as the CdaGeometry constructor would, under the id
+    // the primitives refer to it by.
+    void addSource( const QDomElement& element, const QString& id )
+    {
+        CdaSource* source = new CdaSource(element);
+        source->_id = id;
+        _sources << source;
+    }
+
+    void parse( QDomElement& element, CdaPrimitiveType type )
+    {
+        parsePrimitive(element, type);
+    }
+};
+
+class BenchNPRGeometry : public NPRGeometry
+{
+public:
+    void bsphere() { findBoundingSphere(); }
+};
+
+class BenchPathSet : public NPRFixedPathSet
+{
+public:
+    BenchPathSet( const NPRGeometry* empty ) : NPRFixedPathSet(empty) {}
+
+    void stitch( const NPRGeometry* geom )
+    {
+        _const_geom = geom;
+        NPRFixedPathAttr attr;
+        for (int i = 0; i < geom->primList(NPR_LINES).size(); i++)
+            stitchLinesIntoPaths(geom->primList(NPR_LINES)[i], attr);
+    }
+};
+
+// The synthetic model.
+
+struct SyntheticCounts
+{
+    int vertices;
+    int triangles;
+    int line_segments;
+};
+
+// A grid x grid vertex height field in one geometry, from cdagen's
+// generator. Every 1/line_density-th row and column of grid edges carries
+// feature lines, which stitch into long straight paths that cross each
+// other.
+QByteArray makeSyntheticModel( int grid, float line_density, int instances,
+                               SyntheticCounts& counts )
+{
+    GeneratorSettings settings;
+    settings.triangles = 2 * (grid - 1) * (grid - 1);
+    settings.geometries = 1;
+    settings.lines = line_density;
+    settings.creases = 0.0f;
+    settings.contours = 0.0f;
+    settings.materials = 1;
+    settings.depth = 0;
+    settings.branching = 1;
+    settings.instances = instances;
+    settings.paths = 0;
+
+    GridLayout layout = gridLayout(settings);
+    counts.vertices = layout.side * layout.side;
+    counts.triangles = layout.triangles();
+    counts.line_segments = layout.lineSegments();
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    ColladaWriter out(&buffer);
+    writeScene(out, settings, layout);
+    out.flush();
+
+    return data;
+}
+
+void myMessageOutput(QtMsgType type, const char *msg)
+{
+    switch (type) {
+    case QtDebugMsg:
+        break;
+    case QtWarningMsg:
+        fprintf(stderr, "Warning: %s\n", msg);
+        break;
+    case QtCriticalMsg:
+        fprintf(stderr, "Critical: %s\n", msg);
+        break;
+    case QtFatalMsg:
+        fprintf(stderr, "Fatal: %s\n", msg);
+        abort();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    qInstallMsgHandler(myMessageOutput);
+
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+
+    int grid = 256;
+    float line_density = 0.25f;
+    int instances = 16;
+    int iterations = 5;
+
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        if (arguments[i] == "-grid" && i+1 < arguments.size())
+            grid = arguments[++i].toInt();
+        else if (arguments[i] == "-lines" && i+1 < arguments.size())
+            line_density = arguments[++i].toFloat();
+        else if (arguments[i] == "-instances" && i+1 < arguments.size())
+            instances = arguments[++i].toInt();
+        else if (arguments[i] == "-iterations" && i+1 < arguments.size())
+            iterations = arguments[++i].toInt();
+        else
+        {
+            printf("%s", qPrintable(usage));
+            return 0;
+        }
+    }
+
+    if (grid < 2 || line_density < 0.0f || line_density > 1.0f ||
+        instances <= 0 || iterations <= 0)
+    {
+        printf("%s", qPrintable(usage));
+        return 1;
+    }
+
+    SyntheticCounts counts;
+    QByteArray model = makeSyntheticModel(grid, line_density, instances, counts);
+
+    // The scene loaders only read from files.
+    QString model_filename = QDir::temp().filePath(
+        QString("loadbench-%1.dae").arg(QCoreApplication::applicationPid()));
+    QFile model_file(model_filename);
+    if (!model_file.open(QIODevice::WriteOnly) || model_file.write(model) != model.size())
+    {
+        fprintf(stderr, "Could not write %s\n", qPrintable(model_filename));
+        return 1;
+    }
+    model_file.close();
+
+    QDomDocument doc;
+    doc.setContent(model);
+    QDomElement mesh_e = doc.documentElement().firstChildElement("library_geometries")
+        .firstChildElement("geometry").firstChildElement("mesh");
+    QDomElement geometry_e = mesh_e.parentNode().toElement();
+    QDomElement position_e = mesh_e.firstChildElement("source");
+    QDomElement normal_e = position_e.nextSiblingElement("source");
+    QDomElement triangles_e = mesh_e.firstChildElement("triangles");
+    QDomElement lines_e = mesh_e.firstChildElement("lines");
+
+    printf("%d x %d grid: %d vertices, %d triangles, %d line segments, "
+           "%d instances, %.1f MB, %d iterations\n",
+        grid, grid, counts.vertices, counts.triangles, counts.line_segments,
+        instances, model.size() / (1024.0f * 1024.0f), iterations);
+    printf("%-40s %9s %9s %16s", "stage", "mean ms", "min ms", "throughput");
+    if (allocations_counted)
+        printf(" %10s %10s", "allocs", "alloc KB");
+    printf("\n");
+
+    // Shared inputs of the later stages.
+    CdaGeometry cda_geometry(geometry_e);
+    NPRGeometry npr_geometry(&cda_geometry);
+    int num_indices = 2 * 3 * counts.triangles + 2 * counts.line_segments;
+
+    {
+        StageTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            timer.start();
+            CdaSource* source = new CdaSource(position_e);
+            timer.stop();
+            delete source;
+        }
+        printStage(timer, "CdaSource (float parsing)", 3 * counts.vertices, "floats");
+    }
+
+    {
+        StageTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            BenchGeometry geometry;
+            geometry.addSource(position_e, "geometry0-vertex");
+            geometry.addSource(normal_e, "geometry0-normal");
+
+            timer.start();
+            geometry.parse(triangles_e, CDA_TRIANGLES);
+            if (!lines_e.isNull())
+                geometry.parse(lines_e, CDA_LINES);
+            timer.stop();
+        }
+        printStage(timer, "CdaGeometry::parsePrimitive", num_indices, "indices");
+    }
+
+    {
+        StageTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            NPRGeometry* geometry = new NPRGeometry;
+
+            timer.start();
+            NPRGeometry::convertFromCdaGeometry(geometry, &cda_geometry);
+            timer.stop();
+
+            delete geometry;
+        }
+        printStage(timer, "NPRGeometry::convertFromCdaGeometry", num_indices, "indices");
+    }
+
+    {
+        BenchNPRGeometry geometry;
+        NPRGeometry::convertFromCdaGeometry(&geometry, &cda_geometry);
+
+        StageTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            timer.start();
+            geometry.bsphere();
+            timer.stop();
+        }
+        printStage(timer, "NPRGeometry::findBoundingSphere", counts.vertices, "verts");
+    }
+
+    {
+        NPRGeometry empty;
+        StageTimer timer;
+        int num_paths = 0;
+        for (int i = 0; i < iterations; i++)
+        {
+            BenchPathSet paths(&empty);
+
+            timer.start();
+            paths.stitch(&npr_geometry);
+            timer.stop();
+
+            num_paths = paths.size();
+        }
+        QString name = QString("NPRFixedPathSet::stitchLines (%1 paths)").arg(num_paths);
+        printStage(timer, qPrintable(name), counts.line_segments, "segs");
+    }
+
+    {
+        StageTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            CdaScene* scene = new CdaScene;
+
+            timer.start();
+            bool loaded = scene->load(model_filename);
+            timer.stop();
+
+            delete scene;
+            if (!loaded)
+            {
+                QFile::remove(model_filename);
+                return 1;
+            }
+        }
+        printStage(timer, "CdaScene::load", model.size(), "bytes");
+    }
+
+    {
+        CdaScene scene;
+        scene.load(model_filename);
+
+        StageTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            vec center;
+            float radius;
+
+            timer.start();
+            CdaScene::findBoundingSphere(&scene, scene.root(), center, radius);
+            timer.stop();
+        }
+        printStage(timer, "CdaScene::findBoundingSphere",
+                   (double)counts.vertices * instances, "verts");
+    }
+
+    {
+        NPRScene scene;
+        StageTimer load_timer;
+        load_timer.start();
+        bool loaded = scene.load(model_filename);
+        load_timer.stop();
+        if (!loaded)
+        {
+            QFile::remove(model_filename);
+            return 1;
+        }
+
+        StageTimer timer;
+        for (int i = 0; i < iterations; i++)
+        {
+            timer.start();
+            scene.updateSortedPaths();
+            timer.stop();
+        }
+        QString name = QString("NPRScene::updateSortedPaths (%1 paths)")
+            .arg(scene.sortedPaths().size());
+        printStage(timer, qPrintable(name), scene.sortedPaths().size(), "paths");
+        printStage(load_timer, "NPRScene::load (once, all stages)", model.size(), "bytes");
+    }
+
+    QFile::remove(model_filename);
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+CONFIG += debug_and_release
+
+CONFIG(release, debug|release) {
+	DBGNAME = release
+}
+else {
+	DBGNAME = debug
+}
+
+QT += opengl xml
+
+TEMPLATE = app
+TARGET = 
+CONFIG += console
+
+unix {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+unix:!macx {
+    # clock_gettime
+    LIBS += -lrt
+}
+macx: DEFINES += DARWIN
+
+DEPENDPATH += ../include 
+INCLUDEPATH += ../include ../../libgq/include ../../libcda/include ../../libcda/utilsrc
+
+PRE_TARGETDEPS += ../$${DBGNAME}/libnpr.a
+LIBS += -L../$${DBGNAME} -lnpr
+PRE_TARGETDEPS += ../../libgq/$${DBGNAME}/libgq.a
+LIBS += -L../../libgq/$${DBGNAME} -lgq
+PRE_TARGETDEPS += ../../libcda/$${DBGNAME}/libcda.a
+LIBS += -L../../libcda/$${DBGNAME} -lcda
+
+# Input
+HEADERS += ../../libcda/utilsrc/stagetimer.h ../../libcda/utilsrc/cdagenerator.h
+SOURCES += loadbench.cc ../../libcda/utilsrc/stagetimer.cc
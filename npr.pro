@@ -6,3 +6,5 @@ SUBDIRS += libcda
 SUBDIRS += libgq
 SUBDIRS += libnpr
 SUBDIRS += dpix
+SUBDIRS += dpix/batch
+SUBDIRS += dpix/bench